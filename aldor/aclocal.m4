@@ -1215,6 +1215,7 @@ m4_include([m4/ltoptions.m4])
 m4_include([m4/ltsugar.m4])
 m4_include([m4/ltversion.m4])
 m4_include([m4/lt~obsolete.m4])
+m4_include([m4/pthread.m4])
 m4_include([m4/readline.m4])
 m4_include([m4/sbrk.m4])
 m4_include([m4/strict_compile.m4])
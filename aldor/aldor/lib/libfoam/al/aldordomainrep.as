@@ -43,9 +43,12 @@ output(d, txt) ==> { puts(concat(txt, " ", coerce(rep(d).id))$String); }
 output3(d, txt, suffix) ==> puts(concat(txt, " ", coerce(rep(d).id), " ", suffix)$String);
 
 local addGetCache(cache: PtrCache, key: BasicTuple, box: Box): () == {
+	import from BasicTuple;
+	-- Failures are not remembered: the export may not have been
+	-- filled in yet by the add body of the domain.
+	not box => dispose! key;
 	-- must copy the box...
-	val := if not box then Nil Ptr else (new value box) pretend Ptr;
-	addEntry(cache, key, val);
+	addEntry(cache, key, (new value box) pretend Ptr);
 }
 
 
@@ -72,6 +75,11 @@ local checkGetCache(cache: PtrCache, pcent: Domain,
 +++ any code from the "add" body is run.
 +++ Domains cache the last few lookups (this gives up to 10% speedup, 
 +++ depending on the example.
++++ Once the "add" body has run, the exports of a domain with more than a
++++ handful of operations are indexed by an open-addressed hash table keyed
++++ on (name, type), with a second table keyed on the name alone for
++++ wildcard lookups, so that finding an export does not depend on the
++++ number of exports.
 AldorDomainRep: Conditional with {
 	new:		DomainFun % -> %;
 		++ new(fun) creates a new domain.
@@ -154,7 +162,9 @@ AldorDomainRep: Conditional with {
 			serial: 	SingleInteger,
 			cache:		PtrCache,
 			nameFn: ()->DomainName,
-			id: Int);
+			id: Int,
+			byType:		Array Int,
+			byName:		Array Int);
 
 	import from Rep;
 
@@ -170,7 +180,8 @@ AldorDomainRep: Conditional with {
 		     Nil Array Hash, Nil Array Value, 0,
 		     --serialThis, 
 		     0,
-		     newCache(), (): DomainName +->  new "Dunno", fiCounter()]
+		     newCache(), (): DomainName +->  new "Dunno", fiCounter(),
+		     Nil Array Int, Nil Array Int]
 	}
 	prepare!(dom: %): () == {
 #if ExtendReplace
@@ -184,6 +195,10 @@ AldorDomainRep: Conditional with {
 		rep(dom).names    := nams;
 		rep(dom).types    := typs;
 		rep(dom).exports  := expts;
+		-- The arrays are filled in by the "add" body, so the index
+		-- is built by prepareGetter! once the body has been run.
+		rep(dom).byType   := Nil Array Int;
+		rep(dom).byName   := Nil Array Int;
 		for i in 1..#nams repeat {
 		    rep(dom).names(i) := 0;
 		    rep(dom).types(i) := 0;
@@ -210,8 +225,90 @@ AldorDomainRep: Conditional with {
 
 	local prepareGetter!(dom: %): () == {
 		h := hash(dom);
-		if Nil?(Array Hash)(rep(dom).names) then
+		if Nil?(Array Hash)(rep(dom).names) then {
 			per2(rep(dom).f2)(dom, h);
+			buildExportIndex! dom;
+		}
+	}
+
+	-- Export index.
+	-- byType and byName are open-addressed tables (linear probing,
+	-- power of two size, at most half full) holding 1-based positions
+	-- in the names/types/exports arrays; 0 marks an empty slot.
+	-- Entries are inserted in export order and never replaced, so a
+	-- probe finds the same export as a linear scan would.
+
+	-- domains with fewer exports than this are searched linearly
+	ExportIndexMin ==> 8;
+
+	local exportSlot(name: Hash, type: Hash, mask: Int): Int ==
+		xor(name, xor(shift(type, 5), shift(type, -3))) /\ mask;
+
+	local buildExportIndex!(dom: %): () == {
+		nams := rep(dom).names;
+		typs := rep(dom).types;
+		Nil?(Array Hash)(nams) => ();
+		n: Int := 0;
+		for nm in nams repeat if not zero? nm then n := n + 1;
+		n < ExportIndexMin => ();
+		sz: Int := 16;
+		while sz < n + n repeat sz := sz + sz;
+		mask := sz - 1;
+		typeTbl: Array Int := new(sz, 0);
+		nameTbl: Array Int := new(sz, 0);
+		for i in 1..#nams repeat {
+			nm := nams.i;
+			zero? nm => iterate;
+			ty := typs.i;
+			s := exportSlot(nm, ty, mask);
+			while not zero? typeTbl(s+1) repeat {
+				j := typeTbl(s+1);
+				nams.j = nm and typs.j = ty => break;
+				s := (s + 1) /\ mask;
+			}
+			if zero? typeTbl(s+1) then typeTbl(s+1) := i;
+			s := exportSlot(nm, 0, mask);
+			while not zero? nameTbl(s+1) repeat {
+				nams(nameTbl(s+1)) = nm => break;
+				s := (s + 1) /\ mask;
+			}
+			if zero? nameTbl(s+1) then nameTbl(s+1) := i;
+		}
+		rep(dom).byType := typeTbl;
+		rep(dom).byName := nameTbl;
+		DEBUG(PRINT() << "(Indexed " << n << " exports of "
+			      << name dom << ")" << NL());
+	}
+
+	-- Returns the position of the first export matching name and type
+	-- (any type if type is wildcard), or 0 if there is none.
+	local findExport(dom: %, nameCode: Hash, type: Hash): Int == {
+		import from String, TextWriter, StringTable;
+		nams := rep(dom).names;
+		typs := rep(dom).types;
+		Nil?(Array Hash)(nams) => 0;
+		wild := type = wildcard;
+		tbl  := if wild then rep(dom).byName else rep(dom).byType;
+		Nil?(Array Int)(tbl) => {
+			for i in 1..#nams repeat {
+				expName := nams.i;
+				zero? expName => iterate;
+				DEBUG(PRINT() << "(Export: " << find expName
+					      << " with type " << typs.i << NL());
+				nameCode = expName and (wild or type = typs.i)
+					=> return i;
+			}
+			0
+		}
+		mask := #tbl - 1;
+		s := exportSlot(nameCode, if wild then 0 else type, mask);
+		repeat {
+			j := tbl(s+1);
+			zero? j => return 0;
+			nams.j = nameCode and (wild or typs.j = type) => return j;
+			s := (s + 1) /\ mask;
+		}
+		never;
 	}
 
 	prepareHash!(dom: %): () == {
@@ -258,19 +355,10 @@ AldorDomainRep: Conditional with {
 		DEBUG(PRINT() << "(Preparing " << name dom << ")" << NL());
 		prepareGetter! dom;
 		DEBUG(PRINT() << "(" << name dom << " is prepared)" << NL());
-		for expName  in rep(dom).names 
-		for expType  in rep(dom).types
-		for expValue in rep(dom).exports
-	        repeat {
-			zero? expName => iterate;
-
-			DEBUG(PRINT() << "(Export: " << find expName
-				      << " with type " << expType << NL());
-
-			nameCode=expName and (type=expType or type=wildcard) => {
-				setVal!(box, expValue);
-				return box;
-			}
+		idx := findExport(dom, nameCode, type);
+		idx > 0 => {
+			setVal!(box, rep(dom).exports.idx);
+			box
 		}
 
 		DEBUG(PRINT()<<"(Not found "<<find nameCode
@@ -1,61 +1,141 @@
 #include "runtimelib.as"
 
 
++++ PtrCache is a memo table from tuples of words to words.  It is used
++++ for the instance caches of parameterised domains (rtCacheCheck), for
++++ category instances and for domain export lookups.
++++ Keys are compared and hashed word by word, so domain arguments are
++++ matched by identity and the cache never asks a domain for its hash
++++ code: doing so could force a lazy domain part way through its own
++++ initialisation.  Lazy domains are filled in place, so their identity
++++ is stable.
++++ The table is open-addressed with linear probing and doubles when it
++++ becomes half full.  Once it reaches cacheMaxSize slots it is emptied
++++ instead, so that a functor applied to many different arguments does
++++ not keep every instance alive.
 PtrCache: with {
 	addEntry: (%, BasicTuple, Ptr) -> Ptr;
 	getEntry: (%, BasicTuple) -> (Ptr, Boolean);
 	newCache: () -> %;
 	newCache: SingleInteger -> %;
+	count:	  % -> SingleInteger;
+		++ count(c) is the number of entries in the cache.
+	hits:	  % -> SingleInteger;
+		++ hits(c) is the number of successful calls to getEntry.
+	misses:	  % -> SingleInteger;
+		++ misses(c) is the number of failed calls to getEntry.
 } == add {
 	-- how big to make the cache (if unspecified)
 	cacheSize ==> 15;
-	Rep ==> Record(posn: SingleInteger, 
-		       keys: Array BasicTuple, 
-		       values: Array Ptr,
-		       size: SingleInteger);
+	-- the cache is flushed rather than grown beyond this many slots
+	cacheMaxSize ==> 4096;
+	Rep ==> Record(count:	SingleInteger,
+		       keys:	Array BasicTuple,
+		       hashes:	Array SingleInteger,
+		       values:	Array Ptr,
+		       hits:	SingleInteger,
+		       misses:	SingleInteger);
 	import from Rep, SingleInteger, Array BasicTuple;
-	
+	import from Array SingleInteger, Array Ptr;
+
 	keys(x: %): Array BasicTuple == rep(x).keys;
+	hashes(x: %): Array SingleInteger == rep(x).hashes;
 	values(x: %): Array Ptr == rep(x).values;
-	posn(x: %): SingleInteger == rep(x).posn;
-	size(x: %): SingleInteger == rep(x).size;
+	count(x: %): SingleInteger == rep(x).count;
+	hits(x: %): SingleInteger == rep(x).hits;
+	misses(x: %): SingleInteger == rep(x).misses;
 
-	newCache(): % == per([0, 
-			     new(cacheSize, Nil(BasicTuple)), 
-			     new(cacheSize, Nil Ptr),
-			     cacheSize]);
+	newCache(): % == newCache(cacheSize);
 
 	-- He who calls with (x < 1) is eternally doomed.
-	newCache(x:SingleInteger): % == per([0, 
-			     new(x, Nil(BasicTuple)), 
-			     new(x, Nil Ptr),
-			     x]);
+	newCache(x:SingleInteger): % == per([0,
+			     new(slots x, Nil(BasicTuple)),
+			     new(slots x, 0),
+			     new(slots x, Nil Ptr),
+			     0, 0]);
+
+	-- Number of slots needed to hold n entries at most half full.
+	local slots(n: SingleInteger): SingleInteger == {
+		sz: SingleInteger := 8;
+		while sz < n + n and sz < cacheMaxSize repeat sz := sz + sz;
+		sz
+	}
+
+	local keyHash(key: BasicTuple): SingleInteger == {
+		h := length key;
+		for i in 1..length key repeat {
+			w := element(key, i) pretend SingleInteger;
+			h := xor(shift(h, 5) + shift(h, -2), xor(w, shift(w, -4)));
+		}
+		h;
+	}
+
+	local sameKey(a: BasicTuple, b: BasicTuple): Boolean == {
+		length a ~= length b => false;
+		for i in 1..length a repeat {
+			element(a, i) ~= element(b, i) => return false;
+		}
+		true
+	}
+
+	-- Returns the slot holding key, or the empty slot where it belongs.
+	local probe(cache: %, key: BasicTuple, h: SingleInteger): SingleInteger == {
+		mask := #keys(cache) - 1;
+		s := h /\ mask;
+		repeat {
+			k := keys(cache)(s+1);
+			Nil?(BasicTuple)(k) => return s+1;
+			hashes(cache)(s+1) = h and sameKey(k, key) => return s+1;
+			s := (s + 1) /\ mask;
+		}
+		never;
+	}
+
+	local resize!(cache: %, sz: SingleInteger): () == {
+		oldKeys := keys cache;
+		oldHashes := hashes cache;
+		oldValues := values cache;
+		rep(cache).keys   := new(sz, Nil BasicTuple);
+		rep(cache).hashes := new(sz, 0);
+		rep(cache).values := new(sz, Nil Ptr);
+		rep(cache).count  := 0;
+		sz = #oldKeys => ();
+		for i in 1..#oldKeys repeat {
+			k := oldKeys.i;
+			Nil?(BasicTuple)(k) => iterate;
+			s := probe(cache, k, oldHashes.i);
+			keys(cache).s   := k;
+			hashes(cache).s := oldHashes.i;
+			values(cache).s := oldValues.i;
+			rep(cache).count := count cache + 1;
+		}
+	}
 
 	addEntry(cache: %, key:  BasicTuple, value: Ptr): Ptr == {
-		--(val, flag) := getEntry(cache, key);
-		--flag => val;
 		DEBUG(PRINT()<<NL()<<"Adding: "<<cache pretend SingleInteger
 		             <<key<<NL());
-		keys(cache).(posn(cache)+1) := key;
-		values(cache).(posn(cache)+1) := value;
-		rep(cache).posn := mod_+(posn(cache), 1, size(cache));
+		h := keyHash key;
+		if count(cache) + count(cache) + 2 > #keys(cache) then {
+			sz := #keys(cache);
+			resize!(cache, if sz < cacheMaxSize then sz + sz else sz);
+		}
+		s := probe(cache, key, h);
+		if Nil?(BasicTuple)(keys(cache).s) then {
+			keys(cache).s   := key;
+			hashes(cache).s := h;
+			rep(cache).count := count cache + 1;
+		}
+		values(cache).s := value;
 		value
 	}
 
---	getEntry(cache: %, key: BasicTuple): (Ptr, Boolean) == {
---		for k in keys(cache)
---		for v in values(cache) repeat {
---			not Nil?(BasicTuple) k and k = key => return(v, true);
---		}
---		(nil(), false)
---	}
-
 	getEntry(cache: %, key: BasicTuple): (Ptr, Boolean) == {
---		for i in 1..#keys(cache) repeat {
---		    k := keys(cache)(i);
---		    v := values(cache)(i);
---		    not Nil?(BasicTuple) k and k = key => return(v, true);
---		}
-		(nil(), false)
+		s := probe(cache, key, keyHash key);
+		Nil?(BasicTuple)(keys(cache).s) => {
+			rep(cache).misses := misses cache + 1;
+			(nil(), false)
+		}
+		rep(cache).hits := hits cache + 1;
+		(values(cache).s, true)
 	}
 }
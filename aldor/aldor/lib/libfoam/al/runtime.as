@@ -258,11 +258,16 @@ export {
 
 rtDelayedInit!(fn: InitFn, n: SingleInteger)(): Value == fn n;
 
+-- The forcer remembers the export once it has been found, so that a
+-- forcer held in a call-site cache does not repeat the lookup.
 rtDelayedGetExport!(d: Domain, n1: Hash, n2: Hash): () -> Value == {
      import from Pointer;
      if (d pretend Pointer = nil()) then never;
+     v: Value := Nil Value;
      (): Value +-> {
-	domainGetExport!(d, n1, n2);
+	free v: Value;
+	if Nil?(Value)(v) then v := domainGetExport!(d, n1, n2);
+	v
      }
 }
 
@@ -400,6 +405,9 @@ export {
 	rtCacheExplicitMake:  BSInt -> PtrCache;
 	rtCacheCheck: (PtrCache, Tuple Ptr) -> (Ptr, Boolean);
 	rtCacheAdd:   (PtrCache, Tuple Ptr, Ptr) -> Ptr;
+	rtCacheDynamicMake:  () -> PtrCache;
+	rtCacheDynamicCheck: (PtrCache, Tuple Ptr) -> (Ptr, Boolean);
+	rtCacheDynamicAdd:   (PtrCache, Tuple Ptr, Ptr) -> Ptr;
 } to Foreign(Builtin);
 
 import from PtrCache;
@@ -420,6 +428,15 @@ rtCacheCheck(cache: PtrCache, key: Tuple Ptr): (Ptr, Boolean) == {
 rtCacheAdd(cache: PtrCache, key: Tuple Ptr, value: Ptr): Ptr == 
 		addEntry(cache, key pretend BasicTuple, value);
 
+-- Caches grow as needed, so -Wrtcache=-1 just gets a default one.
+rtCacheDynamicMake(): PtrCache == newCache();
+
+rtCacheDynamicCheck(cache: PtrCache, key: Tuple Ptr): (Ptr, Boolean) ==
+		rtCacheCheck(cache, key);
+
+rtCacheDynamicAdd(cache: PtrCache, key: Tuple Ptr, value: Ptr): Ptr ==
+		rtCacheAdd(cache, key, value);
+
 
 
 
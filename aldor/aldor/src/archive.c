@@ -45,6 +45,10 @@ local Lib		arExtractEntry		(Archive, ArEntry);
 
 local void		arRdFormat		(Archive);
 local void		arRdTable		(Archive);
+local Bool		arRdIndex		(Archive);
+local Bool		arRdIndexExports	(Archive, String);
+local void		arFreeExports		(Archive);
+local void		arIndexMembers		(Archive);
 
 local String		arFirst			(Archive);
 local String		arNext			(Archive);
@@ -185,19 +189,17 @@ arEntryKey(String name)
 local ArEntry
 arFindEntry(Archive ar, String name)
 {
-	ArEntryList	alist;
+	ArEntry		arent;
 
 	arDEBUG(dbOut, "Looking for \"%s\"", name);
 
 	name = arEntryKey(name);
 	arDEBUG(dbOut, " as archive key \"%s\"", name);
 
-	for (alist = ar->members; alist; alist = cdr(alist)) {
-		ArEntry		arent = car(alist);
-		if (strAEqual(name, arent->name)) {
-			arDEBUG(dbOut, " at offset %ld\n",arent->pos);
-			return arent;
-		}
+	arent = (ArEntry) tblElt(ar->index, (TblKey) name, (TblElt) NULL);
+	if (arent) {
+		arDEBUG(dbOut, " at offset %ld\n",arent->pos);
+		return arent;
 	}
 
 	arDEBUG(dbOut, " not found.\n");
@@ -223,6 +225,8 @@ arExtractEntry(Archive ar, ArEntry arent)
 
 	lib = libExtract(fnameParse(arent->name), arFile(ar), arent->pos);
 	lib->arent = arent;
+	lib->map = ar->map;
+	lib->mapSize = ar->mapSize;
 
 	arent->lib = lib;
 	return lib;
@@ -288,6 +292,11 @@ arRdTable(Archive ar)
 	String		name;
 	arDEBUG(dbOut, "arRdTable:\n");
 
+	if (arRdIndex(ar)) {
+		arIndexMembers(ar);
+		return;
+	}
+
 	for (name = arFirst(ar); !arEndp(ar); name = arNext(ar)) {
 		if (arItemIsIntermed(name)) {
 			Offset		pos = arPosition(ar);
@@ -299,6 +308,27 @@ arRdTable(Archive ar)
 	}
 
 	ar->members = listNReverse(ArEntry)(members);
+	arIndexMembers(ar);
+}
+
+/*
+ * Enter the members in a table by name, so that arFindEntry does not
+ * depend on the size of the archive.  The first of several members with
+ * the same name is the one found.
+ */
+local void
+arIndexMembers(Archive ar)
+{
+	ArEntryList	alist;
+
+	ar->index = tblNew((TblHashFun) strAHash, (TblEqFun) strAEqual);
+
+	for (alist = ar->members; alist; alist = cdr(alist)) {
+		ArEntry	arent = car(alist);
+		if (!tblElt(ar->index, (TblKey) arent->name, (TblElt) NULL))
+			tblSetElt(ar->index, (TblKey) arent->name,
+				  (TblElt) arent);
+	}
 }
 
 local String
@@ -741,6 +771,8 @@ arNew(FileName fname, FILE *f)
 	ar->hasFile	= true;
 	ar->hasIntermed = false;
 	ar->file	= f;
+	ar->map		= 0;
+	ar->mapSize	= 0;
 
 	ar->format	= 0;
 	ar->size	= 0;
@@ -750,6 +782,9 @@ arNew(FileName fname, FILE *f)
 	ar->__next	= 0;
 
 	ar->members	= listNil(ArEntry);
+	ar->index	= 0;
+	ar->indexPos	= 0;
+	ar->exports	= 0;
 	ar->symes	= listNil(Syme);
 
 	ar->names	= strCopy(""); /* strCopy so we can strFree later */
@@ -767,6 +802,9 @@ arRead(FileName fname)
 	arRdFormat(ar);
 	arRdTable(ar);
 
+	/* Members read their sections straight from the mapping. */
+	ar->map = (String) osFileMap(ar->file, &ar->mapSize);
+
 	return ar;
 }
 
@@ -775,6 +813,9 @@ arClose(Archive ar)
 {
 	fnameFree(ar->name);
 	if (ar->hasFile) fclose(ar->file);
+	if (ar->map) osFileUnmap((Pointer) ar->map, ar->mapSize);
+	if (ar->index) tblFree(ar->index);
+	if (ar->exports) arFreeExports(ar);
 	listFreeDeeply(ArEntry)(ar->members, arFreeEntry);
 	listFree(Syme)(ar->symes);
 
@@ -796,17 +837,21 @@ arFileNameFrPath(String name)
 	return fname;
 }
 
+static Table	arArchiveTbl = 0;	/* Archives opened by name */
+
 Archive
 arFrString(String name)
 {
-	static Table	tbl = 0;
+	Table		tbl;
 	Archive		ar;
 	FileName	fn;
 
 	arDEBUG(dbOut, "Looking for archive \"%s\"\n", name);
 	
-	if (tbl == 0)
-		tbl = tblNew((TblHashFun) strAHash, (TblEqFun) strAEqual);
+	if (arArchiveTbl == 0)
+		arArchiveTbl = tblNew((TblHashFun) strAHash,
+				      (TblEqFun) strAEqual);
+	tbl = arArchiveTbl;
 
 	if ((ar = (Archive) tblElt(tbl, (TblKey) name, (TblElt) 0)) != 0)
 		return ar;
@@ -825,6 +870,26 @@ arFrString(String name)
 	return ar;
 }
 
+/*
+ * Give each archive opened by arFrString a file of its own, so that
+ * reading it does not move the file position of another process
+ * sharing the open file, such as the one which made this one by osFork.
+ */
+void
+arReopenFiles(void)
+{
+	TableIterator	it;
+	Archive		ar;
+
+	if (!arArchiveTbl) return;
+
+	for (tblITER(it, arArchiveTbl); tblMORE(it); tblSTEP(it)) {
+		ar = (Archive) tblELT(it);
+		if (ar && ar->hasFile)
+			fileReopen(ar->file, ar->name, osIoRbMode);
+	}
+}
+
 Lib
 arFind(PathList path, String name)
 {
@@ -874,6 +939,63 @@ arGetGlobalMacros(Archive ar)
 	return abNewSequenceL(sposNone, lst);
 }
 
+/*
+ * Continue the hash h over the interfaces of the members (libHashInterface).
+ */
+ULong
+arHashInterface(Archive ar, ULong h, Bool withCode)
+{
+	ArEntryList	alist;
+	ArEntry		arent;
+
+	for (alist = ar->members; alist; alist = cdr(alist)) {
+		arent = car(alist);
+		h = hashBytes(h, arent->name, strlen(arent->name));
+		h = libHashInterface(arEntryLib(ar, arent), h, withCode);
+	}
+	return h;
+}
+
+/*
+ * Continue the hash h over the names of the members.
+ */
+ULong
+arHashMembers(Archive ar, ULong h)
+{
+	ArEntryList	alist;
+
+	for (alist = ar->members; alist; alist = cdr(alist))
+		h = hashBytes(h, car(alist)->name, strlen(car(alist)->name) + 1);
+	return h;
+}
+
+/*
+ * Return the libraries already read from the members.
+ */
+LibList
+arGetLoadedLibs(Archive ar)
+{
+	ArEntryList	alist;
+	LibList		libs = listNil(Lib);
+
+	for (alist = ar->members; alist; alist = cdr(alist))
+		if (car(alist)->lib)
+			libs = listCons(Lib)(car(alist)->lib, libs);
+	return listNReverse(Lib)(libs);
+}
+
+/*
+ * Read the symbol meanings and types of every member.
+ */
+void
+arLoadMembers(Archive ar)
+{
+	ArEntryList	alist;
+
+	for (alist = ar->members; alist; alist = cdr(alist))
+		libGetAllSymes(arEntryLib(ar, car(alist)));
+}
+
 SymeList
 arGetLibrarySymes(Archive ar)
 {
@@ -1065,6 +1187,283 @@ arFilterMarkExpanded(Archive ar, ArEntry arent)
 	}
 }
 
+/*****************************************************************************
+ *
+ * :: Archive index
+ *
+ ****************************************************************************/
+
+/*
+ * An `ar' archive may end with an index member listing the positions of
+ * its .ao members, so that opening the archive need not read the header
+ * of every member.  It is added by "-W ar-index=<file>" once the archive
+ * has been made.  The member data is
+ *
+ *	aldor-index <version> <position of the index header>
+ *	<position> <name>			(one line per .ao member)
+ *	= <member> <hash> <name>		(one line per constructor)
+ *	ALDORIX <position of the index header>	(fixed width, ends the file)
+ *
+ * A constructor line gives the name and syme hash code of a top level
+ * export, and the number of the member which exports it, counting from 0.
+ * The index is believed only if the trailer leads back to its own header,
+ * so an archive which has had members added or resized since the index
+ * was written is read member by member, as before.
+ */
+
+#define AR_INDEX_NAME		"__.ALDORIX/"
+#define AR_INDEX_VERSION	2
+#define AR_INDEX_TRAILER	"ALDORIX "
+#define AR_INDEX_TRAILER_LEN	20		/* Tag, 11 digits, newline. */
+#define AR_HDR_LEN		60
+
+local Bool
+arRdIndex(Archive ar)
+{
+	ArEntryList	members = listNil(ArEntry);
+	char		tail[AR_INDEX_TRAILER_LEN + 1], hdr[AR_HDR_LEN + 1];
+	Offset		hpos, size, first = arFirstPosArch(ar);
+	String		data, s, t;
+	unsigned long	pos;
+	int		version, n = 0;
+	Bool		ok;
+
+	if (ar->format != AR_Arch) return false;
+	if (ar->size < first + AR_HDR_LEN + AR_INDEX_TRAILER_LEN) return false;
+
+	AR_SEEK(ar, ar->size - AR_INDEX_TRAILER_LEN);
+	if (arReadString(ar, tail, AR_INDEX_TRAILER_LEN) ||
+	    !strIsPrefix(AR_INDEX_TRAILER, tail))
+		return false;
+
+	hpos = (Offset) atol(tail + strlen(AR_INDEX_TRAILER));
+	if (hpos < first || hpos + AR_HDR_LEN + AR_INDEX_TRAILER_LEN > ar->size)
+		return false;
+	size = ar->size - hpos - AR_HDR_LEN;
+
+	/* The trailer must lead back to the header of the index itself. */
+	AR_SEEK(ar, hpos);
+	if (arReadString(ar, hdr, AR_HDR_LEN) ||
+	    !strIsPrefix(AR_INDEX_NAME, hdr) ||
+	    (Offset) atol(hdr + 48) != size || !strIsPrefix("`\n", hdr + 58))
+		return false;
+
+	data = strAlloc(size);
+	ok   = !arReadString(ar, data, size) &&
+		sscanf(data, "aldor-index %d %lu%n", &version, &pos, &n) == 2 &&
+		version == AR_INDEX_VERSION && pos == hpos;
+
+	/* Each line after the first is "<position> <name>". */
+	for (s = data + n; ok && *s == '\n'; s = t) {
+		while (*s == '\n') s += 1;
+		if (strIsPrefix(AR_INDEX_TRAILER, s) || *s == '=') break;
+
+		pos = strtoul(s, &t, 10);
+		ok  = t != s && *t == ' ' && pos < hpos;
+		if (!ok) break;
+
+		s = t + 1;
+		t = strchr(s, '\n');
+		ok = t != NULL && t != s;
+		if (!ok) break;
+
+		*t = '\0';
+		members = listCons(ArEntry)(arAllocEntry(strCopy(s), ar,
+							 (Offset) pos),
+					    members);
+		*t = '\n';
+		arDEBUG(dbOut, "    %s(%lu)\n", car(members)->name, pos);
+	}
+
+	ar->members = listNReverse(ArEntry)(members);
+	if (ok) ok = arRdIndexExports(ar, s);
+	strFree(data);
+
+	if (!ok) {
+		if (ar->exports) arFreeExports(ar);
+		listFreeDeeply(ArEntry)(ar->members, arFreeEntry);
+		ar->members = listNil(ArEntry);
+		return false;
+	}
+
+	ar->hasIntermed	= ar->members != listNil(ArEntry);
+	ar->indexPos	= hpos;
+	return true;
+}
+
+/*
+ * The constructors of an index are kept in ar->exports, which maps each
+ * name to a chain of the members exporting something by that name.
+ */
+typedef struct ar_export {
+	Hash			code;
+	ArEntry			arent;
+	struct ar_export *	next;
+} *ArExport;
+
+/*
+ * Read the constructor lines "= <member> <hash> <name>" at s.
+ */
+local Bool
+arRdIndexExports(Archive ar, String s)
+{
+	Length		i, memc = listLength(ArEntry)(ar->members);
+	ArEntry		*memv;
+	ArEntryList	alist;
+	ArExport	x;
+	unsigned long	mem, code;
+	Symbol		sym;
+	String		t;
+	Bool		ok = true;
+
+	memv = (ArEntry *) stoAlloc(OB_Other, (memc + 1) * sizeof(ArEntry));
+	for (i = 0, alist = ar->members; alist; i += 1, alist = cdr(alist))
+		memv[i] = car(alist);
+
+	ar->exports = tblNew((TblHashFun) 0, (TblEqFun) 0);
+
+	for (; ok && *s == '='; s = t) {
+		mem  = strtoul(s + 1, &t, 10);
+		ok   = t != s + 1 && *t == ' ' && mem < memc;
+		if (!ok) break;
+
+		s    = t + 1;
+		code = strtoul(s, &t, 10);
+		ok   = t != s && *t == ' ';
+		if (!ok) break;
+
+		s = t + 1;
+		t = strchr(s, '\n');
+		ok = t != NULL && t != s;
+		if (!ok) break;
+
+		*t  = '\0';
+		sym = symIntern(s);
+		*t  = '\n';
+
+		x = (ArExport) stoAlloc(OB_Other, sizeof(*x));
+		x->code	 = (Hash) code;
+		x->arent = memv[mem];
+		x->next	 = (ArExport) tblElt(ar->exports, (TblKey) sym, NULL);
+		tblSetElt(ar->exports, (TblKey) sym, (TblElt) x);
+
+		while (*t == '\n') t += 1;
+	}
+	stoFree((Pointer) memv);
+
+	return ok && strIsPrefix(AR_INDEX_TRAILER, s);
+}
+
+local void
+arFreeExports(Archive ar)
+{
+	TableIterator	it;
+	ArExport	x, next;
+
+	for (tblITER(it, ar->exports); tblMORE(it); tblSTEP(it))
+		for (x = (ArExport) tblELT(it); x; x = next) {
+			next = x->next;
+			stoFree((Pointer) x);
+		}
+	tblFree(ar->exports);
+	ar->exports = 0;
+}
+
+/*
+ * Return the member of an indexed archive which exports the constructor
+ * sym with the hash code, or NULL if there is none or no index.
+ */
+Lib
+arFindExport(Archive ar, Symbol sym, Hash code)
+{
+	ArExport	x;
+
+	if (!ar->exports) return NULL;
+
+	x = (ArExport) tblElt(ar->exports, (TblKey) sym, NULL);
+	for (; x; x = x->next)
+		if (x->code == code)
+			return arEntryLib(ar, x->arent);
+
+	return NULL;
+}
+
+/*
+ * Add an index to the archive "fname", replacing any index it has.
+ * The new archive is written alongside and renamed into place.
+ */
+void
+arWriteIndex(FileName fname)
+{
+	Archive		ar = arRead(fname);
+	Offset		end = ar->indexPos ? ar->indexPos : ar->size;
+	Buffer		buf;
+	ArEntryList	alist;
+	FileName	tfn;
+	FILE		*fout;
+	String		tmp;
+	char		chunk[4096];
+	Offset		pos;
+	Length		cc, i;
+	Bool		ok;
+
+	if (ar->format != AR_Arch) {
+		arClose(ar);
+		return;
+	}
+
+	/* Members start on even positions. */
+	pos  = end + end % 2;
+
+	buf = bufNew();
+	bufPrintf(buf, "aldor-index %d %lu\n", AR_INDEX_VERSION, (ULong) pos);
+	for (alist = ar->members; alist; alist = cdr(alist))
+		bufPrintf(buf, "%lu %s\n", (ULong) car(alist)->pos,
+			  car(alist)->name);
+	for (i = 0, alist = ar->members; alist; i += 1, alist = cdr(alist)) {
+		Symbol	*syms;
+		Hash	*codes;
+		Length	j, n;
+
+		n = libGetTopExports(arEntryLib(ar, car(alist)), &syms, &codes);
+		for (j = 0; j < n; j += 1)
+			bufPrintf(buf, "= %d %lu %s\n", (int) i,
+				  (ULong) codes[j], symString(syms[j]));
+		stoFree((Pointer) syms);
+		stoFree((Pointer) codes);
+	}
+	if ((bufPosition(buf) + AR_INDEX_TRAILER_LEN) % 2)
+		bufPutc(buf, '\n');
+	bufPrintf(buf, "%s%011lu\n", AR_INDEX_TRAILER, (ULong) pos);
+
+	tmp  = strPrintf("tmp%d", osFnameTempSeed());
+	tfn  = fnameNew(fnameDir(fname), fnameName(fname), tmp);
+	strFree(tmp);
+	fout = fileMustOpen(tfn, osIoWbMode);
+
+	AR_SEEK(ar, int0);
+	for (ok = true; ok && end > 0; end -= cc) {
+		cc = end < sizeof(chunk) ? end : sizeof(chunk);
+		ok = fread(chunk, 1, cc, arFile(ar)) == cc;
+		if (ok) FILE_PUT_CHARS(fout, chunk, cc);
+	}
+	if (pos % 2) fputc('\n', fout);
+
+	fprintf(fout, "%-16s%-12d%-6d%-6d%-8o%-10lu`\n", AR_INDEX_NAME,
+		0, 0, 0, 0644, (ULong) bufPosition(buf));
+	FILE_PUT_CHARS(fout, bufChars(buf), bufPosition(buf));
+	bufFree(buf);
+	arClose(ar);
+
+	if (fclose(fout) == 0 && ok)
+		fileRename(tfn, fname);
+	else {
+		fileRemove(tfn);
+		comsgFatal(NULL, ALDOR_F_CantOpen, fnameUnparseStatic(fname));
+	}
+	fnameFree(tfn);
+}
+
 /*****************************************************************************
  *
  * :: Utility functions taken from uniar2
@@ -10,6 +10,7 @@
 #define _ARCHIVE_H_
 
 #include "axlobs.h"
+#include "lib.h"
 #include "path.h"
 
 /*****************************************************************************
@@ -76,6 +77,8 @@ struct archive {
 	BPack(Bool)	hasFile;	/* Have we opened the stream? */
 	BPack(Bool)	hasIntermed;	/* Do we contain an ao file? */
 	FILE *		file;		/* Stream. */
+	String		map;		/* Mapped file contents, or 0. */
+	Length		mapSize;	/* Length of the mapped file. */
 
 	ArFmtTag	format;		/* Archive file format. */
 	Offset		size;		/* Archive file length. */
@@ -85,6 +88,9 @@ struct archive {
 	Offset		__next;		/* Position of the next item hdr. */
 
 	ArEntryList	members;	/* Archive members. */
+	Table		index;		/* Archive members by name. */
+	Offset		indexPos;	/* Index member header, or 0. */
+	Table		exports;	/* Indexed constructors, or 0. */
 	SymeList	symes;		/* List of symes. */
 
 	String		names;		/* Name table */
@@ -107,6 +113,7 @@ extern void	arClose			(Archive);
 extern Bool	arEqual			(Archive, Archive);
 
 extern Archive	arFrString		(String);
+extern void	arReopenFiles		(void);
 #define		arToString(ar)		fnameUnparse((ar)->name)
 #define		arToStringStatic(ar)	fnameUnparseStaticWithout((ar)->name)
 
@@ -119,5 +126,11 @@ extern Bool	arLibraryIsMember	(Archive, Lib);
 extern Bool	arHasBasicLib		(Archive);
 extern void	arUseExpandedReplacement(void);
 extern AbSyn    arGetGlobalMacros	(Archive);
+extern ULong	arHashInterface		(Archive, ULong, Bool);
+extern ULong	arHashMembers		(Archive, ULong);
+extern LibList	arGetLoadedLibs		(Archive);
+extern void	arWriteIndex		(FileName);
+extern Lib	arFindExport		(Archive, Symbol, Hash);
+extern void	arLoadMembers		(Archive);
 
 #endif /* !_ARCHIVE_H_ */
@@ -28,6 +28,7 @@
 #include "include.h"
 #include "linear.h"
 #include "macex.h"
+#include "of_inlin.h"
 #include "opsys.h"
 #include "optfoam.h"
 #include "parseby.h"
@@ -58,11 +59,17 @@ static Bool	compDoGc	= true;
 static Bool	compDoGcVerbose	= false;
 static Bool	compDoGcFile	= false;
 static EmitInfo *compFinfov	= 0;	/* Tells exit handler about files. */
+static String	compProgName	= 0;	/* How the compiler was run. */
 
 static JmpBuf	compFintJmpBuf;
 static void	compFintBreakHandler0	(int);
 
 static String compRootFromCmdLine(String cwd, String file);
+local int	compFiles		(int, String *);
+local int	compOneFile		(String *, int, Bool);
+local int	compFilesParallel	(String *, Bool);
+local void	compCacheSetOptions	(int, String *);
+local Bool	compFileIsReused	(EmitInfo, SrcLineList);
 
 extern int	compGLoop	(int, char **, FILE *, FILE *);
 extern void	compGLoopEval	(FILE *, FILE *, EmitInfo);
@@ -88,6 +95,12 @@ compCmd(int argc, char **argv)
 
 	echo = cmdSubsumeResponseFiles(1, &argc, &argv);
 
+	/* A client needs none of what follows: the server has done it. */
+	if (cmdHasConnectOption(argc, argv)) {
+		int	rc = compClient(argc, argv, cmdOptionArg);
+		if (rc != -1) return rc;
+	}
+
 	/* Display the version string in all its glory */
 	if (cmdHasVerboseOption(argc, argv)) {
 		fprintf(osStdout, "%s version %s",
@@ -122,6 +135,8 @@ compCmd(int argc, char **argv)
 	}
 
 
+	compProgName = argv[0];
+
 	/*
 	 * Find the root for the system library.
 	 */
@@ -149,6 +164,9 @@ compCmd(int argc, char **argv)
 	/*
 	 * Decide on the entry point.
 	 */
+	if (cmdHasServerOption(argc, argv))
+		return compServerLoop(argc, argv, cmdOptionArg);
+
 	if (cmdHasHelpOption(argc, argv)) {
 		compInit();
 		cmdArguments(1, argc, argv);
@@ -476,13 +494,26 @@ compGLoopFinish(FileName fn, EmitInfo finfo)
 int
 compFilesLoop(int argc, char **argv)
 {
-	int		i, iargc, totErrors, nErrors;
-	FileName	fn;
-	Bool		isSolo;
- 
+	int		totErrors;
+
 	compInit();
+	totErrors = compFiles(argc, argv);
+	compFini();
+
+	return totErrors;
+}
+
+/*
+ * Compile the files on the command line, once the compiler is initialized.
+ */
+local int
+compFiles(int argc, char **argv)
+{
+	int		i, iargc, totErrors;
+	Bool		isSolo;
 
 	iargc = cmdArguments(1, argc, argv);
+	compCacheSetOptions(iargc - 1, argv + 1);
  
 	argc -= iargc;
 	argv += iargc;
@@ -501,58 +532,11 @@ compFilesLoop(int argc, char **argv)
 	for (i = 0; i <= cmdFileCount; i += 1) compFinfov[i] = 0;
  
 	totErrors = 0;
-	for (i = 0; i < cmdFileCount; i++) {
-		fn = fnameParse(argv[i]);
-		compFinfov[i] = emitInfoNew(fn);
-		nErrors = 0;
- 
-		if (!fileIsReadable(fn)) {
-			if (comsgOkBreakLoop())
-				bloopMsgFPrintf(osStdout, ALDOR_F_CantOpen, argv[i]);
-			comsgFatal(NULL, ALDOR_F_CantOpen, argv[i]);
-		}
- 
-		switch (ftypeNo(fnameType(fn))) {
-#if 0
-		case FTYPENO_C:
-			nErrors = compCFile(compFinfov[i]);
-			break;
-#endif
-		case FTYPENO_OBJECT:
-		case FTYPENO_AR_OBJ:
-		case FTYPENO_AR_INT:
-			break;
-		case FTYPENO_FOAMEXPR:
-		case FTYPENO_INTERMED:
-			if (!isSolo) fprintf(osStdout, "\n%s:\n", argv[i]);
-			nErrors = compSavedFile(compFinfov[i]);
-			break;
-		default:
-			if (!ftypeEqual(fnameType(fn), "")) {
-				if (comsgOkBreakLoop())
-					bloopMsgFPrintf(osStdout,
-							ALDOR_F_BadFType,
-							argv[i],
-							fnameType(fn),
-							FTYPE_SRC);
-				comsgFatal(NULL, ALDOR_F_BadFType, argv[i],
-					   fnameType(fn), FTYPE_SRC);
-			}
-			if (!isSolo) fprintf(osStdout, "\n%s:\n", argv[i]);
-			nErrors = compSourceFile(compFinfov[i]);
-			break;
-		case FTYPENO_NONE:
-		case FTYPENO_SRC:
-		case FTYPENO_INCLUDED:
-		case FTYPENO_ABSYN:
-		case FTYPENO_OLDABSYN:
-			if (!isSolo) fprintf(osStdout, "\n%s:\n", argv[i]);
-			nErrors = compSourceFile(compFinfov[i]);
-			break;
-		}
-		totErrors += nErrors;
-		fnameFree(fn);
-	}
+	if (cmdJobCount > 1 && cmdFileCount > 1)
+		totErrors = compFilesParallel(argv, isSolo);
+	else
+		for (i = 0; i < cmdFileCount; i++)
+			totErrors += compOneFile(argv, i, isSolo);
  
 	if (cmdFileCount > 0 && totErrors == 0) {
 		compFinfov[cmdFileCount] = emitInfoNewAXLmain();
@@ -563,6 +547,7 @@ compFilesLoop(int argc, char **argv)
 		emitInterp(argc, argv);
 		emitRun   (argc, argv);
 	}
+	ccWaitCompiles(true);
 	if (totErrors > 0) emitAllDone();
  
 	for (i = 0; i < cmdFileCount + 1; i++) emitInfoFree(compFinfov[i]);
@@ -570,12 +555,350 @@ compFilesLoop(int argc, char **argv)
 	compFinfov = 0;
 
 	if (!isSolo) phGrandTotals(cmdVerboseFlag);
-	compFini();
 
 	return totErrors;
 }
  
  
+/*
+ * Compile the i-th file on the command line, returning its error count.
+ */
+local int
+compOneFile(String *argv, int i, Bool isSolo)
+{
+	FileName	fn;
+	int		nErrors = 0;
+
+	fn = fnameParse(argv[i]);
+	if (!compFinfov[i]) compFinfov[i] = emitInfoNew(fn);
+ 
+	if (!fileIsReadable(fn)) {
+		if (comsgOkBreakLoop())
+			bloopMsgFPrintf(osStdout, ALDOR_F_CantOpen, argv[i]);
+		comsgFatal(NULL, ALDOR_F_CantOpen, argv[i]);
+	}
+ 
+	switch (ftypeNo(fnameType(fn))) {
+#if 0
+	case FTYPENO_C:
+		nErrors = compCFile(compFinfov[i]);
+		break;
+#endif
+	case FTYPENO_OBJECT:
+	case FTYPENO_AR_OBJ:
+	case FTYPENO_AR_INT:
+		break;
+	case FTYPENO_FOAMEXPR:
+	case FTYPENO_INTERMED:
+		if (!isSolo) fprintf(osStdout, "\n%s:\n", argv[i]);
+		nErrors = compSavedFile(compFinfov[i]);
+		break;
+	default:
+		if (!ftypeEqual(fnameType(fn), "")) {
+			if (comsgOkBreakLoop())
+				bloopMsgFPrintf(osStdout,
+						ALDOR_F_BadFType,
+						argv[i],
+						fnameType(fn),
+						FTYPE_SRC);
+			comsgFatal(NULL, ALDOR_F_BadFType, argv[i],
+				   fnameType(fn), FTYPE_SRC);
+		}
+		if (!isSolo) fprintf(osStdout, "\n%s:\n", argv[i]);
+		nErrors = compSourceFile(compFinfov[i]);
+		break;
+	case FTYPENO_NONE:
+	case FTYPENO_SRC:
+	case FTYPENO_INCLUDED:
+	case FTYPENO_ABSYN:
+	case FTYPENO_OLDABSYN:
+		if (!isSolo) fprintf(osStdout, "\n%s:\n", argv[i]);
+		nErrors = compSourceFile(compFinfov[i]);
+		break;
+	}
+	fnameFree(fn);
+
+	return nErrors;
+}
+
+/*****************************************************************************
+ *
+ * :: Compiling files in worker processes (-W jobs=N)
+ *
+ ****************************************************************************/
+
+/*
+ * Each file is compiled by a copy of the compiler made by osFork once
+ * the command line has been processed.  At most cmdJobCount run at once,
+ * and a file is not started until the earlier files it names in #library
+ * lines have been compiled.  A worker's output goes to a temporary file
+ * which is copied to osStdout in command line order.  What the parent
+ * needs for the link step (the error count and the file names chosen
+ * by the emitter) comes back in a second one.
+ */
+
+enum compJobState {
+	COMP_JobWaiting,
+	COMP_JobRunning,
+	COMP_JobDone
+};
+
+struct compJob {
+	enum compJobState	state;
+	int			pid;
+	FILE			*out;	/* Worker's messages */
+	FILE			*res;	/* Worker's results */
+	Bool			*needs;	/* Earlier files to wait for */
+};
+
+#define COMP_JobLineMax	1024	/* For scanning #library lines */
+
+local Bool	*compJobNeeds	(String *argv, int i);
+local Bool	compJobIsReady	(struct compJob *jobv, int i);
+local Bool	compJobStart	(struct compJob *jobv, String *argv, int i,
+				 Bool isSolo);
+local void	compJobReport	(FILE *res, EmitInfo finfo, int nErrors);
+local int	compJobFinish	(struct compJob *job, EmitInfo finfo, int status);
+local void	compJobShow	(struct compJob *job);
+
+local int
+compFilesParallel(String *argv, Bool isSolo)
+{
+	struct compJob	*jobv;
+	int		n = cmdFileCount;
+	int		i, pid, status, nRunning, nShown, nErrors, totErrors;
+	int		*pidv;
+	Bool		stop;
+
+	jobv = (struct compJob *) stoAlloc((unsigned) OB_Other,
+					   n * sizeof(struct compJob));
+	pidv = (int *) stoAlloc((unsigned) OB_Other, n * sizeof(int));
+	for (i = 0; i < n; i++) {
+		FileName fn = fnameParse(argv[i]);
+		compFinfov[i]  = emitInfoNew(fn);
+		fnameFree(fn);
+
+		jobv[i].state = COMP_JobWaiting;
+		jobv[i].pid   = -1;
+		jobv[i].out   = NULL;
+		jobv[i].res   = NULL;
+		jobv[i].needs = compJobNeeds(argv, i);
+	}
+
+	nRunning = nShown = totErrors = 0;
+	stop	 = false;
+
+	for (;;) {
+		while (nShown < n && jobv[nShown].state == COMP_JobDone)
+			compJobShow(&jobv[nShown++]);
+
+		for (i = nShown; i < n && nRunning < cmdJobCount && !stop; i++) {
+			if (jobv[i].state != COMP_JobWaiting) continue;
+			if (!compJobIsReady(jobv, i)) continue;
+			if (compJobStart(jobv, argv, i, isSolo)) {
+				nRunning += 1;
+				continue;
+			}
+			/* No worker: compile it here when its turn comes. */
+			if (nRunning == 0 && i == nShown) {
+				totErrors += compOneFile(argv, i, isSolo);
+				jobv[i].state = COMP_JobDone;
+			}
+			break;
+		}
+
+		if (nRunning == 0) {
+			if (stop || nShown == n) break;
+			continue;
+		}
+
+		/* C compiles run here by the fallback are not ours to reap. */
+		for (i = nShown, nRunning = 0; i < n; i++)
+			if (jobv[i].state == COMP_JobRunning)
+				pidv[nRunning++] = jobv[i].pid;
+
+		pid = osWaitAny(pidv, nRunning, &status);
+		if (pid == -1) break;
+
+		for (i = 0; i < n; i++) {
+			if (jobv[i].state != COMP_JobRunning) continue;
+			if (jobv[i].pid != pid) continue;
+
+			nErrors = compJobFinish(&jobv[i], compFinfov[i], status);
+			if (nErrors < 0) {
+				/* The worker died: start nothing new. */
+				stop	= true;
+				nErrors = 1;
+			}
+			totErrors += nErrors;
+			nRunning  -= 1;
+			break;
+		}
+	}
+
+	/* After a failure, the files which were not started leave gaps. */
+	for (i = nShown; i < n; i++)
+		if (jobv[i].state == COMP_JobDone)
+			compJobShow(&jobv[i]);
+
+	for (i = 0; i < n; i++) {
+		if (jobv[i].out) fclose(jobv[i].out);
+		if (jobv[i].needs) stoFree((Pointer) jobv[i].needs);
+	}
+	stoFree((Pointer) pidv);
+	stoFree((Pointer) jobv);
+
+	return totErrors;
+}
+
+/*
+ * Find the earlier files on the command line which file i names in a
+ * #library line.  Returns NULL if there are none.
+ */
+local Bool *
+compJobNeeds(String *argv, int i)
+{
+	FileName	fn, lfn;
+	FILE		*fin;
+	Bool		*needs = NULL;
+	char		line[COMP_JobLineMax];
+	String		s, e;
+	int		j;
+
+	fn  = fnameParse(argv[i]);
+	fin = fileTryOpen(fn, osIoRdMode);
+	fnameFree(fn);
+	if (!fin) return NULL;
+
+	while (fgets(line, sizeof(line), fin)) {
+		for (s = line; isspace(*s); s++) ;
+		if (!strAIsPrefix("#library", s)) continue;
+		if ((s = strchr(s, '"')) == NULL) continue;
+		if ((e = strchr(++s, '"')) == NULL) continue;
+		*e  = 0;
+		lfn = fnameParse(s);
+
+		for (j = 0; j < i; j++) {
+			fn = fnameParse(argv[j]);
+			if (strEqual(fnameName(fn), fnameName(lfn))) {
+				if (!needs) {
+					needs = (Bool *) stoAlloc((unsigned)
+						OB_Other, i * sizeof(Bool));
+					memset(needs, 0, i * sizeof(Bool));
+				}
+				needs[j] = true;
+			}
+			fnameFree(fn);
+		}
+		fnameFree(lfn);
+	}
+	fclose(fin);
+
+	return needs;
+}
+
+local Bool
+compJobIsReady(struct compJob *jobv, int i)
+{
+	int	j;
+
+	if (!jobv[i].needs) return true;
+
+	for (j = 0; j < i; j++)
+		if (jobv[i].needs[j] && jobv[j].state != COMP_JobDone)
+			return false;
+	return true;
+}
+
+/*
+ * Start a worker for file i.  Returns false if none could be started.
+ */
+local Bool
+compJobStart(struct compJob *jobv, String *argv, int i, Bool isSolo)
+{
+	struct compJob	*job = &jobv[i];
+	int		j, pid, nErrors;
+
+	job->out = tmpfile();
+	job->res = tmpfile();
+	pid = (job->out && job->res) ? osFork(job->out) : -1;
+
+	if (pid == 0) {
+		/* Reading shared open files would move the parent's position. */
+		arReopenFiles();
+		libReopenFiles();
+
+		/* The exit handler should only clean up after this file. */
+		for (j = 0; j < cmdFileCount; j++)
+			if (j != i) compFinfov[j] = 0;
+
+		nErrors = compOneFile(argv, i, isSolo);
+		ccWaitCompiles(true);
+		compJobReport(job->res, compFinfov[i], nErrors);
+		osForkExit(EXIT_SUCCESS);
+	}
+
+	if (pid == -1) {
+		if (job->out) fclose(job->out);
+		if (job->res) fclose(job->res);
+		job->out = job->res = NULL;
+		return false;
+	}
+
+	job->pid   = pid;
+	job->state = COMP_JobRunning;
+	return true;
+}
+
+/*
+ * Write what the parent needs to know about a file compiled by a worker:
+ * the error count, then the state of its EmitInfo.
+ */
+local void
+compJobReport(FILE *res, EmitInfo finfo, int nErrors)
+{
+	fprintf(res, "%d\n", nErrors);
+	emitInfoSave(res, finfo);
+}
+
+/*
+ * Read back a worker's report.  Returns its error count, or -1 if the
+ * worker did not finish normally.
+ */
+local int
+compJobFinish(struct compJob *job, EmitInfo finfo, int status)
+{
+	int	nErrors = -1;
+
+	job->state = COMP_JobDone;
+
+	rewind(job->res);
+	if (status == EXIT_SUCCESS && fscanf(job->res, "%d\n", &nErrors) == 1
+	    && !emitInfoRestore(job->res, finfo))
+		nErrors = -1;
+
+	fclose(job->res);
+	job->res = NULL;
+
+	return nErrors;
+}
+
+local void
+compJobShow(struct compJob *job)
+{
+	int	c;
+
+	if (!job->out) return;
+
+	rewind(job->out);
+	while ((c = getc(job->out)) != EOF)
+		putc(c, osStdout);
+	fflush(osStdout);
+
+	fclose(job->out);
+	job->out = NULL;
+}
+ 
 /*****************************************************************************
  *
  * :: Constituents of the "compXxxxLoop" programs.
@@ -598,6 +921,290 @@ compFilesLoop(int argc, char **argv)
  * ALDORROOT overrides AXIOMXLROOT.
  */
 
+/*****************************************************************************
+ *
+ * :: Reused outputs (-W cache=<dir>, -W incremental)
+ *
+ ****************************************************************************/
+
+static String	compCacheOptions = NULL;	/* Options, as one string. */
+static Bool	compFileReused	 = false;	/* Last file not compiled? */
+
+local ULong	compSourceHash		(EmitInfo, SrcLineList);
+local Bool	compFileFromCache	(EmitInfo, SrcLineList);
+local ULong	compCacheHashString	(ULong, String);
+local ULong	compCacheHashProgram	(ULong);
+local ULong	compCacheHashLibrary	(ULong, String, Bool, Bool *);
+local ULong	compCacheHashSysCmd	(ULong, String, Bool, Bool *);
+local void	compRedoSysCmds		(SrcLineList);
+local Bool	compCacheIsKeyOption	(String, String);
+local Bool	compCacheIsOptArg	(String, String);
+
+/*
+ * Keep the options as a string for the cache key, less those which do
+ * not change the outputs.
+ */
+local void
+compCacheSetOptions(int argc, String *argv)
+{
+	Buffer	buf = bufNew();
+	String	arg;
+	int	i, j;
+
+	for (i = 0; i < argc; i = j) {
+		/* "-W" and "-C" may be separated from their arguments. */
+		j   = i + 1;
+		arg = argv[i] + 2;
+		if ((strEqual(argv[i], "-W") || strEqual(argv[i], "-C")) &&
+		    j < argc)
+			arg = argv[j++];
+
+		if (!compCacheIsKeyOption(argv[i], arg))
+			continue;
+		for (; i < j; i++) {
+			bufPuts(buf, argv[i]);
+			bufPutc(buf, '\n');
+		}
+	}
+	compCacheOptions = bufLiberate(buf);
+}
+
+/*
+ * Is the option opt, whose argument is arg, part of the cache key?
+ * Only -v, -W cache=<dir>, -W cache-size=<n>, -W jobs=<n> and
+ * -C jobs=<n> are left out.
+ */
+local Bool
+compCacheIsKeyOption(String opt, String arg)
+{
+	if (strEqual(opt, "-v"))
+		return false;
+	if (strIsPrefix("-W", opt))
+		return !compCacheIsOptArg(arg, "cache") &&
+			!compCacheIsOptArg(arg, "cache-size") &&
+			!compCacheIsOptArg(arg, "jobs");
+	if (strIsPrefix("-C", opt))
+		return !compCacheIsOptArg(arg, "jobs");
+	return true;
+}
+
+/*
+ * Is arg the option name followed by its value, as cmdDGetOptArg reads it?
+ */
+local Bool
+compCacheIsOptArg(String arg, String name)
+{
+	String	rest = arg + strlen(name);
+
+	return strAIsPrefix(name, arg) && *rest && strchr("+-=:", *rest)
+		&& rest[1];
+}
+
+/*
+ * Can the outputs of a source file be kept from its last compile, or got
+ * from the cache, instead of compiling it?  Its library commands are
+ * still carried out, since they affect the files compiled after it.
+ */
+local Bool
+compFileIsReused(EmitInfo finfo, SrcLineList sll)
+{
+	Bool	incr = emitIsIncremental(finfo);
+
+	if (incr || emitIsCacheable(finfo))
+		finfo->srcHash = compSourceHash(finfo, sll);
+
+	compFileReused = (incr && emitIsUpToDate(finfo)) ||
+		compFileFromCache(finfo, sll);
+	if (compFileReused) compRedoSysCmds(sll);
+
+	return compFileReused;
+}
+
+/*
+ * Hash the compiler version and build, the options, the call counts read
+ * by -Wprofile-use and the source lines after inclusion.
+ */
+local ULong
+compSourceHash(EmitInfo finfo, SrcLineList sll)
+{
+	SrcLine		sl;
+	String		id;
+	Length		lno;
+	Hash		ph;
+	ULong		h;
+
+	h = HASH_BYTES_INIT;
+	h = compCacheHashString(h, (String) verName);
+	h = compCacheHashString(h, (String) verVersionId);
+	h = compCacheHashString(h, (String) verPatchLevel);
+	h = compCacheHashProgram(h);
+	h = compCacheHashString(h, compCacheOptions);
+	h = compCacheHashString(h, fnameUnparseStatic(emitSrcFile(finfo)));
+	id = emitGetFileIdName(finfo);
+	h = compCacheHashString(h, id);
+	strFree(id);
+	ph = inlProfileHash();
+	h = hashBytes(h, &ph, sizeof(ph));
+
+	for ( ; sll; sll = cdr(sll)) {
+		sl  = car(sll);
+		lno = sposLine(sl->spos);
+		h = hashBytes(h, &lno, sizeof(lno));
+		h = compCacheHashString(h, fnameUnparseStatic(sposFile(sl->spos)));
+		h = compCacheHashString(h, sl->text);
+	}
+
+	return h;
+}
+
+/*
+ * Compute the cache key for a source file from the hash of its source
+ * and the interfaces of the libraries it uses, and try to get its outputs
+ * from the cache with it.  Libraries are hashed with their foam when it
+ * may be inlined.
+ */
+local Bool
+compFileFromCache(EmitInfo finfo, SrcLineList sll)
+{
+	Bool		ok = true, code = optIsInlineWanted();
+	PathList	al;
+	SrcLine		sl;
+	ULong		h;
+	char		key[2 * sizeof(ULong) + 1];
+
+	if (!emitIsCacheable(finfo)) return false;
+
+	h = finfo->srcHash;
+	for ( ; sll; sll = cdr(sll)) {
+		sl = car(sll);
+		if (sl->isSysCmd)
+			h = compCacheHashSysCmd(h, sl->text, code, &ok);
+	}
+	for (al = arLibraryFiles(); al; al = cdr(al))
+		h = compCacheHashLibrary(h, car(al), code, &ok);
+
+	/* Some library could not be found: let the compiler say so. */
+	if (!ok) return false;
+
+	sprintf(key, "%0*lx", (int) (2 * sizeof(ULong)), h);
+	return emitFromCache(finfo, key);
+}
+
+local void
+compRedoSysCmds(SrcLineList sll)
+{
+	SrcLine	sl;
+	String	s, id, fname;
+
+	for ( ; sll; sll = cdr(sll)) {
+		sl = car(sll);
+		if (!sl->isSysCmd) continue;
+
+		if ((s = scmdIsDirective(sl->text, "library")) != 0) {
+			if ((s = scmdScanId(s, &id)) != 0 &&
+			    (s = scmdScanFName(s, &fname)) != 0)
+				scmdHandleLibrary(id, fname);
+		}
+		else if ((s = scmdIsDirective(sl->text, "libraryDir")) != 0) {
+			if ((s = scmdScanFName(s, &fname)) != 0)
+				scmdHandleLibraryDir(fname);
+		}
+	}
+}
+
+local ULong
+compCacheHashString(ULong h, String s)
+{
+	return hashBytes(h, s, strlen(s) + 1);
+}
+
+/*
+ * Hash the contents of the compiler's own executable, so that two builds
+ * of the same version do not share cached outputs.  The file is read
+ * once, from /proc/self/exe where there is one, else from the name the
+ * compiler was run by.
+ */
+local ULong
+compCacheHashProgram(ULong h)
+{
+	static Bool	done = false;
+	static ULong	ph = 0;
+	char		chunk[8192];
+	Length		cc;
+	FILE		*f;
+
+	if (!done) {
+		done = true;
+		f = fopen("/proc/self/exe", osIoRbMode);
+		if (!f && compProgName)
+			f = fopen(compProgName, osIoRbMode);
+		if (f) {
+			ph = HASH_BYTES_INIT;
+			while ((cc = fread(chunk, 1, sizeof(chunk), f)) > 0)
+				ph = hashBytes(ph, chunk, cc);
+			fclose(f);
+		}
+	}
+	return hashBytes(h, &ph, sizeof(ph));
+}
+
+/*
+ * Hash the library named by a "#library id file" line.
+ */
+local ULong
+compCacheHashSysCmd(ULong h, String s, Bool code, Bool *pok)
+{
+	String	id, fname;
+
+	if ((s = scmdIsDirective(s, "library")) == 0) return h;
+	if ((s = scmdScanId(s, &id)) == 0) return h;
+
+	if ((s = scmdScanFName(s, &fname)) != 0) {
+		h = compCacheHashLibrary(h, fname, code, pok);
+		strFree(fname);
+	}
+	strFree(id);
+
+	return h;
+}
+
+/*
+ * Hash the interface of a library, found as scmdHandleLibrary finds it.
+ */
+local ULong
+compCacheHashLibrary(ULong h, String name, Bool code, Bool *pok)
+{
+	FileName	fn = fnameParse(name), lfn;
+	Bool		keyed = !(fnameHasDir(fn) || fnameHasType(fn));
+	Archive		ar;
+	String		fstr;
+
+	h = compCacheHashString(h, name);
+
+	if (keyed || ftypeHas(fn, FTYPENO_AR_INT)) {
+		fstr = keyed ? strPrintf("lib%s.%s", name, FTYPE_AR_INT)
+			     : strCopy(name);
+		ar = arFrString(fstr);
+		if (ar && arHasIntermed(ar))
+			h = arHashInterface(ar, h, code);
+		else if (!keyed)
+			*pok = false;
+		strFree(fstr);
+	}
+	else if (ftypeHas(fn, FTYPENO_INTERMED)) {
+		lfn = fileRdFind(libSearchPath(), name, FTYPE_INTERMED);
+		if (lfn) {
+			h = libHashInterface(libFrString(name), h, code);
+			fnameFree(lfn);
+		}
+		else
+			*pok = false;
+	}
+
+	fnameFree(fn);
+	return h;
+}
+
 static String	compLibraryFiles[] = { 0 };
 static String	compLibraryKeys[]  = { 0 };
  
@@ -685,7 +1292,9 @@ compSourceFile(EmitInfo finfo)
 		emitTheCpp();
 	}
 
-	if (compIsMoreAfterFront(finfo)) {
+	if (compFileReused)
+		compFileReused = false;	/* The outputs are already there. */
+	else if (compIsMoreAfterFront(finfo)) {
 		foam = compFileMiddle(finfo, stab, ab);
  
 		compFileSave(finfo, stab, foam);
@@ -695,6 +1304,7 @@ compSourceFile(EmitInfo finfo)
 	}
  
 	msgCount = comsgErrorCount();
+	if (msgCount == 0 && comsgWarningCount() == 0) emitToCache(finfo);
 	compFileFini(finfo);
 	/* abFree(ab); !! ab is seeping into types. */
 	if (msgCount < 1) breakInterrupt();
@@ -756,8 +1366,172 @@ compFini(void)
 	comsgClose();
 	stabFiniGlobal();
 	compCfgFini();
+	phTimelineClose();
+}
+
+
+/*****************************************************************************
+ *
+ * :: Compile server (-W server=<socket>, -W connect=<socket>)
+ *
+ ****************************************************************************/
+
+/*
+ * The server reads the archives named by its -l options once, then waits
+ * for requests on a Unix domain socket.  A request is the directory and
+ * command line of a client started with "-W connect=<socket>".  Each one
+ * is compiled by a copy of the server made by osFork, so it starts with
+ * the libraries, symbol meanings and types already in memory, and what
+ * it does is lost when it finishes.  The copy's output goes straight to
+ * the client, followed by a NUL and its exit status.
+ *
+ * Options on the server's own command line other than -l and -Y apply to
+ * every request.  The server runs until it is killed.
+ */
+
+local void	compServerPreload	(void);
+local void	compServerRequest	(FILE *in, FILE *out);
+local String	compServerGetArg	(FILE *in);
+
+int
+compServerLoop(int argc, char **argv, String path)
+{
+	FILE	*in, *out;
+	int	sd, pid, status;
+
+	compInit();
+	cmdArguments(1, argc, argv);
+	compServerPreload();
+
+	if ((sd = osServerOpen(path)) == -1)
+		comsgFatal(NULL, ALDOR_F_CantOpen, path);
+
+	for (;;) {
+		in = osServerAccept(sd, &out);
+
+		/* Collect the processes answering earlier requests. */
+		while (osWaitDone(&status) > 0)
+			;
+		if (!in) continue;
+
+		pid = osFork(NULL);
+		if (pid == 0) compServerRequest(in, out);
+		if (pid == -1) {
+			putc('\0', out);
+			fprintf(out, "%d\n", EXIT_FAILURE);
+		}
+		fclose(in);
+		fclose(out);
+	}
 }
 
+/*
+ * Read every member of the archives on the command line, as the first of
+ * several files compiled together would, then forget the archive list so
+ * that requests use only the libraries they name.
+ */
+local void
+compServerPreload(void)
+{
+	FileName	fn = fnameParse("aldor-server");
+	EmitInfo	finfo = emitInfoNew(fn);
+	PathList	pl;
+	Archive		ar;
+
+	compFileInit(finfo);
+	for (pl = arLibraryFiles(); pl; pl = cdr(pl))
+		if ((ar = arFrString(car(pl))) != NULL)
+			arLoadMembers(ar);
+	compFileFini(finfo);
+
+	emitInfoFree(finfo);
+	fnameFree(fn);
+	arInit(compLibraryFiles, compLibraryKeys);
+}
+
+/*
+ * Answer one request, in a copy of the server: compile it in a further
+ * copy and send back how that finished.
+ */
+local void
+compServerRequest(FILE *in, FILE *out)
+{
+	String	cwd, *argv;
+	int	argc, i, pid, status = -1;
+
+	if (fscanf(in, "%d\n", &argc) != 1 || argc < 1)
+		osForkExit(EXIT_FAILURE);
+
+	cwd  = compServerGetArg(in);
+	argv = (String *) stoAlloc((unsigned) OB_Other,
+				   (argc + 1) * sizeof(String));
+	for (i = 0; i < argc; i++)
+		if ((argv[i] = compServerGetArg(in)) == NULL)
+			osForkExit(EXIT_FAILURE);
+	argv[argc] = NULL;
+
+	pid = cwd ? osFork(out) : -1;
+	if (pid == 0) {
+		if (osDirSwap(cwd, NULL, int0) == -1)
+			comsgFatal(NULL, ALDOR_F_CdFailed, cwd);
+
+		/* Reading shared open files would move the server's position. */
+		arReopenFiles();
+		libReopenFiles();
+
+		osForkExit(compFiles(argc, argv));
+	}
+	if (pid != -1) osWait(pid, &status);
+
+	putc('\0', out);
+	fprintf(out, "%d\n", status == -1 ? EXIT_FAILURE : status);
+	osForkExit(EXIT_SUCCESS);
+}
+
+local String
+compServerGetArg(FILE *in)
+{
+	Buffer	buf = bufNew();
+	int	c;
+
+	while ((c = getc(in)) != EOF && c != '\0')
+		bufPutc(buf, c);
+	if (c == EOF) {
+		bufFree(buf);
+		return NULL;
+	}
+	return bufLiberate(buf);
+}
+
+int
+compClient(int argc, char **argv, String path)
+{
+	FILE	*in, *out;
+	char	cwd[1024];
+	int	i, c, status = EXIT_FAILURE;
+
+	if (osDirSwap(".", cwd, sizeof(cwd)) == -1) return -1;
+	if ((in = osServerConnect(path, &out)) == NULL) return -1;
+
+	fprintf(out, "%d\n", argc);
+	fputs(cwd, out);
+	putc('\0', out);
+	for (i = 0; i < argc; i++) {
+		fputs(argv[i], out);
+		putc('\0', out);
+	}
+	fflush(out);
+
+	while ((c = getc(in)) != EOF && c != '\0')
+		putc(c, osStdout);
+	if (c == EOF || fscanf(in, "%d", &status) != 1)
+		status = EXIT_FAILURE;
+	fflush(osStdout);
+
+	fclose(in);
+	fclose(out);
+	return status;
+}
 
 /*****************************************************************************
  *
@@ -827,6 +1601,10 @@ compFileFront(EmitInfo finfo, Stab stab, FILE *fin, int *plno)
 		fintGetInitCompTime();
 
 		if (!compIsMoreAfterInclude(finfo)) { inclFree(sll); return 0; }
+		if (!fin && compFileIsReused(finfo, sll)) {
+			inclFree(sll);
+			return 0;
+		}
 
 		tl   = compPhaseScan   (finfo, sll);
 		tl   = compPhaseSysCmd (finfo, tl);
@@ -1366,8 +2144,11 @@ void
 compExitHandler(int status)
 {
 	exitSetHandler((ExitFun) 0);
-	if (status == EXIT_FAILURE)
+	if (status == EXIT_FAILURE) {
+		ccWaitCompiles(false);
 		emitCleanup(cmdFileCount + 1, compFinfov);
+	}
+	phTimelineClose();
 	comsgFini();
 	if (cmdTrapFlag) abort();
 }
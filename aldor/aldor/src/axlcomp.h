@@ -28,6 +28,20 @@ extern int		compFilesLoop(int argc, String *argv);
 			 * and return the total error count.
 			 */
 
+extern int		compServerLoop(int argc, String *argv, String path);
+			/*
+			 * Load the libraries named by the argument vector and
+			 * compile the files of each request sent to the Unix
+			 * domain socket "path" in a copy of this process.
+			 */
+
+extern int		compClient(int argc, String *argv, String path);
+			/*
+			 * Have the server at "path" compile as the argument
+			 * vector says and return its exit status, or -1 if
+			 * there is no server.
+			 */
+
 extern int		compInteractiveLoop(int argc, String *argv,
 					    FILE *in, FILE *out);
 			/*
@@ -90,7 +90,7 @@ bitvResize(BitvClass newc, BitvClass oldc, Bitv b)
 
 	new = bitvNew(newc);
 	for (i = 0; i < oldc->nwords; i++)
-		new[i] = *b++;
+		new[i] = b[i];
 	
 	bitvFree(b);
 
@@ -172,96 +172,215 @@ bitvToString(BitvClass class, Bitv a)
 }
 
 
+/*
+ * Mask of the bits of the last word which are in use.
+ */
+#define bitvLastMask(class) \
+	((class)->nbits % BpW == 0 ? ~(BitvWord) 0 : \
+	 ~((~(BitvWord) 0) << ((class)->nbits % BpW)))
+
+#define bitvBit(ix)	(((BitvWord) 1) << ((ix) % BpW))
+
 Bool
 bitvEqual(BitvClass class, Bitv a, Bitv b)
 {
-	int	 i;
-	BitvWord mask;
+	Length	 i, n = class->nwords;
+	BitvWord diff = 0;
 
-	if (class->nwords == 0) return true;
+	if (n == 0) return true;
 
-	for (i = 0; i < class->nwords-1; i++) if (*a++ != *b++) return false;
-	if (class->nbits % BpW == 0) return *a == *b;
+	for (i = 0; i < n - 1; i++) diff |= a[i] ^ b[i];
 
 	/*
 	 * Test last word differently -- mask out extra bits so they
 	 * do not influence the equality test.
 	 */
-	mask = ~((~0UL) << (class->nbits % BpW));
-	return (*a & mask) == (*b & mask);
+	diff |= (a[n-1] ^ b[n-1]) & bitvLastMask(class);
+	return diff == 0;
 }
 
 void
 bitvSetAll(BitvClass class, Bitv r)
 {
-	int	i;
-
-	for (i = 0; i < class->nwords; i++) *r++ = (BitvWord)(~0L);
+	Length	i;
+	for (i = 0; i < class->nwords; i++) r[i] = ~(BitvWord) 0;
 }
 
 void
 bitvClearAll(BitvClass class, Bitv r)
 {
-	int	i;
-	for (i = 0; i < class->nwords; i++) *r++ = 0;
+	Length	i;
+	for (i = 0; i < class->nwords; i++) r[i] = 0;
 }
 
 int
 bitvTest(BitvClass class, Bitv r, int ix)
 {
 	assert(ix < class->nbits);
-	return !!(r[ix/BpW] & (1L << (ix % BpW)));
+	return (r[ix/BpW] & bitvBit(ix)) != 0;
 }
 
 void
 bitvSet(BitvClass class, Bitv r, int ix)
 {
 	assert(ix < class->nbits);
-	r[ix/BpW] |=  (1L << (ix % BpW));
+	r[ix/BpW] |=  bitvBit(ix);
 }
 
 void
 bitvClear(BitvClass class, Bitv r, int ix)
 {
 	assert(ix < class->nbits);
-	r[ix/BpW] &= ~(1L << (ix % BpW));
+	r[ix/BpW] &= ~bitvBit(ix);
 }
 
 void
 bitvCopy(BitvClass class, Bitv r, Bitv a)
 {
-	int	i;
-	for (i = 0; i < class->nwords; i++) *r++ = *a++;
+	Length	i;
+	for (i = 0; i < class->nwords; i++) r[i] = a[i];
 }
 
 void
 bitvNot(BitvClass class, Bitv r, Bitv a)
 {
-	int	i;
-	for (i = 0; i < class->nwords; i++) *r++ = ~*a++;
+	Length	i;
+	for (i = 0; i < class->nwords; i++) r[i] = ~a[i];
 }
 
 void
 bitvAnd(BitvClass class, Bitv r, Bitv a, Bitv b)
 {
-	int	i;
-	for (i = 0; i < class->nwords; i++) *r++ = *a++ & *b++;
+	Length	i;
+	for (i = 0; i < class->nwords; i++) r[i] = a[i] & b[i];
 }
 
 void
 bitvOr(BitvClass class, Bitv r, Bitv a, Bitv b)
 {
-	int 	i;
-	for (i = 0; i < class->nwords; i++) *r++ = *a++ | *b++;
+	Length	i;
+	for (i = 0; i < class->nwords; i++) r[i] = a[i] | b[i];
 }
 
 void
 bitvMinus(BitvClass class, Bitv r, Bitv a, Bitv b)
 {
-	int	i;
-	for (i = 0; i < class->nwords; i++) *r++ = *a++ & ~*b++;
+	Length	i;
+	for (i = 0; i < class->nwords; i++) r[i] = a[i] & ~b[i];
+}
+
+/*
+ * The fused operations accumulate the bits which change, so a data-flow
+ * step needs one pass over the words instead of an update, a copy and
+ * a comparison.  Bits past nbits in the last word may change too, which
+ * is harmless: bitvEqual ignores them and they are never tested.
+ */
+Bool
+bitvOrInto(BitvClass class, Bitv r, Bitv a)
+{
+	Length	 i;
+	BitvWord diff = 0, w;
+
+	for (i = 0; i < class->nwords; i++) {
+		w     = r[i] | a[i];
+		diff |= w ^ r[i];
+		r[i]  = w;
+	}
+	return diff != 0;
+}
+
+Bool
+bitvAndInto(BitvClass class, Bitv r, Bitv a)
+{
+	Length	 i;
+	BitvWord diff = 0, w;
+
+	for (i = 0; i < class->nwords; i++) {
+		w     = r[i] & a[i];
+		diff |= w ^ r[i];
+		r[i]  = w;
+	}
+	return diff != 0;
+}
+
+Bool
+bitvCopyInto(BitvClass class, Bitv r, Bitv a)
+{
+	Length	 i;
+	BitvWord diff = 0;
+
+	for (i = 0; i < class->nwords; i++) {
+		diff |= a[i] ^ r[i];
+		r[i]  = a[i];
+	}
+	return diff != 0;
+}
+
+Bool
+bitvOrMinus(BitvClass class, Bitv r, Bitv a, Bitv b, Bitv c)
+{
+	Length	 i;
+	BitvWord diff = 0, w;
+
+	for (i = 0; i < class->nwords; i++) {
+		w     = (a[i] | b[i]) & ~c[i];
+		diff |= w ^ r[i];
+		r[i]  = w;
+	}
+	return diff != 0;
 }
 
+Bool
+bitvOrAndNot(BitvClass class, Bitv r, Bitv a, Bitv b, Bitv c)
+{
+	Length	 i;
+	BitvWord diff = 0, w;
+
+	for (i = 0; i < class->nwords; i++) {
+		w     = a[i] | (b[i] & ~c[i]);
+		diff |= w ^ r[i];
+		r[i]  = w;
+	}
+	return diff != 0;
+}
+
+/*
+ * Word-level bit counting and searching.
+ */
+#if defined(__GNUC__)
+# define bitvWordCount(w)	__builtin_popcountll(w)
+# define bitvWordLow(w)		__builtin_ctzll(w)
+# define bitvWordHigh(w)	((int) BpW - 1 - __builtin_clzll(w))
+#else
+# define bitvWordCount(w)	bitvWordCount0(w)
+# define bitvWordLow(w)		bitvWordLow0(w)
+# define bitvWordHigh(w)	bitvWordHigh0(w)
+
+local int
+bitvWordCount0(BitvWord w)
+{
+	int	n = 0;
+	for (; w; w &= w - 1) n++;
+	return n;
+}
+
+local int
+bitvWordLow0(BitvWord w)
+{
+	int	i = 0;
+	for (; !(w & 1); w >>= 1) i++;
+	return i;
+}
+
+local int
+bitvWordHigh0(BitvWord w)
+{
+	int	i = -1;
+	for (; w; w >>= 1) i++;
+	return i;
+}
+#endif
+
 /**
  * Returns last set bit.
  * Returns -1 if none set.
@@ -269,40 +388,52 @@ bitvMinus(BitvClass class, Bitv r, Bitv a, Bitv b)
 int 
 bitvMax(BitvClass class, Bitv bv)
 {
-	int i;
-	/* FIXME: Could be _much_ more efficient */
-	for (i=class->nbits-1; i>= 0; i--) {
-		if (bitvTest(class, bv, i))
-			return i;
+	int	 i;
+	BitvWord w;
+
+	for (i = class->nwords - 1; i >= 0; i--) {
+		w = bv[i];
+		if (i == class->nwords - 1) w &= bitvLastMask(class);
+		if (w) return i * BpW + bitvWordHigh(w);
 	}
-	return i;
+	return -1;
 }
 
 int
 bitvCount(BitvClass class, Bitv bv)
+{
+	return bitvCountTo(class, bv, class->nbits);
+}
+
+int
+bitvCountTo(BitvClass class, Bitv bv, int n)
 {
 	int total = 0;
 	int i;
-	/* FIXME: Could be _much_ more efficient */
-	for (i=0; i<class->nbits; i++) {
-		if (bitvTest(class, bv, i))
-			total++;
-	}
+
+	for (i = 0; i < n / BpW; i++)
+		total += bitvWordCount(bv[i]);
+	if (n % BpW)
+		total += bitvWordCount(bv[i] & ~((~(BitvWord) 0) << (n % BpW)));
 	return total;
 }
 
 int
-bitvCountTo(BitvClass class, Bitv bv, int n)
+bitvNext(BitvClass class, Bitv bv, int ix)
 {
-	int total = 0;
-	int i = 0;
+	int	 i;
+	BitvWord w;
 
-	/* FIXME: Could be _much_ more efficient */
-	for (i=0; i<n; i++) {
-		if (bitvTest(class, bv, i))
-			total++;
+	if (ix >= class->nbits) return -1;
+
+	i = ix / BpW;
+	w = bv[i] & ((~(BitvWord) 0) << (ix % BpW));
+	for (;;) {
+		if (i == class->nwords - 1) w &= bitvLastMask(class);
+		if (w) return i * BpW + bitvWordLow(w);
+		if (++i >= class->nwords) return -1;
+		w = bv[i];
 	}
-	return total;
 }
 
 int
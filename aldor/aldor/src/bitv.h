@@ -11,7 +11,12 @@
 
 #include "cport.h"
 
-typedef ULong		BitvWord;
+/*
+ * Bit vectors are arrays of 64-bit words on all platforms.  The word loops
+ * are kept simple (indexed, no early exits) so that the C compiler can
+ * vectorise them.
+ */
+typedef unsigned long long	BitvWord;
 
 typedef BitvWord	*Bitv;
 
@@ -65,10 +70,27 @@ extern void	bitvAnd		(BitvClass, Bitv r, Bitv a, Bitv b);
 extern void	bitvOr		(BitvClass, Bitv r, Bitv a, Bitv b);
 extern void	bitvMinus	(BitvClass, Bitv r, Bitv a, Bitv b);
 
+/*
+ * Fused operations for data-flow solvers: these update 'r' and return
+ * true if it changed.
+ */
+extern Bool	bitvOrInto	(BitvClass, Bitv r, Bitv a);
+			/* r := r \/ a */
+extern Bool	bitvAndInto	(BitvClass, Bitv r, Bitv a);
+			/* r := r /\ a */
+extern Bool	bitvCopyInto	(BitvClass, Bitv r, Bitv a);
+			/* r := a */
+extern Bool	bitvOrMinus	(BitvClass, Bitv r, Bitv a, Bitv b, Bitv c);
+			/* r := (a \/ b) - c */
+extern Bool	bitvOrAndNot	(BitvClass, Bitv r, Bitv a, Bitv b, Bitv c);
+			/* r := a \/ (b - c) */
+
 /*
  * Esoterica: for clients.
  */
 extern	int	bitvUnique1IndexInRange(BitvClass, Bitv, int org, int lim);
+extern	int	bitvNext	(BitvClass, Bitv, int ix);
+			/* First set bit at or after ix, or -1. */
 extern  Bitv    bitvFromInt(BitvClass, int);
 extern  int     bitvToInt(BitvClass, Bitv);
 
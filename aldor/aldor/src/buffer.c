@@ -51,6 +51,14 @@ bufCapture(String s, Length l)
 	return b;
 }
 
+void
+bufRecapture(Buffer b, String s, Length l)
+{
+	b->argv = (UByte *) s;
+	b->argc = l;
+	b->pos	= 0;
+}
+
 String
 bufLiberate(Buffer b)
 {
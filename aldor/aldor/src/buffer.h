@@ -20,6 +20,8 @@ extern void	bufFree		(Buffer);
 
 extern Buffer	bufCapture	(String, Length);
 	/* Form buffer from given string. */
+extern void	bufRecapture	(Buffer, String, Length);
+	/* Make buffer use given string, dropping but not freeing its own. */
 extern String	bufLiberate	(Buffer);
 	/* Free buffer but keep chars. */
 
@@ -11,6 +11,7 @@
 #include "emit.h"
 #include "genc.h"
 #include "opsys.h"
+#include "phase.h"
 #include "store.h"
 #include "archive.h"
 #include "comsg.h"
@@ -126,6 +127,7 @@ local void	ccPushOption	(enum ccoptTag, String);
 #define COPT_SYS	"sys"
 #define COPT_FORTRAN	"fortran"
 #define COPT_RUNTIME	"runtime"
+#define COPT_JOBS	"jobs"
 
 /*
  * Control C Code generation and compilation.
@@ -138,12 +140,16 @@ String 		ccSystem     = 0;
 String 		ccRuntime    = 0;
 Bool 		ccFortran    = 0;
 Bool		ccVerboseFlag= false;
+int		ccJobMax     = 1;
 Bool		ccLineNosFlag= false;
 int		ccDoStandardCFlag = -1;
 StringList      ccLibraries;
 String          ccRoot;
 
 local void ccSetStandardC(Bool flg);
+local void ccSetJobs	 (int);
+local Bool ccJobStart	 (String);
+local void ccJobFinishReady (void);
 
 void ccSetRoot(String root)
 {
@@ -175,6 +181,7 @@ ccOption(String opt)
 	else if (s = strAIsPrefix(COPT_SYS, opt), s)	ccSystem  = ++s;
 	else if (s = strAIsPrefix(COPT_RUNTIME, opt), s)ccRuntime = ++s;
 	else if (s = strAIsPrefix(COPT_LIB, opt), s)    ccPushLibrary(++s);
+	else if (s = strAIsPrefix(COPT_JOBS, opt), s)	ccSetJobs(atoi(++s));
 	else return -1;
 
 	return 0;
@@ -519,6 +526,7 @@ ccAppendToHiddenArgs(String str)
 /*
  * Compile a single C file.
  * Have to assume output will go in the current directory of the compile.
+ * With -C jobs=N the compile may still be running on return.
  */
 void
 ccCompileFile(String newwd, FileName outfile, FileName fn)
@@ -534,12 +542,20 @@ ccCompileFile(String newwd, FileName outfile, FileName fn)
 				   ccOptionList, newwd, oldwd, outfile);
 
 	ccEchoIf("Exec: %s\n", command);
-	rc = osRun(command);
-	if (rc != 0) comsgFatal(NULL, ALDOR_F_CcFailed, command);
+	if (ccJobMax > 1 && ccJobStart(command))
+		command = NULL;
+	else {
+		phSpanStart("cc", command);
+		rc = osRun(command);
+		phSpanEnd();
+		if (rc != 0) comsgFatal(NULL, ALDOR_F_CcFailed, command);
+	}
 
 	ccSwapDir(oldwd, NULL, int0);
-	strFree(command);
+	if (command) strFree(command);
 	strFree(newwd);
+
+	ccJobFinishReady();
 }
 
 /*
@@ -560,7 +576,9 @@ ccLinkProgram(String newwd, FileName *files, int numFiles)
 				ccOptionList, newwd, oldwd);
 
 	ccEchoIf("Exec: %s\n", command);
+	phSpanStart("cc", command);
 	rc = osRun(command);
+	phSpanEnd();
 	if (rc != 0) comsgFatal(NULL, ALDOR_F_LinkFailed, command);
 
 	ccSwapDir(oldwd, NULL, int0);
@@ -637,3 +655,193 @@ ccEchoIf(String fmt, String arg)
 {
 	if (ccVerboseFlag) { fprintf(osStdout, fmt, arg); fflush(osStdout); }
 }
+
+/*****************************************************************************
+ *
+ * :: Concurrent compiles
+ *
+ ****************************************************************************/
+
+/*
+ * With -C jobs=N, up to N C compiles run while the compiler carries on.
+ * Jobs are finished in the order they were started, showing each one's
+ * output and checking its exit code then.  An action queued by
+ * ccAfterCompiles runs once every compile started before it is done.
+ *
+ * Making room for a new compile only reaps the oldest running one, since
+ * ccJobStart runs in the output directory.  Outputs, failures and actions
+ * are seen to by ccJobFinishReady, once the old directory is back.
+ */
+struct ccJob {
+	int		pid;		/* -1 for an action */
+	Bool		reaped;		/* Compile has exited, with status */
+	int		status;
+	String		command;
+	FILE		*out;		/* Output of the compile */
+	ULong		start;		/* phSpanClock() when started */
+	CcJobFun	fun;
+	Pointer		arg;
+	struct ccJob	*next;
+};
+
+static int		ccJobCount  = 0;	/* Compiles running */
+static struct ccJob	*ccJobFirst = 0;
+static struct ccJob	*ccJobLast  = 0;
+
+local void
+ccSetJobs(int n)
+{
+	ccJobMax = n > 0 ? n : osCpuCount();
+}
+
+local void
+ccJobQueue(struct ccJob *job)
+{
+	job->next = 0;
+	if (ccJobLast)
+		ccJobLast->next = job;
+	else
+		ccJobFirst = job;
+	ccJobLast = job;
+}
+
+/*
+ * Wait for a compile to exit.
+ */
+local void
+ccJobReap(struct ccJob *job)
+{
+	int	status = 0;
+
+	if (osWait(job->pid, &status) == -1) status = -1;
+	ccJobCount -= 1;
+	phSpanDone("cc", job->command, job->start, job->pid);
+
+	job->reaped = true;
+	job->status = status;
+}
+
+/*
+ * Wait for the oldest compile still running.
+ */
+local void
+ccJobReapOldest(void)
+{
+	struct ccJob	*job;
+
+	for (job = ccJobFirst; job; job = job->next)
+		if (job->pid != -1 && !job->reaped) {
+			ccJobReap(job);
+			return;
+		}
+}
+
+/*
+ * Finish the oldest job.  If check is false, failed compiles are not
+ * reported and actions are dropped.
+ */
+local void
+ccJobFinish(Bool check)
+{
+	struct ccJob	*job = ccJobFirst;
+	int		c;
+
+	ccJobFirst = job->next;
+	if (!ccJobFirst) ccJobLast = 0;
+
+	if (job->pid == -1) {
+		if (check) job->fun(job->arg);
+		stoFree((Pointer) job);
+		return;
+	}
+
+	if (!job->reaped) ccJobReap(job);
+
+	rewind(job->out);
+	while ((c = getc(job->out)) != EOF)
+		putc(c, osStdout);
+	fflush(osStdout);
+	fclose(job->out);
+
+	if (job->status != 0 && check)
+		comsgFatal(NULL, ALDOR_F_CcFailed, job->command);
+
+	strFree(job->command);
+	stoFree((Pointer) job);
+}
+
+/*
+ * Finish the jobs which need no more waiting: compiles already reaped,
+ * and the actions which follow them.
+ */
+local void
+ccJobFinishReady(void)
+{
+	while (ccJobFirst && (ccJobFirst->pid == -1 || ccJobFirst->reaped))
+		ccJobFinish(true);
+}
+
+/*
+ * Start command as a job, taking ownership of it.  Returns false if it
+ * could not be started, in which case it should be run directly.
+ */
+local Bool
+ccJobStart(String command)
+{
+	struct ccJob	*job;
+	FILE		*out;
+	int		pid;
+
+	while (ccJobCount >= ccJobMax)
+		ccJobReapOldest();
+
+	out = tmpfile();
+	pid = out ? osRunAsync(command, out) : -1;
+	if (pid == -1) {
+		if (out) fclose(out);
+		return false;
+	}
+
+	job = (struct ccJob *) stoAlloc(OB_Other, sizeof(*job));
+	job->pid     = pid;
+	job->reaped  = false;
+	job->status  = 0;
+	job->command = command;
+	job->out     = out;
+	job->start   = phSpanClock();
+	job->fun     = 0;
+	job->arg     = 0;
+	ccJobQueue(job);
+	ccJobCount += 1;
+
+	return true;
+}
+
+void
+ccAfterCompiles(CcJobFun fun, Pointer arg)
+{
+	struct ccJob	*job;
+
+	if (!ccJobFirst) {
+		fun(arg);
+		return;
+	}
+
+	job = (struct ccJob *) stoAlloc(OB_Other, sizeof(*job));
+	job->pid     = -1;
+	job->reaped  = false;
+	job->status  = 0;
+	job->command = 0;
+	job->out     = 0;
+	job->start   = 0;
+	job->fun     = fun;
+	job->arg     = arg;
+	ccJobQueue(job);
+}
+
+void
+ccWaitCompiles(Bool check)
+{
+	while (ccJobFirst)
+		ccJobFinish(check);
+}
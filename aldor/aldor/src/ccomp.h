@@ -33,4 +33,12 @@ extern void	ccCompileFile		(String newwd, FileName, FileName);
 extern void	ccLinkProgram		(String newwd, FileName *, int);
 extern void	ccGoProgram		(FileName, int argc1, String *argv1);
 
+/*
+ * Compiles running concurrently (-C jobs=N)
+ */
+typedef void	(*CcJobFun)		(Pointer);
+
+extern void	ccAfterCompiles		(CcJobFun, Pointer);
+extern void	ccWaitCompiles		(Bool check);
+
 #endif /* _CCOMP_H_ */
@@ -17,6 +17,7 @@
 #include "genlisp.h"
 #include "include.h"
 #include "of_emerg.h"
+#include "of_inlin.h"
 #include "of_util.h"
 #include "opsys.h"
 #include "optfoam.h"
@@ -41,6 +42,7 @@ Bool		cmdSExprFlag	    = false;
 Bool		cmdSEvalFlag	    = false;
 Bool		cmdTrapFlag	    = false;
 int		cmdFileCount	    = 0;
+int		cmdJobCount	    = 1;
 
 #define		optIs(a,b)	(toupper(a) == toupper(b))
 
@@ -857,6 +859,10 @@ local int	cmdDDebug		(String, Bool sense);
 local void	cmdDoKeywordStatus	(String, Bool);
 
 extern	void gencSetTraceFuns(Bool);
+extern	void gencSetWriteBarriers(Bool);
+extern	void gencSetProfileCounts(Bool);
+extern	void gencSetProfileAlloc(Bool);
+extern	int  gencSetGetCache(String);
 extern	void stabSetDumbImport(Bool);
 extern	void gfSetLazyCatch(Bool);
 extern	void jflowSetNegate(Bool);
@@ -933,6 +939,52 @@ cmdDoOptDeveloper(String arg)
 	else if (strAEqual("loops", arg)) {
 		optSetLoopOption();
 	}
+	else if (strAEqual("opt-stats", arg)) {
+		optSetStatsWanted(true);
+	}
+	else if (strAEqual("profile-gen", arg)) {
+		gencSetProfileCounts(true);
+		inlSetProfileGen(true);
+		emitSetFoamPositions(true);
+	}
+	else if (strAEqual("write-barrier", arg)) {
+		gencSetWriteBarriers(true);
+	}
+	else if (strAEqual("profile-alloc", arg)) {
+		gencSetProfileAlloc(true);
+	}
+	else if (strAIsPrefix("profile-use", arg)) {
+		String darg = cmdDGetOptArg(arg, "profile-use", NULL);
+		inlSetProfileUse(darg);
+	}
+	else if (strAIsPrefix("timeline", arg)) {
+		String darg = cmdDGetOptArg(arg, "timeline", NULL);
+		phTimelineOpen(darg);
+	}
+	else if (strAIsPrefix("jobs", arg)) {
+		String darg = cmdDGetOptArg(arg, "jobs", NULL);
+		cmdJobCount = atoi(darg);
+		if (cmdJobCount < 1) cmdJobCount = osCpuCount();
+	}
+	else if (strAIsPrefix("cache-size", arg)) {
+		String darg = cmdDGetOptArg(arg, "cache-size", NULL);
+		emitSetCacheSize((Length) atol(darg) * 1024 * 1024);
+	}
+	else if (strAIsPrefix("cache", arg)) {
+		String darg = cmdDGetOptArg(arg, "cache", NULL);
+		emitSetCacheDir(darg);
+	}
+	else if (strAEqual("incremental", arg)) {
+		emitSetIncremental(true);
+	}
+	else if (strAIsPrefix("server", arg) || strAIsPrefix("connect", arg)) {
+		/* Handled already - no action need be taken here */
+	}
+	else if (strAIsPrefix("ar-index", arg)) {
+		String darg = cmdDGetOptArg(arg, "ar-index", NULL);
+		arWriteIndex(fnameParse(darg));
+		exitSuccess();
+	}
 	else if (strAEqual("emerge-noalias", arg)) {
 		emSetNoAlias();
 	}
@@ -949,6 +1001,10 @@ cmdDoOptDeveloper(String arg)
 		sscanf(darg, "%ld", &rtsize);
 		gen0SetRtCacheSize((AInt)rtsize);
 	}
+	else if (strAIsPrefix("getcache", arg)) {
+		String darg = cmdDGetOptArg(arg, "getcache", NULL);
+		rc = gencSetGetCache(darg);
+	}
 	else if (strAIsPrefix("D", arg)) {
 		char	sep;
 		String  darg = cmdDGetOptArg(arg, "D", &sep);
@@ -1021,7 +1077,7 @@ extern Bool
 	cfoldDebug, condApplyDebug, cpDebug, cpDfDebug,
 	crinDebug,
         cseDebug, cseDfDebug, cseDfiDebug, daDebug,
-        dnfDebug, dvDebug, emergeDebug, fileDebug,
+        dnfDebug, dvDebug, emergeDebug, escDebug, fileDebug,
         fintDebug, fintLinkDebug, fintStoDebug,
 	flogDebug, foamConstDebug, foamDebug, foamSposDebug, 
 	fortranTypesDebug, fvDebug,
@@ -1040,7 +1096,7 @@ extern Bool
 	macDebug, oeDebug,
 	optfDebug, optfShowDebug, peepDebug,
 	retDebug, rrfmtDebug,
-	scoDebug, scoFluidDebug, scoStabDebug, scoUndoDebug,
+	sccpDebug, scoDebug, scoFluidDebug, scoStabDebug, scoUndoDebug,
 	sefoCloseDebug, sefoEqualDebug, sefoFreeDebug,
 	sefoPrintDebug, sefoSubstDebug, sefoUnionDebug, sefoInterDebug,
 	sexprDebug, sstDebug, sstMarkDebug,
@@ -1088,6 +1144,7 @@ struct dbVarInfo dbVarInfo[] = {
 	{ & dnfDebug,		"dnf" },
 	{ & dvDebug,		"dv" },
 	{ & emergeDebug,	"emerge" },
+	{ & escDebug,		"esc" },
 	{ & fileDebug,		"file" },
 	{ & fintDebug,		"fint" },
 	{ & fintLinkDebug,	"fintLink" },
@@ -1135,6 +1192,7 @@ struct dbVarInfo dbVarInfo[] = {
 	{ & peepDebug,          "peep" },
 	{ & retDebug,		"ret" },
 	{ & rrfmtDebug,		"rrfmt" },
+	{ & sccpDebug,		"sccp" },
 	{ & scoDebug,		"sco" },
 	{ & scoFluidDebug,	"scoFluid" },
 	{ & scoStabDebug,	"scoStab" },
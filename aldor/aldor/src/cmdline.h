@@ -109,6 +109,8 @@ extern void cmdDebugReset();
 #define cmdHasInteractiveOption(ac,av) cmdHasOption('G',"loop",  ac,av)
 #define cmdHasCfgFileOption(ac,av)     cmdHasOptionPrefix('N',"file=",  ac,av)
 #define cmdHasCfgNameOption(ac,av)     cmdHasOptionPrefix('N',"sys=",  ac,av)
+#define cmdHasServerOption(ac,av)      cmdHasOptionPrefix('W',"server=", ac,av)
+#define cmdHasConnectOption(ac,av)     cmdHasOptionPrefix('W',"connect=",ac,av)
 
 
 /*****************************************************************************
@@ -126,5 +128,6 @@ extern Bool	cmdGcFileFlag;	    /* Had the gcfile option     (-Wgcfile)?*/
 extern Bool     cmdFloatRepFlag;    /* Decrease double precision -Wfloatrep */
 
 extern int	cmdFileCount;	    /* Number of files to compile.          */
+extern int	cmdJobCount;	    /* Files to compile at once (-Wjobs=N). */
 
 #endif	/* !_CMDLINE_H_ */
@@ -113,6 +113,7 @@ extern String		comsgName	(Msg);
 extern void		comsgInit	(void);
 extern void		comsgFini	(void);
 extern int		comsgErrorCount (void);
+extern int		comsgWarningCount (void);
 
 local  String		comsgText	(Msg, va_list);
 local  CoMsg		comsgNew	(CoMsgTag tag, Length serial,
@@ -620,6 +621,12 @@ comsgErrorCount(void)
 	return nErrors;
 }
 
+int
+comsgWarningCount(void)
+{
+	return nWarnings;
+}
+
 
 /*****************************************************************************
  *
@@ -9,6 +9,7 @@
 #include "axlobs.h"
 #include "dflow.h"
 #include "flog.h"
+#include "store.h"
 #include "util.h"
 
 
@@ -93,6 +94,150 @@ dflowPrintBlockInfo(FILE *fout, BBlock bb)
 	return cc;
 }
 
+/*****************************************************************************
+ *
+ * :: Worklist
+ *
+ ****************************************************************************/
+
+/*
+ * dflowFwdIterate and dflowRevIterate visit the blocks in reverse
+ * postorder (postorder for reverse problems), so that in the absence of
+ * loops a block is seen after all the blocks which feed it.  A block is
+ * visited again only when a set it depends on has changed: the pending
+ * blocks are kept in a bit vector indexed by position in the order, and
+ * are taken in order, wrapping around at the end.  Each wrap-around is
+ * one "iteration" as far as the cutoff is concerned.
+ *
+ * Only blocks with entries (and block0) take part, as in the step
+ * functions below.
+ */
+
+#define dflowIsLive(bb)	((bb) && (bbEntryC(bb) > 0 || (bb)->isblock0))
+
+typedef struct {
+	int		count;		/* Number of blocks in the order */
+	BBlock		*order;		/* The blocks, in visiting order */
+	int		*pos;		/* Position of each label in order */
+	BitvClass	class;
+	Bitv		pending;	/* Positions waiting to be visited */
+	int		cursor;		/* Position to look from next */
+	int		iters;		/* Number of wrap-arounds */
+} DFlowWork;
+
+local void	dflowWorkInit	(DFlowWork *, FlowGraph, Bool post);
+local void	dflowWorkFini	(DFlowWork *);
+local void	dflowWorkPush	(DFlowWork *, BBlock);
+local BBlock	dflowWorkNext	(DFlowWork *, int cutoff);
+
+local void
+dflowWorkInit(DFlowWork *work, FlowGraph flog, Bool post)
+{
+	int	n = flogBlockC(flog), i, j, top, count;
+	int	*stack, *next;
+	BBlock	bb, dd, *order;
+
+	order = (BBlock *) stoAlloc(OB_Other, (n + 1) * sizeof(BBlock));
+	stack = (int *)	   stoAlloc(OB_Other, (n + 1) * sizeof(int));
+	next  = (int *)	   stoAlloc(OB_Other, (n + 1) * sizeof(int));
+	work->pos = (int *) stoAlloc(OB_Other, (n + 1) * sizeof(int));
+
+	for (i = 0; i < n; i++) work->pos[i] = -1;
+
+	/* Depth-first walk from block0, collecting blocks in postorder. */
+	count = 0;
+	top   = 0;
+	if (flog->block0) {
+		work->pos[flog->block0->label] = 0;
+		next[top] = 0;
+		stack[top++] = flog->block0->label;
+	}
+	while (top > 0) {
+		bb = flogBlock(flog, stack[top-1]);
+		j  = next[top-1];
+		if (j < bbExitC(bb)) {
+			next[top-1] = j + 1;
+			dd = bbExit(bb, j);
+			if (work->pos[dd->label] != -1) continue;
+			work->pos[dd->label] = 0;
+			next[top] = 0;
+			stack[top++] = dd->label;
+		}
+		else {
+			order[count++] = bb;
+			top -= 1;
+		}
+	}
+
+	/* Reverse it, unless postorder is wanted. */
+	if (!post)
+		for (i = 0, j = count - 1; i < j; i++, j--) {
+			bb = order[i];
+			order[i] = order[j];
+			order[j] = bb;
+		}
+
+	/* Live blocks not reached from block0 go last. */
+	for (i = 0; i < n; i++) {
+		bb = flogBlock(flog, i);
+		if (!dflowIsLive(bb) || work->pos[i] != -1) continue;
+		order[count++] = bb;
+	}
+	for (i = 0; i < count; i++)
+		work->pos[order[i]->label] = i;
+
+	stoFree(stack);
+	stoFree(next);
+
+	work->count   = count;
+	work->order   = order;
+	work->class   = bitvClassCreate(count);
+	work->pending = bitvNew(work->class);
+	work->cursor  = 0;
+	work->iters   = 0;
+
+	bitvClearAll(work->class, work->pending);
+}
+
+local void
+dflowWorkFini(DFlowWork *work)
+{
+	bitvFree(work->pending);
+	bitvClassDestroy(work->class);
+	stoFree(work->order);
+	stoFree(work->pos);
+}
+
+local void
+dflowWorkPush(DFlowWork *work, BBlock bb)
+{
+	int	k = work->pos[bb->label];
+
+	if (k != -1) bitvSet(work->class, work->pending, k);
+}
+
+/*
+ * Take the next pending block, or return NULL if there is none or the
+ * cutoff has been reached.
+ */
+local BBlock
+dflowWorkNext(DFlowWork *work, int cutoff)
+{
+	int	k;
+
+	k = bitvNext(work->class, work->pending, work->cursor);
+	if (k == -1) {
+		work->iters += 1;
+		if (cutoff >= 0 && work->iters >= cutoff) return NULL;
+		k = bitvNext(work->class, work->pending, 0);
+		if (k == -1) return NULL;
+	}
+	bitvClear(work->class, work->pending, k);
+	work->cursor = k + 1;
+
+	return work->order[k];
+}
+
 /*****************************************************************************
  *
  * :: Forward Dataflow
@@ -192,19 +337,63 @@ dflowFwdStep(FlowGraph flog, DFlowType inFrOut)
 	return nchanged;
 }
 
+/*
+ * Recompute the "in" set of bb from the "out" sets of its predecessors,
+ * returning true if it changed.  IN[B0] also meets the value it was
+ * given initially, in "entry".
+ */
+local Bool
+dflowFwdMeet(FlowGraph flog, DFlowType inFrOut, BBlock bb, Bitv entry)
+{
+	BitvClass	class = flogBitvClass(flog);
+	Bitv		in = dfFwdTemp(bb);
+	BBlock		pp;
+	int		i, j;
+
+	if (bb == flog->block0)
+		bitvCopy(class, in, entry);
+	else if (inFrOut == DFLOW_Union)
+		bitvClearAll(class, in);
+	else
+		bitvSetAll(class, in);
+
+	for (i = 0; i < bbEntryC(bb); i++) {
+		pp = bbEntry(bb, i);
+		if (!dflowIsLive(pp)) continue;
+
+		for (j = 0; j < bbExitC(pp); j++) {
+			Bitv	out;
+
+			if (bbExit(pp, j) != bb) continue;
+			out = dfFwdOut(pp, flog->dfIsPerExit ? j : 0);
+
+			if (inFrOut == DFLOW_Union)
+				bitvOrInto(class, in, out);
+			else
+				bitvAndInto(class, in, out);
+		}
+	}
+
+	return bitvCopyInto(class, dfFwdIn(bb), in);
+}
+
 /* "inFrOut" is the type of equations we want to use; it must be
  * DFLOW_Intersection or DFLOW_Union (see header file).
  * "dflowInit" is a pointer to an initialization function that is called
  * after dflowFwdInit (standard initializer). It may be NULL.
  * "cutoff" is the max num. of iterations.
- * Upon exit, if *pcount == 0 => the algorithm didn't converge with "cutoff"
- * limit.
+ * Upon exit, *pcount is the number of iterations used.
  */
 Bool
 dflowFwdIterate(FlowGraph flog, DFlowType inFrOut, int cutoff, int *pcount,
 		DFlowInitFun dflowInit)
 {
-	int	i, n=-1;
+	BitvClass	class = flogBitvClass(flog);
+	DFlowWork	work;
+	BBlock		bb;
+	Bitv		entry;
+	int		i, j, n;
+
 	flogFixEntries(flog);
 
 	if (inFrOut != DFLOW_Intersection && inFrOut != DFLOW_Union)
@@ -214,11 +403,42 @@ dflowFwdIterate(FlowGraph flog, DFlowType inFrOut, int cutoff, int *pcount,
 
 	if (dflowInit)  dflowInit(flog);
 
-	for (i = 0; i < cutoff; i++) {
-		n = dflowFwdStep(flog, inFrOut);
-		if (n == 0) break;
+	entry = bitvNew(class);
+	if (flog->block0)
+		bitvCopy(class, entry, dfFwdIn(flog->block0));
+
+	dflowWorkInit(&work, flog, false);
+
+	/* Start with "out" sets which agree with the initial "in" sets. */
+	for (i = 0; i < work.count; i++) {
+		bb = work.order[i];
+		for (j = 0; j < bbDfC(bb); j++)
+			bitvOrMinus(class, dfFwdOut(bb,j),
+				    dfFwdIn(bb), dfFwdGen(bb), dfFwdKill(bb,j));
+		dflowWorkPush(&work, bb);
 	}
-	if (pcount) *pcount = i;
+
+	while ((bb = dflowWorkNext(&work, cutoff)) != NULL) {
+		if (!dflowFwdMeet(flog, inFrOut, bb, entry)) continue;
+
+		/* outj = (in \/ gen) - killj */
+		for (j = 0; j < bbDfC(bb); j++) {
+			if (!bitvOrMinus(class, dfFwdOut(bb,j), dfFwdIn(bb),
+					 dfFwdGen(bb), dfFwdKill(bb,j)))
+				continue;
+			if (flog->dfIsPerExit)
+				dflowWorkPush(&work, bbExit(bb, j));
+			else
+				for (i = 0; i < bbExitC(bb); i++)
+					dflowWorkPush(&work, bbExit(bb, i));
+		}
+	}
+
+	n = bitvCount(work.class, work.pending);
+	if (pcount) *pcount = work.iters;
+
+	dflowWorkFini(&work);
+	bitvFree(entry);
 
 	return n;
 }
@@ -255,16 +475,47 @@ dflowRevIterate(FlowGraph flog, DFlowType inFrOut,
 		int cutoff, int *pcount,
 		DFlowInitFun dfInit)
 {
-	int i, n=-1;
+	BitvClass	class = flogBitvClass(flog);
+	DFlowWork	work;
+	BBlock		bb;
+	int		i, n;
 
 	dflowRevInit(flog, inFrOut);
 	
 	if (dfInit) dfInit(flog);
 
-	for (i = 0; n != 0 && i < cutoff ; i++)
-		n = dflowRevStep(flog, inFrOut);
-	
-	if (pcount) *pcount = i;
+	dflowWorkInit(&work, flog, true);
+	for (i = 0; i < work.count; i++)
+		dflowWorkPush(&work, work.order[i]);
+
+	while ((bb = dflowWorkNext(&work, cutoff)) != NULL) {
+		/* Create the new "out" set */
+		if (inFrOut == DFLOW_Union) {
+			bitvClearAll(class, dfRevOut(bb));
+			for (i = 0; i < bbExitC(bb); i++)
+				bitvOrInto(class, dfRevOut(bb),
+					   dfRevIn(bbExit(bb, i)));
+		}
+		else { /* Intersection */
+			bitvSetAll(class, dfRevOut(bb));
+			for (i = 0; i < bbExitC(bb); i++)
+				bitvAndInto(class, dfRevOut(bb),
+					    dfRevIn(bbExit(bb, i)));
+		}
+
+		/* In[B] := use[B] op (out[B] - def[B]) */
+		if (!bitvOrAndNot(class, dfRevIn(bb), dfRevGen(bb),
+				  dfRevOut(bb), dfRevKill(bb)))
+			continue;
+
+		for (i = 0; i < bbEntryC(bb); i++)
+			dflowWorkPush(&work, bbEntry(bb, i));
+	}
+
+	n = bitvCount(work.class, work.pending);
+	if (pcount) *pcount = work.iters;
+
+	dflowWorkFini(&work);
 
 	return n;
 }
@@ -42,8 +42,11 @@ static String   emitFileIdPrefix = NULL;
 
 static Bool	emitSolo	= false;
 static Bool	emitDoLineNos   = false;
+static Bool	emitDoFoamPos   = false;
 static Bool	emitDoRun	= false;
 static Bool	emitDoInterp	= false;
+static Bool	emitIncremental	= false;
+static int	emitIncrKept, emitIncrCompiled;
 
 static Bool	emitDo  [FTYPENO_LIMIT];
 static Bool	emitDone[FTYPENO_LIMIT];
@@ -195,6 +198,17 @@ emitSetDebug(Bool wantDebug)
 	ccSetDebug(wantDebug);
 }
 
+/*
+ * Keep the positions of the foam in .ao files, without other debugging
+ * information: the sites counted by -Wprofile-gen are keyed by line, also
+ * when the C code is generated from the .ao file by a later run.
+ */
+void
+emitSetFoamPositions(Bool wantPos)
+{
+	emitDoFoamPos = wantPos;
+}
+
 void
 emitSetProfile(Bool wantProfile)
 {
@@ -341,6 +355,8 @@ emitInfoNew(FileName srcfn)
 	}
 	emitInfoIsAXLmain(finfo) = false;
 	emitInfoFname(finfo, FTYPENO_SRC) = fnameCopy(srcfn);
+	finfo->cacheKey = NULL;
+	finfo->srcHash  = 0;
 
 	dir  = emitOutputDir;
 	name = fnameName(srcfn);
@@ -410,6 +426,81 @@ emitInfoShow(EmitInfo finfo)
 	fprintf(fout, ">>\n");
 }
 
+/*
+ * Write out the file names chosen for finfo and the file types emitted
+ * so far, so that another process can carry on with emitInfoRestore.
+ * Each line is a tag, a file type number and a file name.
+ */
+void
+emitInfoSave(FILE *fout, EmitInfo finfo)
+{
+	FileNameList	fl;
+	int		i;
+
+	for (i = 0; i < FTYPENO_LIMIT; i++) {
+		if (emitDone[i])
+			fprintf(fout, "D %d -\n", i);
+		if (emitInfoFname(finfo, i))
+			fprintf(fout, "F %d %s\n", i,
+				fnameUnparseStatic(emitInfoFname(finfo, i)));
+	}
+	for (i = 0; emitInfoFnameTempV(finfo) && emitInfoFnameTemp(finfo, i); i++)
+		fprintf(fout, "T 0 %s\n",
+			fnameUnparseStatic(emitInfoFnameTemp(finfo, i)));
+	for (fl = finfo->flist; fl; fl = cdr(fl))
+		fprintf(fout, "O 0 %s\n", fnameUnparseStatic(car(fl)));
+}
+
+/*
+ * Read back what emitInfoSave wrote.  Returns false if it is garbled.
+ */
+Bool
+emitInfoRestore(FILE *fin, EmitInfo finfo)
+{
+	FileNameList	flist = listNil(FileName), tlist = listNil(FileName);
+	char		line[1024], tag, *name;
+	int		i, n;
+
+	while (fgets(line, sizeof(line), fin)) {
+		line[strcspn(line, "\n")] = 0;
+		if (sscanf(line, "%c %d %n", &tag, &i, &n) < 2) return false;
+		if (i < 0 || i >= FTYPENO_LIMIT) return false;
+		name = line + n;
+
+		switch (tag) {
+		case 'D':
+			emitDone[i] = true;
+			break;
+		case 'F':
+			if (emitInfoFname(finfo, i))
+				fnameFree(emitInfoFname(finfo, i));
+			emitInfoFname(finfo, i) = fnameParse(name);
+			break;
+		case 'T':
+			tlist = listCons(FileName)(fnameParse(name), tlist);
+			break;
+		case 'O':
+			flist = listCons(FileName)(fnameParse(name), flist);
+			break;
+		default:
+			return false;
+		}
+	}
+
+	if (tlist) {
+		tlist = listNReverse(FileName)(tlist);
+		n = listLength(FileName)(tlist);
+		emitInfoFnameTempV(finfo) = (FileName *)
+			stoAlloc((unsigned) OB_Other, (n+1) * sizeof(FileName));
+		for (i = 0; i < n; i++, tlist = listFreeCons(FileName)(tlist))
+			emitInfoFnameTemp(finfo, i) = car(tlist);
+		emitInfoFnameTemp(finfo, n) = NULL;
+	}
+	if (flist) finfo->flist = listNReverse(FileName)(flist);
+
+	return true;
+}
+
 void
 emitInfoFree(EmitInfo finfo)
 {
@@ -439,6 +530,7 @@ emitInfoFree(EmitInfo finfo)
 		fnameFree(fn);
 	}
 	listFree(FileName)(finfo->flist);
+	if (finfo->cacheKey) strFree(finfo->cacheKey);
 	stoFree((Pointer) finfo);
 }
 
@@ -861,9 +953,12 @@ emitTheIntermed(EmitInfo finfo, SymeList sl, Foam foam, AbSyn macs)
 
 	libPutFileId(lib, emitGetFileIdName(finfo));
 
-	if (emitDoLineNos)
+	if (emitDoLineNos || emitDoFoamPos)
 		libPutPos(lib, foam);
 
+	if (emitIncremental)
+		libPutInterface(lib, finfo->srcHash);
+
 	libClose(lib);
 	emitInfoInUse(finfo, FTYPENO_INTERMED) = false;
 	emitSetDone(FTYPENO_INTERMED);
@@ -1125,6 +1220,8 @@ emitTheC(EmitInfo finfo, CCodeList cco)
 	}
 }
 
+local void	emitTheObjectDone	(EmitInfo finfo);
+
 /*
  * Emit the .o object-code file by compiling C-code.
  */
@@ -1145,6 +1242,16 @@ emitTheObject(EmitInfo finfo)
 	emitInfoInUse(finfo, FTYPENO_OBJECT) = false;
 	emitSetDone(FTYPENO_OBJECT);
 
+	/* The C files are still needed until their compiles are done. */
+	ccAfterCompiles((CcJobFun) emitTheObjectDone, (Pointer) finfo);
+}
+
+local void
+emitTheObjectDone(EmitInfo finfo)
+{
+	FileNameList	fl;
+	FileName cfile = emitFileName(finfo, FTYPENO_C);
+
 	/* Keep if (-Fc && !aldormain.c) or (-Waldormain && aldormain.c). */
 	if (emitKeep[FTYPENO_C] && !emitInfoIsAXLmain(finfo))
 		; /* Keep */
@@ -1166,6 +1273,372 @@ emitTheObject(EmitInfo finfo)
 
 
 
+/*****************************************************************************
+ *
+ * :: Output cache
+ *
+ * With -W cache=<dir>, the .ao, .c and .o files made from a source file
+ * are saved in <dir> under a key computed by the caller from everything
+ * the outputs depend on (see compFileFromCache).  A later compile with
+ * the same key copies them back instead of compiling.  Only the outputs
+ * which would be kept are cached, together with the object file.
+ *
+ * The file <dir>/index lists the cached files, least recently used
+ * first, one "<key> <type> <bytes>" line each.  When the total exceeds
+ * the size limit the oldest files are removed.  The index is replaced
+ * in one rename, so processes sharing a cache never see it half written;
+ * an entry lost to a racing update is only put back when next used.
+ *
+ *****************************************************************************/
+
+static String	emitCacheDir	= NULL;
+static Length	emitCacheSize	= 256 * 1024 * 1024;
+
+static int	emitCacheHits, emitCacheMisses, emitCacheStores, emitCacheEvicts;
+
+static FTypeNo	emitCacheTypes[] = {
+	FTYPENO_INTERMED, FTYPENO_C, FTYPENO_OBJECT
+};
+#define EMIT_CACHE_NTYPES (sizeof(emitCacheTypes)/sizeof(emitCacheTypes[0]))
+
+struct emitCacheEntry {
+	String		key;
+	String		type;
+	Length		size;
+};
+
+local Bool	emitCacheWants		(EmitInfo, FTypeNo);
+local void	emitCacheStore		(EmitInfo, FTypeNo);
+local void	emitCacheStoreObject	(EmitInfo);
+local void	emitCacheTouch		(String key);
+
+void
+emitSetCacheDir(String dir)
+{
+	emitCacheDir = strCopy(dir);
+	if (!osDirIsThere(dir)) osDirCreate(dir);
+}
+
+void
+emitSetCacheSize(Length size)
+{
+	emitCacheSize = size;
+}
+
+/*
+ * Are all the outputs needed from this file of the kinds which can be
+ * reused without compiling it?
+ */
+local Bool
+emitIsReusable(EmitInfo finfo)
+{
+	static FTypeNo	otherv[] = {
+		FTYPENO_INCLUDED, FTYPENO_ABSYN, FTYPENO_OLDABSYN,
+		FTYPENO_FOAMEXPR, FTYPENO_SYMEEXPR, FTYPENO_ANNABS,
+		FTYPENO_LISP, FTYPENO_JAVA, FTYPENO_CPP
+	};
+	Bool	any = false;
+	int	i;
+
+	if (emitInfoIsAXLmain(finfo) || emitInfoIsStdIn(finfo))
+		return false;
+
+	for (i = 0; i < sizeof(otherv)/sizeof(otherv[0]); i++)
+		if (emitIsOutputNeeded(finfo, otherv[i])) return false;
+	for (i = 0; i < EMIT_CACHE_NTYPES; i++)
+		if (emitCacheWants(finfo, emitCacheTypes[i])) any = true;
+
+	return any;
+}
+
+/*
+ * Can the outputs needed from this file come from the cache?
+ */
+Bool
+emitIsCacheable(EmitInfo finfo)
+{
+	return emitCacheDir && emitIsReusable(finfo);
+}
+
+/*
+ * Restore the outputs of finfo saved under key, if they are all there.
+ * Otherwise remember the key so that emitToCache can save them.
+ */
+Bool
+emitFromCache(EmitInfo finfo, String key)
+{
+	FileName	fn;
+	FTypeNo		ft;
+	Bool		ok = true;
+	int		i;
+
+	for (i = 0; ok && i < EMIT_CACHE_NTYPES; i++) {
+		ft = emitCacheTypes[i];
+		if (!emitCacheWants(finfo, ft)) continue;
+		fn = fnameNew(emitCacheDir, key, ftypeString(ft));
+		ok = fileIsThere(fn);
+		fnameFree(fn);
+	}
+
+	if (!ok) {
+		emitCacheMisses += 1;
+		finfo->cacheKey = strCopy(key);
+		return false;
+	}
+
+	for (i = 0; ok && i < EMIT_CACHE_NTYPES; i++) {
+		ft = emitCacheTypes[i];
+		if (!emitIsOutputNeeded(finfo, ft)) continue;
+		/* A C file only needed to make the object is done with. */
+		emitSetDone(ft);
+		if (!emitCacheWants(finfo, ft)) continue;
+		fn = fnameNew(emitCacheDir, key, ftypeString(ft));
+		emitFileRemove(finfo, ft);
+		ok = fileCopy(fn, emitFileName(finfo, ft));
+		fnameFree(fn);
+		if (ft == FTYPENO_C) emitFileRename(finfo, ft);
+	}
+
+	/* A damaged entry is compiled over again. */
+	if (!ok) {
+		emitCacheMisses += 1;
+		finfo->cacheKey = strCopy(key);
+		return false;
+	}
+
+	emitCacheHits += 1;
+	emitCacheTouch(key);
+	return true;
+}
+
+/*
+ * Save the outputs of a successful compile under the key emitFromCache
+ * gave it.  The object file is saved once its compile has finished.
+ */
+void
+emitToCache(EmitInfo finfo)
+{
+	if (!finfo->cacheKey) return;
+
+	/* Split C files are not cached. */
+	if (finfo->flist) {
+		strFree(finfo->cacheKey);
+		finfo->cacheKey = NULL;
+		return;
+	}
+
+	emitCacheStore(finfo, FTYPENO_INTERMED);
+	emitCacheStore(finfo, FTYPENO_C);
+	ccAfterCompiles((CcJobFun) emitCacheStoreObject, (Pointer) finfo);
+}
+
+void
+emitShowReuseStats(FILE *fout)
+{
+	if (emitCacheDir)
+		fprintf(fout, " Cache%6d hits, %d misses, %d stores, "
+			"%d evictions\n", emitCacheHits, emitCacheMisses,
+			emitCacheStores, emitCacheEvicts);
+	if (emitIncremental)
+		fprintf(fout, " Kept%7d up to date, %d compiled\n",
+			emitIncrKept, emitIncrCompiled);
+}
+
+local Bool
+emitCacheWants(EmitInfo finfo, FTypeNo ft)
+{
+	return emitIsOutputNeeded(finfo, ft) &&
+		(emitKeep[ft] || ft == FTYPENO_OBJECT);
+}
+
+local void
+emitCacheStore(EmitInfo finfo, FTypeNo ft)
+{
+	FileName	fn, tfn;
+	String		key = finfo->cacheKey, tmp;
+
+	if (!emitCacheWants(finfo, ft) || !emitDone[ft]) return;
+
+	/* Copy to a name of our own first, so no one sees a partial file. */
+	tmp = strPrintf("tmp%d", osFnameTempSeed());
+	fn  = fnameNew(emitCacheDir, key, ftypeString(ft));
+	tfn = fnameNew(emitCacheDir, key, tmp);
+	strFree(tmp);
+	if (fileCopy(emitFileName(finfo, ft), tfn)) {
+		fileRename(tfn, fn);
+		emitCacheStores += 1;
+		emitCacheTouch(key);
+	}
+	else
+		fileRemove(tfn);
+	fnameFree(fn);
+	fnameFree(tfn);
+}
+
+local void
+emitCacheStoreObject(EmitInfo finfo)
+{
+	emitCacheStore(finfo, FTYPENO_OBJECT);
+	strFree(finfo->cacheKey);
+	finfo->cacheKey = NULL;
+}
+
+/*
+ * Make the files saved under key the most recently used ones in the
+ * index, and remove the least recently used files while the cache is
+ * over its size.
+ */
+local void
+emitCacheTouch(String key)
+{
+	struct emitCacheEntry	*entv;
+	FileName		ifn, tfn, fn;
+	FILE			*f;
+	String			tmp;
+	char			line[256], ekey[128], etype[32];
+	unsigned long		esize;
+	Length			total = 0;
+	int			entc = 0, entn = 64, i, nkey;
+
+	entv = (struct emitCacheEntry *)
+		stoAlloc(OB_Other, entn * sizeof(*entv));
+
+	/* Read the index, less the entries for key. */
+	ifn = fnameNew(emitCacheDir, "index", NULL);
+	if ((f = fileTryOpen(ifn, osIoRdMode)) != NULL) {
+		while (fgets(line, sizeof(line), f)) {
+			if (sscanf(line, "%127s %31s %lu", ekey, etype,
+				   &esize) != 3 || strEqual(ekey, key))
+				continue;
+			if (entc == entn) {
+				entn *= 2;
+				entv = (struct emitCacheEntry *)
+					stoResize(entv, entn * sizeof(*entv));
+			}
+			entv[entc].key  = strCopy(ekey);
+			entv[entc].type = strCopy(etype);
+			entv[entc].size = esize;
+			total += esize;
+			entc += 1;
+		}
+		fclose(f);
+	}
+
+	/* Put the files for key at the end. */
+	nkey = 0;
+	for (i = 0; i < EMIT_CACHE_NTYPES; i++) {
+		String type = ftypeString(emitCacheTypes[i]);
+
+		fn = fnameNew(emitCacheDir, key, type);
+		if (fileIsThere(fn)) {
+			if (entc == entn) {
+				entn *= 2;
+				entv = (struct emitCacheEntry *)
+					stoResize(entv, entn * sizeof(*entv));
+			}
+			entv[entc].key  = strCopy(key);
+			entv[entc].type = strCopy(type);
+			entv[entc].size = fileSize(fn);
+			total += entv[entc].size;
+			entc += 1;
+			nkey += 1;
+		}
+		fnameFree(fn);
+	}
+
+	/* Evict the oldest files, never those for key. */
+	for (i = 0; i < entc - nkey && total > emitCacheSize; i++) {
+		fn = fnameNew(emitCacheDir, entv[i].key, entv[i].type);
+		fileRemove(fn);
+		fnameFree(fn);
+		total -= entv[i].size;
+		entv[i].size = (Length) -1;
+		emitCacheEvicts += 1;
+	}
+
+	/* Write the new index and put it in place. */
+	tmp = strPrintf("tmp%d", osFnameTempSeed());
+	tfn = fnameNew(emitCacheDir, "index", tmp);
+	strFree(tmp);
+	if ((f = fileTryOpen(tfn, osIoWrMode)) != NULL) {
+		for (i = 0; i < entc; i++)
+			if (entv[i].size != (Length) -1)
+				fprintf(f, "%s %s %lu\n", entv[i].key,
+					entv[i].type,
+					(unsigned long) entv[i].size);
+		if (fclose(f) == 0)
+			fileRename(tfn, ifn);
+		else
+			fileRemove(tfn);
+	}
+
+	for (i = 0; i < entc; i++) {
+		strFree(entv[i].key);
+		strFree(entv[i].type);
+	}
+	stoFree((Pointer) entv);
+	fnameFree(ifn);
+	fnameFree(tfn);
+}
+
+/*****************************************************************************
+ *
+ * :: Incremental compilation
+ *
+ * With -W incremental, each .ao file records the hash of its source and
+ * the interface hashes of the libraries it was compiled against (see
+ * libPutInterface).  A source file whose .ao shows that none of these
+ * have changed is not compiled again, and its outputs keep their dates,
+ * so that files depending on it are not rebuilt by make either.
+ *
+ *****************************************************************************/
+
+void
+emitSetIncremental(Bool flag)
+{
+	emitIncremental = flag;
+}
+
+Bool
+emitIsIncremental(EmitInfo finfo)
+{
+	return emitIncremental && emitIsReusable(finfo) &&
+		emitIsOutputNeeded(finfo, FTYPENO_INTERMED);
+}
+
+/*
+ * Are the outputs of finfo there, from a compile of the same source
+ * against libraries with the same interfaces?
+ */
+Bool
+emitIsUpToDate(EmitInfo finfo)
+{
+	FTypeNo	ft;
+	Bool	ok;
+	int	i;
+
+	ok = libIsUpToDate(emitFileName(finfo, FTYPENO_INTERMED),
+			   finfo->srcHash);
+
+	for (i = 0; ok && i < EMIT_CACHE_NTYPES; i++) {
+		ft = emitCacheTypes[i];
+		if (emitCacheWants(finfo, ft))
+			ok = fileIsThere(emitFileName(finfo, ft));
+	}
+
+	if (!ok) {
+		emitIncrCompiled += 1;
+		return false;
+	}
+
+	for (i = 0; i < EMIT_CACHE_NTYPES; i++)
+		if (emitIsOutputNeeded(finfo, emitCacheTypes[i]))
+			emitSetDone(emitCacheTypes[i]);
+
+	emitIncrKept += 1;
+	return true;
+}
+
 /*****************************************************************************
  *
  * :: Java
@@ -1251,6 +1724,9 @@ emitLink(int numFiles, EmitInfo * finfov)
 	FileName	execfn;
 	int		i, ix, tmpFiles = 0;
 
+	/* The object files must all be there. */
+	ccWaitCompiles(true);
+
 	/*
 	 * Compute the exec name first, so we get the `file out of date'
 	 * warning message even if we don't need an executable.
@@ -29,6 +29,7 @@ extern void   emitSetCfgFile    (String);
 extern void   emitSetCName      (String);    /* Prefix for C names.          */
 extern void   emitSetDebug      (Bool);      /* Want debug info:  -Zg        */
 extern void   emitSetProfile    (Bool);      /* Want profile info:-Zp        */
+extern void   emitSetFoamPositions(Bool);    /* Keep positions in .ao files. */
 extern void   emitSetRun	(Bool);      /* Run result:       -go        */
 extern void   emitSetInterp	(Bool);      /* Run result:       -g[fi]     */
 extern void   emitSetStandardC  (Bool);      /* -Cstandard vs -Coldc.        */
@@ -47,11 +48,15 @@ typedef struct emitInfo {
 	FileNameList	flist;
 	Bool		isAXLmain; /* Is the generated file invoking "entry"? */
 	Bool 		isStdIn;
+	String		cacheKey;  /* Key for the output cache, if cacheable. */
+	ULong		srcHash;   /* Hash of the source and options. */
 } *EmitInfo;
 
 extern EmitInfo emitInfoNew		(FileName srcfn);
 extern EmitInfo emitInfoNewAXLmain	(void);
 extern void	emitInfoFree		(EmitInfo finfo);
+extern void	emitInfoSave		(FILE *, EmitInfo);
+extern Bool	emitInfoRestore		(FILE *, EmitInfo);
 
 extern void	emitSetDependsWanted	(Bool);
 extern Bool	emitDependsWanted	(void);
@@ -96,6 +101,24 @@ extern void	emitTheCpp    	    	();
 extern void	emitTheObject	    	(EmitInfo);
 extern void	emitTheJava	    	(EmitInfo, JavaCodeList);
 
+/*
+ * Output cache (-W cache=<dir>).
+ */
+extern void	emitSetCacheDir		(String);
+extern void	emitSetCacheSize	(Length);
+extern Bool	emitIsCacheable		(EmitInfo);
+extern Bool	emitFromCache		(EmitInfo, String key);
+extern void	emitToCache		(EmitInfo);
+
+/*
+ * Incremental compilation (-W incremental).
+ */
+extern void	emitSetIncremental	(Bool);
+extern Bool	emitIsIncremental	(EmitInfo);
+extern Bool	emitIsUpToDate		(EmitInfo);
+
+extern void	emitShowReuseStats	(FILE *);
+
 /*
  * Linkage, execution, and cleanup.
  */
@@ -69,6 +69,21 @@ fileMustOpen(FileName fn, IOMode mode)
 	return stream;
 }
 
+/*
+ * Open fn again on the existing stream, keeping its position.  The new
+ * open file is not shared with any other process.
+ */
+void
+fileReopen(FILE *stream, FileName fn, IOMode mode)
+{
+	long	pos = ftell(stream);
+
+	if (!freopen(fnameUnparseStatic(fn), mode, stream))
+		(*fileError)(fn, mode);
+	else
+		fseek(stream, pos, SEEK_SET);
+}
+
 Bool
 fileIsOpenable(FileName fn, IOMode mode)
 {
@@ -142,6 +157,34 @@ fileRename(FileName from, FileName to)
 	strFree(name1);
 }
 
+/*
+ * Copy the contents of one file to another, returning false on failure.
+ */
+Bool
+fileCopy(FileName from, FileName to)
+{
+	FILE	*fin, *fout;
+	char	buf[8192];
+	size_t	cc;
+	Bool	ok = true;
+
+	if ((fin = fileTryOpen(from, osIoRbMode)) == NULL)
+		return false;
+	if ((fout = fileTryOpen(to, osIoWbMode)) == NULL) {
+		fclose(fin);
+		return false;
+	}
+
+	while (ok && (cc = fread(buf, 1, sizeof(buf), fin)) > 0)
+		ok = fwrite(buf, 1, cc, fout) == cc;
+
+	if (ferror(fin)) ok = false;
+	fclose(fin);
+	if (fclose(fout) != 0) ok = false;
+
+	return ok;
+}
+
 void
 fileEnsureDirectory(FileName fileName)
 {
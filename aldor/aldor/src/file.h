@@ -25,6 +25,7 @@ extern  FileErrorFun    fileSetHandler     	(FileErrorFun);
 extern Hash     	fileHash        	(FileName);
 extern FILE *   	fileTryOpen     	(FileName, IOMode);
 extern FILE *   	fileMustOpen    	(FileName, IOMode);
+extern void		fileReopen		(FILE *, FileName, IOMode);
 extern Bool     	fileIsOpenable  	(FileName, IOMode);
 extern Bool		fileIsThere		(FileName);
 extern Length		fileSize		(FileName);
@@ -32,6 +33,7 @@ extern String		fileContentsString      (FileName);
 extern void		fileFreeContentsString	(String);
 extern void     	fileRemove      	(FileName);
 extern void     	fileRename      	(FileName, FileName);
+extern Bool		fileCopy		(FileName, FileName);
 extern void     	fileEnsureDirectory    	(FileName);
 
 # define		fileRdOpen(fn)       	fileMustOpen(fn,osIoRdMode)
@@ -524,6 +524,7 @@ struct foamHdr {
  		UdInfoList	defList; /* Reaching definitions (of_copyp.c)*/
 		ExpInfo		expInfo; /* for common subexpr elimination */
                 InvInfo         invInfo; /* for loop optimization */
+		Bool		onStack; /* allocation in C frame (of_escape.c) */
 #if EDIT_1_0_n1_AB
 		FoamUses	fuses;   /* foamLoc pointer to SSA use list */
 #endif
@@ -1427,6 +1428,7 @@ extern struct foamDDecl_info foamDDeclInfoTable[];
 #define foamPure(foam)       ((foam)->hdr.info.pure)
 #define foamFixed(foam)      ((foam)->hdr.info.fixed)
 #define foamLazy(foam)       ((foam)->hdr.info.lazy)
+#define foamOnStack(foam)    ((foam)->hdr.info.onStack)
 #define foamSyme(foam)	     ((foam)->hdr.syme)
 #define foamStab(foam)	     ((foam)->hdr.info.stab)
 
@@ -1452,6 +1454,7 @@ extern struct foamDDecl_info foamDDeclInfoTable[];
 #define IB_SINGLESTMT	 (1 << 12)	/* prog has a single statement	 */
 #define IB_CALLEDONCE	 (1 << 13)	/* prog is called once.		 */
 #define IB_NOENVUSE	 (1 << 14)	/* Prog does not refer to its environsment */
+#define IB_LOCALENV	 (1 << 15)	/* Prog level may live in its C frame */
 
 /* Foam prog information bits */
 #define foamProgIsSidingEffect(x) ((x)->foamProg.infoBits & IB_SIDE)
@@ -1470,6 +1473,7 @@ extern struct foamDDecl_info foamDDeclInfoTable[];
 #define foamProgHasSingleStmt(x) ((x)->foamProg.infoBits & IB_SINGLESTMT)
 #define foamProgIsCalledOnce(x)  ((x)->foamProg.infoBits & IB_CALLEDONCE)
 #define foamProgHasNoEnvUse(x)   ((x)->foamProg.infoBits & IB_NOENVUSE)
+#define foamProgHasLocalEnv(x)   ((x)->foamProg.infoBits & IB_LOCALENV)
 
 #define foamProgSetHasInlineInfo(x)  ((x)->foamProg.infoBits |= IB_INLINEINFO)
 #define foamProgSetLeaf(x)           ((x)->foamProg.infoBits |= IB_LEAF)
@@ -1487,6 +1491,7 @@ extern struct foamDDecl_info foamDDeclInfoTable[];
 #define foamProgSetHasSingleStmt(x)  ((x)->foamProg.infoBits |= IB_SINGLESTMT)
 #define foamProgSetIsCalledOnce(x)   ((x)->foamProg.infoBits |= IB_CALLEDONCE)
 #define foamProgSetNoEnvUse(x)       ((x)->foamProg.infoBits |= IB_NOENVUSE)
+#define foamProgSetLocalEnv(x)       ((x)->foamProg.infoBits |= IB_LOCALENV)
 
 #define foamProgUnsetSide(x)         ((x)->foamProg.infoBits &= ~IB_SIDE)
 #define foamProgUnsetLeaf(x)         ((x)->foamProg.infoBits &= ~IB_LEAF)
@@ -1496,6 +1501,7 @@ extern struct foamDDecl_info foamDDeclInfoTable[];
 #define foamProgUnsetHasSingleStmt(x) ((x)->foamProg.infoBits &= ~IB_SINGLESTMT)
 #define foamProgUnsetIsCalledOnce(x)  ((x)->foamProg.infoBits &= ~IB_CALLEDONCE)
 #define foamProgUnsetNoEnvUse(x)      ((x)->foamProg.infoBits &= ~IB_NOENVUSE)
+#define foamProgUnsetLocalEnv(x)      ((x)->foamProg.infoBits &= ~IB_LOCALENV)
 #define foamProgUnsetCoroutine(x)     ((x)->foamProg.infoBits &= ~IB_COROUTINE)
 
 #define foamArgc(foam)         ((foam)->hdr.argc)
@@ -117,6 +117,226 @@ fiFree(Ptr p)
 	FI_FREE(p);
 }
 
+/*****************************************************************************
+ *
+ * :: Allocation profiling
+ *
+ * Set GC_PROFILE to a file name ("-" for the standard error) to sample
+ * about one allocation in every GC_PROFILE_BYTES bytes (default 64K).
+ * Each sample is charged to the prog named by fiProfProg, as standing
+ * for that many bytes or its own size, whichever is the larger.
+ *
+ * At exit the file gets a line per prog, sorted by bytes, with the tab
+ * separated columns
+ *
+ *	prog samples bytes objects survived 8 16 32 ... 32768 more
+ *
+ * bytes, objects and survived are estimates scaled up from the samples.
+ * survived is the bytes still alive at the first collection after their
+ * allocation.  The last columns count the samples of each size, up to
+ * the given number of bytes.
+ *
+ * A prog left by an exception does not restore fiProfProg, so the
+ * allocations of its handler are charged to it until the next call.
+ *
+ *****************************************************************************/
+
+#define FI_PROF_BUCKETS		1024
+#define FI_PROF_SIZES		14
+
+typedef struct fiProfRec {
+	FiProfId		prog;
+	ULong			samples, bytes, objects, survived;
+	ULong			sizes[FI_PROF_SIZES];
+	struct fiProfRec	*next;
+} *FiProfRec;
+
+FiProfId		fiProfProg = 0;
+
+static FiProfRec	fiProfTable[FI_PROF_BUCKETS];
+static ULong		fiProfBytes;
+static String		fiProfFile;
+
+local ULong
+fiProfWeight(ULong nbytes)
+{
+	return nbytes < fiProfBytes ? fiProfBytes : nbytes;
+}
+
+/*
+ * Called by the store for each sample: the records are kept out of the
+ * heap, so that the survival of the samples can be noted during a gc.
+ */
+local Pointer
+fiProfSample(ULong nbytes)
+{
+	FiProfId	prog = fiProfProg;
+	FiProfRec	r, *bucket;
+	int		i;
+
+	bucket = &fiProfTable[((ULong) prog >> 3) % FI_PROF_BUCKETS];
+	for (r = *bucket; r && r->prog != prog; r = r->next)
+		;
+	if (!r) {
+		r = (FiProfRec) calloc(1, sizeof(*r));
+		if (!r) return NULL;
+		r->prog = prog;
+		r->next = *bucket;
+		*bucket = r;
+	}
+
+	r->samples += 1;
+	r->bytes   += fiProfWeight(nbytes);
+	r->objects += fiProfWeight(nbytes) / nbytes;
+	for (i = 0; i < FI_PROF_SIZES - 1 && nbytes > (8UL << i); i++)
+		;
+	r->sizes[i] += 1;
+
+	return (Pointer) r;
+}
+
+local void
+fiProfSurvive(Pointer tag, ULong nbytes)
+{
+	if (tag) ((FiProfRec) tag)->survived += fiProfWeight(nbytes);
+}
+
+local int
+fiProfCmp(const void *a, const void *b)
+{
+	ULong	x = (*(FiProfRec *) a)->bytes;
+	ULong	y = (*(FiProfRec *) b)->bytes;
+
+	return x < y ? 1 : x > y ? -1 : 0;
+}
+
+local void
+fiProfReport(void)
+{
+	FiProfRec	r, *v;
+	FILE		*out;
+	int		i, n;
+
+	stoCtl(StoCtl_Sample, (ULong) 0, (StoSampleFun) 0, (StoSurviveFun) 0);
+
+	for (n = 0, i = 0; i < FI_PROF_BUCKETS; i++)
+		for (r = fiProfTable[i]; r; r = r->next) n++;
+	v = (FiProfRec *) malloc((n + 1) * sizeof(FiProfRec));
+	if (!v) return;
+	for (n = 0, i = 0; i < FI_PROF_BUCKETS; i++)
+		for (r = fiProfTable[i]; r; r = r->next) v[n++] = r;
+	qsort(v, n, sizeof(FiProfRec), fiProfCmp);
+
+	out = strcmp(fiProfFile, "-") ? fopen(fiProfFile, "w") : osStderr;
+	if (!out) {
+		free(v);
+		return;
+	}
+
+	fprintf(out, "# sampled every %lu bytes\n", fiProfBytes);
+	fprintf(out, "# prog\tsamples\tbytes\tobjects\tsurvived");
+	for (i = 0; i < FI_PROF_SIZES - 1; i++)
+		fprintf(out, "\t%lu", 8UL << i);
+	fprintf(out, "\tmore\n");
+
+	for (i = 0; i < n; i++) {
+		int	j;
+		r = v[i];
+		fprintf(out, "%s\t%lu\t%lu\t%lu\t%lu",
+			r->prog ? r->prog : "(unknown)",
+			r->samples, r->bytes, r->objects, r->survived);
+		for (j = 0; j < FI_PROF_SIZES; j++)
+			fprintf(out, "\t%lu", r->sizes[j]);
+		fprintf(out, "\n");
+	}
+	free(v);
+
+	if (out == osStderr)
+		fflush(out);
+	else
+		fclose(out);
+}
+
+/*
+ * Called from main() in code generated by genc.
+ */
+void
+fiInitialiseProfile(void)
+{
+	String	file  = osGetEnv("GC_PROFILE");
+	String	bytes = osGetEnv("GC_PROFILE_BYTES");
+
+	if (!file || fiProfFile) return;
+	fiProfFile = file;
+
+	fiProfBytes = bytes ? atol(bytes) : 64*1024;
+	if (fiProfBytes == 0) fiProfBytes = 1;
+
+	stoCtl(StoCtl_Sample, fiProfBytes, fiProfSample, fiProfSurvive);
+	atexit(fiProfReport);
+}
+
+/*****************************************************************************
+ *
+ * :: Call counting
+ *
+ * At exit the file named by ALDOR_PROFILE (default aldor.prof) gets a
+ * line for each site counted by a prog compiled with -W profile-gen:
+ *
+ *	count prog unit const name
+ *	count call unit const line
+ *
+ * The first counts the entries to the prog defined by the given constant
+ * of the unit, and the second the calls made by it from the given line
+ * of source.  The file is read back by -W profile-use.
+ *
+ *****************************************************************************/
+
+typedef struct fiProfTable {
+	FiProfCount		*sites;
+	FiSInt			count;
+	struct fiProfTable	*next;
+} *FiProfTable;
+
+static FiProfTable	fiProfTables;
+
+local void
+fiProfCountReport(void)
+{
+	FiProfTable	t;
+	String		file = osGetEnv("ALDOR_PROFILE");
+	FILE		*out;
+	FiSInt		i;
+
+	out = fopen(file ? file : "aldor.prof", "w");
+	if (!out) return;
+
+	fprintf(out, "# aldor call counts\n");
+	for (t = fiProfTables; t; t = t->next)
+		for (i = 0; i < t->count; i++)
+			fprintf(out, "%lu %s\n", t->sites[i].count,
+				t->sites[i].site);
+	fclose(out);
+}
+
+/*
+ * Called by a prog on its first entry, so the count of its first site
+ * (the prog itself) is already non-zero.
+ */
+void
+fiProfCountRegister(FiProfCount *sites, FiSInt count)
+{
+	FiProfTable	t = (FiProfTable) malloc(sizeof(*t));
+
+	if (!t) return;
+	if (!fiProfTables) atexit(fiProfCountReport);
+
+	t->sites = sites;
+	t->count = count;
+	t->next  = fiProfTables;
+	fiProfTables = t;
+}
+
 /*****************************************************************************
  *
  * :: Closures and functions
@@ -1354,6 +1574,16 @@ fiArrNew_Clos(unsigned long arrSize)
 	return array;
 }
 
+/*
+ * Arrays which do not escape their prog (see of_escape.c) live in its C
+ * frame: clear them each time they are made, as fiArrNew_* would.
+ */
+Ptr
+fiArrClear(Ptr array, unsigned long nbytes)
+{
+	return (Ptr) memlset(array, 0, nbytes);
+}
+
 /*****************************************************************************
  *
  * :: Format operations
@@ -1862,6 +2092,7 @@ void
 fiSetFluid(FiFluid obj,FiWord  val)
 {
 	obj->value = val;
+	fiWriteBarrier(&obj->value);
 }
 
 void
@@ -2408,6 +2639,58 @@ fiGenerStep(FiGenIter gi)
 	}
 	gi->step  = newStep;
 	gi->value = ret;
+	fiWriteBarrier(&gi->value);
+}
+
+
+/*****************************************************************************
+ *
+ * :: Call-site export caches
+ *
+ *****************************************************************************/
+
+/*
+ * A zero value may come from a domain whose exports are still being
+ * filled in, so it is returned but never remembered.
+ */
+FiWord
+fiExportCacheMiss(FiExportCache *c, FiClos fn, FiWord d, FiWord n, FiWord t)
+{
+	FiWord	v = (FiWord) fiCCall3(Ptr, fn, d, n, t);
+
+	if (v) {
+		c->dom	 = d;
+		c->type	 = t;
+		c->value = v;
+	}
+	return v;
+}
+
+FiWord
+fiExportPCacheMiss(FiExportPCache *c, FiClos fn, FiWord d, FiWord n, FiWord t)
+{
+	FiExportCache	hit;
+	int		i;
+
+	for (i = 1; i < FI_EXPORT_PCACHE_WAYS; i++)
+		if (c->way[i].dom == d && c->way[i].type == t) break;
+
+	if (i < FI_EXPORT_PCACHE_WAYS)
+		hit = c->way[i];
+	else {
+		hit.dom	  = d;
+		hit.type  = t;
+		hit.value = (FiWord) fiCCall3(Ptr, fn, d, n, t);
+		if (!hit.value) return hit.value;
+		i = FI_EXPORT_PCACHE_WAYS - 1;
+	}
+
+	/* Keep the most recently used entry in way 0. */
+	for (; i > 0; i--)
+		c->way[i] = c->way[i-1];
+	c->way[0] = hit;
+
+	return hit.value;
 }
 
 
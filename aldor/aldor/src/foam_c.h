@@ -145,6 +145,10 @@ typedef enum fiDbgTag	FiDbgTag;
 #define		fiEnvInfo(e)		(((FiEnv) (e))->info)
 extern FiEnv	fiEnvPushFun		(FiPtr, FiEnv);
 
+/* Environments which do not escape their prog (see of_escape.c). */
+#define		fiEnvPushStack(a,e,s)	((s).level = (Ptr) (a), (s).next = (e), \
+					 (s).info = (FiWord) 0, &(s))
+
 #define		fiEnvEnsure(e)		fiEnvEnsureFun(e)
 extern void	fiEnvEnsureFun		(FiEnv);
 
@@ -179,6 +183,45 @@ extern void fiGenerStep(FiGenIter g);
 #define fiGenerStepIndex(gi) ((gi)->step)
 #define fiGenerValue(gi) ((gi)->value)
 
+/*
+ * Call-site caches for export lookups (see -Wgetcache).
+ * A monomorphic cache remembers the last (domain, type) pair seen at a
+ * call site and the value looked up for it.  A polymorphic cache keeps
+ * FI_EXPORT_PCACHE_WAYS such entries, most recently used first.  Only
+ * the first entry is tested inline; everything else goes through the
+ * miss functions, which call the lookup closure and update the cache.
+ * Caches are statics of the generated module, so the domains they hold
+ * are kept alive by the collector and their addresses cannot be reused.
+ */
+typedef struct fiExportCache {
+	FiWord	dom;
+	FiWord	type;
+	FiWord	value;
+} FiExportCache;
+
+#define FI_EXPORT_PCACHE_WAYS	4
+
+typedef struct fiExportPCache {
+	FiExportCache	way[FI_EXPORT_PCACHE_WAYS];
+} FiExportPCache;
+
+#define fiExportCached(c, fn, d, n, t) \
+	(((c).dom == (FiWord) (d) && (c).type == (FiWord) (t)) \
+	 ? (c).value \
+	 : fiExportCacheMiss(&(c), (FiClos) (fn), \
+			     (FiWord) (d), (FiWord) (n), (FiWord) (t)))
+
+#define fiExportPCached(c, fn, d, n, t) \
+	(((c).way[0].dom == (FiWord) (d) && (c).way[0].type == (FiWord) (t)) \
+	 ? (c).way[0].value \
+	 : fiExportPCacheMiss(&(c), (FiClos) (fn), \
+			      (FiWord) (d), (FiWord) (n), (FiWord) (t)))
+
+extern FiWord	fiExportCacheMiss  (FiExportCache *, FiClos,
+				    FiWord, FiWord, FiWord);
+extern FiWord	fiExportPCacheMiss (FiExportPCache *, FiClos,
+				    FiWord, FiWord, FiWord);
+
 
 /*****************************************************************************
  *
@@ -232,6 +275,37 @@ extern void fiGenerStep(FiGenIter g);
 		sizeof(type)+(n)*sizeof(itype)-fiNARY*sizeof(itype),	\
 		CENSUS_TrailingArray))
 
+/*****************************************************************************
+ *
+ * :: Write barrier
+ *
+ * Code generated with -Wwrite-barrier calls fiWriteBarrier(&x) after
+ * storing into a heap location x, so that a generational collection can
+ * find the pointers from old objects to new ones.  fiWriteBarrierAll() is
+ * used when the location cannot be recomputed; it makes the next collection
+ * a full one.  Each unit's initialisation calls fiWriteBarrierUnit to say
+ * whether it was compiled with barriers; generational collection is only
+ * used while every unit seen has them.
+ * The card size and map must agree with store.h.
+ *
+ ****************************************************************************/
+
+#define FI_LG_CARD	12
+
+extern unsigned char	*stoCardMap;
+extern char		*stoCardBase;
+extern unsigned long	stoCardSize;
+extern void		stoWriteBarrierAll	(void);
+extern void		stoWriteBarrierUnit	(char *, int);
+
+#define fiCardOffset(p)	((unsigned long) (p) - (unsigned long) stoCardBase)
+#define fiWriteBarrier(p) \
+	(fiCardOffset(p) < stoCardSize \
+	 ? (void) (stoCardMap[fiCardOffset(p) >> FI_LG_CARD] = 1) \
+	 : (void) 0)
+#define fiWriteBarrierAll()	stoWriteBarrierAll()
+#define fiWriteBarrierUnit(u, b)	stoWriteBarrierUnit(u, b)
+
 /*****************************************************************************
  *
  * :: FOAM operations -- expression versions
@@ -259,6 +333,7 @@ extern FiRRec	*fiArrNew_RRec	(unsigned long);
 extern FiTR	*fiArrNew_TR	(unsigned long);
 extern FiBInt	*fiArrNew_BInt	(unsigned long);
 extern FiClos	*fiArrNew_Clos	(unsigned long);
+extern Ptr	fiArrClear	(Ptr, unsigned long);
 
 #define		fiNil		((Ptr) 0)
 #define		fiPtrIsNil(p)	((p) == 0)
@@ -453,6 +528,7 @@ extern FiPtr	fiListCons	(FiWord, FiPtr);
 #define fiARRNEW_TR(r,t,i)		((r) = (t) fiArrNew_TR(i))
 #define fiARRNEW_BInt(r,t,i)		((r) = (t) fiArrNew_BInt(i))
 #define fiARRNEW_Clos(r,t,i)		((r) = (t) fiArrNew_Clos(i))
+#define fiARRSTACK(r,t,a)		((r) = (t) fiArrClear((Ptr) (a), sizeof(a)))
 
 #define	fiPTR_IS_NIL(r,t,p)		((r) = (t)((FiPtr) (p) == (FiPtr) 0))
 #define	fiPTR_MAGIC_EQ(r,t,p,q)		((r) = (t)((FiPtr) (p) == (FiPtr) (q)))
@@ -702,6 +778,36 @@ extern FiWord		fiFluidValue	(FiFluid);
 extern FiFluid		fiGetFluid	(char *);
 
 
+/******************************************************************************
+ *
+ * :: Allocation profiling
+ *
+ *****************************************************************************/
+
+/*
+ * Each prog compiled by genc with -W profile-alloc saves fiProfProg on
+ * entry, points it at a string naming the prog, and restores it on return.
+ * Allocations sampled by the profiler are charged to the prog it names.
+ */
+typedef char *FiProfId;
+
+extern FiProfId		fiProfProg;
+extern void		fiInitialiseProfile	(void);
+
+/*
+ * Progs compiled with -W profile-gen count their entries, and the calls
+ * made from each of their source lines, in a static table of sites.  The
+ * table is registered on the first entry to the prog, and the counts of
+ * all the registered tables are written to a profile file at exit.
+ */
+typedef struct _FiProfCount {
+	FiWord		count;
+	char		*site;
+} FiProfCount;
+
+extern void		fiProfCountRegister	(FiProfCount *, FiSInt);
+
+
 /******************************************************************************
  *
  * :: Interface to the store management
@@ -111,15 +111,21 @@ static Foam	gcvLocFluids;		/* Prog fluids */
 static AIntList gcvFluidList;		/* Fluids used */
 static Foam	gcvLFmtStk;		/* Prog lexical format stack */
 static Foam	gcvDefs;		/* Unit definitions */
+static String	gcvUnitName;		/* Unit name, for profiling */
+static AIntList	gcvProfLines;		/* Lines counted in the prog */
 static FoamList gcvLexStk = 0;		/* Unit/Prog lexicals stack */
 static Bool	gcvIsLeaf;		/* True iff prog is a leaf proc */
 static Bool	gcvIsCoroutine;		/* True iff prog is a coroutine */
+static Bool	gcvIsLocalEnv;		/* True iff prog level is in its frame */
+static Bool	gcvIsProfiled;		/* True iff prog names itself in fiProfProg */
+static UByte	*gcvLocNew;		/* Locals holding new objects (GC_Loc*) */
 static int	gcvIdChars[CHAR_MAX];	/* Array of special print chars */
 static int	gcvIdCharc[CHAR_MAX];	/* Array of special print lengths */
 static int	gcvNLocs  = 0;		/* Number of locals */
 static int	gcvNStmts = 0;		/* Number of statements */
 static int	gcvNBInts = 0;		/* Counter for global big ints */
 static int	gcvNRRFmt = 0;		/* Counter for global RRFmts */
+static int	gcvNXCache = 0;		/* Counter for export caches */
 static int	gcvisInitConst = 0;	/* True if prog is constant 0 */
 static int	gcvisStmtFCall = 0;	/* True if stmt is a function call */
 static GcNesting gcvCallNesting;	/* Depth of nesting of foam-level calls*/
@@ -249,6 +255,9 @@ local	CCode	gc0ExportFtnString(CCode, Bool, CCodeList *, CCodeList *,
 local	CCodeList	gc0ExportInit	(String, Foam, int);
 local	CCode	gc0FunFoamCall	(Foam, int);
 local	CCode	gc0FunCCall0	(Foam, int);
+local	int	gc0GetCacheKind	(Foam);
+local	CCode	gc0GetCacheCall	(Foam, int);
+local	CCode	gc0ExportCache	(int);
 local	CCode	gc0FunOCall0	(Foam, int);
 local	CCode	gc0FunPCall0	(Foam, int);
 local	CCode	gc0FiCFun	(FoamTag, int, FoamTag *, CCode, int); 
@@ -278,6 +287,16 @@ local	CCode 	gc0FluidSet	(Foam, Foam);
 local	CCode	gc0FluidRef	(Foam);
 local	CCode	gc0PushFluid	(void);
 local	CCode	gc0PopFluid	(void);
+local	CCode	gc0PushProf	(void);
+local	CCode	gc0SetProf	(Foam);
+local	CCode	gc0PopProf	(void);
+local	Bool	gc0IsGoto	(CCode);
+local	Bool	gc0ProfAllocates(Foam);
+local	Bool	gc0ProfIsSimple	(CCode);
+local	Bool	gc0ProfIsSite	(Foam);
+local	CCode	gc0ProfSite	(Foam);
+local	CCode	gc0ProfDecl	(Foam);
+local	CCode	gc0ProfEntry	(void);
 local	CCode	gc0GetFluid	(AInt);
 local	CCode	gc0AddFluid	(AInt);
 local	CCode	gc0MultVarId	(String, int, String);
@@ -289,6 +308,7 @@ local	CCodeList gc0Levels	(int, int, int, int, int);
 local	CCode	gc0LexRef	(int, int);
 local	CCode	gc0EnvNext	(int, int);
 local	CCode	gc0EnvMake	(int);
+local	CCode	gc0EnvStack	(int);
 local	CCode	gc0EnvPush	(int);
 local	CCode	gc0EnvLevel	(int, int);
 local	CCode	gc0EnvRef	(int);
@@ -299,6 +319,11 @@ local 	CCode	gc0GenModuleInitFun	(String, Bool, int);
 local 	CCode	gc0DeclModuleInitFun	(String, int);
 
 local 	CCode	gc0SpecialSFloWord (Foam,AInt,CCode);
+local	Bool	gc0NeedsBarrier	(Foam, AInt, Foam);
+local	CCode	gc0WriteBarrier	(Foam, AInt, Foam, CCode, CCode);
+local	Bool	gc0MayAllocate	(Foam);
+local	void	gc0BarrierStep	(Foam);
+local	CCode	gc0StackAlloc	(Foam);
 
 /*****************************************************************************
  *
@@ -398,6 +423,11 @@ local	Foam		gc0AddExplicitReturn(Foam);
 #define gcFiFluidStack "FiFluidStack"
 #define gcFiFluidStackLVar "localStack"
 #define gcFiFluidStackGVar "fiGlobalFluidStack"
+#define gcFiProfId "FiProfId"
+#define gcFiProfLVar "localProf"
+#define gcFiProfGVar "fiProfProg"
+#define gcFiProfCount "FiProfCount"
+#define gcFiProfCountLVar "profCount"
 #define gcFiNil   "fiNil"	/* The Nil value */
 #define gcFmtName "Fmt"
 #define gcTFmtName "TFmt"
@@ -422,6 +452,8 @@ local	Foam		gc0AddExplicitReturn(Foam);
 						       ccoStructRef(gc0VarId(s2,f)), \
 						       n))
 #define gcFiEnvPush(s,e) ccoFCall(ccoIdOf("fiEnvPush"), ccoMany2(s, e))
+#define gcFiEnvPushStack(s,e,v) \
+	ccoFCall(ccoIdOf("fiEnvPushStack"), ccoMany3(s, e, v))
 #define gcFiEnvNext(c)   ccoFCall(ccoIdOf("fiEnvNext"), c)
 #define gcFiEnvLevel(c)  ccoFCall(ccoIdOf("fiEnvLevel"), c)
 #define gcFiEnvInfo(e)	 ccoFCall(ccoIdOf("fiEnvInfo"), e)
@@ -524,6 +556,89 @@ gencTraceFuns(void)
 	return gc0TraceFuns;
 }
 
+/*****************************************************************************
+ *
+ * :: Developer options (-Wprofile-gen, -Wprofile-alloc)
+ *
+ ****************************************************************************/
+
+static Bool gc0ProfCounts = false;
+static Bool gc0ProfAlloc  = false;
+
+void
+gencSetProfileCounts(Bool flag)
+{
+	gc0ProfCounts = flag;
+}
+
+/*
+ * -Wprofile-alloc: name each prog in fiProfProg for the allocation
+ * profiler enabled at run time by GC_PROFILE.
+ */
+void
+gencSetProfileAlloc(Bool flag)
+{
+	gc0ProfAlloc = flag;
+}
+
+/*****************************************************************************
+ *
+ * :: Developer options (-Wwrite-barrier)
+ *
+ ****************************************************************************/
+
+/*
+ * Stores into the heap are followed by write barriers only if asked for:
+ * generational collection (GC_GENERATIONAL) needs them in all the code of
+ * the program.  Each unit's initialisation tells the run-time system
+ * whether it has them, and the collector stays full if any unit has not.
+ */
+static Bool gc0WriteBarriers = false;
+
+enum gcLocNew {
+	GC_LocOld,		/* May hold an old object */
+	GC_LocHeap,		/* Holds an object allocated since the last
+				   statement able to collect */
+	GC_LocStack		/* Holds an object allocated in the C frame */
+};
+
+void
+gencSetWriteBarriers(Bool flag)
+{
+	gc0WriteBarriers = flag;
+}
+
+/*****************************************************************************
+ *
+ * :: Developer options (-Wgetcache)
+ *
+ ****************************************************************************/
+
+enum gcGetCache {
+	GC_GetCacheNone,	/* Always call the runtime */
+	GC_GetCacheMono,	/* One (domain, type) pair per call site */
+	GC_GetCachePoly,	/* A few pairs per call site */
+	GC_GetCacheAuto		/* Mono for global domains, else poly */
+};
+
+static int gc0GetCache = GC_GetCacheAuto;
+
+int
+gencSetGetCache(String kind)
+{
+	if (strEqual(kind, "none"))
+		gc0GetCache = GC_GetCacheNone;
+	else if (strEqual(kind, "mono"))
+		gc0GetCache = GC_GetCacheMono;
+	else if (strEqual(kind, "poly"))
+		gc0GetCache = GC_GetCachePoly;
+	else if (strEqual(kind, "auto"))
+		gc0GetCache = GC_GetCacheAuto;
+	else
+		return -1;
+	return 0;
+}
+
 /*****************************************************************************
  *
  * :: Top level entry point for C generation.
@@ -560,6 +675,8 @@ gccUnit(Foam foam, String name)
 	assert(foamTag(foam) == FOAM_Unit);
 
 	gcvLvl	  = 0;
+	gcvNXCache = 0;
+	gcvUnitName = name;
 	gcvGlo	  = foamUnitGlobals(foam);
 	gcvConst  = foamUnitConstants(foam);
 	gcvFluids  = foamUnitFluids(foam);
@@ -946,6 +1063,11 @@ gc0GenModuleInitFun(String name, int main, int n)
 
 	code = listNReverse(CCode)(code);
 
+	/* fiWriteBarrierUnit("name", withBarriers); */
+	gc0AddLine(code, ccoStat(ccoFCall(ccoIdOf("fiWriteBarrierUnit"),
+				 ccoMany2(ccoStringOf(name),
+					  ccoIntOf(gc0WriteBarriers ? 1 : 0)))));
+
 /***  Generate the following code:
  * static int initialized; = 0
  * if (initialized)
@@ -2356,6 +2478,9 @@ gc0Prog(Foam ref, Foam foam)
 	ccParams  = gc0Param(foam, params);
 	gcvIsLeaf = foamProgIsLeaf(foam);
 	gcvIsCoroutine = foamProgIsCoroutine(foam);
+	gcvIsLocalEnv = foamProgHasLocalEnv(foam);
+	gcvIsProfiled = gc0ProfAlloc &&
+		(!gcvIsLeaf || gc0ProfAllocates(foam->foamProg.body));
 
 	ccBody = gc0ProgBody(ref, foam);
 
@@ -2627,14 +2752,20 @@ gc0Compound(Foam locals, Foam body, Foam ref, int fmt, int leaf, int isCoroutine
 	gc0CreateLocList(locals);
 	assert(foamDDeclArgc(locals) == gcvNLocs);
 
+	gcvLocNew = (UByte *) stoAlloc(OB_Other, gcvNLocs + 1);
+	for (i = 0; i < gcvNLocs; i++) gcvLocNew[i] = GC_LocOld;
+
 	/*
 	 * Some compilers (eg MSVC++ 6.0) need an explicit return
 	 * instruction after code that does not return (e.g fiHalt).
 	 */
 	nbody = gc0AddExplicitReturn(body);
 
+	gcvProfLines = listNil(AInt);
 	gc0NewStmtInit();
 	gccCmd(nbody);
+	stoFree(gcvLocNew);
+	gcvLocNew = NULL;
 
 	maxLevel  = gc0MaxLevel(numLexs);
 
@@ -2650,6 +2781,10 @@ gc0Compound(Foam locals, Foam body, Foam ref, int fmt, int leaf, int isCoroutine
 		}
 		gc0AddLine(code, gc0PushFluid());
 	}
+	if (gcvIsProfiled)
+		gc0AddLine(code, gc0PushProf());
+	if (gc0ProfCounts)
+		gc0AddLine(code, gc0ProfDecl(ref));
 	ccLevels = gc0Levels(numLexs, maxLevel, leaf, isCoroutine, fmt);
 	tmp = ccLevels;
 	while (tmp) {
@@ -2688,6 +2823,11 @@ gc0Compound(Foam locals, Foam body, Foam ref, int fmt, int leaf, int isCoroutine
 				   gc0AddFluid(gcvLocFluids->foamDFluid.argv[i]));
 		}
 	}
+	if (gcvIsProfiled)
+		gc0AddLine(cmpd, gc0SetProf(ref));
+	if (gc0ProfCounts)
+		gc0AddLine(cmpd, gc0ProfEntry());
+	listFree(AInt)(gcvProfLines);
 
 	/* Hack to announce function entry */
 	if (gencTraceFuns()) {
@@ -2724,8 +2864,12 @@ gc0Compound(Foam locals, Foam body, Foam ref, int fmt, int leaf, int isCoroutine
 	for (i = 0; i < gcvStmts->pos; i++)
 		gc0AddLine(cmpd, gcvStmts->stmt[i]);
 
-	if (gcvFluidList && !gc0IsReturn(car(cmpd)))
-		gc0AddLine(cmpd, gc0PopFluid());
+	if (!gc0IsReturn(car(cmpd)) && !gc0IsGoto(car(cmpd))) {
+		if (gcvIsProfiled)
+			gc0AddLine(cmpd, gc0PopProf());
+		if (gcvFluidList)
+			gc0AddLine(cmpd, gc0PopFluid());
+	}
 	cmpd = listNReverse(CCode)(cmpd);
 	ccCmpd = gc0ListOf(CCO_Many, cmpd);
 	listFree(CCode)(cmpd);
@@ -2768,6 +2912,14 @@ gc0IsReturn(CCode cc)
 	return ccoTag(cc) == CCO_Return;
 }
 
+local Bool
+gc0IsGoto(CCode cc)
+{
+	if (ccoTag(cc) == CCO_Stat)
+		cc = ccoArgv(cc)[0];
+	return ccoTag(cc) == CCO_Goto;
+}
+
 /*****************************************************************************
  * 
  * :: Compress program labels and local variable declarations from the
@@ -2968,9 +3120,10 @@ gccReturn(Foam foam)
 {
 	FoamTag		fTag = foamTag(foam);
 	int		retFmt;
-	CCode ret;
+	CCode ret, type;
 
 	retFmt = gcvProg->foamProg.format;
+	type   = ccoArgc(gcvSpec) > 1 ? ccoArgv(gcvSpec)[1] : gcvSpec;
 
 	if (fTag == FOAM_Cast && foamTag(foam->foamCast.expr) != FOAM_BVal
 	    && foamTag(foam->foamCast.expr) != FOAM_BCall
@@ -2980,11 +3133,19 @@ gccReturn(Foam foam)
 		ret = gccReturnValues(foam);
 	else if (gcvProg->foamProg.retType==FOAM_NOp)
 		ret = ccoNewNode(CCO_Return, int0);
-	else if (ccoArgc(gcvSpec) > 1)
-		ret = ccoReturn(gc0SubExpr(foam,
-					   ccoCopy(ccoArgv(gcvSpec)[1])));
 	else
-		ret = ccoReturn(gc0SubExpr(foam, ccoCopy(gcvSpec)));
+		ret = ccoReturn(gc0SubExpr(foam, ccoCopy(type)));
+
+	/*
+	 * The value is computed before fiProfProg is restored, so that
+	 * what it allocates is charged to this prog.
+	 */
+	if (gcvIsProfiled) {
+		if (ccoArgc(ret) > 0 && !gc0ProfIsSimple(ccoArgv(ret)[0]))
+			ccoArgv(ret)[0] = gc0UnNestCall(ccoCopy(type),
+							ccoArgv(ret)[0]);
+		gc0AddTopLevelStmt(gcvStmts, gc0PopProf());
+	}
 
 	if (foamProgUsesFluids(gcvProg)) {
 		return ccoNew(CCO_Compound, 1, ccoMany2(gc0PopFluid(), ret));
@@ -3057,6 +3218,8 @@ gccSeq(Foam foam)
 	for (i = 0; i < nSeq; i++) {
 		gcvisStmtFCall = 0;
 		seqFoam = foamArgv(foam)[i].code;
+		if (gc0ProfCounts && gc0ProfIsSite(seqFoam))
+			gc0AddTopLevelStmt(gcvStmts, gc0ProfSite(seqFoam));
 		/* These automatically generate a statement. */
 		if (!isStmt(foamTag(seqFoam))) {
 			ccoArgv(ccSeq)[i] = gc0SeqStmt(foam, i);
@@ -3068,6 +3231,8 @@ gccSeq(Foam foam)
 			gc0AddTopLevelStmt(gcvStmts, ccoArgv(ccSeq)[i]);
 		}
 		ccoPos(ccoArgv(ccSeq)[i]) = foamPos(seqFoam);
+		if (foamTag(seqFoam) != FOAM_Seq)
+			gc0BarrierStep(seqFoam);
 		while (gcvNestUsed) {
 			gcvNestFree = listCons(CCode)(car(gcvNestUsed),
 						      gcvNestFree);
@@ -4696,6 +4861,14 @@ gc0Levels(int nLexs, int maxLev, int isLeaf, int isCoroutine, int fmt)
 		// Declare env0
 		if (gc0EmptyEnv(fmt))
 			gc0AddLine(code, gc0EnvRef(int0));
+		// Declare the level and env0 if they do not escape the prog
+		if (gcvIsLocalEnv && !gc0EmptyEnv(fmt) && fmt != envUsedSlot)
+			if (foamArgc(foamArgv(gcvFmt)[fmt].code) > 0)
+				gc0AddLine(code, gc0EnvStack(fmt));
+		if (gcvIsLocalEnv)
+			gc0AddLine(code,
+				   ccoDecl(ccoStructRef(ccoIdOf("_FiEnv")),
+					   gc0VarId("E", int0)));
 	}
 
 	// Definitions
@@ -4745,23 +4918,35 @@ local CCode
 gc0EnvMake(int fmt)
 {
 	if (gc0EmptyFormat(fmt)) return ccoIdOf(gcFiNil);
+	if (gcvIsLocalEnv)
+		return ccoStatAsst(gc0VarId("l", int0),
+				   ccoPreAnd(gc0VarId("s", int0)));
 	return ccoStatAsst(gc0VarId("l", int0),
 			   gcFi0New(gcFmtName, fmt, "CENSUS_EnvLevel"));
 }
 
+local CCode
+gc0EnvStack(int fmt)
+{
+	return ccoDecl(ccoStructRef(gc0VarId(gcFmtName, fmt)),
+		       gc0VarId("s", int0));
+}
+
 local CCode
 gc0EnvPush(int fmt)
 {
-	CCode	ccEnvPush;
+	CCode	ccEnvPush, ccLevel;
 
+	ccLevel = gc0EmptyFormat(fmt) ? ccoIdOf(gcFiNil) : gc0VarId("l", int0);
 	if (gcvIsLeaf)
 		ccEnvPush = ccoCast(ccoTypeIdOf(gcFiEnv),
 				    ccoInit(ccoMany2(ccoIdOf(gcFiNil),
 						     gc0VarId("e", 1))));
-	else if (gc0EmptyFormat(fmt))
-		ccEnvPush = gcFiEnvPush(ccoIdOf(gcFiNil), gc0VarId("e", 1));
+	else if (gcvIsLocalEnv)
+		ccEnvPush = gcFiEnvPushStack(ccLevel, gc0VarId("e", 1),
+					     gc0VarId("E", int0));
 	else
-		ccEnvPush = gcFiEnvPush(gc0VarId("l", int0), gc0VarId("e", 1));
+		ccEnvPush = gcFiEnvPush(ccLevel, gc0VarId("e", 1));
 	return ccoStatAsst(gc0VarId("e", int0), ccEnvPush);
 }
 
@@ -4833,6 +5018,7 @@ gc0MainDef(String name)
 	 * mainArgc = argc;
 	 * mainArgv = argv;
 	 * fiInitialiseFpu();
+	 * fiInitialiseProfile();
 	 * <fortran-io-init-fn>();
 	 * INIT__0_YYY();
 	 * fiImportGlobal("G_XXXXX_try", pG_XXXXX_YYY);
@@ -4853,6 +5039,8 @@ gc0MainDef(String name)
 	stmts = listCons(CCode)(stmt, stmts);
 	stmt  = ccoStat(ccoFCall(ccoIdOf("fiInitialiseFpu"), ccoMany0()));
 	stmts = listCons(CCode)(stmt, stmts);
+	stmt  = ccoStat(ccoFCall(ccoIdOf("fiInitialiseProfile"), ccoMany0()));
+	stmts = listCons(CCode)(stmt, stmts);
 
 	if (ftnInitFn)
 	{
@@ -4992,7 +5180,7 @@ gc0Set(Foam foamLHS, Foam foamRHS)
 		 foamRHS->foamPCall.protocol == FOAM_Proto_Fortran)
 		return gc0FortranSet(foamLHS, foamRHS, FOAM_NOp, FOAM_NOp);
 	else {
-		CCode	ccArg, ccType, ccSpecial;
+		CCode	ccArg, ccType, ccSpecial, cc;
 		AInt    typeLhs = gc0ExprType(foamLHS);
 
 		ccArg = gccRef(foamLHS);
@@ -5028,25 +5216,256 @@ gc0Set(Foam foamLHS, Foam foamRHS)
 			ccoArgv(ccArgs)[1] = ccType;
 			for (i = 2, ix = 0; ix < argc; i++, ix++)
 				ccoArgv(ccArgs)[i] = gccExpr(foamRHS->foamBCall.argv[ix]);
-			return ccoFCall(ccoIdOf(ccBValMacro(tag)), ccArgs);
+			cc = ccoFCall(ccoIdOf(ccBValMacro(tag)), ccArgs);
+			return gc0WriteBarrier(foamLHS, typeLhs, foamRHS,
+					       ccArg, cc);
 		}
 #endif
-		if (foamTag(foamRHS) == FOAM_RNew)
-			return ccoAsst(ccArg, gccExpr(foamRHS));
+		if (foamTag(foamRHS) == FOAM_RNew && foamOnStack(foamRHS))
+			cc = ccoAsst(ccArg,
+				     ccoCast(ccType,
+					     ccoPreAnd(gc0StackAlloc(foamRHS))));
+		else if (foamTag(foamRHS) == FOAM_RNew)
+			cc = ccoAsst(ccArg, gccExpr(foamRHS));
+		else if (foamTag(foamRHS) == FOAM_ANew && foamOnStack(foamRHS))
+			cc = ccoFCall(ccoIdOf("fiARRSTACK"),
+				      ccoMany3(ccArg, ccType,
+					       gc0StackAlloc(foamRHS)));
 		else if (foamTag(foamRHS) == FOAM_ANew) {
 			CCode	ccArrIndex, ccFunName;
 
 			ccArrIndex = gccExpr(foamRHS->foamANew.size);
 			ccFunName  = ccoIdOf(strConcat("fiARRNEW_",
 				       foamStr(foamRHS->foamANew.eltType)));
-			return ccoFCall(ccFunName, ccoMany3(ccArg,
-							    ccType,
-							    ccArrIndex));
+			cc = ccoFCall(ccFunName, ccoMany3(ccArg,
+							  ccType,
+							  ccArrIndex));
 		}
 		else if ((ccSpecial = gc0SpecialSFloWord(foamRHS,typeCastExpr,ccArg)) != NULL )  return ccSpecial;
 			 
 		else
-			return ccoAsst(ccArg, gc0SubExpr(foamRHS, ccType));
+			cc = ccoAsst(ccArg, gc0SubExpr(foamRHS, ccType));
+
+		return gc0WriteBarrier(foamLHS, typeLhs, foamRHS, ccArg, cc);
+	}
+}
+
+/*
+ * Declare storage in the C frame for an RNew or ANew which of_escape.c
+ * found does not escape the prog, and return its name.
+ */
+local CCode
+gc0StackAlloc(Foam foam)
+{
+	CCode	ccName, ccDecl;
+
+	ccName = gc0VarId("S", gcvNLocs);
+	if (foamTag(foam) == FOAM_RNew)
+		ccDecl = ccoDecl(ccoStructRef(gc0VarId(gcFmtName,
+						       foam->foamRNew.format)),
+				 ccoCopy(ccName));
+	else
+		ccDecl = ccoDecl(gc0TypeId(foam->foamANew.eltType,
+					   emptyFormatSlot),
+				 ccoARef(ccoCopy(ccName),
+					 gccExpr(foam->foamANew.size)));
+	gc0AddUnSortedLocal(ccDecl);
+
+	return ccName;
+}
+
+/*
+ * Does a store of foamRHS to foamLHS need a write barrier?  Only stores
+ * into the heap of values which may be pointers to it do, and then only
+ * if the object stored into may already be old: not if it was allocated
+ * in the C frame, or in the heap with nothing able to collect since.
+ */
+local Bool
+gc0NeedsBarrier(Foam foamLHS, AInt typeLhs, Foam foamRHS)
+{
+	Foam	base;
+
+	if (!gc0WriteBarriers)
+		return false;
+
+	switch (foamTag(foamLHS)) {
+	case FOAM_AElt:
+		base = foamLHS->foamAElt.expr;
+		break;
+	case FOAM_RElt:
+		base = foamLHS->foamRElt.expr;
+		break;
+	case FOAM_RRElt:
+	case FOAM_IRElt:
+	case FOAM_TRElt:
+	case FOAM_EElt:
+	case FOAM_Lex:
+	case FOAM_EInfo:
+	case FOAM_CEnv:
+	case FOAM_CProg:
+		base = NULL;
+		break;
+	default:
+		return false;
+	}
+
+	switch (typeLhs) {
+	case FOAM_Char:
+	case FOAM_Bool:
+	case FOAM_Byte:
+	case FOAM_HInt:
+	case FOAM_SInt:
+	case FOAM_SFlo:
+	case FOAM_DFlo:
+		return false;
+	default:
+		break;
+	}
+
+	while (foamTag(foamRHS) == FOAM_Cast)
+		foamRHS = foamRHS->foamCast.expr;
+	switch (foamTag(foamRHS)) {
+	case FOAM_Nil:
+	case FOAM_Char:
+	case FOAM_Bool:
+	case FOAM_Byte:
+	case FOAM_HInt:
+	case FOAM_SInt:
+	case FOAM_SFlo:
+	case FOAM_DFlo:
+		return false;
+	default:
+		break;
+	}
+
+	while (base && foamTag(base) == FOAM_Cast)
+		base = base->foamCast.expr;
+	if (base && foamTag(base) == FOAM_Loc && gcvLocNew) {
+		switch (gcvLocNew[base->foamLoc.index]) {
+		case GC_LocStack:
+			return false;
+		case GC_LocHeap:
+			return gc0MayAllocate(foamRHS) ||
+				gc0MayAllocate(foamLHS);
+		default:
+			break;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Follow the store cc to ccLhs by a write barrier, if needed.  The
+ * barrier comes after the store, as evaluating the rhs may collect.
+ */
+local CCode
+gc0WriteBarrier(Foam foamLHS, AInt typeLhs, Foam foamRHS, CCode ccLhs, CCode cc)
+{
+	CCode	ccBarrier;
+
+	if (!gc0NeedsBarrier(foamLHS, typeLhs, foamRHS))
+		return cc;
+
+	if (foamHasSideEffect(foamLHS))
+		ccBarrier = ccoFCall(ccoIdOf("fiWriteBarrierAll"),
+				     ccoMany0());
+	else
+		ccBarrier = ccoFCall(ccoIdOf("fiWriteBarrier"),
+				     ccoPreAnd(ccoCopy(ccLhs)));
+
+	return ccoComma(cc, ccBarrier);
+}
+
+/*
+ * May evaluating foam allocate, and so collect?  Builtins are taken not
+ * to unless they have side effects or return something other than a
+ * scalar.
+ */
+local Bool
+gc0MayAllocate(Foam foam)
+{
+	switch (foamTag(foam)) {
+	case FOAM_BCall:
+		if (foamBValInfo(foam->foamBCall.op).hasSideFx)
+			return true;
+		switch (foamBValInfo(foam->foamBCall.op).retType) {
+		case FOAM_Char:
+		case FOAM_Bool:
+		case FOAM_Byte:
+		case FOAM_HInt:
+		case FOAM_SInt:
+		case FOAM_SFlo:
+		case FOAM_DFlo:
+		case FOAM_NOp:
+			break;
+		default:
+			return true;
+		}
+		break;
+	case FOAM_CCall:
+	case FOAM_OCall:
+	case FOAM_PCall:
+	case FOAM_RNew:
+	case FOAM_ANew:
+	case FOAM_RRNew:
+	case FOAM_TRNew:
+	case FOAM_PushEnv:
+	case FOAM_EEnsure:
+	case FOAM_Catch:
+		return true;
+	default:
+		break;
+	}
+	foamIter(foam, arg, {
+		if (gc0MayAllocate(*arg)) return true;
+	});
+	return false;
+}
+
+/*
+ * Track which locals hold objects stores into which need no barrier,
+ * after the statement stmt.  A label forgets them all, as it may be
+ * reached from elsewhere.
+ */
+local void
+gc0BarrierStep(Foam stmt)
+{
+	Foam	lhs, rhs;
+	AInt	i, n = foamDDeclArgc(gcvLoc);
+
+	if (!gc0WriteBarriers || !gcvLocNew) return;
+
+	if (foamTag(stmt) == FOAM_Label) {
+		for (i = 0; i < n; i++) gcvLocNew[i] = GC_LocOld;
+		return;
+	}
+
+	if (gc0MayAllocate(stmt)) {
+		for (i = 0; i < n; i++)
+			if (gcvLocNew[i] == GC_LocHeap)
+				gcvLocNew[i] = GC_LocOld;
+	}
+
+	if (foamTag(stmt) != FOAM_Set && foamTag(stmt) != FOAM_Def)
+		return;
+
+	lhs = stmt->foamSet.lhs;
+	rhs = stmt->foamSet.rhs;
+	if (foamTag(lhs) == FOAM_Values) {
+		for (i = 0; i < foamArgc(lhs); i++)
+			if (foamTag(lhs->foamValues.argv[i]) == FOAM_Loc)
+				gcvLocNew[lhs->foamValues.argv[i]->foamLoc.index]
+					= GC_LocOld;
+	}
+	else if (foamTag(lhs) == FOAM_Loc) {
+		i = lhs->foamLoc.index;
+		if (foamTag(rhs) != FOAM_RNew && foamTag(rhs) != FOAM_ANew)
+			gcvLocNew[i] = GC_LocOld;
+		else if (foamOnStack(rhs))
+			gcvLocNew[i] = GC_LocStack;
+		else
+			gcvLocNew[i] = GC_LocHeap;
 	}
 }
 
@@ -5116,6 +5535,12 @@ gc0SetValues(Foam foamLHS, Foam foamRHS)
 	code   = listNReverse(CCode)(code);
 	ccoArgv(ccRhs)[1] = gc0ListOf(CCO_Many, code);
 	listFree(CCode)(code);
+
+	for (i = 0; i < num; i++) {
+		Foam	lhs = foamLHS->foamValues.argv[i];
+		ccRhs = gc0WriteBarrier(lhs, gc0ExprType(lhs), foamRHS,
+					gccRef(lhs), ccRhs);
+	}
 	return ccRhs;
 }
 
@@ -5489,6 +5914,10 @@ gc0FunCCall0(Foam foam, int returnFmt)
 
 	assert(foamTag(foam) == FOAM_CCall);
 
+	i = gc0GetCacheKind(foam);
+	if (i != GC_GetCacheNone)
+		return gc0GetCacheCall(foam, i);
+
 	argc = foamCCallArgc(foam);
 	gc0AddLine(code, gc0TypeId(foam->foamCCall.type, emptyFormatSlot));
 	
@@ -5517,6 +5946,126 @@ gc0FunCCall0(Foam foam, int returnFmt)
 	return ccCall;
 }
 
+/*
+ * Export lookups with a constant name may be given a call-site cache
+ * keyed on the domain and type hash.  The cache macros evaluate these
+ * arguments twice, so they must be plain variables or constants.
+ */
+local Bool
+gc0GetCacheArg(Foam foam)
+{
+	while (foamTag(foam) == FOAM_Cast)
+		foam = foam->foamCast.expr;
+
+	switch (foamTag(foam)) {
+	  case FOAM_Loc:
+	  case FOAM_Par:
+	  case FOAM_Lex:
+	  case FOAM_Glo:
+	  case FOAM_Const:
+		return true;
+	  default:
+		return foamIsData(foam) && foamTag(foam) != FOAM_BInt;
+	}
+}
+
+local int
+gc0GetCacheKind(Foam foam)
+{
+	Foam	op, dom, name;
+	String	id;
+
+	if (gc0GetCache == GC_GetCacheNone) return GC_GetCacheNone;
+	if (foam->foamCCall.type != FOAM_Word) return GC_GetCacheNone;
+	if (foamCCallArgc(foam) != 3) return GC_GetCacheNone;
+
+	op = foam->foamCCall.op;
+	if (foamTag(op) != FOAM_Glo) return GC_GetCacheNone;
+
+	id = gcvGlo->foamDDecl.argv[op->foamGlo.index]->foamGDecl.id;
+	if (!strEqual(id, "domainGetExport!") &&
+	    !strEqual(id, "rtDelayedGetExport!") &&
+	    !strEqual(id, "lazyGetExport!"))
+		return GC_GetCacheNone;
+
+	dom  = foam->foamCCall.argv[0];
+	name = foam->foamCCall.argv[1];
+	while (foamTag(name) == FOAM_Cast)
+		name = name->foamCast.expr;
+
+	if (foamTag(name) != FOAM_SInt) return GC_GetCacheNone;
+	if (!gc0GetCacheArg(dom)) return GC_GetCacheNone;
+	if (!gc0GetCacheArg(foam->foamCCall.argv[2])) return GC_GetCacheNone;
+
+	if (gc0GetCache != GC_GetCacheAuto) return gc0GetCache;
+
+	/* Parameters and lexicals vary between calls of the same code. */
+	while (foamTag(dom) == FOAM_Cast)
+		dom = dom->foamCast.expr;
+	return foamTag(dom) == FOAM_Glo ? GC_GetCacheMono : GC_GetCachePoly;
+}
+
+/* fiExportCached(GXCache0, (FiClos) fn, dom, name, type) */
+local CCode
+gc0GetCacheCall(Foam foam, int kind)
+{
+	CCode	ccOp, ccArgs;
+	String	macro;
+	int	i;
+
+	ccOp = gccId(foam->foamCCall.op);
+	if (gc0ExprType(foam->foamCCall.op) != FOAM_Clos)
+		ccOp = ccoCast(ccoTypeIdOf(gcFiClos), ccOp);
+
+	ccArgs = ccoNewNode(CCO_Many, 5);
+	ccoArgv(ccArgs)[0] = gc0ExportCache(kind);
+	ccoArgv(ccArgs)[1] = ccOp;
+	for (i = 0; i < 3; i++)
+		ccoArgv(ccArgs)[i + 2] = gccExpr(foam->foamCCall.argv[i]);
+
+	macro = (kind == GC_GetCacheMono) ? "fiExportCached" : "fiExportPCached";
+	return ccoFCall(ccoIdOf(macro), ccArgs);
+}
+
+/* Create a C global holding a call-site export cache */
+local CCode
+gc0ExportCache(int kind)
+{
+	CCode	cctype, ccdecl, ccname;
+	String	type;
+
+	type = (kind == GC_GetCacheMono) ? "FiExportCache" : "FiExportPCache";
+
+	if (gc0OverSMax())
+	{
+		String id = gcvConst->foamDDecl.argv[0]->foamDecl.id;
+		ccname = gc0MultVarId("GXCache", gcvNXCache, id);
+
+
+		/* extern FiExportCache GXCache0; */
+		cctype = ccoType(ccoExtern(), ccoTypeIdOf(type));
+		ccdecl = ccoDecl(cctype, ccoCopy(ccname));
+		gc0AddLine(gcvGloCC, ccdecl);
+
+
+		/* FiExportCache GXCache0; */
+		cctype = ccoTypeIdOf(type);
+	}
+	else
+	{
+		/* static FiExportCache GXCache0; */
+		ccname = gc0VarId("GXCache", gcvNXCache);
+		cctype = ccoType(ccoStatic(), ccoTypeIdOf(type));
+	}
+
+	ccdecl = ccoDecl(cctype, ccoCopy(ccname));
+	gc0AddLine(gcvDefCC, ccdecl);
+
+	gcvNXCache++;
+
+	return ccname;
+}
+
 local CCode
 gc0FunOCall0(Foam foam, int returnKind)
 {
@@ -6481,6 +7030,186 @@ gc0PopFluid()
 
 }
 
+/*
+ * With -Wprofile-alloc each prog saves fiProfProg, names itself there for
+ * the allocation profiler, and restores it on return.  Leaf progs which
+ * allocate nothing themselves are left out: the builtins they call are
+ * charged to their caller.
+ */
+local CCode
+gc0PushProf()
+{
+	return ccoDecl(ccoTypeIdOf(gcFiProfId),
+		       ccoAsst(ccoIdOf(gcFiProfLVar),
+			       ccoIdOf(gcFiProfGVar)));
+}
+
+local CCode
+gc0SetProf(Foam ref)
+{
+	String	name;
+	CCode	cc;
+
+	name = strPrintf("%s:%s", gcvUnitName, gc0GetDecl(ref)->foamDecl.id);
+	cc   = ccoStatAsst(ccoIdOf(gcFiProfGVar), ccoStringOf(name));
+	strFree(name);
+
+	return cc;
+}
+
+local CCode
+gc0PopProf()
+{
+	return ccoStat(ccoAsst(ccoIdOf(gcFiProfGVar),
+			       ccoIdOf(gcFiProfLVar)));
+}
+
+/*
+ * True if evaluating cc cannot allocate, so it may follow the restore.
+ */
+local Bool
+gc0ProfIsSimple(CCode cc)
+{
+	while (ccoTag(cc) == CCO_Cast)
+		cc = ccoArgv(cc)[1];
+
+	switch (ccoTag(cc)) {
+	case CCO_Id:
+	case CCO_IntVal:
+	case CCO_CharVal:
+	case CCO_FloatVal:
+	case CCO_StringVal:
+		return true;
+	default:
+		return false;
+	}
+}
+
+local Bool
+gc0ProfAllocates(Foam foam)
+{
+	switch (foamTag(foam)) {
+	case FOAM_RNew:
+	case FOAM_ANew:
+	case FOAM_RRNew:
+	case FOAM_TRNew:
+	case FOAM_PushEnv:
+	case FOAM_Clos:
+		return true;
+	default:
+		break;
+	}
+	foamIter(foam, arg, {
+		if (gc0ProfAllocates(*arg)) return true;
+	});
+	return false;
+}
+
+/*
+ * With -Wprofile-gen each prog has a static table of FiProfCount sites:
+ * the first counts the entries to the prog, and each of the others the
+ * calls made from one line of it.  The inliner reads the counts back
+ * with -Wprofile-use, keyed by the unit, the constant and the line.
+ */
+local Bool
+gc0ProfHasCall(Foam foam)
+{
+	if (foamTag(foam) == FOAM_CCall || foamTag(foam) == FOAM_OCall)
+		return true;
+
+	foamIter(foam, arg, {
+		if (gc0ProfHasCall(*arg)) return true;
+	});
+	return false;
+}
+
+local Bool
+gc0ProfIsSite(Foam stmt)
+{
+	return foamTag(stmt) != FOAM_Seq && !sposIsNone(foamPos(stmt)) &&
+		gc0ProfHasCall(stmt);
+}
+
+local CCode
+gc0ProfCount(AInt i)
+{
+	return ccoDot(ccoARef(ccoIdOf(gcFiProfCountLVar), ccoIntOf(i)),
+		      ccoIdOf("count"));
+}
+
+/*
+ * profCount[i].count++;
+ */
+local CCode
+gc0ProfSite(Foam stmt)
+{
+	AInt		line = sposLine(foamPos(stmt)), i;
+	AIntList	l;
+
+	i = listLength(AInt)(gcvProfLines);
+	for (l = gcvProfLines; l && car(l) != line; l = cdr(l))
+		i -= 1;
+	if (!l) {
+		gcvProfLines = listCons(AInt)(line, gcvProfLines);
+		i = listLength(AInt)(gcvProfLines);
+	}
+
+	return ccoStat(ccoPostInc(gc0ProfCount(i)));
+}
+
+/*
+ * static FiProfCount profCount[n] = {{0, "prog unit const name"},
+ *				       {0, "call unit const line"}, ...};
+ */
+local CCode
+gc0ProfDecl(Foam ref)
+{
+	CCodeList	sites = listNil(CCode);
+	AIntList	l;
+	String		site;
+	AInt		n;
+	CCode		cc;
+
+	for (l = gcvProfLines; l; l = cdr(l)) {
+		site = strPrintf("call %s %d %d", gcvUnitName,
+				 (int) ref->foamConst.index, (int) car(l));
+		sites = listCons(CCode)(ccoInit(ccoMany2(ccoIntOf(int0),
+							 ccoStringOf(site))),
+					sites);
+		strFree(site);
+	}
+	site  = strPrintf("prog %s %d %s", gcvUnitName,
+			  (int) ref->foamConst.index,
+			  gc0GetDecl(ref)->foamDecl.id);
+	sites = listCons(CCode)(ccoInit(ccoMany2(ccoIntOf(int0),
+						 ccoStringOf(site))),
+				sites);
+	strFree(site);
+
+	n  = listLength(CCode)(sites);
+	cc = ccoDecl(ccoType(ccoStatic(), ccoTypeIdOf(gcFiProfCount)),
+		     ccoAsst(ccoARef(ccoIdOf(gcFiProfCountLVar), ccoIntOf(n)),
+			     ccoInit(gc0ListOf(CCO_Many, sites))));
+	listFree(CCode)(sites);
+
+	return cc;
+}
+
+/*
+ * if (!profCount[0].count++) fiProfCountRegister(profCount, n);
+ */
+local CCode
+gc0ProfEntry()
+{
+	AInt	n = listLength(AInt)(gcvProfLines) + 1;
+
+	return ccoIf(ccoLNot(ccoPostInc(gc0ProfCount(int0))),
+		     ccoStat(ccoFCall(ccoIdOf("fiProfCountRegister"),
+				      ccoMany2(ccoIdOf(gcFiProfCountLVar),
+					       ccoIntOf(n)))),
+		     NULL);
+}
+
 local CCode
 gc0GetFluid(AInt i)
 {
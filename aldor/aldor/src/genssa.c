@@ -6,18 +6,37 @@
  *
  ****************************************************************************/
 
+#include "flog.h"
 #include "genssa.h"
-#include "gf_util.h"
-#include "fortran.h"
-#include "compcfg.h"
-#include "optfoam.h"
+#include "store.h"
 
 /*
  * SSA stands for Static Single Assignment. It is identical to standard
  * foam flogs except that every Loc has precisely one definition point.
  * This simplifies optimisations based on use-def analysis and allows us
- * to perform several optimisations in parallel. There are other advantages
- * that I'll not go into just now.
+ * to perform several optimisations in parallel.
+ *
+ * The translation follows Cytron et al: compute the dominator tree
+ * (Lengauer-Tarjan) and the dominance frontiers, insert phi functions
+ * for every local which is live across blocks and rename the locals by
+ * walking the dominator tree.  A phi function is the statement
+ *
+ *	(Set (Loc n) (BCall ssaPhi (Loc a0) ... (Loc ak)))
+ *
+ * where argument j is the value reaching the block along its j-th entry.
+ * The entry block gets an extra last argument for the value on entry to
+ * the prog if it has any entries.  Phi functions are always placed at the
+ * start of their block.
+ *
+ * Blocks which cannot be reached from the entry are left alone.  They are
+ * neither renamed nor given phi functions.
+ *
+ * The translation back does not insert copies: the names of a local are
+ * simply mapped back to the local and the phi functions are dropped.
+ * This is why clients must not extend the live range of a name past a
+ * later definition of the same local.  Copy folding during renaming
+ * respects this by only replacing a use of a copy by its source if the
+ * source is still the current name of its local at the use.
  */
 
 
@@ -30,6 +49,44 @@
 /* Simply to reduce the number of characters on a stoAlloc line ... */
 #define SSA_ALLOC(n)	stoAlloc(OB_Other, n)
 
+#define ssaIsStmtDef(s)	(foamTag(s) == FOAM_Set || foamTag(s) == FOAM_Def)
+
+
+/*****************************************************************************
+ *
+ * :: Local operations
+ *
+ ****************************************************************************/
+
+local Bool	ssaCheckFlog		(FlowGraph, Bool *);
+local Bool	ssaCheckExp		(Foam);
+local AInt	ssaNewName		(SSA, AInt, Foam, AInt);
+local void	ssaAddUse		(SSA, AInt, Foam, AInt);
+local AInt	ssaDFS			(SSA, AInt);
+local AInt	ssaLowestSemiAncestor	(SSA, AInt *, AInt *, AInt *,
+					 AInt *, AInt);
+local void	ssaScanUses		(Foam, AInt, AInt *, Bool *);
+local void	ssaMarkCopySource	(Foam, Bool *);
+local Foam	ssaNewPhiFunction	(AInt, AInt);
+local void	ssaRenameBlock		(SSA, AInt, AInt *, Bool);
+local Foam	ssaRenameExp		(SSA, Foam, Foam, AInt, AInt *, Bool);
+local Foam	ssaFoldCopy		(SSA, AInt, AInt *);
+local Bool	ssaIsCurrent		(SSA, Foam, AInt *);
+local void	ssaRenamePhiArgs	(SSA, BBlock, AInt, AInt, AInt *);
+local void	ssaRestoreExp		(SSA, Foam);
+local void	ssaRestoreBlock		(SSA, BBlock);
+
+/*
+ * Parameters which are assigned somewhere in the prog being translated.
+ * Only the others may replace copies of them.
+ */
+static Bool	*ssaParSet;
+
+/* Log of (local, previous name) pairs for undoing renamings. */
+static AInt	*ssaLogv;
+static AInt	ssaLogc, ssaLogMax;
+
+
 /*****************************************************************************
  *
  * :: Top level entry-points for SSA conversion.
@@ -37,170 +94,199 @@
  ****************************************************************************/
 
 SSA
-ssaFromFlog(FlowGraph flog)
+ssaFromFlog(FlowGraph flog, Bool foldCopies)
 {
-	BBlock		bb;
-	AInt		root;
-	Foam		ddecl = flog->prog->foamProg.locals;
-	AInt		nlocs = foamDDeclArgc(ddecl);
-	SSA		result = (SSA)SSA_ALLOC(sizeof(*result));
-	AIntList	*stack = (AIntList *)SSA_ALLOC(nlocs*sizeof(*stack));
-	AInt		*fmt = (AInt *)SSA_ALLOC(nlocs*sizeof(*fmt));
-	AInt		*typ = (AInt *)SSA_ALLOC(nlocs*sizeof(*typ));
+	SSA		result;
+	Foam		prog = flog->prog;
+	AInt		i, parc = foamDDeclArgc(prog->foamProg.params);
+	Bool		*parset;
 
-	/* Create the basic structure */
-	result->flog = flog;
-	result->usec = int0;
-	result->uses = (FoamUses *)NULL;
-	result->locals = vpNew(fboxNew(ddecl));
+	parset = (Bool *) SSA_ALLOC((parc + 1) * sizeof(Bool));
+	for (i = 0; i < parc; i++) parset[i] = false;
+
+	if (!ssaCheckFlog(flog, parset)) {
+		stoFree(parset);
+		return NULL;
+	}
+	flogFixEntries(flog);
 
-	/* Perform edge-splitting and dead-code removal */
-	ssaEdgeSplit(result);
+	/* Create the basic structure */
+	result = (SSA) SSA_ALLOC(sizeof(*result));
+	result->flog	= flog;
+	result->root	= flog->block0->label;
+	result->blockc	= flogBlockC(flog);
+	result->locc	= foamDDeclArgc(prog->foamProg.locals);
+	result->namec	= result->locc;
+	result->namemax	= 2 * result->locc + 16;
+	result->copies	= 0;
+
+	result->orig	 = (AInt *) SSA_ALLOC(result->namemax * sizeof(AInt));
+	result->defs	 = (Foam *) SSA_ALLOC(result->namemax * sizeof(Foam));
+	result->defblock = (AInt *) SSA_ALLOC(result->namemax * sizeof(AInt));
+	result->uses	 = (FoamUses *)
+		SSA_ALLOC(result->namemax * sizeof(FoamUses));
+	for (i = 0; i < result->locc; i++) {
+		result->orig[i]	    = i;
+		result->defs[i]	    = NULL;
+		result->defblock[i] = -1;
+		result->uses[i]	    = fuEmpty();
+	}
 
-	/* Number every basic block (order is irrelevent) */
-	flogIter(ssa->flog, bb, bbSetSExtra(bb, _i));
-	root = ssa->root = bbSExtra(ssa->flog->block0);
+	ssaParSet = parset;
 
 	/* Compute immediate dominators */
-	ssaDominatorTree(result, root);
+	ssaDominatorTree(result, result->root);
 
 	/* Compute the dominance frontiers */
-	ssaDominanceFrontiers(result, root);
+	ssaDominanceFrontiers(result);
 
 	/* Insert phi-functions */
-	ssaInsertPhiFunctions(result);
+	ssaInsertPhiFunctions(result, foldCopies);
 
-	/* State for ssaRename */
-	for (i = 0; i < nlocs; i++) {
-		stack[i] = listSingleton(AInt)(i);
-		fmt[i] = ddecl->foamDDecl.argv[i]->foamDecl.format;
-		typ[i] = ddecl->foamDDecl.argv[i]->foamDecl.type;
-	}
-
-	/* Rename all identifiers to obtain a valid edge-split SSA */
-	ssaRename(result, root, stack, fmt, typ);
-
-	/* Clean up */
-	for (i = 0; i < nlocs; i++) listFree(AInt)(stack[i]);
-	stoFree(stack);
-	stoFree(formats);
+	/* Rename all identifiers to obtain a valid SSA */
+	ssaRename(result, foldCopies);
 
-	/* FIXME: can we kill any other fields in ssa (e.g. samedom)? */
+	ssaParSet = NULL;
+	stoFree(parset);
 
 	/* Return the augmented flog */
-	return (SSA)result;
+	return result;
 }
 
+/*
+ * Map every name back to its local, drop the phi functions and release
+ * the SSA tables.  Copies of a local to itself are removed.
+ */
 FlowGraph
 ssaToFlog(SSA ssa)
 {
 	AInt 		i;
 	FlowGraph	result = ssa->flog;
 
-	/* Remove all phi-functions */
-	ssaRemovePhiFunctions(ssa);
+	flogIter(result, bb, ssaRestoreBlock(ssa, bb));
 
-	/* Clean up and return the updated flog */
-	result->prog->foamProg.locals = fboxMake(ssa->locals->fbox);
-	fuDestroy(ssa->uses);
-	stoFree(ssa->idom);
-	stoFree(ssa->dfnum);
-	stoFree(ssa->semi);
-	stoFree(ssa->best);
-	stoFree(ssa->ancestor);
-	stoFree(ssa->samedom);
-	stoFree(ssa->vertex);
-	stoFree(ssa->parent);
+	for (i = 0; i < ssa->namec; i++)
+		fuDestroy(ssa->uses[i]);
 	for (i = 0; i < ssa->blockc; i++) {
 		listFree(AInt)(ssa->dfrontier[i]);
 		listFree(AInt)(ssa->dtree[i]);
 	}
+	stoFree(ssa->orig);
+	stoFree(ssa->defs);
+	stoFree(ssa->defblock);
+	stoFree(ssa->uses);
+	stoFree(ssa->idom);
+	stoFree(ssa->dfnum);
+	stoFree(ssa->vertex);
+	stoFree(ssa->parent);
+	stoFree(ssa->dfrontier);
+	stoFree(ssa->dtree);
 	stoFree(ssa);
+
 	return result;
 }
 
+
 /*****************************************************************************
  *
- * :: Edge-splitting, dead-code removal, loop pre-headers etc
+ * :: Checking and name tables
  *
  ****************************************************************************/
 
 /*
- * To make the SSA analysis easier we require that every successor of a
- * block X with multiple exits has precisely one entry (from X). We also
- * require that the predecessor of every block X with multiple entries
- * has precisely one exit (to X). Ensuring one of these properties will
- * ensure the other.
+ * Locals may only be defined by Set and Def statements at the outermost
+ * level of a block.  We also stay clear of code with non-local transfers
+ * of control (Catch, Protect) whose effect on locals is not in the flog.
  */
-void
-ssaEdgeSplit(SSA ssa)
+local Bool
+ssaCheckFlog(FlowGraph flog, Bool *parset)
 {
-	BBlockList	todo = listNil(BBlock);
-
-	/* Walk the flog from the start node */
-	todo = listCons(BBlock)(ssa->flog->block0, todo);
-	flogClearMarks(ssa->flog);
-	while (todo) {
-		/* Remove the next node from the work list */
-		BBlock	bb = car(todo);
-		todo = cdr(todo);
-		if (bb->mark) continue; /* Already processed */
-		bb->mark = true;
-
-		/* We only process nodes with multiple successors */
-		if (!bbExitC(bb)) continue;
-		if (bbExitC(bb) == 1) {
-			todo = listCons(BBlock)(bbExit(bb, 0), todo);
-			continue;
-		}
+	flogIter(flog, bb, {
+		Foam	code = bb->code;
+		int	k;
 
-		/* Check every successor for multiple predecessors */
-		for (i = 0; i < bbExitC(bb); i++) {
-			AInt		j;
-			Foam		code;
-			BlockLabel	nlab;
-			BBlock		new, succ = bbExit(bb, i);
-
-			/* Always add children to the to-do list */
-			todo = listCons(BBlock)(succ, todo);
-
-			/* Ignore successors without multiple predecessors */
-			if (bbEntryC(succ) < 2) continue;
-
-			/* Edge-split: create empty node and attach to flog */
-			nlab = flogReserveLabel(ssa->flog);
-			code = foamNewEmpty(FOAM_Seq, 1);
-			code->foamSeq.argv[0] = foamNewNOp();
-			new = bbNew(code, nlab);
-			flogSetBlock(ssa->flog, nlab, new);
-			/* Don't add the new node to the to-do list! */
-
-			/* The only entry to new block is bb */
-			bbufNeed(new->entries, 1);
-			bbSetEntryC(new, 1);
-			bbSetEntry(new, 0, bb);
-
-			/* The only exit is to succ */
-			bbufNeed(new->exits, 1);
-			bbSetExitC(new, 1);
-			bbSetExit(new, 0, succ);
-
-			/* Fix the exit from bb */
-			bbSetExit(bb, i, new);
-
-			/* Fix the entry to succ */
-			for (j = 0; j < bbEntryC(succ); j++) {
-				/* Search for bb */
-				if (bbEntry(succ, j) != bb) continue;
-				bbSetEntry(succ, j, new);
+		for (k = 0; k < foamArgc(code); k++) {
+			Foam	stmt = code->foamSeq.argv[k];
+			Foam	lhs;
+
+			if (!ssaIsStmtDef(stmt)) {
+				if (!ssaCheckExp(stmt)) return false;
+				continue;
 			}
+			lhs = stmt->foamSet.lhs;
+			if (foamTag(lhs) == FOAM_Par)
+				parset[lhs->foamPar.index] = true;
+			else if (foamTag(lhs) == FOAM_Values) {
+				int	v;
+				for (v = 0; v < foamArgc(lhs); v++) {
+					Foam	var = lhs->foamValues.argv[v];
+					if (foamTag(var) == FOAM_Par)
+						parset[var->foamPar.index] = true;
+					else if (!ssaCheckExp(var))
+						return false;
+				}
+			}
+			else if (!ssaCheckExp(lhs))
+				return false;
+			if (!ssaCheckExp(stmt->foamSet.rhs)) return false;
 		}
+	});
+	return true;
+}
+
+local Bool
+ssaCheckExp(Foam foam)
+{
+	switch (foamTag(foam)) {
+	  case FOAM_Set:
+	  case FOAM_Def:
+	  case FOAM_Seq:
+	  case FOAM_Catch:
+	  case FOAM_Protect:
+	  case FOAM_Kill:
+		return false;
+	  default:
+		break;
 	}
+	foamIter(foam, argp, {
+		if (!ssaCheckExp(*argp)) return false;
+	});
+	return true;
+}
 
-	/* Remove dead blocks */
-	(void)flogCollect(ssa->flog);
+local AInt
+ssaNewName(SSA ssa, AInt loc, Foam def, AInt block)
+{
+	AInt	n = ssa->namec++;
+
+	if (n == ssa->namemax) {
+		AInt	max = 2 * ssa->namemax;
+		ssa->orig     = (AInt *) stoResize(ssa->orig, max*sizeof(AInt));
+		ssa->defs     = (Foam *) stoResize(ssa->defs, max*sizeof(Foam));
+		ssa->defblock = (AInt *)
+			stoResize(ssa->defblock, max*sizeof(AInt));
+		ssa->uses     = (FoamUses *)
+			stoResize(ssa->uses, max*sizeof(FoamUses));
+		ssa->namemax  = max;
+	}
+	ssa->orig[n]	 = loc;
+	ssa->defs[n]	 = def;
+	ssa->defblock[n] = block;
+	ssa->uses[n]	 = fuEmpty();
+
+	return n;
 }
 
+local void
+ssaAddUse(SSA ssa, AInt n, Foam stmt, AInt block)
+{
+	FoamUses	fu = ssa->uses[n];
+
+	if (fu && fuStmt(fu) == stmt) return;
+	ssa->uses[n] = fuNew(stmt, block, fu);
+}
+
+
 /*****************************************************************************
  *
  * :: Computation of immediate dominators
@@ -208,43 +294,69 @@ ssaEdgeSplit(SSA ssa)
  ****************************************************************************/
 
 /*
- * ssaDFS(ssa, parent, node, n) recursively updates the dfnum, vertex and
- * parent tables for "node" whose parent is "parent" starting with number n.
- *
+ * ssaDFS(ssa, root) numbers the nodes reachable from root in depth-first
+ * order, filling in the dfnum, vertex and parent tables.  Returns the
+ * number of nodes reached.
  */
 local AInt
-ssaDFS(SSA ssa, AInt parent, AInt node, AInt num)
+ssaDFS(SSA ssa, AInt root)
 {
-	AInt i;
-	BBlock bb;
-
-	/* If we have already numbered this node then we stop recursing */
-	if (ssa->dfnum[node]) return num;
-
-	/* Store the df number of this node and update the relevent tables */
-	ssa->dfnum[node] = num;
-	ssa->vertex[num++] = node;
-	ssa->parent[node] = parent;
+	AInt	*stack = (AInt *) SSA_ALLOC(ssa->blockc * sizeof(AInt));
+	AInt	*next  = (AInt *) SSA_ALLOC(ssa->blockc * sizeof(AInt));
+	AInt	sp = 0, num = 0;
+
+	ssa->dfnum[root]  = num;
+	ssa->vertex[num++] = root;
+	ssa->parent[root] = -1;
+	next[root] = 0;
+	stack[sp++] = root;
+
+	while (sp) {
+		AInt	n  = stack[sp - 1];
+		BBlock	bb = ssaBlock(ssa, n);
+		AInt	s;
+
+		if (next[n] == bbExitC(bb)) {
+			sp--;
+			continue;
+		}
+		s = bbExit(bb, next[n]++)->label;
+		if (ssa->dfnum[s] != -1) continue;
+
+		ssa->dfnum[s]	   = num;
+		ssa->vertex[num++] = s;
+		ssa->parent[s]	   = n;
+		next[s] = 0;
+		stack[sp++] = s;
+	}
 
-	/* Recurse over all successors of this node */
-	bb = flogBlock(ssa->flog, node);
-	for (i = 0; i < bbExitC(bb); i++)
-		num = ssaDFS(ssa, node, bbSExtra(bbExit(bb, i)), num);
+	stoFree(stack);
+	stoFree(next);
 	return num;
 }
 
+/*
+ * Find the ancestor of v in the spanning forest with the lowest
+ * semi-dominator, compressing the path as we go.
+ */
 local AInt
-ssaLowestSemiAncestor(SSA ssa, AInt v)
+ssaLowestSemiAncestor(SSA ssa, AInt *ancestor, AInt *semi, AInt *best,
+		      AInt *path, AInt v)
 {
-	AInt	a = ssa->ancestor[v];
-	if (ssa->ancestor[a] != -1) {
-		/* Recurse */
-		AInt b = ssaLowestSemiAncestor(ssa, a);
-		AInt	*dfnum = ssa->dfnum;
-		AInt	*semi = ssa->semi;
-		ancestor[v] = ancestor[a];
-		if (dfnum[semi[b]] < dfnum[semi[ssa->best[v]]])
-			ssa->best[v] = b;
+	AInt	*dfnum = ssa->dfnum;
+	AInt	n = 0, u;
+
+	for (u = v; ancestor[ancestor[u]] != -1; u = ancestor[u])
+		path[n++] = u;
+
+	while (n) {
+		AInt	a;
+
+		u = path[--n];
+		a = ancestor[u];
+		if (dfnum[semi[best[a]]] < dfnum[semi[best[u]]])
+			best[u] = best[a];
+		ancestor[u] = ancestor[a];
 	}
 	return best[v];
 }
@@ -252,219 +364,191 @@ ssaLowestSemiAncestor(SSA ssa, AInt v)
 /*
  * ssaDominatorTree(ssa, root) computes the immediate dominator tables
  * for ssa whose root is root. Assumes that ssa has at least one bb.
+ * Nodes which cannot be reached from root get dfnum and idom -1.
  */
 void
 ssaDominatorTree(SSA ssa, AInt root)
 {
-	BBlock		bb;
-	AIntList	bl;
 	AInt		i, N;
-	AInt		sz = flogBlockC(ssa->flog);
-
-	/* Allocate the buckets */
-	ssa->blockc = sz;
-	ssa->bucketv = (AIntList *)SSA_ALLOC(sz*sizeof(*(ssa->bucketv)));
-	ssa->dfrontier = (AIntList *)SSA_ALLOC(sz*sizeof(*(ssa->dfrontier)));
-	ssa->dtree = (AIntList *)SSA_ALLOC(sz*sizeof(*(ssa->dtree)));
-	for (i = 0; i < sz; i++) {
-		bucketv[i] = listNil(AInt);
-		dfrontier[i] = listNil(AInt);
-		dtree[i] = listNil(AInt);
-	}
+	AInt		sz = ssa->blockc;
+	AInt		*semi, *ancestor, *best, *samedom, *bucket, *bnext;
+	AInt		*path;
 
 	/* Allocate and initialise depth-first numbers and other tables */
-	ssa->dfnum = (AInt *)SSA_ALLOC(sz*sizeof(*(ssa->dfnum)));
-	ssa->idom = (AInt *)SSA_ALLOC(sz*sizeof(*(ssa->idom)));
-	ssa->semi = (AInt *)SSA_ALLOC(sz*sizeof(*(ssa->semi)));
-	ssa->ancestor = (AInt *)SSA_ALLOC(sz*sizeof(*(ssa->ancestor)));
-	ssa->samedom = (AInt *)SSA_ALLOC(sz*sizeof(*(ssa->samedom)));
-	ssa->vertex = (AInt *)SSA_ALLOC(sz*sizeof(*(ssa->vertex)));
-	ssa->parent = (AInt *)SSA_ALLOC(sz*sizeof(*(ssa->parent)));
-	ssa->best = (AInt *)SSA_ALLOC(sz*sizeof(*(ssa->best)));
+	ssa->dfnum  = (AInt *) SSA_ALLOC(sz * sizeof(AInt));
+	ssa->idom   = (AInt *) SSA_ALLOC(sz * sizeof(AInt));
+	ssa->vertex = (AInt *) SSA_ALLOC(sz * sizeof(AInt));
+	ssa->parent = (AInt *) SSA_ALLOC(sz * sizeof(AInt));
+	ssa->dfrontier = (AIntList *) SSA_ALLOC(sz * sizeof(AIntList));
+	ssa->dtree  = (AIntList *) SSA_ALLOC(sz * sizeof(AIntList));
+
+	semi	 = (AInt *) SSA_ALLOC(sz * sizeof(AInt));
+	ancestor = (AInt *) SSA_ALLOC(sz * sizeof(AInt));
+	best	 = (AInt *) SSA_ALLOC(sz * sizeof(AInt));
+	samedom	 = (AInt *) SSA_ALLOC(sz * sizeof(AInt));
+	bucket	 = (AInt *) SSA_ALLOC(sz * sizeof(AInt));
+	bnext	 = (AInt *) SSA_ALLOC(sz * sizeof(AInt));
+	path	 = (AInt *) SSA_ALLOC(sz * sizeof(AInt));
+
 	for (i = 0; i < sz; i++) {
-		ssa->dfnum[i] = 0;
-		ssa->best[i] = root;
-		ssa->semi[i] = ssa->ancestor[i] = -1; /* -1 => none */
-		ssa->samedom[i] = -1; /* -1 => none */
+		ssa->dfnum[i] = -1;
+		ssa->idom[i]  = -1;
+		ssa->parent[i] = -1;
+		ssa->dfrontier[i] = listNil(AInt);
+		ssa->dtree[i] = listNil(AInt);
+		semi[i] = ancestor[i] = samedom[i] = -1; /* -1 => none */
+		best[i] = i;
+		bucket[i] = bnext[i] = -1;
 	}
 
 	/* Compute depth-first numbers, parents and vertices */
-	N = ssaDFS(ssa, -1, root, 0);
+	N = ssa->nodec = ssaDFS(ssa, root);
 
 	/* Process every node except the root */
-	for (i = N - 1; i; i--) {
-		AInt	j;
+	for (i = N - 1; i > 0; i--) {
+		AInt	j, v;
 		AInt	n = ssa->vertex[i];
-		AInt	p = ssa->parent[i];
-		AInt	s = parent;
-		AInt	sprime;
+		AInt	p = ssa->parent[n];
+		AInt	s = p;
+		BBlock	bb = ssaBlock(ssa, n);
 
-		/* Calculate the semidominator of node (ssa->semi[node]) */
-		bb = flogBlock(ssa->flog, n);
+		/* Calculate the semidominator of n */
 		for (j = 0; j < bbEntryC(bb); j++) {
-			BBlock	vbb = bbEntry(bb, j);
-			AInt	v = bbSExtra(vbb);
+			AInt	sprime;
+
+			v = bbEntry(bb, j)->label;
+			if (ssa->dfnum[v] == -1) continue; /* Unreachable */
 
-			/* Compute the next candidate for semi[n] */
 			if (ssa->dfnum[v] <= ssa->dfnum[n])
 				sprime = v;
 			else
-				sprime = semi[ssaLowestSemiAncestor(ssa, v)];
-			if (dfnum[sprime] < dfnum[s]) s = sprime;
+				sprime = semi[ssaLowestSemiAncestor(ssa,
+					ancestor, semi, best, path, v)];
+			if (ssa->dfnum[sprime] < ssa->dfnum[s]) s = sprime;
 		}
 
 		/* Defer calculation of idom[n] until processed path s->n */
-		ssa->semi[n] = s;
-		ssa->bucketv[s] = listCons(AInt)(n, ssa->bucketv[s]);
-
-		/* Add edge parent->node to the forest (processed paths) */
-		ssa->ancestor[n] = p;
-		ssa->best[n] = n;
-
-		/* Compute the idom[v] if possible */
-		for (bl = ssa->bucketv[p]; bl; bl = listFreeCons(AInt)(bl)) {
-			AInt	v = car(bl);
-			AInt	y = ssaLowestSemiAncestor(ssa, v);
-
-			if (ssa->semi[y] == semi[v])
+		semi[n]	  = s;
+		bnext[n]  = bucket[s];
+		bucket[s] = n;
+
+		/* Add edge p->n to the forest (processed paths) */
+		ancestor[n] = p;
+		best[n] = n;
+
+		/* Compute idom[v] if possible */
+		for (v = bucket[p]; v != -1; v = bnext[v]) {
+			AInt	y = ssaLowestSemiAncestor(ssa, ancestor, semi,
+							  best, path, v);
+			if (semi[y] == semi[v])
 				ssa->idom[v] = p;
 			else
-				ssa->samedom[v] = y;
+				samedom[v] = y;
 		}
-		ssa->bucketv[p] = bl;
+		bucket[p] = -1;
 	}
 
 	/* Finish the deferred calculations */
-	for (i = 1; i <= N; i++) {
+	for (i = 1; i < N; i++) {
 		AInt	n = ssa->vertex[i];
-		if (ssa->samedom[n] != -1)
-			ssa->idom[n] = ssa->idom[ssa->samedom[n]];
+		if (samedom[n] != -1)
+			ssa->idom[n] = ssa->idom[samedom[n]];
 	}
 
-	/* Release unused storage */
-	stoFree(ssa->bucketv);
-
 	/* Compute the dominator tree */
-	for (i = 0; i < ssa->blockc; i++) {
-		AInt dom = ssa->idom[n];
-		if (dom == -1) continue;
-		/* Add ourselves to the child list of our idom */
+	for (i = N - 1; i > 0; i--) {
+		AInt	n = ssa->vertex[i];
+		AInt	dom = ssa->idom[n];
 		ssa->dtree[dom] = listCons(AInt)(n, ssa->dtree[dom]);
 	}
+
+	/* Release unused storage */
+	stoFree(semi);
+	stoFree(ancestor);
+	stoFree(best);
+	stoFree(samedom);
+	stoFree(bucket);
+	stoFree(bnext);
+	stoFree(path);
 }
 
+
 /*****************************************************************************
  *
  * :: Computation of dominance frontiers
  *
  ****************************************************************************/
 
-local Bool
-ssaDominates(SSA ssa, AInt n1, AInt n2)
-{
-	AInt	*idom = ssa->idom;
-	AInt	n = n2;
-	AInt	in = idom[n];
-
-	/* Each node dominates itsef */
-	if (n1 == n2) return true;
-
-	/* n1 dominates n2 iff n1 lies above n2 in the dominator tree */
-	while (in != -1) {
-		n = in;
-		if (n == n1) return true;
-		in = idom[in];
-	}
-	return false;
-}
-
+/*
+ * A join node y is in the dominance frontier of each node on the
+ * dominator tree path from a predecessor of y up to, but excluding,
+ * the immediate dominator of y.
+ */
 void
-ssaDominanceFrontiers(SSA ssa, AInt n)
+ssaDominanceFrontiers(SSA ssa)
 {
-	AInt		i;
-	BBlock		bb;
-	AIntList	l1, l2;
-	AIntList	S = listNil(AInt);
-
-	/* Compute DFlocal[n] */
-	bb = flogBlock(ssa->flog, n);
-	for (i = 0; i < bbExitC(bb); i++) {
-		BBlock	ybb = bbExit(bb, i);
-		AInt	y = bbSExtra(ybb);
-
-		/* Add successors of n not strictly dominated by n */
-		if (ssa->idom[y] != n) S = listCons(AInt)(y, S);
-	}
+	AInt	i, j;
 
-	/* Compute DFup[n] */
-	for (l1 = ssa->dtree[n]; l1; l1 = cdr(l1)) {
-		AInt	c = car(l1);
-		ssaDominanceFrontiers(ssa, c);
-		for (l2 = ssa->dfrontier[c]; l2; l2 = cdr(l2)) {
-			AInt	w = car(l2);
+	for (i = 0; i < ssa->nodec; i++) {
+		AInt	y = ssa->vertex[i], nentries;
+		BBlock	bb = ssaBlock(ssa, y);
 
-			/* Add nodes not dominated by n */
-			if (!ssaDominates(n, w)) S = listCons(AInt)(w, S);
+		nentries = (y == ssa->root);
+		for (j = 0; j < bbEntryC(bb); j++)
+			if (ssa->dfnum[bbEntry(bb, j)->label] != -1)
+				nentries++;
+		if (nentries < 2) continue;
+
+		for (j = 0; j < bbEntryC(bb); j++) {
+			AInt	runner = bbEntry(bb, j)->label;
+
+			if (ssa->dfnum[runner] == -1) continue;
+			while (runner != -1 && runner != ssa->idom[y]) {
+				AIntList df = ssa->dfrontier[runner];
+				if (!df || car(df) != y)
+					ssa->dfrontier[runner] =
+						listCons(AInt)(y, df);
+				runner = ssa->idom[runner];
+			}
 		}
 	}
-
-	/* Store the dominance frontier */
-	ssa->dfrontier[n] = S;
 }
 
+
 /*****************************************************************************
  *
- * :: Insertion of phi functions and identifier renaming
+ * :: Insertion of phi functions
  *
  ****************************************************************************/
 
+/*
+ * Mark the locals used in foam before being defined in the current block
+ * (whose label is n) as global.
+ */
 local void
-ssaPhiScanBB(BBlock bb, BitvClass class, AIntList defs, Bitv *Aorig)
+ssaScanUses(Foam foam, AInt n, AInt *defd, Bool *global)
 {
-	/* Access the code for the bblock */
-	AInt	fc = foamArgc(bb->code);
-	Foam	*fv = bb->code->foamSeq.argv;
-
-	/* Scan for definitions */
-	for (; fc; fv++, fc--) {
-		FoamTag tag = foamTag(*fv);
-		if ((tag == FOAM_Def) || (tag == FOAM_Set)) {
-			/* Assume foamDef and foamSet are identical */
-			Foam lhs = (*fv)->foamSet.lhs;
-
-			/* Check the lhs for locals */
-			if (foamTag(lhs) == FOAM_Loc) {
-				AInt i = lhs->foamLoc.index;
-				/* Add to Aorig[n] and defsites[i] */
-				if (!bitvTest(class, Aorig[n], i)) {
-					/* Not seen here: add to tables */
-					bitvSet(class, Aorig[n], i);
-					defs[i] = listCons(AInt)(n, defs[i]);
-				}
-				continue;
-			}
-
-			/* If it isn't a multi, ignore it */
-			if (foamTag(lhs) != FOAM_Values) continue;
-
-			/* Scan for locals */
-			for (v = 0; v < foamArgc(lhs); v++) {
-				AInt i;
-				FoamTag tag = foamTag(foamArgv(lhs)[v]);
-
-				/* Ignore non-locals */
-				if (tag != FOAM_Loc) continue;
-				i = lhs->foamLoc.index;
-
-				/* Add to Aorig[n] and defsites[i] */
-				if (!bitvTest(class, Aorig[n], i)) {
-					/* Not seen here: add to tables */
-					bitvSet(class, Aorig[n], i);
-					defs[i] = listCons(AInt)(n, defs[i]);
-				}
-			}
-		}
+	if (foamTag(foam) == FOAM_Loc) {
+		if (defd[foam->foamLoc.index] != n)
+			global[foam->foamLoc.index] = true;
+		return;
 	}
+	foamIter(foam, argp, ssaScanUses(*argp, n, defd, global));
+}
+
+/*
+ * Copy folding relies on the names of the source of a copy being exact,
+ * so the source must get its phi functions even when it is not global.
+ */
+local void
+ssaMarkCopySource(Foam rhs, Bool *global)
+{
+	if (foamTag(rhs) == FOAM_Cast)
+		rhs = rhs->foamCast.expr;
+	else if (foamTag(rhs) == FOAM_Clos)
+		rhs = rhs->foamClos.env;
+	if (foamTag(rhs) == FOAM_Loc)
+		global[rhs->foamLoc.index] = true;
 }
 
 local Foam
@@ -484,387 +568,490 @@ ssaNewPhiFunction(AInt nargs, AInt loc)
 	return foamNewSet(foamNewLoc(loc), result);
 }
 
+/*
+ * Place phi functions for the locals which are used in a block other
+ * than the one defining them (semi-pruned SSA).
+ */
 void
-ssaInsertPhiFunctions(SSA ssa)
+ssaInsertPhiFunctions(SSA ssa, Bool foldCopies)
 {
-	AInt		i;
-	BitvClass	bclass;
+	AInt		i, k;
+	AInt		nlocs = ssa->locc;
 	AIntList	*defsites;
-	Foam		ddecl = ssa->flog->prog->foamProg.locals;
-	AInt		nlocs = foamDDeclArgc(ddecl);
-	Bitv		*Aorig, *Aphi;
+	AInt		*defd, *hasphi, *work;
+	Bool		*global;
 	FoamList	*phis;
 
-	/* Table of definition sites indexed by local */
-	defsites = (AIntList *)SSA_ALLOC(nlocs*sizeof(*defsites));
-	for (i = 0; i < nlocs; i++) defsites[i] = listNil(AInt);
+	if (nlocs == 0) return;
 
-	/* List of phi functions to insert index by node */
-
-	/*
-	 * Set membership bits index by node; phi functions to add
-	 * indexed by node.
-	 */
-	Aorig = (Bitv *)SSA_ALLOC(ssa->blockc*sizeof(*Aorig));
-	Aphi = (Bitv *)SSA_ALLOC(ssa->blockc*sizeof(*Aphi));
-	phis = (FoamList *)SSA_ALLOC(ssa->blockc*sizeof(*stmts));
-	bclass = bitvClassCreate(nlocs);
-	for (i = 0; i < ssa->blockc; i++) {
-		Aorig[i] = bitvNew(bclass);
-		Aphi[i] = bitvNew(bclass);
-		bitvClearAll(bclass, Aorig[i]);
-		bitvClearAll(bclass, Aphi[i]);
-		phis[i] = listNil(Foam);
+	defsites = (AIntList *) SSA_ALLOC(nlocs * sizeof(AIntList));
+	defd	 = (AInt *) SSA_ALLOC(nlocs * sizeof(AInt));
+	global	 = (Bool *) SSA_ALLOC(nlocs * sizeof(Bool));
+	for (i = 0; i < nlocs; i++) {
+		defsites[i] = listNil(AInt);
+		defd[i]	    = -1;
+		global[i]   = false;
 	}
 
-	/* Compute defsites[] and Aorig[] */
-	for (n = 0; n < ssa->blockc; n++) {
-		BBlock	bb = flogBlock(ssa->flog, n);
-		if (!bb) continue; /* Not all bb slots are used */
+	/* Compute defsites[] and global[] */
+	for (i = 0; i < ssa->nodec; i++) {
+		AInt	n = ssa->vertex[i];
+		Foam	code = ssaBlock(ssa, n)->code;
+
+		for (k = 0; k < foamArgc(code); k++) {
+			Foam	stmt = code->foamSeq.argv[k], lhs;
+			int	v;
+
+			if (!ssaIsStmtDef(stmt)) {
+				ssaScanUses(stmt, n, defd, global);
+				continue;
+			}
+			ssaScanUses(stmt->foamSet.rhs, n, defd, global);
+			if (foldCopies)
+				ssaMarkCopySource(stmt->foamSet.rhs, global);
+
+			lhs = stmt->foamSet.lhs;
+			if (foamTag(lhs) == FOAM_Values) {
+				for (v = 0; v < foamArgc(lhs); v++) {
+					Foam	var = lhs->foamValues.argv[v];
+					AInt	loc;
+
+					if (foamTag(var) != FOAM_Loc) {
+						ssaScanUses(var, n, defd,
+							    global);
+						continue;
+					}
+					loc = var->foamLoc.index;
+					if (defd[loc] == n) continue;
+					defd[loc] = n;
+					defsites[loc] = listCons(AInt)
+						(n, defsites[loc]);
+				}
+			}
+			else if (foamTag(lhs) == FOAM_Loc) {
+				AInt	loc = lhs->foamLoc.index;
 
-		/* Scan bblock for definitions of locals */
-		ssaPhiScanBB(bb, bclass, defsites, Aorig);
+				if (defd[loc] == n) continue;
+				defd[loc] = n;
+				defsites[loc] = listCons(AInt)(n, defsites[loc]);
+			}
+			else
+				ssaScanUses(lhs, n, defd, global);
+		}
+	}
+
+	/* Place the phi functions */
+	hasphi = (AInt *) SSA_ALLOC(ssa->blockc * sizeof(AInt));
+	work   = (AInt *) SSA_ALLOC(ssa->blockc * sizeof(AInt));
+	phis   = (FoamList *) SSA_ALLOC(ssa->blockc * sizeof(FoamList));
+	for (k = 0; k < ssa->blockc; k++) {
+		hasphi[k] = work[k] = -1;
+		phis[k] = listNil(Foam);
 	}
 
-	/*
-	 * Insert phi-functions. FIXME: avoid creating unary phi
-	 * functions: (Set (Loc i) (BCall ssaPhi (Loc i))).
-	 */
 	for (i = 0; i < nlocs; i++) {
-		/* Start by processing all nodes in which (Loc i) is set */
-		AIntList todo = defsites[i];
+		AIntList	todo = defsites[i], l;
+
+		if (!global[i]) {
+			listFree(AInt)(todo);
+			continue;
+		}
+		for (l = todo; l; l = cdr(l)) work[car(l)] = i;
+
 		while (todo) {
-			/* Remove the next element from the to-do list */
 			AInt		n = car(todo);
-			AIntList	df = ssa->dfrontier[n];
-			todo = cdr(todo);
-
-			/* Check each node in the dominance frontier of n */
-			listIter(AInt, y, df, {
-				if (!bitvTest(bclass, Aphi[n], y)) {
-					/* Phi function needed */
-					BBlock	bb = flogBlock(ssa->flog, y);
-					AInt ec = bbEntryC(bb);
-					Foam fm = ssaNewPhiFunction(ec, i);
-					phis[y] = listCons(Foam)(fm, phis[y]);
-
-					/* Record this phi function */
-					bitvSet(class, Aphi[n], y);
-
-					/* Preserve the dominance frontier */
-					if (!bitvTest(bclass, Aorig[n], y))
-						todo = listCons(AInt)(y, todo);
+			AIntList	df;
+
+			todo = listFreeCons(AInt)(todo);
+			for (df = ssa->dfrontier[n]; df; df = cdr(df)) {
+				AInt	y = car(df);
+				BBlock	bb;
+				AInt	nargs;
+
+				if (hasphi[y] == i) continue;
+				hasphi[y] = i;
+
+				bb = ssaBlock(ssa, y);
+				nargs = bbEntryC(bb) + (y == ssa->root);
+				phis[y] = listCons(Foam)
+					(ssaNewPhiFunction(nargs, i), phis[y]);
+
+				if (work[y] != i) {
+					work[y] = i;
+					todo = listCons(AInt)(y, todo);
 				}
-			});
+			}
 		}
 	}
 
 	/* Actually insert the phi functions */
-	for (i = 0; i < ssa->blockc; i++) {
-		Foam code;
-		BBlock bb;
-		FoamList stmts = phis[i];
+	for (k = 0; k < ssa->blockc; k++) {
+		FoamList	stmts = phis[k], l;
+		BBlock		bb;
+		Foam		code, ncode;
+		AInt		j, c;
 
-		/* Skip blocks with nothing to add */
 		if (!stmts) continue;
 
-		/* Append every statement in the block to our list */
-		bb = flogBlock(ssa->flog, i);
+		bb = ssaBlock(ssa, k);
 		code = bb->code;
-		foamIter(code, stmtp, {
-			stmts = listCons(Foam)(*stmtp, stmts);
-			/* We want to foamFree(code) afterwards */
-			*stmtp = (Foam)NULL;
-		});
-
-		/* Replace the bblock code */
-		stmts = listNReverse(Foam)(stmts);
-		bb->code = foamNewOfList(FOAM_Seq, stmts);
-
-		/* Cleanup */
-		foamFree(code);
+		ncode = foamNewEmpty(FOAM_Seq, listLength(Foam)(stmts) +
+				     foamArgc(code));
+		for (c = 0, l = stmts; l; l = cdr(l))
+			ncode->foamSeq.argv[c++] = car(l);
+		for (j = 0; j < foamArgc(code); j++)
+			ncode->foamSeq.argv[c++] = code->foamSeq.argv[j];
+		foamFreeNode(code);
+		bb->code = ncode;
 		listFree(Foam)(stmts);
 	}
 
-	/* Clean up */
-	for (i = 0; i < ssa->blockc; i++) {
-		bitvFree(Aorig[i]);
-		bitvFree(Aphi[i]);
-	}
-	bitvClassDestroy(bclass);
+	stoFree(defsites);
+	stoFree(defd);
+	stoFree(global);
+	stoFree(hasphi);
+	stoFree(work);
+	stoFree(phis);
 }
 
+
 /*****************************************************************************
  *
  * :: Variable renaming
  *
  ****************************************************************************/
 
+#define ssaLogPush(loc, prev) { 					\
+	if (ssaLogc + 2 > ssaLogMax) {					\
+		ssaLogMax = 2 * ssaLogMax + 64;				\
+		ssaLogv = (AInt *) stoResize(ssaLogv,			\
+					     ssaLogMax * sizeof(AInt));	\
+	}								\
+	ssaLogv[ssaLogc++] = (loc);					\
+	ssaLogv[ssaLogc++] = (prev);					\
+}
+
 /*
- * Rename all identifier uses in a piece of FOAM that isn't a definition.
+ * Having inserted phi functions we must now rename identifiers to ensure
+ * that there is precisely one definition of each.  The dominator tree is
+ * walked with an explicit stack: node n is pushed as n to enter it and as
+ * -n-1 to leave it, when the names it defined are popped again.
  */
-local Foam
-ssaRenameDeeply(Foam foam, AIntList *stack)
+void
+ssaRename(SSA ssa, Bool foldCopies)
 {
-	if (foamTag(foam) == FOAM_Loc) {
-		/* Rename this local */
-		AInt index = foam->foamLoc.index;
-		AInt nindex = car(stack[index]);
-		return (nindex == index) ? foam : foamNewLoc(nindex);
-	}
-
-	/* Recursively process the expression */
-	foamIter(foam, stmtp, {
-		Foam	new = ssaRenameDeeply(*stmtp, stack);
-		if (new != *stmtp) {
-			foamFree(*stmtp);
-			*stmtp = new;
+	AInt	i, sp = 0;
+	AInt	*cur   = (AInt *) SSA_ALLOC((ssa->locc + 1) * sizeof(AInt));
+	AInt	*mark  = (AInt *) SSA_ALLOC(ssa->blockc * sizeof(AInt));
+	AInt	*stack = (AInt *) SSA_ALLOC(2 * ssa->blockc * sizeof(AInt));
+	BBlock	root = ssaBlock(ssa, ssa->root);
+
+	for (i = 0; i < ssa->locc; i++) cur[i] = i;
+
+	ssaLogv	  = (AInt *) SSA_ALLOC(64 * sizeof(AInt));
+	ssaLogc	  = 0;
+	ssaLogMax = 64;
+
+	/* The last argument of phi functions in the root is the entry value */
+	ssaRenamePhiArgs(ssa, root, bbEntryC(root), ssa->root, cur);
+
+	stack[sp++] = ssa->root;
+	while (sp) {
+		AInt		n = stack[--sp];
+		AIntList	l;
+
+		if (n < 0) {
+			n = -n - 1;
+			while (ssaLogc > mark[n]) {
+				AInt	prev = ssaLogv[--ssaLogc];
+				AInt	loc  = ssaLogv[--ssaLogc];
+				cur[loc] = prev;
+			}
+			continue;
 		}
-	});
 
-	/* Foam returned unchanged */
-	return foam;
+		mark[n] = ssaLogc;
+		ssaRenameBlock(ssa, n, cur, foldCopies);
+
+		stack[sp++] = -n - 1;
+		for (l = ssa->dtree[n]; l; l = cdr(l))
+			stack[sp++] = car(l);
+	}
+
+	stoFree(ssaLogv);
+	ssaLogv = NULL;
+	stoFree(cur);
+	stoFree(mark);
+	stoFree(stack);
 }
 
-local AInt
-ssaRenameDef(SSA ssa, Foam def, AIntList *stack, AIntList *done, AInt *fmt,
-		AInt *typ)
+local void
+ssaRenameBlock(SSA ssa, AInt n, AInt *cur, Bool foldCopies)
 {
-	Foam	new;
-	Foam	lhs = def->foamDef.lhs;
-	Foam	rhs = def->foamDef.rhs;
-	VarPool locs = ssa->locals;
-
-	/* Process phi functions: (Set (Loc n) (BCall ssaPhi (Loc n) ...)) */
-	if (foamIsPhiFunction(rhs)) {
-		/* The lhs MUST be a simple local: clone it */
-		AInt	index = lhs->foamLoc.index;
-		AInt	nindex = vpNewVar0(locs, typ[index], fmt[index]);
-
-		/* This is now the closest/reaching definition */
-		stack[index] = listCons(AInt)(nindex, stack[index]);
-		*did = listCons(AInt)(index, *did);
-
-		/* Update the definition */
-		foamFree(lhs);
-		def->foamDef.lhs = foamNewLoc(nindex);
-
-		/* Do NOT process the phi function just yet */
-		return;
-	}
+	BBlock	bb = ssaBlock(ssa, n);
+	Foam	code = bb->code;
+	AInt	k, e, j, last = foamArgc(code) - 1;
+
+	for (k = 0; k <= last; k++) {
+		Foam	stmt = code->foamSeq.argv[k];
+		Foam	lhs;
+		Bool	record;
+
+		if (!ssaIsStmtDef(stmt)) {
+			FoamTag	tag = foamTag(stmt);
+
+			record = (k == last &&
+				  (tag == FOAM_If || tag == FOAM_Select));
+			code->foamSeq.argv[k] = ssaRenameExp(ssa, stmt,
+				record ? stmt : NULL, n, cur, foldCopies);
+			continue;
+		}
 
-	/* Process the RHS first */
-	new = ssaRenameDeeply(rhs, stack);
-	if (new != rhs) {
-		foamFree(rhs);
-		def->foamDef.rhs = new;
-	}
+		lhs = stmt->foamSet.lhs;
+		record = (foamTag(lhs) == FOAM_Loc);
 
-	/* Deal with simple assignments and definitions */
-	if (foamTag(lhs) == FOAM_Loc) {
-		/* The lhs is a simple local: clone it */
-		AInt	index = lhs->foamLoc.index;
-		AInt	nindex = vpNewVar0(locs, typ[index], fmt[index]);
+		if (!foamIsPhiFunction(stmt->foamSet.rhs))
+			stmt->foamSet.rhs = ssaRenameExp(ssa, stmt->foamSet.rhs,
+				record ? stmt : NULL, n, cur, foldCopies);
 
-		/* This is now the closest/reaching definition */
-		stack[index] = listCons(AInt)(nindex, stack[index]);
-		*did = listCons(AInt)(index, *did);
+		if (foamTag(lhs) == FOAM_Loc) {
+			AInt	loc = lhs->foamLoc.index;
+			AInt	name = ssaNewName(ssa, loc, stmt, n);
 
-		/* Update the definition */
-		foamFree(lhs);
-		def->foamDef.lhs = foamNewLoc(nindex);
-		return;
+			ssaLogPush(loc, cur[loc]);
+			cur[loc] = name;
+			lhs->foamLoc.index = name;
+		}
+		else if (foamTag(lhs) == FOAM_Values) {
+			AInt	v;
+
+			for (v = 0; v < foamArgc(lhs); v++) {
+				Foam	var = lhs->foamValues.argv[v];
+				AInt	loc, name;
+
+				if (foamTag(var) != FOAM_Loc) {
+					lhs->foamValues.argv[v] =
+						ssaRenameExp(ssa, var, NULL, n,
+							     cur, foldCopies);
+					continue;
+				}
+				loc  = var->foamLoc.index;
+				name = ssaNewName(ssa, loc, stmt, n);
+				ssaLogPush(loc, cur[loc]);
+				cur[loc] = name;
+				var->foamLoc.index = name;
+			}
+		}
+		else
+			stmt->foamSet.lhs = ssaRenameExp(ssa, lhs, NULL, n,
+							 cur, foldCopies);
 	}
 
-	/* Deal with multis */
-	if (foamTag(lhs) == FOAM_Values) {
-		AInt	v, index, nindex;
+	/* Rename the arguments of phi functions in our successors */
+	for (e = 0; e < bbExitC(bb); e++) {
+		BBlock	succ = bbExit(bb, e);
 
-		/* Rename any locals */
-		for (v = 0; v < foamArgc(lhs); v++) {
-			Foam loc = foamArgv(lhs)[v];
-			/* Ignore non-locals */
-			if (foamTag(loc) != FOAM_Loc) continue;
+		/* Only do each successor once */
+		for (j = 0; j < e; j++)
+			if (bbExit(bb, j) == succ) break;
+		if (j < e) continue;
 
-			/* Make a new local */
-			index = loc->foamLoc.index;
-			nindex = vpNewVar0(locs, typ[index], fmt[index]);
+		for (j = 0; j < bbEntryC(succ); j++)
+			if (bbEntry(succ, j) == bb)
+				ssaRenamePhiArgs(ssa, succ, j, n, cur);
+	}
+}
+
+/*
+ * Set argument j of each phi function in bb to the current name of its
+ * local, recording the use.
+ */
+local void
+ssaRenamePhiArgs(SSA ssa, BBlock bb, AInt j, AInt from, AInt *cur)
+{
+	Foam	code = bb->code;
+	AInt	k;
 
-			/* This is now the closest/reaching definition */
-			stack[index] = listCons(AInt)(nindex, stack[index]);
-			*did = listCons(AInt)(index, *did);
+	for (k = 0; k < foamArgc(code); k++) {
+		Foam	stmt = code->foamSeq.argv[k];
+		Foam	arg;
+		AInt	loc;
 
-			/* Update the definition */
-			foamFree(loc);
-			foamArgv(lhs)[v] = foamNewLoc(nindex);
-		}
+		if (!foamIsPhiStmt(stmt)) break;
+
+		loc = ssa->orig[stmt->foamSet.lhs->foamLoc.index];
+		arg = stmt->foamSet.rhs->foamBCall.argv[j];
+		arg->foamLoc.index = cur[loc];
+		ssaAddUse(ssa, cur[loc], stmt, bb->label);
 	}
 }
 
 /*
- * Having inserted phi functions we must now rename identifiers to ensure
- * that there is precisely on definition of each.
+ * Rename the locals used in foam, replacing uses of copies when allowed.
+ * Uses are recorded against stmt unless it is NULL.
  */
-void
-ssaRename(SSA ssa, AInt n, AIntList *stack, AInt *fmt, AInt *typ)
+local Foam
+ssaRenameExp(SSA ssa, Foam foam, Foam stmt, AInt n, AInt *cur,
+	     Bool foldCopies)
 {
-	AInt		i;
-	AIntList	nodes, done = listNil(AInt);
-	BBlock		bb = flogBlock(ssa->flog, n);
-
-	/* Examine every statement in the block */
-	foamIter(bb->code, stmtp, {
-		FoamTag tag = foamTag(*stmtp);
-		if ((tag == FOAM_Def) || (tag == FOAM_Set))
-			ssaRenameDef(ssa, *stmtp, stack, &done, fmt, typ);
-		else {
-			Foam	new = ssaRenameDeeply(*stmtp, stack);
-			if (new != *stmtp) {
-				foamFree(*stmtp);
-				*stmtp = new;
-			}
-		}
-	});
-
-	/* Rename arguments to phi functions in our immediate successors */
-	if (bbExitC(bb) > 1) {
-		/*
-		 * Edge splitting ensures that we are the unique
-		 * predecessor of each of our successors.
-		 */
-		for (i = 0; i < bbExitC(bb); i++) {
-			BBlock	succ = bbExit(bb, i);
-
-			/*
-			 * Rename the first argument to every phi function.
-			 * If we can avoid creating unary phi functions then
-			 * we can remove this code. We assume that all phi
-			 * functions are grouped at the start of the block.
-			 */
-			foamIter(succ->code, stmtp, {
-				Foam	rhs;
-				FoamTag	tag = foamTag(*stmtp);
-				/* Stop if this isn't a phi function */
-				if ((tag != FOAM_Set) && (tag != FOAM_Def))
-					break;
-				rhs = (*stmtp)->foamDef.rhs);
-				if (!foamIsPhiFunction(rhs) break;
-
-				/* Rename the first argument */
-				index = rhs->foamBCall.argv[0]->foamLoc.index;
-				nindex = car(stack[index]);
-				foamFree(rhs->foamBCall.argv[0]);
-				rhs->foamBCall.argv[0] = foamNewLoc(nindex);
-			});
+	if (foamTag(foam) == FOAM_Loc) {
+		AInt	name = cur[foam->foamLoc.index];
+		Foam	copy = foldCopies ? ssaFoldCopy(ssa, name, cur) : NULL;
+
+		if (copy) {
+			foamFree(foam);
+			ssa->copies += 1;
+			foam = copy;
+			if (stmt && foamTag(copy) == FOAM_Cast)
+				copy = copy->foamCast.expr;
+			if (stmt && foamTag(copy) == FOAM_Loc)
+				ssaAddUse(ssa, copy->foamLoc.index, stmt, n);
+			return foam;
 		}
-	
+		foam->foamLoc.index = name;
+		if (stmt) ssaAddUse(ssa, name, stmt, n);
+		return foam;
 	}
-	else if (bbExitC(bb)) {
-		AInt	j;
-		BBlock	succ = bbExit(bb, 0);
-
-		/* Search for bb as entry to succ */
-		for (j = 0; j < bbEntryC(succ); j++) {
-			if (bbEntry(succ, j) != bb) continue;
-
-			/* Rename the jth argument of every phi function.
-			 * We assume that all phi functions are grouped at
-			 * the start of the block.
-			 */
-			foamIter(succ->code, stmtp, {
-				Foam	rhs;
-				FoamTag	tag = foamTag(*stmtp);
-				/* Stop if this isn't a phi function */
-				if ((tag != FOAM_Set) && (tag != FOAM_Def))
-					break;
-				rhs = (*stmtp)->foamDef.rhs);
-				if (!foamIsPhiFunction(rhs) break;
-
-				/* Rename the first argument */
-				index = rhs->foamBCall.argv[j]->foamLoc.index;
-				nindex = car(stack[index]);
-				foamFree(rhs->foamBCall.argv[j]);
-				rhs->foamBCall.argv[j] = foamNewLoc(nindex);
-			});
-
-			/* Our bb cannot be another entry to succ so stop */
-			break;
+
+	/* (CEnv x) where x is a copy of (Clos env prog) is env. */
+	if (foldCopies && foamTag(foam) == FOAM_CEnv &&
+	    foamTag(foam->foamCEnv.env) == FOAM_Loc) {
+		AInt	name = cur[foam->foamCEnv.env->foamLoc.index];
+		Foam	def  = ssa->defs[name], env;
+
+		if (def && foamTag(def->foamSet.rhs) == FOAM_Clos) {
+			env = def->foamSet.rhs->foamClos.env;
+			if (ssaIsCurrent(ssa, env, cur)) {
+				foamFree(foam);
+				ssa->copies += 1;
+				if (stmt && foamTag(env) == FOAM_Loc)
+					ssaAddUse(ssa, env->foamLoc.index,
+						  stmt, n);
+				return foamCopy(env);
+			}
 		}
-		
 	}
 
-	/* We are walking the dominator tree */
-	for (nodes = ssa->dtree[n]; nodes; nodes = cdr(nodes)) {
-		AInt	x = car(nodes);
-		ssaRename(ssa, x, stack, fmts);
+	foamIter(foam, argp, {
+		*argp = ssaRenameExp(ssa, *argp, stmt, n, cur, foldCopies);
+	});
+	return foam;
+}
+
+/*
+ * If name is defined by a copy (Set name src) or (Set name (Cast t src))
+ * whose source still has the same value, return a new copy of the rhs.
+ */
+local Foam
+ssaFoldCopy(SSA ssa, AInt name, AInt *cur)
+{
+	Foam	def = ssa->defs[name], rhs, src;
+
+	if (!def || foamTag(def->foamSet.lhs) != FOAM_Loc) return NULL;
+
+	rhs = src = def->foamSet.rhs;
+	if (foamTag(rhs) == FOAM_Cast) {
+		/* Casts to SFlo are conversions */
+		if (rhs->foamCast.type == FOAM_SFlo) return NULL;
+		src = rhs->foamCast.expr;
 	}
+	if (foamTag(src) != FOAM_Loc && foamTag(src) != FOAM_Par)
+		return NULL;
+	if (!ssaIsCurrent(ssa, src, cur)) return NULL;
+
+	return foamCopy(rhs);
+}
 
-	/* Go back to the previous reaching definitions */
-	for (; done; done = listFreeCons(AInt)(done)) {
-		AInt	locno = car(done);
-		stack[locno] = cdr(stack[locno]);
+/*
+ * Is foam (a renamed Loc, a Par or an Env) unchanged since the point at
+ * which it was used in a definition?
+ */
+local Bool
+ssaIsCurrent(SSA ssa, Foam foam, AInt *cur)
+{
+	switch (foamTag(foam)) {
+	  case FOAM_Loc: {
+		AInt	name = foam->foamLoc.index;
+		return cur[ssa->orig[name]] == name;
+	  }
+	  case FOAM_Par:
+		return !ssaParSet[foam->foamPar.index];
+	  case FOAM_Env:
+		return true;
+	  default:
+		return false;
 	}
 }
 
+
 /*****************************************************************************
  *
- * :: FoamUses functions
+ * :: Translation back from SSA
  *
  ****************************************************************************/
 
-FoamUses
-fuNew(Foam *foamp)
+local void
+ssaRestoreExp(SSA ssa, Foam foam)
 {
-	FoamUses result = (FoamUses)SSA_ALLOC(sizeof(*result));
-	fuData(result) = foamp;
-	fuPrevious(result) = fuNext(result) = fuEmpty();
-	return result;
+	if (foamTag(foam) == FOAM_Loc) {
+		foam->foamLoc.index = ssa->orig[foam->foamLoc.index];
+		return;
+	}
+	foamIter(foam, argp, ssaRestoreExp(ssa, *argp));
 }
 
-void
-fuDestroy(FoamUses fu)
+local void
+ssaRestoreBlock(SSA ssa, BBlock bb)
 {
-	FoamUses p = fuNext(fu);
-	/* Destroy everything after fu */
-	while (p) {
-		FoamUses next = fuNext(p);
-		fuFree(p);
-		p = next;
-	}
-	/* Destroy everything before fu */
-	p = fuPrevious(fu);
-	while (p) {
-		FoamUses prev = fuPrevious(p);
-		fuFree(p);
-		p = prev;
+	Foam	code = bb->code, ncode;
+	AInt	k, c, drop = 0;
+
+	for (k = 0; k < foamArgc(code); k++) {
+		Foam	stmt = code->foamSeq.argv[k];
+
+		ssaRestoreExp(ssa, stmt);
+		if (foamIsPhiStmt(stmt) ||
+		    (ssaIsStmtDef(stmt) &&
+		     foamTag(stmt->foamSet.lhs) == FOAM_Loc &&
+		     foamEqual(stmt->foamSet.lhs, stmt->foamSet.rhs))) {
+			foamFree(stmt);
+			code->foamSeq.argv[k] = NULL;
+			drop++;
+		}
 	}
-	/* Destroy fu and return */
-	fuFree(fu);
+	if (!drop) return;
+
+	ncode = foamNewEmpty(FOAM_Seq, foamArgc(code) - drop);
+	for (k = c = 0; k < foamArgc(code); k++)
+		if (code->foamSeq.argv[k])
+			ncode->foamSeq.argv[c++] = code->foamSeq.argv[k];
+	foamFreeNode(code);
+	bb->code = ncode;
 }
 
+
+/*****************************************************************************
+ *
+ * :: FoamUses functions
+ *
+ ****************************************************************************/
+
 FoamUses
-fuInsertBefore(FoamUses fu, Foam *foamp)
+fuNew(Foam stmt, AInt block, FoamUses next)
 {
-	FoamUses result = fuNew(foamp);
-	if (fu) {
-		fuPrevious(result) = fuPrevious(fu);
-		fuNext(result) = fu;
-		if (fuPrevious(fu)) fuNext(fuPrevious(fu)) = result;
-		fuPrevious(fu) = result;
-	}
+	FoamUses result = (FoamUses) SSA_ALLOC(sizeof(*result));
+	fuStmt(result)	= stmt;
+	fuBlock(result)	= block;
+	fuNext(result)	= next;
 	return result;
 }
 
-FoamUses
-fuInsertAfter(FoamUses fu, Foam *foamp)
+void
+fuDestroy(FoamUses fu)
 {
-	FoamUses result = fuNew(foamp);
-	if (fu) {
-		fuNext(result) = fuNext(fu);
-		fuPrevious(result) = fu;
-		if (fuNext(fu)) fuPrevious(fuNext(fu)) = result;
-		fuNext(fu) = result;
+	while (fu) {
+		FoamUses next = fuNext(fu);
+		stoFree(fu);
+		fu = next;
 	}
-	return result;
 }
-
@@ -12,62 +12,85 @@
 #include "axlobs.h"
 
 /*
- * We keep a doubly-linked list of identifier uses. 
+ * For each SSA name we keep a list of the statements which use it.  Only
+ * the statements which an SSA client needs to look at again when the
+ * value of the name is refined are recorded: definitions of locals
+ * (including phi functions) and the branches which end basic blocks.
  */
 struct foamuses_struct
 {
-	Foam		*foamp;
-	FoamUses	prev, next;
+	Foam		stmt;		/* Statement using the name */
+	AInt		block;		/* Label of the block holding stmt */
+	FoamUses	next;
 };
 
 #define fuEmpty()		((FoamUses)NULL)
-#define fuFree(fu)		(stoFree(fu))
-#define fuData(fu)		(fu->foamp)
-#define fuPrevious(fu)		(fu->prev)
-#define fuNext(fu)		(fu->next)
-extern FoamUses	fuNew		(Foam *);
+#define fuStmt(fu)		((fu)->stmt)
+#define fuBlock(fu)		((fu)->block)
+#define fuNext(fu)		((fu)->next)
+extern FoamUses	fuNew		(Foam, AInt, FoamUses);
 extern void	fuDestroy	(FoamUses);
-extern FoamUses fuInsertBefore	(FoamUses, Foam *);
-extern FoamUses fuInsertAfter	(FoamUses, Foam *);
 
 /*
  * SSA form uses standard flogs organised to satisfy certain criteria (such
- * as the dominence-frontier property). Additionally we keep a table of links
- * to the definition of each local for fast use/def analysis and a table of
- * lists of links to the use of each local. Empty use-lists indicate dead
- * variables which can be removed.
+ * as the dominance-frontier property).  The locals of the prog are renamed
+ * in place: (Loc i) for i < locc is the value of local i on entry to the
+ * prog, and each definition and phi function introduces a new name whose
+ * original local is orig[n].  Additionally we keep a table of links to
+ * the definition of each name for fast use/def analysis and a table of
+ * lists of the uses of each name.
+ *
+ * Since the names are never given declarations of their own, the flog
+ * must be returned to normal form with ssaToFlog before it is used by
+ * anything else.  That is only valid if the live ranges of the names of
+ * one local do not overlap, which holds for the flog built by ssaFromFlog
+ * and for any flog whose clients have only replaced uses by constants,
+ * removed code or specialised branches.
  */
 struct ssa_struct
 {
 	FlowGraph	flog;		/* flog satisfying SSA criteria */
 	AInt		root;		/* flog entry point */
-	AInt		blockc;		/* Number of bblocks */
-	AInt		usec;		/* Number of usage lists */
-	FoamUses	*uses;		/* foamLoc usage lists */
-	VarPool		locals;		/* For easy addition of new locals */
+	AInt		blockc;		/* Number of block labels */
+	AInt		nodec;		/* Number of reachable blocks */
+	AInt		locc;		/* Number of locals in the prog */
+	AInt		namec;		/* Number of SSA names */
+	AInt		namemax;	/* Allocated size of name tables */
+	AInt		*orig;		/* Original local of each name */
+	Foam		*defs;		/* Defining statement of each name */
+	AInt		*defblock;	/* Block holding the definition */
+	FoamUses	*uses;		/* Uses of each name */
 	AInt		*idom;		/* Immediate dominator table */
 	AInt		*dfnum;		/* Depth-first numbers */
-	AInt		*semi;		/* Semi-dominator table */
-	AInt		*best;		/* Best-skipped path */
-	AInt		*ancestor;	/* Ancestor table */
-	AInt		*samedom;	/* Same dominator table */
 	AInt		*vertex;	/* Vertex table */
 	AInt		*parent;	/* Parent table */
-	AIntList	*bucketv;	/* For dominator computation */
 	AIntList	*dfrontier;	/* Dominance frontiers */
 	AIntList	*dtree;		/* Dominator tree nodes */
+	int		copies;		/* Number of copies folded */
 };
 
-extern SSA		ssaFromFlog		(FlowGraph);
+/*
+ * ssaFromFlog returns NULL for progs it cannot handle: those whose locals
+ * may be changed other than by Set and Def statements at the outermost
+ * level.  If foldCopies is true, uses of locals defined by copies are
+ * replaced by the source of the copy whenever that is still valid.
+ */
+extern SSA		ssaFromFlog		(FlowGraph, Bool foldCopies);
 extern FlowGraph	ssaToFlog		(SSA);
 
-extern	void		ssaEdgeSplit		(SSA);
 extern	void		ssaDominatorTree	(SSA, AInt);
-extern	void		ssaDominanceFrontiers	(SSA, AInt);
-extern	void		ssaInsertPhiFunctions	(SSA);
-extern	void		ssaRename		(SSA, AInt, AIntList *, AInt *);
+extern	void		ssaDominanceFrontiers	(SSA);
+extern	void		ssaInsertPhiFunctions	(SSA, Bool foldCopies);
+extern	void		ssaRename		(SSA, Bool foldCopies);
+
+#define ssaBlock(ssa, n)	flogBlock((ssa)->flog, n)
+#define ssaIsReachable(ssa, n)	((ssa)->dfnum[n] != -1)
 
 #define foamIsPhiFunction(fm) \
 	((foamTag(fm) == FOAM_BCall) && (fm->foamBCall.op == FOAM_BVal_ssaPhi))
 
+#define foamIsPhiStmt(fm) \
+	((foamTag(fm) == FOAM_Set || foamTag(fm) == FOAM_Def) && \
+	 foamIsPhiFunction((fm)->foamSet.rhs))
+
 #endif /* !_GENSSA_H_ */
@@ -61,7 +61,7 @@ CREATE_LIST(Lib);
  ****************************************************************************/
 
 static UShort		libHdrMagic		= 0420;
-static UShort		libMajorVersion		= 28;
+static UShort		libMajorVersion		= 29;
 static UShort		libMinorVersion		= 0;
 
 /*
@@ -89,17 +89,34 @@ static UShort		libMinorVersion		= 0;
 local Lib		libRegister		(String, Lib);
 local Lib		libGetRegistered	(String);
 local void		libUnRegister		(Lib);		
+local void		libCacheImage		(Lib);
+local Buffer		libTakeImage		(FileName);
 local Lib		libFrArchive		(Archive, String);
 
+/* Functions for the interface section. */
+local ULong		libHashSections		(Lib, ULong, Bool);
+local ULong		libHashExports		(Lib, ULong, Bool);
+local ULong		libHashSyme		(ULong, Syme);
+local ULong		libHashSymeList		(ULong, SymeList);
+local ULong		libHashAbSyn		(ULong, AbSyn);
+local Bool		libGetInterfaceHashes	(Lib, ULong *);
+local Bool		libHasCurrentVersion	(FileName);
+local Bool		libDependIsCurrent	(Buffer);
+local Bool		libArchiveIsCurrent	(Buffer);
+local LibList		libLoadedLibs		(Lib);
+local String		libArchiveName		(Lib);
+
 /* Functions for manipulating the library header. */
 local Lib		libNewHeader		(Lib);
 local Bool		libChkHeader		(Lib);
 local Lib		libPutHeader		(Lib);
+local void		libPutImage		(Lib, Offset, String, Length);
 
 /* Functions for manipulating library sections. */
 local Buffer		libAddSection		(Lib, LibSectName);
 local void		libPutSection		(Lib, LibSectName, Buffer);
 local Buffer		libGetSection		(Lib, LibSectName, Bool);
+local void		libFreeSection		(Lib, Buffer);
 local Bool		libHasSection		(Lib, LibSectName);
 
 local void		libPutPosTbl		(Lib);
@@ -127,7 +144,8 @@ struct _libSectInfo libSectInfoTable[] = {
 	{LIB_Doc,	"doc",    "doc"},
 	{LIB_Foreign,	"foreign","forgn"},
 	{LIB_Id,	"fileid", "id"},
-	{LIB_Macros,	"macros", "macros"}
+	{LIB_Macros,	"macros", "macros"},
+	{LIB_Interface,	"interface", "intf"}
 };
 
 Bool
@@ -180,9 +198,13 @@ libNew(FileName fname, Bool rdOnly, FILE *f, Offset pos)
 	lib->arent	= NULL;
 	lib->rdOnly	= rdOnly;
 	lib->intLoaded	= false;
+	lib->codeUsed	= false;
 	lib->idName	= NULL;
 	lib->file	= f;
 	lib->offset	= pos;
+	lib->map	= NULL;
+	lib->mapSize	= 0;
+	lib->image	= rdOnly ? NULL : bufNew();
 	lib->self	= NULL;
 
 	if (lib->rdOnly)
@@ -224,14 +246,32 @@ libExtract(FileName fname, FILE *f, Offset pos)
 Lib
 libRead(FileName fname)
 {
-	Lib lib =  libExtract(fname, fileRbOpen(fname),  (Offset) 0);
+	Buffer	image = libTakeImage(fname);
+	Lib	lib;
+
+	/* Use the contents of a library written earlier by this compiler. */
+	if (image) {
+		lib = libNew(fname, 2 | 1, NULL, (Offset) 0);
+		lib->image = image;
+		lib->map = bufChars(image);
+		lib->mapSize = bufPosition(image);
+		return libGetHeader(lib);
+	}
+
+	lib = libExtract(fname, fileRbOpen(fname),  (Offset) 0);
 	lib->rdOnly = 1;
+	lib->map = (String) osFileMap(lib->file, &lib->mapSize);
 	return lib;
 }
 
 Lib
 libWrite(FileName fname)
 {
+	/*
+	 * Write a new file rather than over the old one, which may be
+	 * mapped by libRead in this or another process.
+	 */
+	fileRemove(fname);
 	return libNew(fname, false, fileWubOpen(fname), (Offset) 0);
 }
 
@@ -269,7 +309,7 @@ local void
 libClearTypes(Lib lib)
 {
 	if (lib->typeb)
-		bufFree(lib->typeb);
+		libFreeSection(lib, lib->typeb);
 	if (lib->typev)
 		stoFree((Pointer) lib->typev);
 	if (lib->types)
@@ -292,7 +332,7 @@ libClearFoam(Lib lib)
 	int	i;
 
 	if (lib->unitb) {
-		bufFree(lib->unitb);
+		libFreeSection(lib, lib->unitb);
 
 		if (lib->formats)
 			foamFree(lib->formats);
@@ -332,8 +372,10 @@ libClose(Lib lib)
 {
 	if (lib->rdOnly)
 		stabFree(lib->stab);
-	else
+	else {
 		libPutHeader(lib);
+		libCacheImage(lib);
+	}
 
 	if (!(lib->rdOnly & 2)) fclose(lib->file);	
 	libUnRegister(lib);
@@ -344,6 +386,11 @@ libClose(Lib lib)
 	libClearFoam(lib);
 	libClearPos(lib);
 
+	if (lib->map && !(lib->rdOnly & 2))
+		osFileUnmap((Pointer) lib->map, lib->mapSize);
+	if (lib->image)
+		bufFree(lib->image);
+
 	stoFree((Pointer) lib);
 }
 
@@ -398,6 +445,112 @@ libUnRegister(Lib lib)
 	tblDrop(libLibTbl, name);
 }
 
+/*
+ * Give each registered library read from a file of its own a fresh open
+ * file (see arReopenFiles).  Libraries in archives share the archive's.
+ */
+void
+libReopenFiles(void)
+{
+	TableIterator	it;
+	Lib		lib;
+
+	if (!libLibTbl) return;
+
+	for (tblITER(it, libLibTbl); tblMORE(it); tblSTEP(it)) {
+		lib = (Lib) tblELT(it);
+		if (lib && lib->rdOnly && !(lib->rdOnly & 2))
+			fileReopen(lib->file, lib->name, osIoRbMode);
+	}
+}
+
+/*
+ * A read cache of the libraries written by this compiler, by file name.
+ * The first libRead of such a file, for example to compile a file which
+ * imports one compiled earlier on the same command line, takes the
+ * contents from here rather than reading the file back.  The library
+ * read then owns them and frees them when it is closed, so each image
+ * is held only until its library has been opened.  Images which are
+ * never read are dropped, oldest first, once there are more than
+ * LIB_IMAGE_MAX bytes of them: such files are then read from disk.
+ */
+#define		LIB_IMAGE_MAX	(16L * 1024 * 1024)
+
+typedef struct libImage {
+	String		 name;
+	Buffer		 image;
+	struct libImage	*prev, *next;	/* From the oldest to the newest. */
+} *LibImage;
+
+static Table	libImageTbl;
+static LibImage	libImageOldest, libImageNewest;
+static ULong	libImageBytes;
+
+/*
+ * Remove an image from the cache, returning its contents.
+ */
+local Buffer
+libImageUnlink(LibImage li)
+{
+	Buffer	image = li->image;
+
+	tblDrop(libImageTbl, (TblKey) li->name);
+
+	if (li->prev) li->prev->next = li->next; else libImageOldest = li->next;
+	if (li->next) li->next->prev = li->prev; else libImageNewest = li->prev;
+	libImageBytes -= bufPosition(image);
+
+	strFree(li->name);
+	stoFree((Pointer) li);
+	return image;
+}
+
+local void
+libCacheImage(Lib lib)
+{
+	LibImage	li;
+	Buffer		old;
+
+	if (libImageTbl == NULL)
+		libImageTbl = tblNew((TblHashFun) strHash, (TblEqFun) strEqual);
+
+	/* A file written again replaces its image. */
+	old = libTakeImage(lib->name);
+	if (old) bufFree(old);
+
+	li = (LibImage) stoAlloc(OB_Other, sizeof(*li));
+	li->name  = strCopy(fnameUnparseStatic(lib->name));
+	li->image = lib->image;
+	li->prev  = libImageNewest;
+	li->next  = NULL;
+	if (libImageNewest)
+		libImageNewest->next = li;
+	else
+		libImageOldest = li;
+	libImageNewest = li;
+	libImageBytes += bufPosition(li->image);
+
+	tblSetElt(libImageTbl, (TblKey) li->name, (TblElt) li);
+	lib->image = NULL;
+
+	while (libImageBytes > LIB_IMAGE_MAX && libImageOldest != li)
+		bufFree(libImageUnlink(libImageOldest));
+}
+
+local Buffer
+libTakeImage(FileName fname)
+{
+	LibImage	li;
+
+	if (libImageTbl == NULL)
+		return NULL;
+
+	li = (LibImage) tblElt(libImageTbl,
+			       (TblKey) fnameUnparseStatic(fname), (TblElt) NULL);
+
+	return li ? libImageUnlink(li) : NULL;
+}
+
 Lib
 libFrString(String name)
 {
@@ -497,28 +650,51 @@ libSymeTypeNo(Lib lib, Symbol sym, Hash code)
 	return TYPE_NUMBER_UNASSIGNED;
 }
 
+/*
+ * The syme for sym among the symes read from lib, or NULL.
+ */
 local Syme
-libSymeSyme(Lib nlib, Lib lib, Symbol sym, Hash code)
+libSymeFind(Lib lib, Symbol sym, Hash code)
 {
 	UShort		i;
-	Syme		syme = NULL;
-	SymeList	symes;
 
 	if (lib->codev) {
 		i = libSymeIndex(lib, sym, code);
-		if (i < lib->symec)
-			syme = lib->symev[i];
-		else {
-			comsgFatal(NULL, ALDOR_F_LibOutOfDate,
-				   libToStringShort(lib),
-				   libToStringShort(nlib));
-			return syme;
-		}
+		return i < lib->symec ? lib->symev[i] : NULL;
 	}
-	else if (lib->symes) {
-		for (i = 0; i < lib->topc && !syme; i += 1)
+
+	if (lib->symes)
+		for (i = 0; i < lib->topc; i += 1)
 			if (libSymeMatch(lib, sym, code, lib->symev[i]))
-				syme = lib->symev[i];
+				return lib->symev[i];
+
+	return NULL;
+}
+
+local Syme
+libSymeSyme(Lib nlib, Lib lib, Symbol sym, Hash code)
+{
+	Syme		syme;
+	SymeList	symes;
+	Lib		xlib;
+
+	syme = libSymeFind(lib, sym, code);
+
+	/*
+	 * The index of an archive names the member exporting a constructor,
+	 * even one which has moved since nlib was compiled.
+	 */
+	if (!syme && lib->arent &&
+	    (xlib = arFindExport(lib->arent->ar, sym, code)) && xlib != lib) {
+		lib  = xlib;
+		syme = libSymeFind(lib, sym, code);
+	}
+
+	if (!syme && lib->codev) {
+		comsgFatal(NULL, ALDOR_F_LibOutOfDate,
+			   libToStringShort(lib),
+			   libToStringShort(nlib));
+		return syme;
 	}
 
 	for (symes = lib->triggers; symes && !syme; symes = cdr(symes))
@@ -755,11 +931,24 @@ libPutHeader(Lib lib)
 
 	LIB_SEEK(lib, long0);
 	FILE_PUT_CHARS(lib->file, bufChars(buf), bufPosition(buf));
+	libPutImage(lib, long0, bufChars(buf), bufPosition(buf));
 	bufFree(buf);
 
 	return lib;
 }
 
+/* Copy what is written at pos in lib->file to lib->image. */
+local void
+libPutImage(Lib lib, Offset pos, String s, Length cc)
+{
+	Buffer	image = lib->image;
+
+	bufNeed(image, pos + cc);
+	memcpy(bufChars(image) + pos, s, cc);
+	if (bufPosition(image) < pos + cc)
+		bufSetPosition(image, pos + cc);
+}
+
 Lib
 libGetHeader(Lib lib)
 {
@@ -768,10 +957,14 @@ libGetHeader(Lib lib)
 	Offset	cc;
 	String	s;
 
-	LIB_SEEK(lib, long0);
 	cc = libHdrSize;
-	s = strAlloc(cc);
-	FILE_GET_CHARS(lib->file, s, cc);
+	if (lib->map)
+		s = lib->map + lib->offset;
+	else {
+		LIB_SEEK(lib, long0);
+		s = strAlloc(cc);
+		FILE_GET_CHARS(lib->file, s, cc);
+	}
 	buf = bufCapture(s, cc);
 
 	lib->hdr.magic = bufGetHInt(buf);
@@ -794,6 +987,7 @@ libGetHeader(Lib lib)
 		if( n < LIB_NAME_LIMIT )
 			libNameIndex(lib, n) = i;
 	}
+	if (lib->map) bufLiberate(buf);
 
 	libChkHeader(lib);
 	return lib;
@@ -849,6 +1043,7 @@ libPutSection(Lib lib, LibSectName name, Buffer buf)
 
 	LIB_SEEK(lib, libSectOffset(lib, name));
 	FILE_PUT_CHARS(lib->file, bufChars(buf), cc);
+	libPutImage(lib, libSectOffset(lib, name), bufChars(buf), cc);
 	libSectLength(lib, name) = cc;
 	bufFree(buf);
 
@@ -856,11 +1051,19 @@ libPutSection(Lib lib, LibSectName name, Buffer buf)
 }
 
 static Buffer	LibStaticSectBuffer = 0;
+static Buffer	LibStaticSectView   = 0;
 
+/*
+ * Return a buffer with the named section, or 0 if there is none.
+ * If the library file is mapped, the buffer is a view of the mapping and
+ * nothing is read or copied.  Otherwise the section is read into a new
+ * string, or into a shared one if "stat" is true.  Buffers got with stat
+ * are only good until the next such call; others go to libFreeSection.
+ */
 local Buffer
 libGetSection(Lib lib, LibSectName name, Bool stat)
 {
-	Offset	cc;
+	Offset	pos, cc;
 	String	s;
 	Buffer	buf;
 
@@ -869,13 +1072,23 @@ libGetSection(Lib lib, LibSectName name, Bool stat)
 	libVerboseDEBUG(dbOut, "Getting %s section \"%s\":\t", 
 			FTYPE_INTERMED, libSectInfo(name).str);
 
-	/* Seek to the beginning of the section. */
-	LIB_SEEK(lib, libSectOffset(lib, name));
+	pos = lib->offset + libSectOffset(lib, name);
 
 	/* Read the number of bytes in the section. */
 	cc = libSectLength(lib, name);
 	libVerboseDEBUG(dbOut, "%12ld bytes\n", cc);
 
+	if (lib->map && pos + cc <= lib->mapSize) {
+		s = lib->map + pos;
+		if (!stat)
+			return bufCapture(s, cc);
+		if (LibStaticSectView == 0)
+			LibStaticSectView = bufCapture(s, cc);
+		else
+			bufRecapture(LibStaticSectView, s, cc);
+		return LibStaticSectView;
+	}
+
 	if (stat) {
 		if (LibStaticSectBuffer == 0)
 			LibStaticSectBuffer = bufNew();
@@ -889,17 +1102,326 @@ libGetSection(Lib lib, LibSectName name, Bool stat)
 		buf = bufCapture(s, cc);
 	}
 
+	/* Seek to the beginning of the section. */
+	LIB_SEEK(lib, libSectOffset(lib, name));
 	FILE_GET_CHARS(lib->file, s, cc);
 	bufStart(buf);
 	return buf;
 }
 
+/* Free a buffer from libGetSection(lib, name, false). */
+local void
+libFreeSection(Lib lib, Buffer buf)
+{
+	String	s = bufChars(buf);
+
+	if (lib->map && s >= lib->map && s < lib->map + lib->mapSize)
+		bufLiberate(buf);
+	else
+		bufFree(buf);
+}
+
 local Bool
 libHasSection(Lib lib, LibSectName name)
 {
 	return libSectOffset(lib, name) != 0;
 }
 
+/*
+ * Continue the hash h (see hashBytes) over the interface of lib, which a
+ * client compiled against it depends on.  If "withCode" is true the foam
+ * is included too, for clients which may inline from it.  Libraries
+ * without an interface section are hashed over their raw sections, which
+ * also change when only a body does.
+ */
+ULong
+libHashInterface(Lib lib, ULong h, Bool withCode)
+{
+	ULong	hv[2];
+
+	if (libGetInterfaceHashes(lib, hv))
+		return hashBytes(h, &hv[withCode ? 1 : 0], sizeof(ULong));
+	return libHashSections(lib, h, withCode);
+}
+
+local ULong
+libHashSections(Lib lib, ULong h, Bool withCode)
+{
+	static LibSectName sectv[] = {
+		LIB_Id, LIB_Name, LIB_Kind, LIB_Lazy, LIB_Syme, LIB_Type,
+		LIB_Inline, LIB_Twins, LIB_Extend, LIB_Foreign, LIB_Macros,
+		LIB_FoamSyme, LIB_Foam
+	};
+	int	i, n = sizeof(sectv) / sizeof(sectv[0]);
+	Buffer	buf;
+
+	if (!withCode) n -= 2;
+
+	for (i = 0; i < n; i++) {
+		buf = libGetSection(lib, sectv[i], true);
+		if (!buf) continue;
+		h = hashBytes(h, &sectv[i], sizeof(sectv[i]));
+		h = hashBytes(h, bufChars(buf), libSectLength(lib, sectv[i]));
+	}
+	return h;
+}
+
+/*****************************************************************************
+ *
+ * :: Layout of interface section
+ *
+ ****************************************************************************/
+
+/*
+ * The interface section is written for incremental compilation only.  It
+ * holds the hashes of the interface of the library, without and with its
+ * foam (see libHashExports), so that clients need not compute them.
+ * It also holds the hash of the source the library was compiled from, the
+ * interface hashes of the libraries loaded to compile it, and the hashes
+ * of the member lists of the archives it was compiled against.
+ * libIsUpToDate compares these with those of the files there now.
+ *
+ * The section has a slot in the fixed header of every library, so adding
+ * it changed the header size and the format went from version 28 to 29.
+ * Within version 29 the section may be missing: libraries compiled without
+ * -W incremental have none, and are read as before.
+ */
+
+local void
+libPutHash(Buffer buf, ULong h)
+{
+	bufPutSInt(buf, (h >> 16) >> 16);
+	bufPutSInt(buf, h);
+}
+
+local ULong
+libGetHash(Buffer buf)
+{
+	ULong	h = bufGetSInt(buf);
+
+	return ((h << 16) << 16) | bufGetSInt(buf);
+}
+
+void
+libPutInterface(Lib lib, ULong srcHash)
+{
+	ULong		h0, h1;
+	LibList		libs, l;
+	PathList	al;
+	Archive		ar;
+	Buffer		buf;
+	Lib		dep;
+	int		n;
+
+	h0  = libHashExports(lib, HASH_BYTES_INIT, false);
+	h1  = libHashExports(lib, HASH_BYTES_INIT, true);
+	buf = libAddSection(lib, LIB_Interface);
+	if (!buf) return;
+
+	libPutHash(buf, h0);
+	libPutHash(buf, h1);
+	bufPutByte(buf, true);
+
+	libPutHash(buf, srcHash);
+
+	libs = libLoadedLibs(lib);
+	bufPutHInt(buf, listLength(Lib)(libs));
+	for (l = libs; l; l = cdr(l)) {
+		dep = car(l);
+		if (dep->arent) {
+			bufWrString(buf, libArchiveName(dep));
+			bufWrString(buf, dep->arent->name);
+		}
+		else {
+			bufWrString(buf, "");
+			bufWrString(buf, fnameUnparseStatic(dep->name));
+		}
+		bufPutByte(buf, dep->codeUsed);
+		libPutHash(buf, libHashInterface(dep, HASH_BYTES_INIT,
+						 dep->codeUsed));
+	}
+	listFree(Lib)(libs);
+
+	for (n = 0, al = arLibraryFiles(); al; al = cdr(al)) n++;
+	bufPutHInt(buf, n);
+	for (al = arLibraryFiles(); al; al = cdr(al)) {
+		ar = arFrString(car(al));
+		bufWrString(buf, car(al));
+		libPutHash(buf, ar ? arHashMembers(ar, HASH_BYTES_INIT) : 0);
+	}
+	libPutSection(lib, LIB_Interface, buf);
+}
+
+/*
+ * Is fname a library written with dependency information, for a source
+ * with hash srcHash, whose libraries and archives have not changed?
+ */
+Bool
+libIsUpToDate(FileName fname, ULong srcHash)
+{
+	Lib	lib;
+	Buffer	buf;
+	Bool	ok = false;
+	int	i, n;
+
+	if (!libHasCurrentVersion(fname)) return false;
+
+	lib = libRead(fname);
+	buf = libGetSection(lib, LIB_Interface, false);
+
+	if (buf) {
+		libGetHash(buf);
+		libGetHash(buf);
+		ok = bufGetByte(buf) && libGetHash(buf) == srcHash;
+	}
+	if (ok) {
+		n = bufGetHInt(buf);
+		for (i = 0; ok && i < n; i++)
+			ok = libDependIsCurrent(buf);
+	}
+	if (ok) {
+		n = bufGetHInt(buf);
+		for (i = 0; ok && i < n; i++)
+			ok = libArchiveIsCurrent(buf);
+	}
+
+	if (buf) libFreeSection(lib, buf);
+	libClose(lib);
+	return ok;
+}
+
+local Bool
+libGetInterfaceHashes(Lib lib, ULong *hv)
+{
+	Buffer	buf = libGetSection(lib, LIB_Interface, true);
+
+	if (!buf) return false;
+
+	hv[0] = libGetHash(buf);
+	hv[1] = libGetHash(buf);
+	return true;
+}
+
+/*
+ * Does fname start with the header of a library of this version, which
+ * libRead would not reject?
+ */
+local Bool
+libHasCurrentVersion(FileName fname)
+{
+	char	s[HINT_BYTES + 2 * SINT_BYTES];
+	FILE	*fin;
+	Buffer	buf;
+	Bool	ok;
+
+	if (!fileIsReadable(fname)) return false;
+
+	fin = fileRbOpen(fname);
+	ok  = fread(s, 1, sizeof(s), fin) == sizeof(s);
+	fclose(fin);
+	if (!ok) return false;
+
+	buf = bufCapture(s, sizeof(s));
+	ok  = bufGetHInt(buf) == libHdrMagic &&
+	      bufGetSInt(buf) == libMajorVersion &&
+	      bufGetSInt(buf) == libMinorVersion;
+	bufLiberate(buf);
+
+	return ok;
+}
+
+local Bool
+libDependIsCurrent(Buffer buf)
+{
+	String		arName = bufRdString(buf), name = bufRdString(buf);
+	Bool		code   = bufGetByte(buf);
+	ULong		h      = libGetHash(buf);
+	Bool		ok     = false;
+	FileName	fn;
+	PathList	path;
+	Lib		lib;
+
+	if (*arName) {
+		/* The member need not have been read yet. */
+		path = listCons(String)(arName, listNil(String));
+		lib  = arFind(path, name);
+		ok   = lib && libHashInterface(lib, HASH_BYTES_INIT, code) == h;
+		listFree(String)(path);
+	}
+	else {
+		fn = fnameParse(name);
+		if (libHasCurrentVersion(fn)) {
+			lib = libRead(fn);
+			ok  = libHashInterface(lib, HASH_BYTES_INIT, code) == h;
+			libClose(lib);
+		}
+		fnameFree(fn);
+	}
+
+	strFree(arName);
+	strFree(name);
+	return ok;
+}
+
+local Bool
+libArchiveIsCurrent(Buffer buf)
+{
+	String	name = bufRdString(buf);
+	ULong	h    = libGetHash(buf);
+	Archive	ar   = arFrString(name);
+	Bool	ok   = ar && arHashMembers(ar, HASH_BYTES_INIT) == h;
+
+	strFree(name);
+	return ok;
+}
+
+/*
+ * The libraries which the unit being written to lib may depend on: those
+ * loaded so far by this compiler.
+ */
+local LibList
+libLoadedLibs(Lib self)
+{
+	LibList		libs = listNil(Lib), l, loaded;
+	TableIterator	it;
+	PathList	al;
+	Archive		ar;
+
+	if (libLibTbl)
+		for (tblITER(it, libLibTbl); tblMORE(it); tblSTEP(it))
+			libs = listCons(Lib)((Lib) tblELT(it), libs);
+
+	for (al = arLibraryFiles(); al; al = cdr(al))
+		if ((ar = arFrString(car(al))) != 0)
+			libs = listNConcat(Lib)(arGetLoadedLibs(ar), libs);
+
+	libs = listNConcat(Lib)(libGetDependencies(self), libs);
+
+	for (loaded = listNil(Lib), l = libs; l; l = cdr(l)) {
+		Lib	lib = car(l);
+		if (lib && lib != self && lib->rdOnly &&
+		    !listMemq(Lib)(loaded, lib))
+			loaded = listCons(Lib)(lib, loaded);
+	}
+	listFree(Lib)(libs);
+
+	return listNReverse(Lib)(loaded);
+}
+
+/* The name by which the archive holding lib was given to the compiler. */
+local String
+libArchiveName(Lib lib)
+{
+	Archive		ar = lib->arent->ar;
+	PathList	al;
+
+	for (al = arLibraryFiles(); al; al = cdr(al))
+		if (arFrString(car(al)) == ar)
+			return car(al);
+
+	return fnameUnparseStatic(ar->name);
+}
+
 /*****************************************************************************
  *
  * :: Layout of id section
@@ -1029,6 +1551,92 @@ libSymeWasLocal(Lib lib, Syme syme)
 	return symeLib(syme) == NULL || symeLib(syme) == lib;
 }
 
+/*
+ * Continue the hash h over what clients of lib, which is being written,
+ * are compiled against: the name, kind, type and conditions of each syme
+ * it exports at the top level, the symes extended by them, and the
+ * macros.  With "withCode", the symes inlined into each local syme and
+ * the foam are included too.  Symes are hashed by name and type code, and
+ * types by their expressions, so the numbers given to symes and types in
+ * the library, which change with the imports of the bodies, do not count.
+ */
+local ULong
+libHashExports(Lib lib, ULong h, Bool withCode)
+{
+	static LibSectName sectv[] = { LIB_Macros, LIB_FoamSyme, LIB_Foam };
+	int	i, n = sizeof(sectv) / sizeof(sectv[0]);
+	UByte	b;
+	Buffer	buf;
+
+	for (i = 0; i < lib->topc; i += 1) {
+		Syme	syme = lib->symev[i];
+
+		if (!libSymeIsLocal(lib, syme)) continue;
+
+		h = libHashSyme(h, syme);
+		b = (symeIsSpecial(syme) ? LIB_SPECIAL_MASK : 0) |
+		    (symeHasDefault(symeOriginal(syme)) ? LIB_DEF_MASK : 0);
+		h = hashBytes(h, &b, sizeof(b));
+
+		if (!symeIsSelf(syme))
+			h = libHashAbSyn(h, tfExpr(symeType(syme)));
+
+		listIter(Sefo, cond, symeCondition(syme), {
+			h = libHashAbSyn(h, cond);
+		});
+
+		if (symeIsExtend(syme))
+			h = libHashSymeList(h, symeExtendee(syme));
+	}
+
+	for (i = 0; withCode && i < lib->symec; i += 1) {
+		Syme	syme = lib->symev[i];
+
+		if (libSymeIsLocal(lib, syme) && symeInlined(syme)) {
+			h = libHashSyme(h, syme);
+			h = libHashSymeList(h, symeInlined(syme));
+		}
+	}
+
+	if (!withCode) n = 1;
+
+	for (i = 0; i < n; i++) {
+		buf = libGetSection(lib, sectv[i], true);
+		if (!buf) continue;
+		h = hashBytes(h, &sectv[i], sizeof(sectv[i]));
+		h = hashBytes(h, bufChars(buf), libSectLength(lib, sectv[i]));
+	}
+	return h;
+}
+
+local ULong
+libHashSyme(ULong h, Syme syme)
+{
+	String	s = symeString(syme);
+	UByte	kind = (UByte) symeKind(syme);
+	Hash	code = symeTypeCode(syme);
+
+	h = hashBytes(h, s, strLength(s) + 1);
+	h = hashBytes(h, &kind, sizeof(kind));
+	return hashBytes(h, &code, sizeof(code));
+}
+
+local ULong
+libHashSymeList(ULong h, SymeList symes)
+{
+	for (; symes; symes = cdr(symes))
+		h = libHashSyme(h, car(symes));
+	return h;
+}
+
+local ULong
+libHashAbSyn(ULong h, AbSyn ab)
+{
+	Hash	code = abHash(ab);
+
+	return hashBytes(h, &code, sizeof(code));
+}
+
 /*****************************************************************************
  *
  * :: libRepSymes
@@ -2947,6 +3555,71 @@ libGetSymeType(Lib lib, int num)
 	return lib->typev[num];
 }
 
+/*
+ * Find the names and hash codes of the symes which lib exports at the
+ * top level, its constructors, from the name, kind and syme sections
+ * alone.  Return their number; the vectors are freed by the caller.
+ */
+Length
+libGetTopExports(Lib lib, Symbol **psyms, Hash **pcodes)
+{
+	UShort	i, n, symec, topc;
+	Symbol	*syms;
+	Hash	*codes;
+	UByte	*isLocal;
+	Buffer	buf;
+
+	buf   = libGetSection(lib, LIB_Name, true);
+	symec = bufGetHInt(buf);
+	topc  = bufGetHInt(buf);
+	syms  = (Symbol *) stoAlloc(OB_Other, (topc + 1) * sizeof(Symbol));
+	codes = (Hash *)   stoAlloc(OB_Other, (topc + 1) * sizeof(Hash));
+	isLocal = (UByte *) stoAlloc(OB_Other, topc + 1);
+
+	/* Later symes with the name of an earlier one give its position. */
+	for (i = 0; i < topc; i += 1)
+		syms[i] = (Symbol) (ULong) i;
+	for (libGetSymeIndex(buf, i); i < symec; libGetSymeIndex(buf, i)) {
+		n = bufGetHInt(buf);
+		if (i < topc) syms[i] = (Symbol) (ULong) n;
+	}
+	for (i = 0; i < topc; i += 1) {
+		UShort	pos = (UShort) (ULong) syms[i];
+		String	name;
+
+		if (pos < i)
+			syms[i] = syms[pos];
+		else {
+			name = bufGetString(buf);
+			syms[i] = symIntern(name);
+			strFree(name);
+		}
+	}
+
+	buf = libGetSection(lib, LIB_Kind, true);
+	for (i = 0; i < topc; i += 1)
+		isLocal[i] = bufGetByte(buf) != (UByte) SYME_LIMIT;
+
+	buf = libGetSection(lib, LIB_Syme, true);
+	for (i = n = 0; i < topc; i += 1) {
+		UByte	b = bufGetByte(buf);
+		Hash	code = bufGetSInt(buf);
+
+		bufSkip(buf, 3*SINT_BYTES + 3*HINT_BYTES);
+		if (isLocal[i] && (b & LIB_TOP_MASK) &&
+		    (b & ~LIB_BITS_MASK) == (UByte) SYME_Export) {
+			syms[n]  = syms[i];
+			codes[n] = code;
+			n += 1;
+		}
+	}
+
+	stoFree((Pointer) isLocal);
+	*psyms  = syms;
+	*pcodes = codes;
+	return n;
+}
+
 /*****************************************************************************
  *
  * :: Layout of foam section
@@ -3110,7 +3783,7 @@ libGetFoam(Lib lib)
 
 	if (lib->unitb) {
 		lib->unit = foamFrBuffer(lib->unitb);
-		bufFree(lib->unitb);
+		libFreeSection(lib, lib->unitb);
 		lib->unitb = 0;
 	}
 	if (lib->postbl == NULL) libGetPosTbl(lib);
@@ -3212,6 +3885,7 @@ libGetFoamConstant(Lib lib, int num)
 	if (!(0 <= num && num < lib->constc))
 		return 0;
 
+	lib->codeUsed = true;
 	if (lib->unitb && lib->constv[num] == 0)
 		lib->constv[num] =
 			foamConstFrBuffer(lib->unitb, lib->constp[num]);
@@ -3229,6 +3903,7 @@ libGetProgHdr(Lib lib, int num)
 	if (!(0 <= num && num < lib->constc))
 		return 0;
 
+	lib->codeUsed = true;
 	if (lib->unitb && lib->constv[num] == 0)
 		return foamGetProgHdrFrBuffer(lib->unitb, lib->constp[num]);
 	else {
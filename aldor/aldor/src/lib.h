@@ -43,6 +43,7 @@ enum libSectName {
 	LIB_Foreign,			/* ForeignOrigin table. */
 	LIB_Id,				/* Name of the library. */
         LIB_Macros,			/* Macros exported */
+	LIB_Interface,			/* Interface and dependency hashes. */
     LIB_NAME_LIMIT
 };
 
@@ -101,9 +102,13 @@ struct lib {
 	ArEntry		arent;
 	BPack(Bool)	rdOnly;
 	BPack(Bool)	intLoaded;	/* Already loaded by interpreter? */
+	BPack(Bool)	codeUsed;	/* Foam read by the optimiser? */
 	String		idName;		/* Name of initialiser */
 	FILE *		file;
 	Offset		offset;		/* Offset of hdr in file. */
+	String		map;		/* Mapped file contents, or 0. */
+	Length		mapSize;	/* Length of the mapped file. */
+	Buffer		image;		/* Contents written, or read from cache. */
 	Syme		self;		/* Library syme for this lib. */
 	Stab		stab;		/* Stab for symes, tforms. */
 
@@ -164,6 +169,7 @@ extern LibStats libStatsClear		(LibStats);
 extern LibStats libStatsIncrement	(LibStats, LibStats);
 
 extern  Lib	libFrString		(String);
+extern  void	libReopenFiles		(void);
 #define		libToString(lib)	fnameUnparse((lib)->name)
 #define		libToStringStatic(lib)	fnameUnparseStaticWithout((lib)->name)
 #define		libToStringShort(lib)	fnameName((lib)->name)
@@ -171,6 +177,7 @@ extern  Lib	libFrString		(String);
 extern SymeList	libPutSymes		(Lib, SymeList, Foam);
 extern SymeList	libGetSymes		(Lib);
 extern SymeList	libGetAllSymes		(Lib);
+extern Length	libGetTopExports	(Lib, Symbol **, Hash **);
 extern TForm	libGetSymeType		(Lib, int);
 extern ULong	libSymeTypeNo		(Lib, Symbol, Hash);
 extern Syme	libLibrarySyme		(Lib);
@@ -193,6 +200,9 @@ extern AbSyn	libGetMacros		(Lib);
 extern void	libPutFileId		(Lib, String);
 extern String	libGetFileId		(Lib);
 extern Lib	libGetHeader		(Lib);
+extern ULong	libHashInterface	(Lib, ULong, Bool);
+extern void	libPutInterface		(Lib, ULong);
+extern Bool	libIsUpToDate		(FileName, ULong);
 extern void	libGetFoamUnitBuffer	(Lib);
 extern void	libGetUnitBuffer	(Lib);
 
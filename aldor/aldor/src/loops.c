@@ -647,6 +647,7 @@ lpLoopFree(Loop loop)
 {
 	listFree(BBlock)(loop->blockList);
 	bitvFree(loop->blockSet);
+	bitvClassDestroy(loop->bitvClass);
 
 	stoFree(loop);
 }
@@ -100,20 +100,48 @@ cfoldDefs(Foam defs)
 local void
 cfoldProg(Foam prog)
 {	
-	int	i;
-	Foam	body = prog->foamProg.body;
 	assert(foamTag(prog) == FOAM_Prog);
-	assert(foamTag(body) == FOAM_Seq);
-	cfoldProgram = prog;
-	cfoldChanged = false;
-	for(i=0; i<foamArgc(body); i++)
-		body->foamSeq.argv[i] = cfoldExpr(body->foamSeq.argv[i]);
-	if (cfoldChanged) {
+	assert(foamTag(prog->foamProg.body) == FOAM_Seq);
+	if (!optIsCFoldPending(prog)) return;
+	optResetCFoldPending(prog);
+	if (cfoldProgBody(cfoldFormats, prog, cfoldFoldAll, cfoldFoldFloat)) {
 		optSetPeepPending(prog);
 		optSetCPropPending(prog);
 	}
 }
 
+/*
+ * Fold a single expression of prog, or every statement of prog, for
+ * passes which do their own traversal.  The formats are those of the
+ * unit containing prog.
+ */
+Foam
+cfoldProgExpr(Foam formats, Foam prog, Foam expr, Bool foldAll,
+	      Bool foldFloat)
+{
+	cfoldFoldFloat = foldFloat;
+	cfoldFoldAll   = foldAll;
+	cfoldFormats   = formats;
+	cfoldProgram   = prog;
+	return cfoldExpr(expr);
+}
+
+Bool
+cfoldProgBody(Foam formats, Foam prog, Bool foldAll, Bool foldFloat)
+{
+	Foam	body = prog->foamProg.body;
+	int	i;
+
+	cfoldFoldFloat = foldFloat;
+	cfoldFoldAll   = foldAll;
+	cfoldFormats   = formats;
+	cfoldProgram   = prog;
+	cfoldChanged   = false;
+	for(i=0; i<foamArgc(body); i++)
+		body->foamSeq.argv[i] = cfoldExpr(body->foamSeq.argv[i]);
+	return cfoldChanged;
+}
+
 local Foam
 cfoldExpr(Foam expr)
 {
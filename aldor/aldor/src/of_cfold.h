@@ -13,5 +13,7 @@
 #include "foam_c.h" /* For fiType*() calls */
 
 extern Bool     	cfoldUnit	    	(Foam, Bool, Bool);
+extern Foam		cfoldProgExpr		(Foam, Foam, Foam, Bool, Bool);
+extern Bool		cfoldProgBody		(Foam, Foam, Bool, Bool);
 
 #endif /* !_OF_CFOLD_H_ */
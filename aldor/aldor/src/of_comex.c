@@ -242,6 +242,8 @@ struct {
 	VarPool		newLocals;
 
 	BitvClass	bitvClass;
+	Bitv		impureKill;	/* Exps killed by a side effect ... */
+	Bitv		impurePhantom;	/* ... and their phantom bits */
 
 } cseProgInfo;
 
@@ -274,6 +276,7 @@ local void		cseGenExpDeeply		(Foam, BBlock);
 local void		cseGenExp		(Foam, Bitv, Bitv);
 local void		cseKillExpFrDef		(Foam, Bitv, Bitv, Bool);
 local void		cseKillImpureExp	(Bitv, Bitv, Bool);
+local void		cseImpureMasks		(void);
 local void		cseKillExpFrExpInfoList	(ExpInfoList, Bitv, Bitv,Bool);
 
 local void		cseCommonExpEliminate	(FlowGraph);
@@ -332,7 +335,9 @@ cseUnit(Foam foam)
 		if (foamTag(def->foamDef.rhs) != FOAM_Prog)
 			continue;
 
+		optProgSpanStart(foam, i);
 		def->foamDef.rhs = cseProg(def->foamDef.rhs);
+		optProgSpanEnd();
         }
 }
 
@@ -398,6 +403,7 @@ cseProg(Foam foam)
 		optSetCPropPending(foam);
 		optSetDeadvPending(foam);
 		optSetJFlowPending(foam);
+		optSetLoopPending(foam);
 	}
 
 	return flogToProg(flog);
@@ -427,6 +433,8 @@ cseFlog0(FlowGraph flog)
 
 	cseProgInfo.bitvClass = flogBitvClass(flog);
 
+	cseImpureMasks();
+
 	for (i = 0; i < flogBlockC(flog); i++) {
 		bb = flogBlock(flog, i);
 		if (!bb || bb->dfinfo) continue;
@@ -794,15 +802,38 @@ cseKillExpFrDef(Foam def, Bitv bitv, Bitv bitvPhantom, Bool bit)
 local void
 cseKillImpureExp(Bitv bitv, Bitv bitvPhantom, Bool bit)
 {
+	BitvClass	class = cseProgInfo.bitvClass;
+
+	if (bit)
+		bitvOr(class, bitv, bitv, cseProgInfo.impureKill);
+	else
+		bitvMinus(class, bitv, bitv, cseProgInfo.impureKill);
+
+	bitvOr(class, bitvPhantom, bitvPhantom, cseProgInfo.impurePhantom);
+}
+
+/* Side effects kill every expr containing a lex or glob: collect their
+ * bits once, rather than walking the lists at each side effect.
+ */
+local void
+cseImpureMasks()
+{
+	BitvClass		class = cseProgInfo.bitvClass;
+	Bitv			kill, phantom;
 	ExternVarInfoList	evInfol;
 
+	kill    = cseProgInfo.impureKill    = bitvNew(class);
+	phantom = cseProgInfo.impurePhantom = bitvNew(class);
+	bitvClearAll(class, kill);
+	bitvClearAll(class, phantom);
+
 	for (evInfol = cseProgInfo.lexl; evInfol; evInfol = cdr(evInfol))
-		cseKillExpFrExpInfoList(car(evInfol)->expInfoList, bitv,
-					bitvPhantom, bit);
+		cseKillExpFrExpInfoList(car(evInfol)->expInfoList, kill,
+					phantom, true);
 
 	for (evInfol = cseProgInfo.glol; evInfol; evInfol = cdr(evInfol))
-		cseKillExpFrExpInfoList(car(evInfol)->expInfoList, bitv,
-					bitvPhantom, bit);
+		cseKillExpFrExpInfoList(car(evInfol)->expInfoList, kill,
+					phantom, true);
 }
 
 /* Phantom bit: 1 -> expr NOT available
@@ -1461,6 +1492,7 @@ cseProgInit(Foam foam)
 	cseProgInfo.newLocs = cseProgInfo.numLocs;
 	cseProgInfo.expRemoved = false;
 	cseProgInfo.newLocals = (VarPool) NULL;
+	cseProgInfo.impureKill = cseProgInfo.impurePhantom = NULL;
 
 	/* $$!! use foamQuickEqual to avoid string comparison */
 	/* $$!! use foamSmartHash for commutative property */
@@ -1486,6 +1518,12 @@ cseProgFini()
 
 	if (cseProgInfo.newLocals)
 		vpFree(cseProgInfo.newLocals);
+
+	if (cseProgInfo.impureKill) {
+		bitvFree(cseProgInfo.impureKill);
+		bitvFree(cseProgInfo.impurePhantom);
+		cseProgInfo.impureKill = cseProgInfo.impurePhantom = NULL;
+	}
 }
 
 /****************************************************************************
@@ -152,7 +152,6 @@ extern void	cpVarCopiesVectPrint	(void);
 
 local Bool	cpIsDef			(Foam);
 local Bool	cpDefIsCopy		(Foam);
-local Bool	cpIsImmediate		(Foam);
 local Foam	cpRhsVarFrCopy		(Foam);
 
 local void	cpFillGenKill		(FlowGraph, BBlock);
@@ -193,7 +192,9 @@ cpropUnit(Foam foam, Bool isFirst)
 		if (foamTag(def->foamDef.rhs) != FOAM_Prog)
 			continue;
 
+		optProgSpanStart(foam, i);
 		def->foamDef.rhs = cpProg(def->foamDef.rhs);
+		optProgSpanEnd();
 
 		if (DEBUG(cpDf)) {
 			if (cpInfo.nCopies) {
@@ -281,6 +282,7 @@ cpProg(Foam foam)
 		optSetPeepPending(newProg);
 		optSetJFlowPending(newProg);
 		optSetCsePending(newProg);
+		optSetLoopPending(newProg);
 		/* newProg = peepProg(newProg); */
 	}
 	
@@ -486,7 +488,7 @@ cpDefIsCopy(Foam foam)
  *		(Seq (use DATA) (use DATA)) 
  * Note: RRFmt is considered immediate, as are Type* and SizeOf* bcalls.
  */
-local Bool
+Bool
 cpIsImmediate(Foam foam)
 {
 	Bool	result = false;
@@ -19,6 +19,7 @@
 
 extern void	cpropUnit	(Foam, Bool);
 extern Bool	cpFlog		(FlowGraph);
+extern Bool	cpIsImmediate	(Foam);
 
 #endif
 
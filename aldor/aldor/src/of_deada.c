@@ -113,8 +113,11 @@ deadAssign(Foam unit)
 		assert(foamTag(def) == FOAM_Def);
 
 		rhs = def->foamDef.rhs;
-		if (foamTag(rhs) == FOAM_Prog) 
+		if (foamTag(rhs) == FOAM_Prog) {
+			optProgSpanStart(unit, i);
 			def->foamDef.rhs = daProg(rhs);
+			optProgSpanEnd();
+		}
 	}
 	assert(foamAudit(unit));
 }
@@ -183,6 +186,9 @@ daProg(Foam prog)
 	Foam 	  locals, ret;
 	int 	  nbits;
 	
+	if (!optIsDeadaPending(prog)) return prog;
+	optResetDeadaPending(prog);
+
 	if (DEBUG(da)) {
 		fprintf(dbOut, "(Before:\n");
 		foamWrSExpr(dbOut, prog,int0);
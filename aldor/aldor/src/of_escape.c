@@ -0,0 +1,476 @@
+/*****************************************************************************
+ *
+ * of_escape.c: Escape analysis for records, arrays and environments.
+ *
+ * Copyright (c) 1990-2007 Aldor Software Organization Ltd (Aldor.org).
+ *
+ ****************************************************************************/
+
+/*
+ * An allocation escapes its prog if it may still be reachable when the
+ * prog returns.  We use a simple, flow-insensitive test: an RNew, or an
+ * ANew of a small constant size, assigned to a local does not escape if
+ * every use of that local reads or writes one of its elements or frees
+ * it.  Any other use of the local (copying it, passing it to a call,
+ * storing it, returning it, casting it) makes all of the allocations
+ * assigned to it escape.
+ *
+ * Allocations which do not escape are marked with foamOnStack, and genc
+ * gives each of them storage of its own in the C frame of the prog.  The
+ * storage is reused each time the allocation is made: by then the local
+ * was the only reference to the previous record and it is overwritten.
+ * The Frees of the locals are dropped as they may now see the storage.
+ *
+ * The lexical level of a prog, and its environment, are handled the same
+ * way.  A prog is closed if it only uses the environments it can see to
+ * make open calls of closed progs, or to ensure them: such calls cannot
+ * keep any of those environments once they return.  If each (Env 0) of a
+ * prog is of that kind, or makes a closure which is assigned to a local
+ * only ever called, the level cannot outlive the prog and the prog is
+ * marked with foamProgHasLocalEnv.  The closed progs of a unit are found
+ * together, starting from all of them and dropping those which fail the
+ * test until none do, so that recursive calls are allowed.
+ *
+ * The marks are kept in the info field of the allocations, which other
+ * passes use for their own ends, so the pass runs after all of them and
+ * always visits the whole unit: with -Qno-escape it clears the marks.
+ */
+
+#include "axlobs.h"
+#include "debug.h"
+#include "of_escape.h"
+#include "optfoam.h"
+#include "store.h"
+
+Bool	escDebug	= false;
+
+#define escDEBUG	DEBUG_IF(esc)	afprintf
+
+/*
+ * Largest ANew given storage in the C frame.
+ */
+#define EscArrayMax	16
+
+/****************************************************************************
+ *
+ * :: Type definitions
+ *
+ ****************************************************************************/
+
+typedef struct {
+	AInt		locc;		/* Size of the tables below */
+	Bool		*escapes;	/* Locals whose value may escape */
+	Bool		*onStack;	/* Locals given stack allocations */
+
+	Bool		*closed;	/* Consts of closed progs, or NULL */
+	AInt		constc;		/* Size of the table above */
+
+	int		nAllocs;	/* Allocations put on the stack */
+	int		nFrees;		/* Frees dropped */
+	int		nLevels;	/* Lexical levels put on the stack */
+} EscInfo;
+
+static EscInfo	escInfo;
+
+/****************************************************************************
+ *
+ * :: Local declarations
+ *
+ ****************************************************************************/
+
+local void	escClearProg		(Foam);
+local void	escClear		(Foam);
+local void	escUses			(Foam);
+local void	escEltUses		(Foam);
+local Bool	escIsAlloc		(Foam);
+local Bool	escIsArrayType		(AInt);
+local AInt	escFreedLocal		(Foam);
+local void	escFindClosed		(Foam);
+local Bool	escEnvEscapes		(Foam, Bool);
+local Bool	escIsClosedConst	(Foam);
+local Bool	escIsLocalClos		(Foam);
+
+/****************************************************************************
+ *
+ * :: External entry points
+ *
+ ****************************************************************************/
+
+void
+escapeUnit(Foam unit, Bool enabled)
+{
+	Foam	defs, def;
+	int	i;
+
+	assert(foamTag(unit) == FOAM_Unit);
+
+	escInfo.nAllocs = 0;
+	escInfo.nFrees	= 0;
+	escInfo.nLevels = 0;
+
+	if (enabled) escFindClosed(unit);
+
+	defs = unit->foamUnit.defs;
+	for (i = 0; i < foamArgc(defs); i++) {
+		def = defs->foamDDef.argv[i];
+		assert(foamTag(def) == FOAM_Def);
+		if (foamTag(def->foamDef.rhs) != FOAM_Prog) continue;
+
+		optProgSpanStart(unit, i);
+		if (enabled)
+			escapeProg(def->foamDef.rhs);
+		else
+			escClearProg(def->foamDef.rhs);
+		optProgSpanEnd();
+	}
+
+	if (escInfo.closed) stoFree(escInfo.closed);
+	escInfo.closed = NULL;
+	escInfo.constc = 0;
+
+	escDEBUG(dbOut, "escape: %d allocation(s), %d level(s) on the stack,"
+		 " %d free(s) dropped\n",
+		 escInfo.nAllocs, escInfo.nLevels, escInfo.nFrees);
+}
+
+void
+escapeProg(Foam prog)
+{
+	Foam	body, stmt, lhs, rhs;
+	AInt	locc, loc;
+	int	i, j;
+
+	assert(foamTag(prog) == FOAM_Prog);
+
+	escClearProg(prog);
+
+	body = prog->foamProg.body;
+	if (foamTag(body) != FOAM_Seq || foamProgIsCoroutine(prog))
+		return;
+
+	locc = foamDDeclArgc(prog->foamProg.locals);
+
+	/* One more, as there may be no locals. */
+	escInfo.locc	= locc;
+	escInfo.escapes = (Bool *) stoAlloc(OB_Other, (locc+1) * sizeof(Bool));
+	escInfo.onStack = (Bool *) stoAlloc(OB_Other, (locc+1) * sizeof(Bool));
+	for (loc = 0; loc < locc; loc++) {
+		escInfo.escapes[loc] = false;
+		escInfo.onStack[loc] = false;
+	}
+
+	/* Find the locals used other than through their elements. */
+	for (i = 0; i < foamArgc(body); i++) {
+		stmt = body->foamSeq.argv[i];
+		if (foamTag(stmt) == FOAM_Free)
+			escEltUses(stmt->foamFree.place);
+		else
+			escUses(stmt);
+	}
+
+	if (!foamProgIsLeaf(prog) && !escEnvEscapes(body, false)) {
+		escDEBUG(dbOut, "escape: level stays in the prog\n");
+		foamProgSetLocalEnv(prog);
+		escInfo.nLevels += 1;
+	}
+
+	/* Mark the allocations assigned to the other locals. */
+	for (i = 0; i < foamArgc(body); i++) {
+		stmt = body->foamSeq.argv[i];
+		if (foamTag(stmt) != FOAM_Set && foamTag(stmt) != FOAM_Def)
+			continue;
+		lhs = stmt->foamSet.lhs;
+		rhs = stmt->foamSet.rhs;
+		if (foamTag(lhs) != FOAM_Loc || !escIsAlloc(rhs))
+			continue;
+		loc = lhs->foamLoc.index;
+		if (escInfo.escapes[loc]) continue;
+
+		/* genc wants the allocation itself on the rhs. */
+		if (foamTag(rhs) == FOAM_Cast) {
+			stmt->foamSet.rhs = rhs->foamCast.expr;
+			foamFreeNode(rhs);
+		}
+
+		escDEBUG(dbOut, "escape: (Loc %d) stays in the prog\n",
+			 (int) loc);
+		foamOnStack(stmt->foamSet.rhs) = true;
+		escInfo.onStack[loc] = true;
+		escInfo.nAllocs += 1;
+	}
+
+	/* Drop the Frees which may see them. */
+	for (i = j = 0; i < foamArgc(body); i++) {
+		stmt = body->foamSeq.argv[i];
+		loc  = escFreedLocal(stmt);
+		if (loc != -1 && escInfo.onStack[loc]) {
+			foamFree(stmt);
+			escInfo.nFrees += 1;
+			continue;
+		}
+		body->foamSeq.argv[j++] = stmt;
+	}
+	foamArgc(body) = j;
+
+	stoFree(escInfo.escapes);
+	stoFree(escInfo.onStack);
+	escInfo.escapes = NULL;
+	escInfo.onStack = NULL;
+}
+
+/****************************************************************************
+ *
+ * :: Utility functions
+ *
+ ****************************************************************************/
+
+local void
+escClearProg(Foam prog)
+{
+	escClear(prog->foamProg.body);
+	foamProgUnsetLocalEnv(prog);
+}
+
+local void
+escClear(Foam foam)
+{
+	foamIter(foam, arg, escClear(*arg));
+	if (foamTag(foam) == FOAM_RNew || foamTag(foam) == FOAM_ANew)
+		foamOnStack(foam) = false;
+}
+
+/*
+ * Note the locals used in foam other than as the target of an assignment
+ * or through one of their elements.
+ */
+local void
+escUses(Foam foam)
+{
+	Foam	lhs;
+	int	i;
+
+	switch (foamTag(foam)) {
+	case FOAM_Loc:
+		escInfo.escapes[foam->foamLoc.index] = true;
+		break;
+	case FOAM_Set:
+	case FOAM_Def:
+		lhs = foam->foamSet.lhs;
+		if (foamTag(lhs) == FOAM_Values) {
+			for (i = 0; i < foamArgc(lhs); i++)
+				if (foamTag(lhs->foamValues.argv[i]) != FOAM_Loc)
+					escUses(lhs->foamValues.argv[i]);
+		}
+		else if (foamTag(lhs) != FOAM_Loc)
+			escUses(lhs);
+		escUses(foam->foamSet.rhs);
+		break;
+	case FOAM_CCall:
+		/* Calling a closure does not let it escape. */
+		if (foamTag(foam->foamCCall.op) != FOAM_Loc)
+			escUses(foam->foamCCall.op);
+		for (i = 0; i < foamCCallArgc(foam); i++)
+			escUses(foam->foamCCall.argv[i]);
+		break;
+	case FOAM_RElt:
+		escEltUses(foam->foamRElt.expr);
+		break;
+	case FOAM_AElt:
+		escUses(foam->foamAElt.index);
+		escEltUses(foam->foamAElt.expr);
+		break;
+	default:
+		foamIter(foam, arg, escUses(*arg));
+		break;
+	}
+}
+
+/*
+ * foam is the record or array of an element reference, or a freed place.
+ */
+local void
+escEltUses(Foam foam)
+{
+	while (foamTag(foam) == FOAM_Cast)
+		foam = foam->foamCast.expr;
+	if (foamTag(foam) != FOAM_Loc)
+		escUses(foam);
+}
+
+local Bool
+escIsAlloc(Foam foam)
+{
+	Foam	size;
+
+	/* Allow a cast to the type of the allocation. */
+	if (foamTag(foam) == FOAM_Cast) {
+		AInt	type = foam->foamCast.type;
+		foam = foam->foamCast.expr;
+		if (foamTag(foam) == FOAM_RNew && type != FOAM_Rec)
+			return false;
+		if (foamTag(foam) == FOAM_ANew && type != FOAM_Arr)
+			return false;
+	}
+
+	switch (foamTag(foam)) {
+	case FOAM_RNew:
+		return foam->foamRNew.format != emptyFormatSlot;
+	case FOAM_ANew:
+		size = foam->foamANew.size;
+		return escIsArrayType(foam->foamANew.eltType) &&
+			foamTag(size) == FOAM_SInt &&
+			size->foamSInt.SIntData > 0 &&
+			size->foamSInt.SIntData <= EscArrayMax;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Element types which genc can clear with a plain assignment of 0.
+ */
+local Bool
+escIsArrayType(AInt type)
+{
+	switch (type) {
+	case FOAM_Char:
+	case FOAM_Bool:
+	case FOAM_Byte:
+	case FOAM_HInt:
+	case FOAM_SInt:
+	case FOAM_SFlo:
+	case FOAM_DFlo:
+	case FOAM_Word:
+	case FOAM_Ptr:
+	case FOAM_Rec:
+	case FOAM_Arr:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * If stmt frees a local, return it, otherwise -1.
+ */
+local AInt
+escFreedLocal(Foam stmt)
+{
+	Foam	place;
+
+	if (foamTag(stmt) != FOAM_Free) return -1;
+
+	place = stmt->foamFree.place;
+	while (foamTag(place) == FOAM_Cast)
+		place = place->foamCast.expr;
+
+	return foamTag(place) == FOAM_Loc ? place->foamLoc.index : -1;
+}
+
+/*
+ * Find the closed progs of the unit.
+ */
+local void
+escFindClosed(Foam unit)
+{
+	Foam	defs, def, prog;
+	AInt	k;
+	Bool	changed;
+	int	i;
+
+	escInfo.constc = foamDDeclArgc(foamUnitConstants(unit));
+	escInfo.closed = (Bool *) stoAlloc(OB_Other,
+					   (escInfo.constc+1) * sizeof(Bool));
+	for (k = 0; k < escInfo.constc; k++)
+		escInfo.closed[k] = false;
+
+	defs = unit->foamUnit.defs;
+	for (i = 0; i < foamArgc(defs); i++) {
+		def = defs->foamDDef.argv[i];
+		if (foamTag(def->foamDef.lhs) != FOAM_Const) continue;
+		prog = def->foamDef.rhs;
+		if (foamTag(prog) != FOAM_Prog || foamProgIsCoroutine(prog))
+			continue;
+		escInfo.closed[def->foamDef.lhs->foamConst.index] = true;
+	}
+
+	do {
+		changed = false;
+		for (i = 0; i < foamArgc(defs); i++) {
+			def = defs->foamDDef.argv[i];
+			if (!escIsClosedConst(def->foamDef.lhs)) continue;
+			prog = def->foamDef.rhs;
+			if (!escEnvEscapes(prog->foamProg.body, true)) continue;
+			k = def->foamDef.lhs->foamConst.index;
+			escInfo.closed[k] = false;
+			changed = true;
+		}
+	} while (changed);
+}
+
+/*
+ * May foam let an environment escape?  If allLevels is false, only
+ * (Env 0) is considered.
+ */
+local Bool
+escEnvEscapes(Foam foam, Bool allLevels)
+{
+	Foam	env;
+	int	i;
+
+	switch (foamTag(foam)) {
+	case FOAM_Env:
+		return allLevels || foam->foamEnv.level == 0;
+	case FOAM_EEnsure:
+		if (foamTag(foam->foamEEnsure.env) == FOAM_Env)
+			return false;
+		break;
+	case FOAM_OCall:
+		env = foam->foamOCall.env;
+		if (foamTag(env) != FOAM_Env ||
+		    !escIsClosedConst(foam->foamOCall.op))
+			break;
+		for (i = 0; i < foamOCallArgc(foam); i++)
+			if (escEnvEscapes(foam->foamOCall.argv[i], allLevels))
+				return true;
+		return false;
+	case FOAM_Set:
+	case FOAM_Def:
+		if (!allLevels && escIsLocalClos(foam))
+			return false;
+		break;
+	default:
+		break;
+	}
+	foamIter(foam, arg, {
+		if (escEnvEscapes(*arg, allLevels)) return true;
+	});
+	return false;
+}
+
+local Bool
+escIsClosedConst(Foam foam)
+{
+	AInt	k;
+
+	if (foamTag(foam) != FOAM_Const || !escInfo.closed) return false;
+	k = foam->foamConst.index;
+	return k < escInfo.constc && escInfo.closed[k];
+}
+
+/*
+ * Is stmt the assignment of a closure of a closed prog to a local which
+ * is only ever called?
+ */
+local Bool
+escIsLocalClos(Foam stmt)
+{
+	Foam	lhs = stmt->foamSet.lhs, rhs = stmt->foamSet.rhs;
+
+	if (foamTag(lhs) != FOAM_Loc || foamTag(rhs) != FOAM_Clos)
+		return false;
+	if (!escInfo.escapes || escInfo.escapes[lhs->foamLoc.index])
+		return false;
+	return foamTag(rhs->foamClos.env) == FOAM_Env &&
+		escIsClosedConst(rhs->foamClos.prog);
+}
@@ -0,0 +1,17 @@
+/*****************************************************************************
+ *
+ * of_escape.h: Escape analysis for records, arrays and environments.
+ *
+ * Copyright (c) 1990-2007 Aldor Software Organization Ltd (Aldor.org).
+ *
+ ****************************************************************************/
+
+#ifndef _OF_ESCAPE_H_
+#define _OF_ESCAPE_H_
+
+#include "axlobs.h"
+
+extern void	escapeUnit	(Foam, Bool);
+extern void	escapeProg	(Foam);
+
+#endif /* !_OF_ESCAPE_H_ */
@@ -99,6 +99,7 @@
  ***************************************************************************/
 
 #include "debug.h"
+#include "file.h"
 #include "flog.h"
 #include "fluid.h"
 #include "format.h"
@@ -111,6 +112,7 @@
 #include "optfoam.h"
 #include "optinfo.h"
 #include "opttools.h"
+#include "opsys.h"
 #include "stab.h"
 #include "store.h"
 #include "util.h"
@@ -209,6 +211,7 @@ struct InlPriCallStruct {
 	Foam *	stmtPtr;	/* statem. containing call that must be inl.*/
 	BBlock	block;		/* block containing the call */
 	AInt	size;		/* extimated growth after inlining */
+	Bool	hot;		/* made often in the profile */
 };
 
 typedef struct InlPriCallStruct *  InlPriCall;
@@ -242,6 +245,7 @@ int	inlRejectInfo;
 #define	INL_REJ_DontInlineMe		12
 #define	INL_REJ_RecursiveCall		13
 #define INL_REJ_LocalInConst0		14
+#define INL_REJ_Cold			15
 
 extern void	inlPrintRejectCause	(String);
 extern void	inlPrintUninlinedCalls	(InlPriCall, PriQKey);
@@ -420,6 +424,17 @@ static InlineeInfo	inlInlinee;
 static Bool		inlInlineAll;
 static Bool		inlInlineProgs;
 
+/*
+ * Call counts from -W profile-use (see "Profile feedback" below).
+ */
+#define InlProfHotRatio		100
+#define InlProfColdRatio	10000
+
+static Bool		inlProfGen;
+static Table		inlProfCounts;
+static ULong		inlProfMax;
+static Hash		inlProfHash;
+
 /* Maximum size of a program that we will automatically inline. */
 int	inlSizeLimit;	/* default value in optfoam.c */
 
@@ -439,6 +454,7 @@ local Foam *	inlPriCallStmtReset(InlPriCall priCall);
 local Bool 	inlInlinePriCall(InlPriCall priCall, PriQKey priority);
 
 local InlPriCall inlPriCallNew(Foam foam, Foam * stmtPtr, BBlock, int);
+local int	inlProfHeat	(Foam stmt);
 local void	inlPriCallFree(InlPriCall pc);
 
 local Foam	inlInsertSeq(Foam foam);
@@ -514,7 +530,11 @@ extern int optInlineRoof;
 		    && !genIsRuntime() && !optIsMaxLevel())
 			break;
 
-		if (priority > 0 &&
+		/* Only inline what costs nothing when counting calls. */
+		if (priority > 0 && inlProfGen)
+			break;
+
+		if (priority > 0 && !priCall->hot &&
 		    inlSizeLimit != -1) {
 			underLimit = inlIsUnderLimit(inlProg->originalSize,
 			       		prog->foamProg.size + priCall->size,
@@ -1037,7 +1057,7 @@ inlGetSpaceFactor(Foam call, InlProgInfo progInfo)
 /* Return -1 if the call CANNOT be inlined, its priority otherwise
  */
 local PriQKey
-inlPriqGetPriority(int depth, Foam call, int * psize, Foam * pinfo)
+inlPriqGetPriority(int depth, int heat, Foam call, int * psize, Foam * pinfo)
 {
 	InlProgInfo	progInfo;
 	PriQKey		priority, size, spaceFactor;
@@ -1046,7 +1066,8 @@ inlPriqGetPriority(int depth, Foam call, int * psize, Foam * pinfo)
 	Bool		isLocal = false;
 
 	expectedCalls = 1L << (depth * InlLoopMagicNumber);
-	if (expectedCalls <= 0 || expectedCalls > InlInnerLoopMaxIter)
+	if (expectedCalls <= 0 || expectedCalls > InlInnerLoopMaxIter ||
+	    heat == InlProfHot)
 		expectedCalls = InlInnerLoopMaxIter;
 
 	*psize = 0;
@@ -1174,13 +1195,19 @@ inlAddCallToPriq(Foam call, Foam * stmtp, int depth, BBlock bb)
 	InlPriCall 	inlPriCall;
 	InlProgInfo	progInfo;
 	String		string;
-	int size;
+	int size, heat = inlProfHeat(*stmtp);
 
-	PriQKey	priority = inlPriqGetPriority(depth, call, &size, &progInfo);
+	PriQKey	priority = inlPriqGetPriority(depth, heat, call, &size, &progInfo);
+
+	if (priority > 0 && heat == InlProfCold) {
+		inlRejectInfo = INL_REJ_Cold;
+		priority = -1;
+	}
 
 	if (priority != -1) {
 
 		inlPriCall = inlPriCallNew(call, stmtp, bb, size);
+		inlPriCall->hot = (heat == InlProfHot);
 		priqInsert(inlProg->priq, priority, (PriQElt) inlPriCall);
 	}
 
@@ -1433,6 +1460,7 @@ inlPriCallNew(Foam call, Foam * stmtPtr, BBlock bb, int size)
 	i->stmtPtr = stmtPtr;
 	i->block   = bb;
 	i->size    = size;
+	i->hot     = false;
 
 	return i;
 }
@@ -3954,6 +3982,155 @@ inlSetGenerators()
 	inlInlineGenerators = true;
 }
 
+/******************************************************************************
+ *
+ * :: Profile feedback (-Wprofile-gen, -Wprofile-use)
+ *
+ * A program compiled with -Wprofile-gen counts the entries to each prog
+ * and the calls made from each line of it (see fiProfCountRegister).
+ * Compiling again with -Wprofile-use=<file> reads the counts back.  A
+ * call is hot if its line made at least 1/InlProfHotRatio as many calls
+ * as the busiest line, and cold if it made fewer than 1/InlProfColdRatio
+ * as many, or if its prog was never entered.  A prog's counts are only
+ * written once it has been entered, but the progs of a unit are made by
+ * its first prog, so a prog missing from the counts of a unit which has
+ * some was never entered.  Units with no counts are left to the static
+ * heuristics, since they may not have been part of the profiled run.
+ * Hot calls are ranked as if
+ * they were in the innermost loop and may take the prog past the inline
+ * limit; cold calls are only inlined when that costs nothing.
+ *
+ * Lines are only counted as they are seen by genc, so a call which is
+ * inlined cannot be counted.  With -Wprofile-gen the inliner only takes
+ * the calls of priority 0, which it takes in any case, so that the lines
+ * counted are those the priority queue sees with -Wprofile-use.
+ *
+ *****************************************************************************/
+
+void
+inlSetProfileGen(Bool flag)
+{
+	inlProfGen = flag;
+}
+
+/*
+ * Each line of the file is "count prog unit const name" or
+ * "count call unit const line"; the counts are kept under the key
+ * "prog unit const" or "call unit const line", plus one so that they
+ * can be told from a missing key.  The key "unit unit" marks the units
+ * seen.
+ */
+void
+inlSetProfileUse(String file)
+{
+	FileName	fn = fnameParse(file);
+	FILE		*fin = fileMustOpen(fn, osIoRdMode);
+	char		line[1024], kind[8], unit[256];
+	unsigned long	count, prev;
+	long		cnum, lno;
+	String		key;
+
+	if (!inlProfCounts)
+		inlProfCounts = tblNew((TblHashFun) strHash,
+				       (TblEqFun) strEqual);
+
+	while (fgets(line, sizeof(line), fin)) {
+		int	n = sscanf(line, "%lu %7s %255s %ld %ld",
+				   &count, kind, unit, &cnum, &lno);
+
+		if (strEqual(kind, "prog") && n >= 4) {
+			key = strPrintf("unit %s", unit);
+			if (tblElt(inlProfCounts, key, (TblElt) 0))
+				strFree(key);
+			else
+				tblSetElt(inlProfCounts, key, (TblElt) 1);
+			key = strPrintf("prog %s %ld", unit, cnum);
+		}
+		else if (strEqual(kind, "call") && n == 5)
+			key = strPrintf("call %s %ld %ld", unit, cnum, lno);
+		else
+			continue;
+
+		prev   = (ULong) tblElt(inlProfCounts, key, (TblElt) 0);
+		count += prev ? prev : 1;
+		tblSetElt(inlProfCounts, key, (TblElt) count);
+		if (prev) strFree(key);
+		if (kind[0] == 'c' && count - 1 > inlProfMax)
+			inlProfMax = count - 1;
+		inlProfHash = hashCombine(strHash(line), inlProfHash);
+	}
+
+	fclose(fin);
+	fnameFree(fn);
+}
+
+/*
+ * The profile changes what is inlined, so it is part of the cache key.
+ */
+Hash
+inlProfileHash(void)
+{
+	return inlProfHash;
+}
+
+local ULong
+inlProfCount(String key)
+{
+	ULong	count = (ULong) tblElt(inlProfCounts, key, (TblElt) 0);
+
+	strFree(key);
+	return count;
+}
+
+/*
+ * How hot is a call made from stmt, in the prog being inlined?
+ */
+local int
+inlProfHeat(Foam stmt)
+{
+	Foam	consts;
+	String	unit;
+	SrcPos	pos = foamPos(stmt);
+
+	if (!inlProfCounts) return InlProfWarm;
+
+	consts = foamUnitConstants(inlUnit->unit);
+	unit   = consts->foamDDecl.argv[0]->foamDecl.id;
+
+	return inlProfSiteHeat(unit, inlProg->constNum,
+			       sposIsNone(pos) ? -1 : sposLine(pos));
+}
+
+/*
+ * How hot is a call made from the given line (-1 if none) of the prog
+ * defined by the constant cnum of unit?
+ */
+int
+inlProfSiteHeat(String unit, AInt cnum, AInt line)
+{
+	ULong	count;
+
+	if (!inlProfCounts) return InlProfWarm;
+
+	count = inlProfCount(strPrintf("prog %s %d", unit, (int) cnum));
+	if (count == 1) return InlProfCold;
+	if (count == 0 && inlProfCount(strPrintf("unit %s", unit)))
+		return InlProfCold;
+
+	if (line < 0) return InlProfWarm;
+
+	count = inlProfCount(strPrintf("call %s %d %d", unit,
+				       (int) cnum, (int) line));
+	if (count == 0) return InlProfWarm;
+	count -= 1;
+
+	if (count > 0 && count * InlProfHotRatio >= inlProfMax)
+		return InlProfHot;
+	if (count * InlProfColdRatio < inlProfMax)
+		return InlProfCold;
+	return InlProfWarm;
+}
+
 /*****************************************************************************
  *
  * :: Debug Staff
@@ -3986,6 +4163,7 @@ inlPrintRejectCause(String call)
 	case INL_REJ_DontInlineMe: str = "DontInlineMe"; break;
 	case INL_REJ_RecursiveCall: str = "RecursiveCall"; break;
 	case INL_REJ_LocalInConst0: str = "LocalCallInConst(0)"; break;
+	case INL_REJ_Cold: str = "Cold"; break;
 	default:
 		bugWarning("Unknown rejection cause...");
 	}
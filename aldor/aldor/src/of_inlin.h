@@ -15,6 +15,20 @@ extern void     	inlineUnit	    	(Foam, Bool, int, Bool);
 
 extern Bool		inlInlinable		(Stab, Syme);
 extern void		inlSetGenerators	(void);
+extern void		inlSetProfileGen	(Bool);
+extern void		inlSetProfileUse	(String);
+extern Hash		inlProfileHash		(void);
+
+/*
+ * How hot a call is, by the counts from -W profile-use.
+ */
+enum inlProfHeat {
+	InlProfWarm,		/* Not counted, or neither hot nor cold */
+	InlProfHot,
+	InlProfCold
+};
+
+extern int		inlProfSiteHeat		(String, AInt, AInt);
 
 /*
  * The first of these limits is quite critical: make it too
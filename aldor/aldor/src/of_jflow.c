@@ -105,7 +105,11 @@ jflowUnit(Foam unit, int jflowLimit)
 		assert(foamTag(def) == FOAM_Def);
 
 		rhs = def->foamDef.rhs;
-		if (foamTag(rhs) == FOAM_Prog) jflowProg(rhs);
+		if (foamTag(rhs) == FOAM_Prog) {
+			optProgSpanStart(unit, i);
+			jflowProg(rhs);
+			optProgSpanEnd();
+		}
 	}
 	assert(foamAudit(unit));
 }
@@ -7,30 +7,53 @@
  ****************************************************************************/
 /****************************************************************************
  *
- * Open Problems:
- *
- *  - after a preheader is created, udInfoBlock() must be modified.
- *	Solutions:
- *	   a- traverse the flog and check each ud list
- *	   - 
- *
- *  - after a preheader is created, there should be a new bit in each
- *	loop->blockSet, and also loop->blockList(s) should be updated.
- *	Solutions:
- *	   a- the problem should exist only for nested loops. If loops are
- *	     sorted so that external loops are processed before internal ones,
- *	     then a block > nbits is considered an external block
- *	   b- all the loops that must be still examined are updated. Not so
- *	     hard. A dirty trick could avoid alloc/free of each bitv.
+ * Loop invariant code motion.
+ *
+ * Each prog is turned into a flow graph, its natural loops are found and
+ * the loops sharing a header are unified.  The loops are visited
+ * outermost first.  The invariants of the first loop which has any are
+ * moved into a new preheader block, then the usedef chains, dominators and
+ * loops are computed again from the modified graph before looking for
+ * more.  So no loop is examined with stale block sets or reaching
+ * definitions, and code moved into the preheader of an inner loop has
+ * another chance to leave the enclosing loops.
+ *
+ * A definition of a local is moved when its rhs only depends on values
+ * computed outside the loop or by other invariants, and it is the only
+ * definition reaching the uses of its lhs in the loop.
+ *
+ * A block dominating all the loop exits is run before the loop is left,
+ * so any invariant may be moved from it.  The body of a loop testing at
+ * the top, as loops over generators do, does not dominate the exit: from
+ * a block which is run on every trip round the loop, a definition is
+ * only moved if nothing else in the prog defines its lhs and its rhs is
+ * harmless to compute when the loop is not entered (no traps, no visible
+ * side effects: arithmetic and casts).  Runtime lookups are only moved
+ * from blocks dominating the exits, since they instantiate domains.
+ *
+ * So when such a loop only leaves from its header, and the blocks run on
+ * every trip hold invariant lookups or builtins which may trap, the loop
+ * is rotated first: a copy of the header is put in front of it as a
+ * guard, and the loop then tests at the bottom.  Its body dominates the
+ * exit, and the next round moves those invariants into a preheader which
+ * only runs when the guard lets the loop be entered.
+ *
+ * Copy propagation, sccp and cse ask for the pass again when they change a
+ * prog, as they may leave new invariants behind.
  *
  ****************************************************************************/
 
 #include "debug.h"
+#include "fbox.h"
 #include "flog.h"
+#include "gf_rtime.h"
 #include "loops.h"
 #include "of_loops.h"
+#include "of_util.h"
+#include "optfoam.h"
 #include "opttools.h"
 #include "store.h"
+#include "strops.h"
 #include "usedef.h"
 
 /****************************************************************************
@@ -50,6 +73,12 @@ static Bool loopDebug	= false;
  ****************************************************************************/
 #define	loopDefNo(foam)			((foam)->foamGen.hdr.info.defNo)
 
+/* Bound on the number of times the loops of a prog are recomputed. */
+#define LOOP_MaxRounds			50
+
+/* Bound on the size of a header copied to rotate its loop. */
+#define LOOP_MaxGuardStmts		4
+
 /****************************************************************************
  *
  * :: Type Definitions
@@ -75,15 +104,20 @@ struct  {
 	FlowGraph	flog;
 	Dominators	doms;
 
-	Bitv		domExits;
+	Bitv		domExits;	/* Blocks run before leaving the loop */
+	Bitv		domLatches;	/* Blocks run on every trip */
 
 	int		numLocs;
 	int		numPars;
+	int *		locDefc;	/* Number of defs of each local */
 
 	InvInfo 	* invInfov;
 	int		numInv;
 	int		numDefs;
 
+	VarPool		newLocals;	/* Locals for extracted expressions */
+	FoamList	extracted;	/* (Set (Loc new) exp) for those */
+
 } loopInfo;
 
 /*****************************************************************************
@@ -92,31 +126,50 @@ struct  {
  *
  ****************************************************************************/
 
-local void		loopFindAndMoveInvariantsFrLoop	(LoopList);
+local Bool		loopProgHasBackJump		(Foam);
+local LoopList		loopSortOutermostFirst		(LoopList);
+local Bool		loopFindAndMoveInvariantsFrLoop	(Loop);
 
 local void		loopInvariantsFindFrLoop	(Loop);
 local Bool		loopInvariantsFindFrBlock  	(BBlock, Loop);
 
-local Bool		loopIsInvariantExp		(Foam, Loop);
+local int		loopIsInvariantExp		(Foam, Loop);
+local Bool		loopIsSpeculable		(Foam);
+local Bool		loopIsRuntimeLookup		(Foam);
+local Bool		loopBValMayTrap			(FoamBValTag);
 
 
 local void		loopInvariantsFilterFrLoop	(Loop);
 
+local void		loopInvariantsExtractFrLoop	(Loop);
+local void		loopExtractFrBlock		(BBlock, Loop, Bool);
+local void		loopExtractExp			(Foam *, Loop, Bool);
+local void		loopExtractArgs			(Foam, Loop, Bool);
+local Bool		loopIsExtractable		(Foam, Loop, Bool);
+local Bool		loopHasVar			(Foam);
+
+local Bool		loopIsRotatable			(Loop);
+local Bool		loopHasGuardedInvariant		(Foam, Loop);
+local void		loopRotate			(Loop);
+
 local BBlock		loopInvariantsMoveFrLoop	(Loop);
 local Foam		loopPreHeaderCodeCreate		(Loop);
 
 local int		loopDefinitionsReset		(Loop/* , Bitv*/);
+local void		loopAddValuesVarInfo		(Foam, Foam);
+
+local Bool		loopBlockDominatesAll		(BBlock, BBlockList);
 
-local Bool		loopBlockDominatesAllExits	(BBlock, BBlockList);
+local Bitv		loopFindDominatorsOf		(Loop, BBlockList);
+local BBlockList	loopLatchBlocksFrLoop		(Loop);
 
-local Bitv		loopFindExitsDominators		(Loop);
+local void		loopCountDefs			(Foam, int *);
 
 local InvInfo		loopInvInfoNew			(Foam *, BBlock);
+local void		loopInvariantsFree		(void);
 
 local void		loopInvariantsPrintDb		(int);
 
-local void		loopUpdate		     (Loop, BBlock, LoopList);
-
 /****************************************************************************
  *
  * :: Main Entry Points
@@ -130,8 +183,6 @@ loopUnit(Foam foam)
 	Foam 		defs = foam->foamUnit.defs, def, prog;
 	FlowGraph	flog;
 
-	loopDebug = 1;
-
 	assert(foamTag(foam) == FOAM_Unit);
 
 	loopInfo.unit = foam;
@@ -147,68 +198,186 @@ loopUnit(Foam foam)
 
 		prog = def->foamDef.rhs;
 
+		if (!optIsLoopPending(prog)) continue;
+		optResetLoopPending(prog);
+
+		if (!loopProgHasBackJump(prog)) continue;
+
+		optProgSpanStart(foam, i);
+
 		loopInfo.numLocs = foamDDeclArgc(prog->foamProg.locals);
 		loopInfo.numPars = foamDDeclArgc(prog->foamProg.params);
 
 		flog = flogFrProg(prog, FLOG_UniqueExit);
 
-		loopInvariantsMoveFrFlog(flog);
+		if (loopInvariantsMoveFrFlog(flog)) {
+			optSetCPropPending(prog);
+			optSetCsePending(prog);
+			optSetJFlowPending(prog);
+			optSetDeadvPending(prog);
+			optSetPeepPending(prog);
+		}
 
 		def->foamDef.rhs = flogToProg(flog);
+
+		optProgSpanEnd();
 	}
 }
 
 
-/* !!! There is something that must be changed. Usedef must decide that
+/* Move the invariants out of the loops of FLOG, outermost loops first.
+ * Return true if anything was moved.
+ *
+ * !!! There is something that must be changed. Usedef must decide that
  * he need a FLOG_Union, not the client.
  */
-void
+Bool
 loopInvariantsMoveFrFlog(FlowGraph flog)
 {
 	Dominators	doms;
-	LoopList	loops;
+	LoopList	loops, l;
+	Bool		moved = false, again = true;
+	int		round, i;
 
 	loopInfo.flog = flog;
 
-	/* ----- First step: Build usedef chains ------ */
+	for (round = 0; again && round < LOOP_MaxRounds; round++) {
 
-	if (!usedefChainsFrFlog(flog, UD_OUTPUT_UdList))
-		return;
+		again = false;
+
+		/* ----- First step: Find All the Natural Loops ------ */
 
-	/* ----- Second step: Find All the Natural Loops ------ */
+		loops = lpNaturalLoopsFrFlog(flog, &doms);
 
-	loops = lpNaturalLoopsFrFlog(flog, &doms);
+		if (!loops) {
+			lpDominatorsFree(doms);
+			break;
+		}
+
+		loopInfo.doms = doms;
+
+		/* ----- Second step: Build usedef chains ------ */
+
+		if (!usedefChainsFrFlog(flog, UD_OUTPUT_UdList)) {
+			listFreeDeeply(Loop)(loops, lpLoopFree);
+			lpDominatorsFree(doms);
+			break;
+		}
+
+		/* ----- Third step: unify loops with same header ------ */
+
+		loops = lpUnifyCommonHeaders(loops);
+		loops = loopSortOutermostFirst(loops);
+
+		/* ----- Fourth step: Optimize the first loop we can ------ */
+
+		loopInfo.locDefc = (int *) stoAlloc(OB_Other,
+					(loopInfo.numLocs + 1) * sizeof(int));
+		for (i = 0; i < loopInfo.numLocs; i++)
+			loopInfo.locDefc[i] = 0;
+
+		flogIter(flog, bb, loopCountDefs(bb->code, loopInfo.locDefc));
+
+		for (l = loops; l && !again; l = cdr(l))
+			again = loopFindAndMoveInvariantsFrLoop(car(l));
 
-	if (!loops) {
+		stoFree(loopInfo.locDefc);
+		loopInfo.locDefc = NULL;
+
+		listFreeDeeply(Loop)(loops, lpLoopFree);
 		lpDominatorsFree(doms);
-		return;
+		usedefChainsFreeFrFlog(flog);
+
+		/* The preheader invalidates everything: start again. */
+		if (again) {
+			moved = true;
+			flogReuse(flog, FLOG_UniqueExit);
+		}
 	}
 
-	loopInfo.doms = doms;
+	return moved;
+}
 
-	/* ----- Third step: unify loops with some header ------ */
+/* A prog without jumps to a label seen before has no loops, and is not
+ * worth building a flowgraph for.
+ */
+local Bool
+loopProgHasBackJump(Foam prog)
+{
+	Foam	body = prog->foamProg.body, stmt;
+	int	nLabels = prog->foamProg.nLabels, i, j, lab;
+	Bool	* seen, result = false;
+
+	seen = (Bool *) stoAlloc(OB_Other, (nLabels + 1) * sizeof(Bool));
+	for (i = 0; i < nLabels; i++) seen[i] = false;
+
+#define loopSeen(l)	((l) < 0 || (l) >= nLabels || seen[l])
+
+	for (i = 0; i < foamArgc(body) && !result; i++) {
+		stmt = body->foamSeq.argv[i];
+
+		switch (foamTag(stmt)) {
+		case FOAM_Label:
+			lab = stmt->foamLabel.label;
+			if (lab >= 0 && lab < nLabels) seen[lab] = true;
+			break;
+		case FOAM_Goto:
+			result = loopSeen(stmt->foamGoto.label);
+			break;
+		case FOAM_If:
+			result = loopSeen(stmt->foamIf.label);
+			break;
+		case FOAM_GenerStep:
+			result = loopSeen(stmt->foamGenerStep.label);
+			break;
+		case FOAM_Select:
+			for (j = 0; j < foamArgc(stmt) - 1 && !result; j++)
+				result = loopSeen(stmt->foamSelect.argv[j]);
+			break;
+		default:
+			break;
+		}
+	}
 
-	loops = lpUnifyCommonHeaders(loops);
+#undef loopSeen
 
-	/* ----- Fourth step: Optimize each loop ------ */
-	
-	for (; loops; loops = cdr(loops))
-		loopFindAndMoveInvariantsFrLoop(loops);
+	stoFree(seen);
 
-	usedefChainsFreeFrFlog(flog);
+	return result;
+}
+
+/* Sort LOOPS so that each loop comes before the loops nested in it.
+ * An enclosing loop has more blocks than any loop inside it.
+ */
+local LoopList
+loopSortOutermostFirst(LoopList loops)
+{
+	LoopList	sorted = listNil(Loop), *pl;
+	int		n;
+
+	listIter(Loop, loop, loops, {
+		n = lpNumBlocksInLoop(loop);
+		for (pl = &sorted; *pl; pl = &cdr(*pl))
+			if (lpNumBlocksInLoop(car(*pl)) < n) break;
+		*pl = listCons(Loop)(loop, *pl);
+	});
+
+	listFree(Loop)(loops);
 
+	return sorted;
 }
 
 
-/* Given a loopList , find all the invariant computations for the
- * first element, create the preheader and modify the flowgraph, and update
- * the dataflow info for the remaining loops.
+/* Find all the invariant computations of LOOP, create the preheader and
+ * move them there.  Return true if the flowgraph has been modified.
  */
-local void
-loopFindAndMoveInvariantsFrLoop(LoopList loops)
+local Bool
+loopFindAndMoveInvariantsFrLoop(Loop loop)
 {
-	BBlock	preHeader;
-	Loop	loop = car(loops);
+	Bool	moved;
+
+	loopDEBUG(dbOut, "Loop with header %d, %d blocks\n",
+		  (int) loop->header->label, (int) lpNumBlocksInLoop(loop));
 
 	otProgInfoInit(OT_ASSOCIATION_LIST, 
 		       loopInfo.numLocs, loopInfo.numPars, loopInfo.unit);
@@ -217,25 +386,30 @@ loopFindAndMoveInvariantsFrLoop(LoopList loops)
 
 	assert(loopInfo.numInv);
 
-	if (loopInfo.numInv == 1) {
+	if (loopIsRotatable(loop)) {
 		otProgInfoFini();
-		return;
+		loopRotate(loop);
+		loopInvariantsFree();
+		return true;
 	}
 
-	loopInvariantsFilterFrLoop(loop);
+	if (loopInfo.numInv > 1)
+		loopInvariantsFilterFrLoop(loop);
+
+	loopInvariantsExtractFrLoop(loop);
 
 	otProgInfoFini();
 
 	assert(loopInfo.numInv);
 
-	if (loopInfo.numInv == 1)  return;
-
-	preHeader = loopInvariantsMoveFrLoop(loop);
+	moved = loopInfo.numInv > 1 || loopInfo.extracted;
 
-	if (cdr(loops))
-	    loopUpdate(loop, preHeader, cdr(loops));
+	if (moved)
+		loopInvariantsMoveFrLoop(loop);
 
+	loopInvariantsFree();
 
+	return moved;
 }
 
 /****************************************************************************
@@ -250,8 +424,15 @@ loopInvariantsFindFrLoop(Loop loop)
 	int		numDefs;
 	Bool		changed;
 	BitvClass	class = loop->bitvClass;
-	
-	loopInfo.domExits = loopFindExitsDominators(loop);
+	BBlockList	blocks;
+
+	blocks = lpExitBlocksFrLoop(loop);
+	loopInfo.domExits = loopFindDominatorsOf(loop, blocks);
+	listFree(BBlock)(blocks);
+
+	blocks = loopLatchBlocksFrLoop(loop);
+	loopInfo.domLatches = loopFindDominatorsOf(loop, blocks);
+	listFree(BBlock)(blocks);
 
 	/* First: reset all invariant info on definitions */
 
@@ -265,8 +446,11 @@ loopInvariantsFindFrLoop(Loop loop)
 		changed = false;
 		listIter(BBlock, bb, loop->blockList, {
 
-			/* Consider only blocks which dominates exits */
-			if (!bitvTest(class, loopInfo.domExits, bb->label))
+			/* Consider only blocks which dominates exits,
+			 * or are run on each trip.
+			 */
+			if (!bitvTest(class, loopInfo.domExits, bb->label) &&
+			    !bitvTest(class, loopInfo.domLatches, bb->label))
 				continue;
 
 			if (loopInvariantsFindFrBlock(bb, loop))
@@ -276,9 +460,7 @@ loopInvariantsFindFrLoop(Loop loop)
 
 	} while (changed);
 
-	/* bitvFree(domExits); */
-
-	if (loopDebug) loopInvariantsPrintDb(numDefs);
+	if (DEBUG(loop)) loopInvariantsPrintDb(numDefs);
 
 	return;
 }
@@ -288,7 +470,7 @@ loopInvariantsPrintDb(int numDefs)
 {
 	int i;
 
-	if (loopInfo.numInv == 0)
+	if (loopInfo.numInv == 1)
 		fprintf(dbOut, "No invariants found among %d definitions.\n",
 			numDefs);
 	else {
@@ -314,10 +496,12 @@ loopInvariantsFindFrBlock(BBlock bb, Loop loop)
 {
 	Foam 		lhs, rhs, stmt, seq = bb->code;
 	int		i, state;
-	Bool		found = false;
+	Bool		found = false, speculate;
 	InvInfo *	invInfov = loopInfo.invInfov;
 	FoamList	defs;
 
+	speculate = !bitvTest(loop->bitvClass, loopInfo.domExits, bb->label);
+
 	for (i = 0; i < foamArgc(seq); i++) {
 
 		stmt = seq->foamSeq.argv[i];
@@ -327,7 +511,10 @@ loopInvariantsFindFrBlock(BBlock bb, Loop loop)
 		if (loopDefNo(stmt) != LOOP_InvState_Unknown)
 			continue;
 		
-		defs = (FoamList) otGetVarInfoList(stmt->foamDef.lhs);
+		lhs = stmt->foamDef.lhs;
+		rhs = stmt->foamDef.rhs;
+
+		defs = (FoamList) otGetVarInfoList(lhs);
 
 		assert(defs);
 
@@ -336,7 +523,14 @@ loopInvariantsFindFrBlock(BBlock bb, Loop loop)
 			continue;
 		}
 
-		rhs = stmt->foamDef.rhs;
+		/* The block might not be run before leaving the loop. */
+		if (speculate &&
+		    (foamTag(lhs) != FOAM_Loc ||
+		     loopInfo.locDefc[lhs->foamLoc.index] != 1 ||
+		     !loopIsSpeculable(rhs))) {
+			loopDefNo(stmt) = LOOP_InvState_Invalid;
+			continue;
+		}
 
 		state = loopIsInvariantExp(rhs, loop);
 
@@ -346,8 +540,6 @@ loopInvariantsFindFrBlock(BBlock bb, Loop loop)
 
 			found = true;
 
-			lhs = stmt->foamDef.lhs;
-
 			loopDefNo(stmt) = loopInfo.numInv;
 			invInfov[loopInfo.numInv] =
 				loopInvInfoNew(&(seq->foamSeq.argv[i]), bb);
@@ -366,8 +558,25 @@ loopInvariantsFindFrBlock(BBlock bb, Loop loop)
 local int
 loopIsInvariantExp(Foam foam, Loop loop)
 {
+	int	i, state;
+
+	/* Only the arguments of a runtime lookup need to be invariant. */
+	if (foamTag(foam) == FOAM_CCall) {
+		if (!loopIsRuntimeLookup(foam->foamCCall.op))
+			return LOOP_InvState_Invalid;
+
+		for (i = 0; i < foamCCallArgc(foam); i++) {
+			state = loopIsInvariantExp(foam->foamCCall.argv[i], loop);
+
+			if (state == LOOP_InvState_Unknown ||
+			    state == LOOP_InvState_Invalid)
+				return state;
+		}
+		return LOOP_InvState_Valid;
+	}
+
 	foamIter(foam, arg, {
-		int state = loopIsInvariantExp(*arg, loop);
+		state = loopIsInvariantExp(*arg, loop);
 
 		if (state == LOOP_InvState_Unknown ||
 		    state == LOOP_InvState_Invalid)
@@ -378,13 +587,14 @@ loopIsInvariantExp(Foam foam, Loop loop)
 		UdInfoList udInfol = udReachingDefs(foam);
 
 		/* Has this var a unique reaching def. and is this def marked
-		 * invariant ?
+		 * invariant ?  Parameters have a false def. with no block.
 		 */
 
 		if (listIsSingleton(udInfol)) {
 			UdInfo ud = car(udInfol);
 
-			if (!lpIsBlockInLoop(udInfoBlock(ud), loop))
+			if (!udInfoBlock(ud) ||
+			    !lpIsBlockInLoop(udInfoBlock(ud), loop))
 				return LOOP_InvState_Valid;
 			
 			if (loopDefNo(udInfoDef(ud)) == LOOP_InvState_Invalid)
@@ -397,7 +607,8 @@ loopIsInvariantExp(Foam foam, Loop loop)
 		}
 
 		listIter(UdInfo, ud, udInfol, {
-			if (lpIsBlockInLoop(udInfoBlock(ud), loop))
+			if (udInfoBlock(ud) &&
+			    lpIsBlockInLoop(udInfoBlock(ud), loop))
 				return LOOP_InvState_Invalid;
 		});
 
@@ -423,20 +634,130 @@ loopIsInvariantExp(Foam foam, Loop loop)
 		/*!! Could check for non-side-effecting expressions here. */
 		return LOOP_InvState_Invalid;
 
-	if (foamTag(foam) == FOAM_CCall) {
-		if (otIsForcer(foam->foamCCall.op))
-			return LOOP_InvState_Valid;
-
-		/*!! Could check for non-side-effecting expressions here. */
-		return LOOP_InvState_Invalid;
-	}
-	
 	if (foamTag(foam) == FOAM_PCall)
 		return LOOP_InvState_Invalid;
 
 	return LOOP_InvState_Invalid;
 }
 
+/* Return true if FOAM can be computed when the loop is not entered:
+ * it must not trap nor change anything the program can see.
+ * Invariance is checked separately.
+ */
+local Bool
+loopIsSpeculable(Foam foam)
+{
+	switch (foamTag(foam)) {
+	case FOAM_CCall:
+		/* Lookups instantiate domains, which may fail. */
+		return false;
+	case FOAM_BCall:
+		if (foamBValInfo(foam->foamBCall.op).hasSideFx ||
+		    loopBValMayTrap(foam->foamBCall.op))
+			return false;
+		break;
+	case FOAM_Loc:
+	case FOAM_Par:
+	case FOAM_Lex:
+	case FOAM_Glo:
+	case FOAM_Cast:
+	case FOAM_RRFmt:
+		break;
+	default:
+		if (!otIsMovableData(foam) && !otIsFoamConst(foam))
+			return false;
+		break;
+	}
+
+	foamIter(foam, arg, {
+		if (!loopIsSpeculable(*arg))
+			return false;
+	});
+
+	return true;
+}
+
+/* Runtime functions which return the same value each time they are called
+ * with the same arguments, and have no effect the program could notice,
+ * apart from instantiating domains.
+ */
+static String loopRuntimeLookups[] = {
+	"domainGetExport!",
+	"domainTestExport!",
+	"domainHash!",
+	"lazyGetExport!",
+	"rtDelayedGetExport!",
+	NULL
+};
+
+local Bool
+loopIsRuntimeLookup(Foam op)
+{
+	RuntimeCallInfo	info;
+	Foam		decl;
+	int		i;
+
+	if (foamTag(op) != FOAM_Glo)
+		return false;
+
+	decl = foamUnitGlobals(loopInfo.unit)->foamDDecl.argv[op->foamGlo.index];
+	info = gen0GetRuntimeCallInfo(decl);
+
+	if (!info || info->hasSideFx)
+		return false;
+
+	if (rtCallIsForce(info))
+		return true;
+
+	if (strIsPrefix(gen0StdLazyNamePrefix(), decl->foamGDecl.id))
+		return true;
+
+	for (i = 0; loopRuntimeLookups[i]; i++)
+		if (strEqual(info->name, loopRuntimeLookups[i]))
+			return true;
+
+	return false;
+}
+
+/* Builtins which fail on some arguments, or read memory. */
+local Bool
+loopBValMayTrap(FoamBValTag op)
+{
+	switch (op) {
+	case FOAM_BVal_SIntMod:
+	case FOAM_BVal_SIntQuo:
+	case FOAM_BVal_SIntRem:
+	case FOAM_BVal_SIntDivide:
+	case FOAM_BVal_SIntPlusMod:
+	case FOAM_BVal_SIntMinusMod:
+	case FOAM_BVal_SIntTimesMod:
+	case FOAM_BVal_SIntTimesModInv:
+	case FOAM_BVal_WordDivideDouble:
+	case FOAM_BVal_BIntMod:
+	case FOAM_BVal_BIntQuo:
+	case FOAM_BVal_BIntRem:
+	case FOAM_BVal_BIntDivide:
+	case FOAM_BVal_BIntPowerMod:
+	case FOAM_BVal_ArrToSFlo:
+	case FOAM_BVal_ArrToDFlo:
+	case FOAM_BVal_ArrToSInt:
+	case FOAM_BVal_ArrToBInt:
+	case FOAM_BVal_ScanSFlo:
+	case FOAM_BVal_ScanDFlo:
+	case FOAM_BVal_ScanSInt:
+	case FOAM_BVal_ScanBInt:
+	case FOAM_BVal_FormatSFlo:
+	case FOAM_BVal_FormatDFlo:
+	case FOAM_BVal_FormatSInt:
+	case FOAM_BVal_FormatBInt:
+	case FOAM_BVal_ListHead:
+	case FOAM_BVal_ListTail:
+		return true;
+	default:
+		return false;
+	}
+}
+
 /* Assign 0 to each def in the blocks in LOOP and build
  * association lists: (Var in LOOP) -> (All definition of Var in LOOP)
  * Return the number of defs found (== potential invariants)
@@ -449,18 +770,28 @@ loopDefinitionsReset(Loop loop /*, Bitv domExits $$*/ )
 	listIter(BBlock, bb, loop->blockList, {
 		int 	i;
 		Foam	 seq = bb->code;
+		Foam	 stmt;
+		Foam	 lhs;
 
 		/* if (!bitvTest(class, domExits, bb->label)) continue; */
 
 		for (i = 0; i < foamArgc(seq); i++) {
 
-			Foam stmt = seq->foamSeq.argv[i];
+			stmt = seq->foamSeq.argv[i];
 
-			if (otIsDef(stmt)) {
-				loopDefNo(stmt) = 0;
-				numDefs++;
+			if (!otIsDef(stmt)) continue;
 
-				otAddVarInfo(stmt, stmt->foamDef.lhs);
+			lhs = stmt->foamDef.lhs;
+			loopDefNo(stmt) = LOOP_InvState_Unknown;
+			numDefs++;
+
+			/* Only definitions of a single local can move. */
+			if (otIsLocalVar(lhs))
+				otAddVarInfo(stmt, lhs);
+			else {
+				loopDefNo(stmt) = LOOP_InvState_Invalid;
+				if (foamTag(lhs) == FOAM_Values)
+					loopAddValuesVarInfo(stmt, lhs);
 			}
 		}
 	});
@@ -473,10 +804,24 @@ loopDefinitionsReset(Loop loop /*, Bitv domExits $$*/ )
 		for (i = 0; i < numDefs + 1; i++)
 			loopInfo.invInfov[i] = (InvInfo) 0;
 	}
+	else
+		loopInfo.invInfov = NULL;
+
 	loopInfo.numDefs = numDefs;
 
 	return numDefs;
 }
+/* Record STMT as a definition of each local in (Values ...) LHS. */
+local void
+loopAddValuesVarInfo(Foam stmt, Foam lhs)
+{
+	int	i;
+
+	for (i = 0; i < foamArgc(lhs); i++)
+		if (otIsLocalVar(lhs->foamValues.argv[i]))
+			otAddVarInfo(stmt, lhs->foamValues.argv[i]);
+}
+
 /****************************************************************************
  *
  * :: Filter Invariants
@@ -485,8 +830,8 @@ loopDefinitionsReset(Loop loop /*, Bitv domExits $$*/ )
 local Bool	loopFilterExp(Foam foam);
 /* local void	loopInvalidateNotUniqueDef(void);*/
 
-local Bool	loopFilterDependencies(Foam foam);
-local Bool	loopIsStillInvariant(Foam foam);
+local Bool	loopFilterDependencies(Foam foam, Loop loop);
+local Bool	loopIsStillInvariant(Foam foam, Loop loop);
 
 /* For each invariant x := (exp), check the following conditions:
  *
@@ -509,7 +854,7 @@ loopInvariantsFilterFrLoop(Loop loop)
 	
 	listIter(BBlock, bb, loop->blockList, {
 
-		if (!loopFilterExp(bb->code))
+		if (loopFilterExp(bb->code))
 			removed = true;
 
 	});
@@ -527,15 +872,16 @@ loopInvariantsFilterFrLoop(Loop loop)
 
 		listIter(BBlock, bb, loop->blockList, {
 
-			/* Consider only blocks which dominates exits */
-			if (!bitvTest(class, loopInfo.domExits, bb->label))
+			/* Consider only blocks where invariants were found */
+			if (!bitvTest(class, loopInfo.domExits, bb->label) &&
+			    !bitvTest(class, loopInfo.domLatches, bb->label))
 				continue;
 
-			if (!loopFilterDependencies(bb->code))
+			if (loopFilterDependencies(bb->code, loop))
 				removed = true;
 
 		});
-}
+	}
 
 }
 
@@ -555,15 +901,21 @@ loopFilterExp(Foam foam)
 	foamIter(foam, arg, {
 		
 		if (otIsDef(*arg)) {
-			if (!loopFilterExp((*arg)->foamDef.rhs))
+			Foam lhs = (*arg)->foamDef.lhs;
+
+			if (loopFilterExp((*arg)->foamDef.rhs))
+				removed = true;
+			/* Uses in (AElt ...) and such on the lhs */
+			if (!otIsVar(lhs) && foamTag(lhs) != FOAM_Values &&
+			    loopFilterExp(lhs))
 				removed = true;
 		}
 		else
-			if (!loopFilterExp(*arg))
+			if (loopFilterExp(*arg))
 				removed = true;
 	});
 
-	if (!otIsVar(foam)) 
+	if (!otIsLocalVar(foam)) 
 		return removed;
 
 	/* Take all definition for this var inside the loop */
@@ -587,8 +939,7 @@ loopFilterExp(Foam foam)
 	udInfol = udReachingDefs(foam);
 	invDef  = car(defs);
 
-	if (!listIsSingleton(udInfol) &&
-	    udInfoDef(car(udInfol))->foamDef.lhs != foam) {
+	if (!listIsSingleton(udInfol) || udInfoDef(car(udInfol)) != invDef) {
 
 		/* The invariant is marked invalid */
 
@@ -608,7 +959,7 @@ loopFilterExp(Foam foam)
 }
 
 local Bool
-loopFilterDependencies(Foam foam)
+loopFilterDependencies(Foam foam, Loop loop)
 {
 	Foam stmt;
 	int	i;
@@ -623,13 +974,12 @@ loopFilterDependencies(Foam foam)
 
 		if (!otIsDef(stmt)) continue;
 
-		if (loopDefNo(stmt) == LOOP_InvState_Invalid) continue;
-
-		assert(loopDefNo(stmt));
+		/* Definitions left unknown are not invariants. */
+		if (loopDefNo(stmt) <= 0) continue;
 
 		/* Found an invariant. Is it still valid ? */
 
-		if (!loopIsStillInvariant(stmt->foamDef.rhs)) {
+		if (!loopIsStillInvariant(stmt->foamDef.rhs, loop)) {
 
 			/* The invariant is marked invalid */
 
@@ -650,36 +1000,282 @@ loopFilterDependencies(Foam foam)
 
 
 local Bool
-loopIsStillInvariant(Foam foam)
+loopIsStillInvariant(Foam foam, Loop loop)
 {
-	UdInfoList udInfol;
-	UdInfo ud;
-
 	foamIter(foam, arg, {
 
-		if (!loopIsStillInvariant(*arg))
+		if (!loopIsStillInvariant(*arg, loop))
 			return false;
 	});
 
-	if (!otIsVar(foam))
+	if (!otIsLocalVar(foam))
 		return true;
 
-	udInfol = udReachingDefs(foam);
+	/* Are the reaching defs. in LOOP still marked invariant ? */
 
-	/* Has this var still a unique reaching def. and is this def marked
-	 * invariant ?
-	 */
+	listIter(UdInfo, ud, udReachingDefs(foam), {
+		if (udInfoBlock(ud) &&
+		    lpIsBlockInLoop(udInfoBlock(ud), loop) &&
+		    loopDefNo(udInfoDef(ud)) <= 0)
+			return false;
+	});
+
+	return true;
+}
+
+/****************************************************************************
+ *
+ * :: Extract Invariant Expressions
+ *
+ ****************************************************************************/
+
+/* Invariant lookups and builtin calls found inside the statements which
+ * stay in LOOP are computed into new locals by the preheader.
+ */
+local void
+loopInvariantsExtractFrLoop(Loop loop)
+{
+	BitvClass	class = loop->bitvClass;
+	Foam		prog = loopInfo.flog->prog;
+
+	loopInfo.extracted = listNil(Foam);
+	loopInfo.newLocals = NULL;
+
+	listIter(BBlock, bb, loop->blockList, {
+		if (bitvTest(class, loopInfo.domExits, bb->label))
+			loopExtractFrBlock(bb, loop, false);
+		else if (bitvTest(class, loopInfo.domLatches, bb->label))
+			loopExtractFrBlock(bb, loop, true);
+	});
+
+	if (!loopInfo.newLocals) return;
+
+	prog->foamProg.locals = fboxMake(loopInfo.newLocals->fbox);
+	vpFree(loopInfo.newLocals);
+	loopInfo.newLocals = NULL;
+
+	loopInfo.numLocs = foamDDeclArgc(prog->foamProg.locals);
+	loopInfo.extracted = listNReverse(Foam)(loopInfo.extracted);
+}
 
-	assert(listIsSingleton(udInfol));
+local void
+loopExtractFrBlock(BBlock bb, Loop loop, Bool speculate)
+{
+	Foam	seq = bb->code, stmt, lhs;
+	int	i;
 
-	ud = car(udInfol);
+	for (i = 0; i < foamArgc(seq); i++) {
+		stmt = seq->foamSeq.argv[i];
 
-	assert(loopDefNo(udInfoDef(ud)));
+		if (!otIsDef(stmt)) {
+			loopExtractArgs(stmt, loop, speculate);
+			continue;
+		}
+
+		/* Invariant definitions are moved as a whole. */
+		if (loopDefNo(stmt) > 0) continue;
+
+		lhs = stmt->foamDef.lhs;
+		if (!otIsVar(lhs) && foamTag(lhs) != FOAM_Values)
+			loopExtractArgs(lhs, loop, speculate);
 
-	if (loopDefNo(udInfoDef(ud)) == LOOP_InvState_Invalid)
+		loopExtractExp(&stmt->foamDef.rhs, loop, speculate);
+	}
+}
+
+local void
+loopExtractExp(Foam * pfoam, Loop loop, Bool speculate)
+{
+	Foam		foam = *pfoam, var;
+	FoamTag		type;
+
+	if (!loopIsExtractable(foam, loop, speculate)) {
+		loopExtractArgs(foam, loop, speculate);
+		return;
+	}
+
+	if (foamTag(foam) == FOAM_BCall)
+		type = foamBValInfo(foam->foamBCall.op).retType;
+	else
+		type = foam->foamCCall.type;
+
+	if (!loopInfo.newLocals)
+		loopInfo.newLocals =
+			vpNew(fboxNew(loopInfo.flog->prog->foamProg.locals));
+
+	var = foamNewLoc(vpNewVar(loopInfo.newLocals, type));
+	foamPos(var) = foamPos(foam);
+
+	listPush(Foam, foamNewSet(var, foam), loopInfo.extracted);
+
+	*pfoam = foamCopy(var);
+}
+
+local void
+loopExtractArgs(Foam foam, Loop loop, Bool speculate)
+{
+	int	i;
+
+	/* The op of a call is never worth a local of its own. */
+	if (foamTag(foam) == FOAM_CCall) {
+		for (i = 0; i < foamCCallArgc(foam); i++)
+			loopExtractExp(&foam->foamCCall.argv[i], loop, speculate);
+		return;
+	}
+
+	foamIter(foam, arg, loopExtractExp(arg, loop, speculate));
+}
+
+local Bool
+loopIsExtractable(Foam foam, Loop loop, Bool speculate)
+{
+	switch (foamTag(foam)) {
+	case FOAM_BCall:
+		if (foamBValInfo(foam->foamBCall.op).retCount != 1 ||
+		    foamBValInfo(foam->foamBCall.op).retType == FOAM_NOp)
+			return false;
+		/* Calls on constants are left to constant folding. */
+		if (!loopHasVar(foam))
+			return false;
+		break;
+	case FOAM_CCall:
+		if (!loopIsRuntimeLookup(foam->foamCCall.op))
+			return false;
+		break;
+	default:
 		return false;
+	}
 
-	return true;
+	if (speculate && !loopIsSpeculable(foam))
+		return false;
+
+	return loopIsInvariantExp(foam, loop) == LOOP_InvState_Valid;
+}
+
+local Bool
+loopHasVar(Foam foam)
+{
+	if (otIsVar(foam)) return true;
+
+	foamIter(foam, arg, {
+		if (loopHasVar(*arg))
+			return true;
+	});
+
+	return false;
+}
+
+/****************************************************************************
+ *
+ * :: Rotate Loops Testing at the Top
+ *
+ ****************************************************************************/
+
+/* Is LOOP left only from its header, by a short block ending in an If,
+ * with invariants which may only be computed once the loop is entered?
+ */
+local Bool
+loopIsRotatable(Loop loop)
+{
+	BBlock		bbHeader = loop->header;
+	BitvClass	class = loop->bitvClass;
+	BBlockList	exits;
+	Bool		result;
+
+	if (bbHeader->kind != FOAM_If ||
+	    foamArgc(bbHeader->code) > LOOP_MaxGuardStmts ||
+	    lpNumBlocksInLoop(loop) < 2)
+		return false;
+
+	exits  = lpExitBlocksFrLoop(loop);
+	result = listIsSingleton(exits) && car(exits) == bbHeader;
+	listFree(BBlock)(exits);
+
+	if (!result) return false;
+
+	listIter(BBlock, bb, loop->blockList, {
+		if (bitvTest(class, loopInfo.domExits, bb->label) ||
+		    !bitvTest(class, loopInfo.domLatches, bb->label))
+			continue;
+		if (loopHasGuardedInvariant(bb->code, loop))
+			return true;
+	});
+
+	return false;
+}
+
+/* Does FOAM compute an invariant which is not speculable, but may be
+ * moved out of a loop which is sure to be entered?
+ */
+local Bool
+loopHasGuardedInvariant(Foam foam, Loop loop)
+{
+	Bool	guarded = false;
+
+	switch (foamTag(foam)) {
+	case FOAM_CCall:
+		guarded = loopIsRuntimeLookup(foam->foamCCall.op);
+		break;
+	case FOAM_BCall:
+		guarded = !foamBValInfo(foam->foamBCall.op).hasSideFx &&
+			loopBValMayTrap(foam->foamBCall.op);
+		break;
+	default:
+		break;
+	}
+
+	if (guarded && loopIsInvariantExp(foam, loop) == LOOP_InvState_Valid)
+		return true;
+
+	foamIter(foam, arg, {
+		if (loopHasGuardedInvariant(*arg, loop))
+			return true;
+	});
+
+	return false;
+}
+
+/* Put a copy of the header of LOOP in front of it.  The entries from
+ * outside the loop go to the copy, which leaves or enters the loop as
+ * the header would on the first trip, so the same code is run.
+ */
+local void
+loopRotate(Loop loop)
+{
+	BBlock		bbGuard, bbHeader = loop->header;
+	FlowGraph	flog = loopInfo.flog;
+	Length		newLab;
+	int		i, j;
+
+	loopDEBUG(dbOut, "Rotating loop with header %d\n",
+		  (int) bbHeader->label);
+
+	flogFixEntries(flog);
+
+	newLab  = flogReserveLabel(flog);
+	bbGuard = bbNew(foamCopy(bbHeader->code), newLab);
+	flogSetBlock(flog, newLab, bbGuard);
+
+	bbufNeed(bbGuard->exits, bbExitC(bbHeader));
+	for (i = 0; i < bbExitC(bbHeader); i++)
+		bbSetExit(bbGuard, i, bbExit(bbHeader, i));
+	bbSetExitC(bbGuard, bbExitC(bbHeader));
+
+	for (i = 0; i < bbEntryC(bbHeader); i++) {
+		BBlock entryBlock = bbEntry(bbHeader, i);
+
+		if (lpIsBlockInLoop(entryBlock, loop)) continue;
+
+		for (j = 0; j < bbExitC(entryBlock); j++)
+			if (bbExit(entryBlock, j) == bbHeader)
+				bbSetExit(entryBlock, j, bbGuard);
+	}
+
+	if (bbHeader == flog->block0) {
+		flog->block0	   = bbGuard;
+		bbGuard->isblock0  = true;
+		bbHeader->isblock0 = false;
+	}
 }
 
 /****************************************************************************
@@ -735,7 +1331,11 @@ loopInvariantsMoveFrLoop(Loop loop)
 
 	/* If bbHeader was the first, now bbPre will be the first */
 
-	if (bbHeader == flog->block0)  flog->block0 = bbPre;
+	if (bbHeader == flog->block0) {
+		flog->block0 	  = bbPre;
+		bbPre->isblock0	  = true;
+		bbHeader->isblock0 = false;
+	}
 
 	/* NOTE: entries have not been modified, but this isn't important,
 	 * because they have been invalidated.
@@ -748,11 +1348,14 @@ loopInvariantsMoveFrLoop(Loop loop)
 local Foam
 loopPreHeaderCodeCreate(Loop loop)
 {
-	Foam	preHeader = foamNewEmpty(FOAM_Seq, loopInfo.numInv);
+	Foam	preHeader;
 	Foam	foam;
 	InvInfo	* invInfov = loopInfo.invInfov;
 	int	j = 0, i;
 
+	preHeader = foamNewEmpty(FOAM_Seq, loopInfo.numInv +
+				 listLength(Foam)(loopInfo.extracted));
+
 	for (i = 1; i < loopInfo.numDefs + 1; i++) {
 
 		if (!invInfov[i]) continue;
@@ -768,6 +1371,11 @@ loopPreHeaderCodeCreate(Loop loop)
 
 	assert(j == loopInfo.numInv - 1);
 
+	/* The extracted expressions may use the invariants. */
+	listIter(Foam, stmt, loopInfo.extracted, {
+		preHeader->foamSeq.argv[j++] = stmt;
+	});
+
 	/* Add: (Goto the header block) */
 	preHeader->foamSeq.argv[j] = foamNewGoto(loop->header->label);
 
@@ -782,153 +1390,89 @@ loopPreHeaderCodeCreate(Loop loop)
 
 /****************************************************************************
  *
- * :: Updated dflow info and loops
+ * :: Utility
  *
  ****************************************************************************/
 
-local void	loopUpdateBlocks	(Loop, BBlock, LoopList);
-local void	loopUpdateDominators	(Loop, BBlock);
-local void	loopUpdateUseDefChains	(void);
-
-/******************************************************************************
- *
- * :: Update dflow info and loops
- *
- *****************************************************************************/
-
-local void
-loopUpdate(Loop loop, BBlock preHeader, LoopList loops)
-{
-
-	loopUpdateBlocks(loop, preHeader, loops);
-	loopUpdateDominators(loop, preHeader);
-	loopUpdateUseDefChains();
-}
-
-
-local void
-loopUpdateBlocks(Loop loop, BBlock preHeader, LoopList loops)
+/* Return a bitv where are on only bits corresponding to blocks in LOOP which
+ * dominate all the blocks in BLOCKS.  An empty list gives an empty set:
+ * a loop with no exits is never left, so nothing is sure to run before.
+ */
+local Bitv
+loopFindDominatorsOf(Loop loop, BBlockList blocks)
 {
-	BitvClass	oldClass, newClass;
-	Length		newbit = bitvClassSize(loop->bitvClass);
-
-	listIter(Loop, loop0, loops, {
-		oldClass = loop0->bitvClass;
-		newClass = bitvClassCreate(bitvClassSize(oldClass) + 1);
+	BitvClass	bclass = loop->bitvClass;
+	Bitv	     	bres = bitvNew(bclass);
 
-		assert(bitvClassSize(newClass) == preHeader->label + 1);
+	bitvClearAll(bclass, bres);
 
-		loop0->blockSet = 
-			bitvResize(newClass, oldClass, loop0->blockSet);
+	if (!blocks) return bres;
 
-		loop0->bitvClass = newClass;
+	listIter(BBlock, bb, loop->blockList, {
 
-		if (lpIsBlockInLoop(loop->header, loop0)) {
-			bitvSet(newClass, loop0->blockSet, newbit);
-			listPush(BBlock, preHeader, loop0->blockList);
-		}
+		if (loopBlockDominatesAll(bb, blocks))
+			bitvSet(bclass, bres, bb->label);
 
-		bitvClassDestroy(oldClass);
 	});
-}
-
-local void
-loopUpdateDominators(Loop loop, BBlock preHeader)
-{
-	Dominators doms = loopInfo.doms;
-	int	   	i;
-	BitvClass	newClass, oldClass;
-
-	oldClass = doms->bitvClass;
-	newClass = bitvClassCreate(bitvClassSize(oldClass) + 1);
-
-	for (i = 0; i < doms->nBlocks; i++)
-		doms->doms[i] = bitvResize(newClass, oldClass, doms->doms[i]);
-
-	doms->nBlocks += 1;
-	bitvClassDestroy(doms->bitvClass);
-	doms->bitvClass = newClass;
-
-	assert(bitvClassSize(newClass) == doms->nBlocks);
-	assert(bitvClassSize(newClass) == bitvClassSize(loop->bitvClass) + 1);
 
-	/* 1) Each dominator of loop->header become a dominator of preheader.*/
-
-	flogIter(loopInfo.flog, bb, {
-
-		if (bb == preHeader) continue;
-
-		if (lpIsDom(doms, bb, loop->header))
-			lpSetDom(doms, bb, preHeader);
-	});
+	return bres;
+}
 
-	/* 2) Preheader become dominator of header. */
 
-	lpSetDom(doms, preHeader, loop->header);
-	
-}
+/* Return true iif BB dominates all the blocks in BLOCKS */
 
-/* Now this operation is expensive, because all the ud-chains are recomputed
- * again.
- * ToDo:
- *   The UdInfo can be a pair (BB, index), where index is such that
- *    bb->code->foamSeq.argv[index] is the reaching def.
- *   In such way each (NOp) generated when a def is moved will have a UdInfo
- *   on it, (new-block, new-index), and the definition can be found
- *   dereferencing this chains.
- */
-local void
-loopUpdateUseDefChains()
+local Bool
+loopBlockDominatesAll(BBlock bb, BBlockList blocks)
 {
-	usedefChainsFreeFrFlog(loopInfo.flog);
+	Dominators	doms = loopInfo.doms;
 
-	flogReuse(loopInfo.flog, FLOG_UniqueExit);
+	listIter(BBlock, bbOther, blocks, {
+		if (!lpIsDom(doms, bb, bbOther))
+		    	return false;
+	});
 
-	usedefChainsFrFlog(loopInfo.flog, UD_OUTPUT_UdList);
+	return true;
 }
 
-/****************************************************************************
- *
- * :: Utility
- *
- ****************************************************************************/
+/* Return the blocks of LOOP which jump back to the header. */
 
-/* Return a bitv where are on only bits corresponding to blocks in LOOP which
- * dominates all the loop exits
- */
-local Bitv
-loopFindExitsDominators(Loop loop)
+local BBlockList
+loopLatchBlocksFrLoop(Loop loop)
 {
-	BitvClass	bclass = loop->bitvClass;
-	Bitv	     	bres = bitvNew(bclass);
-	BBlockList	exitBlocks = lpExitBlocksFrLoop(loop);
-
-	bitvCopy(bclass, bres, loop->blockSet);
+	BBlockList	latches = listNil(BBlock);
+	int		i;
 
 	listIter(BBlock, bb, loop->blockList, {
+		for (i = 0; i < bbExitC(bb); i++)
+			if (bbExit(bb, i) == loop->header) break;
 
-		if (!loopBlockDominatesAllExits(bb, exitBlocks))
-			bitvClear(bclass, bres, bb->label);
-
+		if (i != bbExitC(bb))
+			listPush(BBlock, bb, latches);
 	});
 
-	return bres;
+	return latches;
 }
 
+/* Add to DEFC[i] the number of definitions of (Loc i) in FOAM. */
 
-/* Return true iif BB dominates all the blocks in EXITS */
-
-local Bool
-loopBlockDominatesAllExits(BBlock bb, BBlockList exits)
+local void
+loopCountDefs(Foam foam, int * defc)
 {
-	Dominators	doms = loopInfo.doms;
+	Foam	lhs;
 
-	listIter(BBlock, bbLoopExit, exits, {
-		if (!lpIsDom(doms, bb, bbLoopExit))
-		    	return false;
-	});
+	foamIter(foam, arg, loopCountDefs(*arg, defc));
 
-	return true;
+	if (!otIsDef(foam)) return;
+
+	lhs = foam->foamDef.lhs;
+
+	if (foamTag(lhs) == FOAM_Loc)
+		defc[lhs->foamLoc.index] += 1;
+	else if (foamTag(lhs) == FOAM_Values)
+		foamIter(lhs, var, {
+			if (foamTag(*var) == FOAM_Loc)
+				defc[(*var)->foamLoc.index] += 1;
+		});
 }
 
 /*****************************************************************************
@@ -947,3 +1491,23 @@ loopInvInfoNew(Foam * pstmt, BBlock bb)
 
 	return invInfo;
 }
+
+local void
+loopInvariantsFree(void)
+{
+	int	i;
+
+	bitvFree(loopInfo.domExits);
+	bitvFree(loopInfo.domLatches);
+
+	listFree(Foam)(loopInfo.extracted);
+	loopInfo.extracted = listNil(Foam);
+
+	if (!loopInfo.invInfov) return;
+
+	for (i = 1; i < loopInfo.numDefs + 1; i++)
+		if (loopInfo.invInfov[i]) stoFree(loopInfo.invInfov[i]);
+
+	stoFree(loopInfo.invInfov);
+	loopInfo.invInfov = NULL;
+}
@@ -11,6 +11,6 @@
 
 #include "axlobs.h"
 extern void		loopUnit			(Foam);
-extern void		loopInvariantsMoveFrFlog	(FlowGraph);
+extern Bool		loopInvariantsMoveFrFlog	(FlowGraph);
 
 #endif  /* _OF_LOOPS_H */
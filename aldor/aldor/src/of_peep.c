@@ -77,8 +77,11 @@ peepUnit(Foam unit,Bool foldfloats)
 		def = defs->foamDDef.argv[i];
 		rhs = def->foamDef.rhs;
 
-		if (foamTag(rhs) == FOAM_Prog)
+		if (foamTag(rhs) == FOAM_Prog) {
+			optProgSpanStart(unit, i);
 			def->foamDef.rhs = peepProg(rhs,foldfloats);
+			optProgSpanEnd();
+		}
 	}
 
 	assert(foamAudit(unit));
@@ -0,0 +1,663 @@
+/*****************************************************************************
+ *
+ * of_sccp.c: Sparse conditional constant propagation.
+ *
+ * Copyright (c) 1990-2007 Aldor Software Organization Ltd (Aldor.org).
+ *
+ ****************************************************************************/
+
+/*
+ * Sparse conditional constant propagation
+ *
+ * (Refer. to Wegman, Zadeck: "Constant Propagation with Conditional
+ * Branches", TOPLAS 13(2), 1991)
+ *
+ * Each prog is put in SSA form (see genssa.c), folding copies of locals
+ * and parameters as it goes.  Every SSA name then gets a value in the
+ * lattice
+ *
+ *	Top (no value seen yet) > Const (one immediate value) > Bottom
+ *
+ * and every block and flog edge is either executable or not.  Starting
+ * with the entry block, the values of definitions in executable blocks
+ * are computed by folding their right hand side (with cfold) and the
+ * branches at the end of executable blocks mark their targets executable.
+ * Phi functions only take account of the values flowing in along
+ * executable edges, so constants survive branches which are never taken.
+ * When the value of a name goes down, the statements using it are looked
+ * at again.  Values only go down, so this stops.
+ *
+ * When it does, uses of names with a constant value are replaced by the
+ * constant, branches with a constant test are turned into gotos, which
+ * leaves the blocks which are not executable unreachable, and the prog
+ * is constant folded.  Definitions which become dead are left to dead
+ * assignment elimination.
+ *
+ * This does the work of iterating copy propagation and constant folding
+ * until nothing changes, in one pass and with a single flog.  Only
+ * immediate values (see cpIsImmediate) are propagated, as cprop does.
+ */
+
+#include "debug.h"
+#include "flog.h"
+#include "genssa.h"
+#include "of_cfold.h"
+#include "of_cprop.h"
+#include "of_sccp.h"
+#include "optfoam.h"
+#include "store.h"
+
+Bool	sccpDebug	= false;
+
+#define sccpDEBUG	DEBUG_IF(sccp)	afprintf
+
+/****************************************************************************
+ *
+ * :: Type definitions
+ *
+ ****************************************************************************/
+
+enum sccpKind {
+	SCCP_Top,
+	SCCP_Const,
+	SCCP_Bottom
+};
+
+typedef struct {
+	SSA		ssa;
+	Foam		formats;	/* Formats of the unit */
+	Foam		prog;
+	Bool		foldAll;
+	Bool		foldFloat;
+
+	AInt		namec;		/* Size of the tables below */
+	char		*kind;		/* Lattice value of each name ... */
+	Foam		*value;		/* ... and its constant, if any */
+
+	Bool		*visited;	/* Executable blocks */
+	AInt		*exitBase;	/* Index of first exit of each block */
+	Bool		*exitExec;	/* Executable exits */
+
+	AIntList	blockWork;	/* Blocks to visit */
+	FoamUses	stmtWork;	/* Statements to look at again */
+
+	int		nConsts;	/* Uses replaced by constants */
+	int		nBranches;	/* Branches turned into gotos */
+} SccpInfo;
+
+static SccpInfo	sccpInfo;
+
+/****************************************************************************
+ *
+ * :: Local declarations
+ *
+ ****************************************************************************/
+
+local Foam	sccpProg		(Foam);
+local void	sccpInit		(SSA);
+local void	sccpFini		(void);
+
+local void	sccpPropagate		(void);
+local void	sccpVisitBlock		(AInt);
+local void	sccpVisitStmt		(Foam, AInt);
+local void	sccpVisitBranch		(BBlock);
+local void	sccpMarkExit		(BBlock, AInt);
+local void	sccpMarkAllExits	(BBlock);
+local Bool	sccpIsEdgeExec		(BBlock, AInt);
+local void	sccpEvalPhi		(Foam, AInt);
+local int	sccpEval		(Foam, Foam *);
+local int	sccpExpKind		(Foam);
+local Bool	sccpHasLoc		(Foam);
+local Foam	sccpSubstCopy		(Foam);
+local void	sccpSetValue		(AInt, int, Foam);
+
+local void	sccpRewrite		(void);
+local Foam	sccpSubst		(Foam);
+
+/****************************************************************************
+ *
+ * :: External entry points
+ *
+ ****************************************************************************/
+
+/*
+ * Run on each prog with copy propagation or constant folding pending.
+ */
+void
+sccpUnit(Foam unit, Bool foldAll, Bool foldFloat)
+{
+	Foam	defs, def;
+	int	i;
+
+	assert(foamTag(unit) == FOAM_Unit);
+
+	sccpInfo.formats   = unit->foamUnit.formats;
+	sccpInfo.foldAll   = foldAll;
+	sccpInfo.foldFloat = foldFloat;
+
+	defs = unit->foamUnit.defs;
+	for (i = 0; i < foamArgc(defs); i++) {
+		def = defs->foamDDef.argv[i];
+		assert(foamTag(def) == FOAM_Def);
+		if (foamTag(def->foamDef.rhs) != FOAM_Prog) continue;
+
+		optProgSpanStart(unit, i);
+		def->foamDef.rhs = sccpProg(def->foamDef.rhs);
+		optProgSpanEnd();
+	}
+}
+
+/****************************************************************************
+ *
+ * :: sccpProg
+ *
+ ****************************************************************************/
+
+local Foam
+sccpProg(Foam prog)
+{
+	FlowGraph	flog;
+	SSA		ssa;
+	Bool		changed = false;
+
+	assert(foamTag(prog) == FOAM_Prog);
+
+	if (!optIsCPropPending(prog) && !optIsCFoldPending(prog))
+		return prog;
+	optResetCPropPending(prog);
+	optResetCFoldPending(prog);
+
+	flog = flogFrProg(prog, FLOG_UniqueExit);
+	ssa  = ssaFromFlog(flog, true);
+
+	if (ssa) {
+		sccpInit(ssa);
+		sccpPropagate();
+		sccpRewrite();
+
+		sccpDEBUG(dbOut, "sccp: %d copies, %d constants, %d branches\n",
+			  ssa->copies, sccpInfo.nConsts, sccpInfo.nBranches);
+
+		changed = ssa->copies + sccpInfo.nConsts +
+			sccpInfo.nBranches > 0;
+		sccpFini();
+		ssaToFlog(ssa);
+	}
+	prog = flogToProg(flog);
+
+	changed |= cfoldProgBody(sccpInfo.formats, prog, sccpInfo.foldAll,
+				 sccpInfo.foldFloat);
+
+	if (changed)
+		optSetPending(prog, OPT_PEEP | OPT_JFLOW | OPT_CSE |
+			      OPT_DEADV | OPT_LOOP);
+
+	return prog;
+}
+
+local void
+sccpInit(SSA ssa)
+{
+	AInt	i, nexits = 0;
+
+	sccpInfo.ssa	  = ssa;
+	sccpInfo.prog	  = ssa->flog->prog;
+	sccpInfo.namec	  = ssa->namec;
+	sccpInfo.kind	  = (char *) stoAlloc(OB_Other, ssa->namec);
+	sccpInfo.value	  = (Foam *) stoAlloc(OB_Other,
+					      ssa->namec * sizeof(Foam));
+	sccpInfo.visited  = (Bool *) stoAlloc(OB_Other,
+					      ssa->blockc * sizeof(Bool));
+	sccpInfo.exitBase = (AInt *) stoAlloc(OB_Other,
+					      ssa->blockc * sizeof(AInt));
+
+	/* Names for the values of locals on entry are unknown */
+	for (i = 0; i < ssa->namec; i++) {
+		sccpInfo.kind[i]  = i < ssa->locc ? SCCP_Bottom : SCCP_Top;
+		sccpInfo.value[i] = NULL;
+	}
+	for (i = 0; i < ssa->blockc; i++) {
+		BBlock	bb = ssaBlock(ssa, i);
+
+		sccpInfo.visited[i]  = false;
+		sccpInfo.exitBase[i] = nexits;
+		if (bb) nexits += bbExitC(bb);
+	}
+	sccpInfo.exitExec = (Bool *) stoAlloc(OB_Other,
+					      (nexits + 1) * sizeof(Bool));
+	for (i = 0; i < nexits; i++) sccpInfo.exitExec[i] = false;
+
+	sccpInfo.blockWork = listNil(AInt);
+	sccpInfo.stmtWork  = fuEmpty();
+	sccpInfo.nConsts   = 0;
+	sccpInfo.nBranches = 0;
+}
+
+local void
+sccpFini()
+{
+	AInt	i;
+
+	for (i = 0; i < sccpInfo.namec; i++)
+		if (sccpInfo.value[i]) foamFree(sccpInfo.value[i]);
+	stoFree(sccpInfo.kind);
+	stoFree(sccpInfo.value);
+	stoFree(sccpInfo.visited);
+	stoFree(sccpInfo.exitBase);
+	stoFree(sccpInfo.exitExec);
+	sccpInfo.ssa = NULL;
+}
+
+/****************************************************************************
+ *
+ * :: Propagation
+ *
+ ****************************************************************************/
+
+local void
+sccpPropagate()
+{
+	SSA	ssa = sccpInfo.ssa;
+
+	sccpInfo.visited[ssa->root] = true;
+	sccpInfo.blockWork = listCons(AInt)(ssa->root, listNil(AInt));
+
+	while (sccpInfo.blockWork || sccpInfo.stmtWork) {
+		if (sccpInfo.blockWork) {
+			AInt	n = car(sccpInfo.blockWork);
+			sccpInfo.blockWork =
+				listFreeCons(AInt)(sccpInfo.blockWork);
+			sccpVisitBlock(n);
+		}
+		else {
+			FoamUses fu = sccpInfo.stmtWork;
+			sccpInfo.stmtWork = fuNext(fu);
+			sccpVisitStmt(fuStmt(fu), fuBlock(fu));
+			stoFree(fu);
+		}
+	}
+}
+
+local void
+sccpVisitBlock(AInt n)
+{
+	BBlock	bb = ssaBlock(sccpInfo.ssa, n);
+	Foam	code = bb->code;
+	AInt	k;
+
+	for (k = 0; k < foamArgc(code); k++)
+		sccpVisitStmt(code->foamSeq.argv[k], n);
+
+	switch (foamTag(bbLastStat(bb))) {
+	  case FOAM_If:
+	  case FOAM_Select:
+		/* Done by sccpVisitStmt */
+		break;
+	  case FOAM_Goto:
+		sccpMarkExit(bb, int0);
+		break;
+	  default:
+		sccpMarkAllExits(bb);
+		break;
+	}
+}
+
+/*
+ * (Re)compute the value defined by stmt, or the targets of the branch
+ * stmt, which is in block n.
+ */
+local void
+sccpVisitStmt(Foam stmt, AInt n)
+{
+	Foam	lhs, val;
+	int	kind;
+
+	switch (foamTag(stmt)) {
+	  case FOAM_Set:
+	  case FOAM_Def:
+		break;
+	  case FOAM_If:
+	  case FOAM_Select: {
+		BBlock	bb = ssaBlock(sccpInfo.ssa, n);
+		if (stmt == bbLastStat(bb)) sccpVisitBranch(bb);
+		return;
+	  }
+	  default:
+		return;
+	}
+
+	lhs = stmt->foamSet.lhs;
+	if (foamTag(lhs) == FOAM_Values) {
+		AInt	v;
+		for (v = 0; v < foamArgc(lhs); v++) {
+			Foam	var = lhs->foamValues.argv[v];
+			if (foamTag(var) == FOAM_Loc)
+				sccpSetValue(var->foamLoc.index,
+					     SCCP_Bottom, NULL);
+		}
+		return;
+	}
+	if (foamTag(lhs) != FOAM_Loc) return;
+
+	if (foamIsPhiFunction(stmt->foamSet.rhs)) {
+		sccpEvalPhi(stmt, n);
+		return;
+	}
+
+	kind = sccpEval(stmt->foamSet.rhs, &val);
+	sccpSetValue(lhs->foamLoc.index, kind, val);
+}
+
+local void
+sccpVisitBranch(BBlock bb)
+{
+	Foam	stmt = bbLastStat(bb), val;
+	int	kind;
+
+	if (foamTag(stmt) == FOAM_If) {
+		kind = sccpEval(stmt->foamIf.test, &val);
+		if (kind == SCCP_Const && foamTag(val) == FOAM_Bool)
+			sccpMarkExit(bb, val->foamBool.BoolData ? 1 : 0);
+		else
+			sccpMarkAllExits(bb);
+	}
+	else {
+		kind = sccpEval(stmt->foamSelect.op, &val);
+		if (kind == SCCP_Const && foamTag(val) == FOAM_SInt &&
+		    val->foamSInt.SIntData >= 0 &&
+		    val->foamSInt.SIntData < bbExitC(bb))
+			sccpMarkExit(bb, val->foamSInt.SIntData);
+		else
+			sccpMarkAllExits(bb);
+	}
+	if (kind == SCCP_Const) foamFree(val);
+}
+
+local void
+sccpMarkExit(BBlock bb, AInt e)
+{
+	AInt	ix = sccpInfo.exitBase[bb->label] + e;
+	BBlock	succ = bbExit(bb, e);
+	Foam	code;
+	AInt	k;
+
+	if (sccpInfo.exitExec[ix]) return;
+	sccpInfo.exitExec[ix] = true;
+
+	if (!sccpInfo.visited[succ->label]) {
+		sccpInfo.visited[succ->label] = true;
+		sccpInfo.blockWork = listCons(AInt)(succ->label,
+						    sccpInfo.blockWork);
+		return;
+	}
+
+	/* A new edge into a visited block: look at its phis again */
+	code = succ->code;
+	for (k = 0; k < foamArgc(code); k++) {
+		Foam	stmt = code->foamSeq.argv[k];
+		if (!foamIsPhiStmt(stmt)) break;
+		sccpInfo.stmtWork = fuNew(stmt, succ->label, sccpInfo.stmtWork);
+	}
+}
+
+local void
+sccpMarkAllExits(BBlock bb)
+{
+	AInt	e;
+
+	for (e = 0; e < bbExitC(bb); e++)
+		sccpMarkExit(bb, e);
+}
+
+/*
+ * Is entry j of bb (the extra entry of the root included) executable?
+ */
+local Bool
+sccpIsEdgeExec(BBlock bb, AInt j)
+{
+	BBlock	pred;
+	AInt	e;
+
+	if (j == bbEntryC(bb)) return true;
+
+	pred = bbEntry(bb, j);
+	if (!sccpInfo.visited[pred->label]) return false;
+	for (e = 0; e < bbExitC(pred); e++)
+		if (bbExit(pred, e) == bb &&
+		    sccpInfo.exitExec[sccpInfo.exitBase[pred->label] + e])
+			return true;
+	return false;
+}
+
+local void
+sccpEvalPhi(Foam stmt, AInt n)
+{
+	BBlock	bb = ssaBlock(sccpInfo.ssa, n);
+	Foam	phi = stmt->foamSet.rhs;
+	Foam	val = NULL;
+	int	kind = SCCP_Top;
+	AInt	j;
+
+	for (j = 0; j < foamArgc(phi) - 1 && kind != SCCP_Bottom; j++) {
+		AInt	name;
+
+		if (!sccpIsEdgeExec(bb, j)) continue;
+
+		name = phi->foamBCall.argv[j]->foamLoc.index;
+		switch (sccpInfo.kind[name]) {
+		  case SCCP_Top:
+			break;
+		  case SCCP_Const:
+			if (kind == SCCP_Top) {
+				kind = SCCP_Const;
+				val  = sccpInfo.value[name];
+			}
+			else if (!foamEqual(val, sccpInfo.value[name]))
+				kind = SCCP_Bottom;
+			break;
+		  default:
+			kind = SCCP_Bottom;
+			break;
+		}
+	}
+	sccpSetValue(stmt->foamSet.lhs->foamLoc.index, kind,
+		     kind == SCCP_Const ? foamCopy(val) : NULL);
+}
+
+/*
+ * Evaluate expr.  For a constant, *pval is set to a new copy of the
+ * value.
+ */
+local int
+sccpEval(Foam expr, Foam *pval)
+{
+	int	kind = sccpExpKind(expr);
+	Foam	val;
+
+	*pval = NULL;
+	if (kind != SCCP_Const) return kind;
+
+	if (foamTag(expr) == FOAM_Loc) {
+		*pval = foamCopy(sccpInfo.value[expr->foamLoc.index]);
+		return SCCP_Const;
+	}
+
+	val = cfoldProgExpr(sccpInfo.formats, sccpInfo.prog,
+			    sccpSubstCopy(expr), sccpInfo.foldAll,
+			    sccpInfo.foldFloat);
+	if (!cpIsImmediate(val)) {
+		foamFree(val);
+		return SCCP_Bottom;
+	}
+	*pval = val;
+	return SCCP_Const;
+}
+
+/*
+ * The meet of the values of the locals in expr, or Bottom if expr
+ * cannot be evaluated at compile time.
+ */
+local int
+sccpExpKind(Foam expr)
+{
+	FoamTag	tag = foamTag(expr);
+	int	kind = SCCP_Const;
+
+	if (tag == FOAM_Loc)
+		return sccpInfo.kind[expr->foamLoc.index];
+	if ((tag >= FOAM_DATA_START && tag < FOAM_DATA_LIMIT) ||
+	    tag == FOAM_BInt)
+		return SCCP_Const;
+	if (cpIsImmediate(expr))
+		return sccpHasLoc(expr) ? SCCP_Bottom : SCCP_Const;
+	if (tag != FOAM_BCall && tag != FOAM_Cast)
+		return SCCP_Bottom;
+
+	foamIter(expr, argp, {
+		int k = sccpExpKind(*argp);
+		if (k == SCCP_Bottom) return SCCP_Bottom;
+		if (k == SCCP_Top) kind = SCCP_Top;
+	});
+	return kind;
+}
+
+local Bool
+sccpHasLoc(Foam foam)
+{
+	if (foamTag(foam) == FOAM_Loc) return true;
+	foamIter(foam, argp, {
+		if (sccpHasLoc(*argp)) return true;
+	});
+	return false;
+}
+
+/*
+ * A copy of expr with each local replaced by its constant value.
+ */
+local Foam
+sccpSubstCopy(Foam expr)
+{
+	Foam	copy;
+
+	if (foamTag(expr) == FOAM_Loc)
+		return foamCopy(sccpInfo.value[expr->foamLoc.index]);
+
+	copy = foamCopyNode(expr);
+	foamIter(copy, argp, *argp = sccpSubstCopy(*argp));
+	return copy;
+}
+
+/*
+ * Lower the value of name to (kind, val), taking ownership of val, and
+ * look again at the statements using name if it changed.
+ */
+local void
+sccpSetValue(AInt name, int kind, Foam val)
+{
+	int		old = sccpInfo.kind[name];
+	FoamUses	fu;
+
+	if (kind == SCCP_Top || old == SCCP_Bottom ||
+	    (old == SCCP_Const && kind == SCCP_Const &&
+	     foamEqual(val, sccpInfo.value[name]))) {
+		if (val) foamFree(val);
+		return;
+	}
+
+	if (sccpInfo.value[name]) foamFree(sccpInfo.value[name]);
+	if (old == SCCP_Const || kind == SCCP_Bottom) {
+		if (val) foamFree(val);
+		sccpInfo.kind[name]  = SCCP_Bottom;
+		sccpInfo.value[name] = NULL;
+	}
+	else {
+		sccpInfo.kind[name]  = SCCP_Const;
+		sccpInfo.value[name] = val;
+	}
+
+	for (fu = sccpInfo.ssa->uses[name]; fu; fu = fuNext(fu))
+		if (sccpInfo.visited[fuBlock(fu)])
+			sccpInfo.stmtWork = fuNew(fuStmt(fu), fuBlock(fu),
+						  sccpInfo.stmtWork);
+}
+
+/****************************************************************************
+ *
+ * :: Rewriting
+ *
+ ****************************************************************************/
+
+/*
+ * Replace uses of constant names in executable blocks and specialise
+ * branches with a single executable exit.
+ */
+local void
+sccpRewrite()
+{
+	SSA	ssa = sccpInfo.ssa;
+	AInt	i, k, e;
+
+	for (i = 0; i < ssa->nodec; i++) {
+		AInt	n = ssa->vertex[i];
+		BBlock	bb = ssaBlock(ssa, n);
+		Foam	code = bb->code, last;
+		AInt	nexec, exec = 0;
+
+		if (!sccpInfo.visited[n]) continue;
+
+		for (k = 0; k < foamArgc(code); k++) {
+			Foam	stmt = code->foamSeq.argv[k], lhs;
+
+			if (foamTag(stmt) != FOAM_Set &&
+			    foamTag(stmt) != FOAM_Def) {
+				code->foamSeq.argv[k] = sccpSubst(stmt);
+				continue;
+			}
+			if (foamIsPhiFunction(stmt->foamSet.rhs)) continue;
+
+			stmt->foamSet.rhs = sccpSubst(stmt->foamSet.rhs);
+			lhs = stmt->foamSet.lhs;
+			if (foamTag(lhs) == FOAM_Values) {
+				AInt	v;
+				for (v = 0; v < foamArgc(lhs); v++)
+					if (foamTag(lhs->foamValues.argv[v])
+					    != FOAM_Loc)
+						lhs->foamValues.argv[v] =
+						  sccpSubst(lhs->foamValues.argv[v]);
+			}
+			else if (foamTag(lhs) != FOAM_Loc)
+				stmt->foamSet.lhs = sccpSubst(lhs);
+		}
+
+		last = bbLastStat(bb);
+		if (foamTag(last) != FOAM_If && foamTag(last) != FOAM_Select)
+			continue;
+		if (bb->kind != FOAM_If && bb->kind != FOAM_Select)
+			continue;
+
+		for (e = nexec = 0; e < bbExitC(bb); e++)
+			if (sccpInfo.exitExec[sccpInfo.exitBase[n] + e]) {
+				nexec += 1;
+				exec = e;
+			}
+		if (nexec == 1 && bbExitC(bb) > 1) {
+			bbSpecializeExit(bb, exec);
+			sccpInfo.nBranches += 1;
+		}
+	}
+}
+
+local Foam
+sccpSubst(Foam foam)
+{
+	if (foamTag(foam) == FOAM_Loc) {
+		AInt	name = foam->foamLoc.index;
+
+		if (sccpInfo.kind[name] != SCCP_Const) return foam;
+		foamFree(foam);
+		sccpInfo.nConsts += 1;
+		return foamCopy(sccpInfo.value[name]);
+	}
+	foamIter(foam, argp, *argp = sccpSubst(*argp));
+	return foam;
+}
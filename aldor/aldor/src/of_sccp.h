@@ -0,0 +1,16 @@
+/*****************************************************************************
+ *
+ * of_sccp.h: Sparse conditional constant propagation.
+ *
+ * Copyright (c) 1990-2007 Aldor Software Organization Ltd (Aldor.org).
+ *
+ ****************************************************************************/
+
+#ifndef _OF_SCCP_H_
+#define _OF_SCCP_H_
+
+#include "axlobs.h"
+
+extern void	sccpUnit	(Foam, Bool, Bool);
+
+#endif /* !_OF_SCCP_H_ */
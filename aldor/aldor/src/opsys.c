@@ -140,6 +140,15 @@ osObtainLicense(void)
  *
  * :: osRun
  * :: osRunConcurrent
+ * :: osFork
+ * :: osRunAsync
+ * :: osWait
+ * :: osForkExit
+ * :: osWaitDone
+ * :: osWaitAny
+ * :: osServerOpen
+ * :: osServerAccept
+ * :: osServerConnect
  * :: osRunQuoteArg
  *
  ****************************************************************************/
@@ -164,6 +173,100 @@ osRunConcurrent(String cmd, FILE **pstdin, FILE **pstdout, FILE **pstderr)
 
 #endif /* ! OS_Has_RunConcurrent */
 
+#if !defined(OS_Has_Fork)
+
+int
+osFork(FILE *out)
+{
+	return -1;
+}
+
+int
+osRunAsync(String cmd, FILE *out)
+{
+	return -1;
+}
+
+int
+osWait(int pid, int *pstatus)
+{
+	return -1;
+}
+
+void
+osForkExit(int status)
+{
+	exit(status);
+}
+
+int
+osWaitDone(int *pstatus)
+{
+	return -1;
+}
+
+int
+osWaitAny(int *pidv, int n, int *pstatus)
+{
+	return -1;
+}
+
+int
+osGetPid(void)
+{
+	return 0;
+}
+
+#endif /* ! OS_Has_Fork */
+
+#if !defined(OS_Has_Server)
+
+int
+osServerOpen(String path)
+{
+	return -1;
+}
+
+FILE *
+osServerAccept(int sd, FILE **pout)
+{
+	return NULL;
+}
+
+FILE *
+osServerConnect(String path, FILE **pout)
+{
+	return NULL;
+}
+
+#endif /* ! OS_Has_Server */
+
+#if !defined(OS_Has_Threads)
+
+OsThread
+osThreadStart(void (*fun)(Pointer), Pointer arg)
+{
+	return 0;
+}
+
+void
+osThreadJoin(OsThread t)
+{
+}
+
+void
+osThreadYield(void)
+{
+}
+
+int
+osCpuCount(void)
+{
+	return 1;
+}
+
+#endif /* ! OS_Has_Threads */
+
 #if !defined(OS_Has_RunQuoteArg)
 
 /*
@@ -230,6 +333,16 @@ osCpuTime(void)
 
 #endif /* ! OS_CpuTime */
 
+#if !defined(OS_Has_WallTime)
+
+ULong
+osWallTime(void)
+{
+	return (ULong) osCpuTime() * 1000;
+}
+
+#endif /* ! OS_Has_WallTime */
+
 
 #if !defined(OS_Has_Date)
 
@@ -727,6 +840,8 @@ osFEof(FILE *f)
  * :: osFileIsThere
  * :: osFileSize
  * :: osFileHash
+ * :: osFileMap
+ * :: osFileUnmap
  * :: osDirIsThere
  * :: osDirSwap
  *
@@ -843,6 +958,22 @@ osFileHash(String name)
 #endif /* ! OS_Has_FileHash */
 
 
+#if !defined(OS_Has_FileMap)
+
+Pointer
+osFileMap(FILE *f, Length *psize)
+{
+	return 0;
+}
+
+void
+osFileUnmap(Pointer p, Length size)
+{
+}
+
+#endif	/* ! OS_Has_FileMap */
+
+
 #if !defined(OS_Has_DirIsThere)
 
 Bool
@@ -979,6 +1110,22 @@ osAllocShow(void)
 #endif	/* ! OS_Has_Alloc */
 
 
+/*****************************************************************************
+ *
+ * :: osMemRelease
+ *
+ ****************************************************************************/
+
+#if !defined(OS_Has_MemRelease)
+
+void
+osMemRelease(Pointer p, ULong nbytes)
+{
+}
+
+#endif /* ! OS_Has_MemRelease */
+
+
 /*****************************************************************************
  *
  * :: osMemMap
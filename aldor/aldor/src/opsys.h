@@ -66,6 +66,86 @@ extern int	osRunQuoteArg	(String word, int (*putter)(int));
 	 * E.g: On Unix the string >$1 is converted to '>$1' and 5 is returned.
 	 */
 
+extern int	osFork		(FILE *out);
+extern int	osRunAsync	(String cmd, FILE *out);
+extern int	osWait		(int pid, int *pstatus);
+extern void	osForkExit	(int status);
+	/*
+	 * osFork makes a copy of the running process.  If "out" is non-NULL,
+	 * the copy's standard output and error go to it.  The return value
+	 * is 0 in the copy and the copy's process id in the original, or -1
+	 * if no copy could be made, as is always the case on platforms
+	 * without processes.
+	 *
+	 * osRunAsync starts the command given as a string argument, as osRun
+	 * would, without waiting for it.  Its standard output and error go
+	 * to "out" if it is non-NULL.  The process id is returned, or -1 if
+	 * the command could not be started this way.
+	 *
+	 * osWait waits for the process "pid" to finish, or for any if pid
+	 * is -1, and returns its process id (-1 if there is none).  *pstatus
+	 * is set to its exit code, or -1 if it did not exit normally.
+	 *
+	 * osForkExit flushes output and leaves a copy without running the
+	 * exit handlers it shares with the original.
+	 */
+
+extern int	osWaitDone	(int *pstatus);
+	/*
+	 * osWaitDone returns the process id of a copy or command which has
+	 * finished, setting *pstatus as osWait does, without waiting.  It
+	 * returns 0 if none has finished yet and -1 if there are none.
+	 */
+
+extern int	osWaitAny	(int *pidv, int n, int *pstatus);
+	/*
+	 * osWaitAny waits for one of the n processes in pidv to finish, as
+	 * osWait does, leaving any other process to whoever started it.
+	 */
+
+extern int	osGetPid	(void);
+	/*
+	 * The process id of the running process, or 0 on platforms without
+	 * processes.
+	 */
+
+extern int	osServerOpen	(String path);
+extern FILE *	osServerAccept	(int sd, FILE **pout);
+extern FILE *	osServerConnect	(String path, FILE **pout);
+	/*
+	 * osServerOpen makes a Unix domain socket named "path", replacing
+	 * any file of that name, and returns a descriptor on which to wait
+	 * for connections, or -1.
+	 *
+	 * osServerAccept waits for a connection to "sd" and osServerConnect
+	 * makes one to the socket "path".  Each returns a stream to read
+	 * from and sets *pout to one to write to, or returns NULL.
+	 */
+
+/*****************************************************************************
+ *
+ * :: Threads.
+ *
+ ****************************************************************************/
+
+typedef struct osThread *OsThread;
+
+extern OsThread	osThreadStart	(void (*fun)(Pointer), Pointer arg);
+extern void	osThreadJoin	(OsThread);
+extern void	osThreadYield	(void);
+extern int	osCpuCount	(void);
+	/*
+	 * osThreadStart runs fun(arg) on a new thread.  It returns 0 if the
+	 * thread could not be started, as is always the case on platforms
+	 * without threads.  osThreadJoin waits for the thread to finish.
+	 *
+	 * Threads have small stacks, which are given back to the system when
+	 * the thread is joined, so they do not appear in later osMemMaps.
+	 *
+	 * osThreadYield lets other threads run.
+	 * osCpuCount gives the number of processors online, or 1 if unknown.
+	 */
+
 /*****************************************************************************
  *
  * :: Time and Date.
@@ -78,6 +158,12 @@ extern Millisec	osCpuTime	(void);
 	 * On systems where it counts, this is user + system time.
 	 */
 
+extern ULong	osWallTime	(void);
+	/*
+	 * The elapsed real time, in microseconds from some fixed point.
+	 * Where there is no clock, the CPU time is used instead.
+	 */
+
 extern String	osDate		(void);
 	/*
 	 * Static area containing a human-readable date.
@@ -246,6 +332,8 @@ extern int	osFileRename	(String from, String to);
 extern Bool	osFileIsThere	(String fn);
 extern Hash	osFileHash	(String fn);
 extern Length	osFileSize	(String fn);
+extern Pointer	osFileMap	(FILE *f, Length *psize);
+extern void	osFileUnmap	(Pointer p, Length size);
 
 extern Bool	osDirIsThere	(String dn);
 extern int	osDirSwap	(String newwd, String oldwd, Length oldwdlen);
@@ -257,6 +345,11 @@ extern void	osDirCreate	(String dn);
 	 * osFileRemove and osFileRename return 0 on success, -1 on error.
 	 * osFileIsThere tests whether the file exists.
 	 *
+	 * osFileMap maps the contents of the open file "f" into memory and
+	 *   sets *psize to its length, or returns 0 if it cannot.  Changing
+	 *   the memory changes a private copy, never the file.
+	 * osFileUnmap releases memory obtained from osFileMap.
+	 *
 	 * osDirIsThere tests whether the directory exists.
 	 *
 	 * osDirSwap changes the current directory.  
@@ -357,6 +450,15 @@ extern void	osAllocShow	(void);
 	 *    where this information is not available, the call does nothing.
 	 */
 
+extern void	osMemRelease	(Pointer p, ULong nbytes);
+	/*
+	 * osMemRelease tells the operating system that the store in
+	 *    [p, p+nbytes) will not be read again before it is written,
+	 *    so the pages wholly inside it may be taken back.  The store
+	 *    stays allocated and reads as zero if it is taken back.
+	 *    Where this is not supported, the call does nothing.
+	 */
+
 struct osMemMap {
 	UAInt	use;
 	Pointer lo, hi;
@@ -21,15 +21,20 @@
 #include "of_deada.h"
 #include "of_deadv.h"
 #include "of_emerg.h"
+#include "of_escape.h"
 #include "of_env.h"
 #include "of_hfold.h" 
 #include "of_inlin.h"
 #include "of_jflow.h"
 #include "of_killp.h"
+#include "of_loops.h"
 #include "of_peep.h"
 #include "of_retyp.h"
 #include "of_rrfmt.h"
+#include "of_sccp.h"
 #include "optfoam.h"
+#include "opsys.h"
+#include "phase.h"
 #include "store.h"
 #include "strops.h"
 
@@ -54,7 +59,9 @@ static int optCommExp;
 static int optEnvMerge;
 static int optEnvOpts;
 static int optCopyProp;
+static int optSccp;
 static int optJumpFlow;
+static int optLoopInv;
 static int optCast;
 static int optCC;
 static int optArgSub;
@@ -63,6 +70,7 @@ static int optCcFnonstd;
 static int optIgnoreAsserts;
 static int optKillPointers;
 static int optEmergeRRFmt;
+static int optEscape;
 
 #define OPT_Negate		"no-"
 #define	OPT_All	        	"all"
@@ -99,6 +107,10 @@ local  void	optSetLevel		(int);
 local  void 	optPrintOpts		(FILE *fout);
 local  void	optSetJFlowLimit	(void);
 local  void	optOptimizationsInit	(void);
+local  void	optSetUnitPending	(Foam, int);
+local  void	optPassStart		(int);
+local  Bool	optPassFinish		(int);
+local  void	optPrintPassStats	(FILE *fout);
 
 	
 /*
@@ -118,11 +130,14 @@ struct optControl	optControl[] = {
 {"dassign",	OPT_FLAG,  &optDeadAssign,    { 0,  0,    1,    1,    1}},
 {"peep",	OPT_FLAG,  &optPeepHole,      { 0,  1,    1,    1,    1}},
 {"cprop",	OPT_FLAG,  &optCopyProp,      { 0,  0,    1,    1,    1}},
+{"sccp",	OPT_FLAG,  &optSccp,	      { 0,  0,    1,    1,    1}},
 {"cse",		OPT_FLAG,  &optCommExp,	      { 0,  0,    1,    1,    1}},
 {"env",		OPT_FLAG,  &optEnvOpts,	      { 0,  0,    1,    1,    1}},
 {"emerge",	OPT_FLAG,  &optEnvMerge,      { 0,  0,    1,    1,    1}},
 {"emerge-rr",  	OPT_FLAG,  &optEmergeRRFmt,   { 0,  0,    1,    1,    1}},
 {"flow",	OPT_FLAG,  &optJumpFlow,      { 0,  0,    1,    1,    1}},
+{"loop",	OPT_FLAG,  &optLoopInv,	      { 0,  0,    0,    1,    1}},
+{"escape",	OPT_FLAG,  &optEscape,	      { 0,  0,    1,    1,    1}},
 {"cast",	OPT_FLAG,  &optCast,	      { 0,  0,    1,    1,    1}},
 {"cc",		OPT_FLAG,  &optCC,	      { 0,  0,    1,    1,    1}},
 {"del-assert",	OPT_FLAG,  &optIgnoreAsserts, { 0,  0,    1,    1,    1}},
@@ -258,10 +273,184 @@ optSetOptimization(String opt)
 	return -1;
 }
 
+/******************************************************************************
+ *
+ * :: Pass manager
+ *
+ *****************************************************************************/
+
+/*
+ * The passes in the main loop of optimizeFoam only visit progs whose
+ * pending bit for the pass is set, and clear it as they go.  A pass which
+ * changes a prog sets the bits of the passes which may profit from the
+ * change; constant folding and dead assignment elimination are asked to
+ * look again after any change.  The loop stops when an iteration changes
+ * nothing, or when the iteration budget for the level runs out.
+ *
+ * With -Qsccp, sparse conditional constant propagation takes the place
+ * of copy propagation and owns the constant folding bit as well, so a
+ * prog it has just folded is not folded again in the same iteration.
+ */
+#define OPT_Rerun	(OPT_CFOLD | OPT_DEADA)
+
+enum optPass {
+	OPT_PassCProp,
+	OPT_PassSccp,
+	OPT_PassPeep,
+	OPT_PassCFold,
+	OPT_PassCse,
+	OPT_PassLoop,
+	OPT_PassJFlow,
+	OPT_PassDeadA,
+	OPT_PassDeadV,
+	OPT_PassLimit
+};
+
+struct optPassInfo {
+	String		name;
+	int		mask;		/* Pending bit owned by the pass */
+	int		runs;		/* Number of times run */
+	int		changed;	/* Number of progs changed */
+	Millisec	time;		/* CPU time spent */
+};
+
+static struct optPassInfo optPassInfo[] = {
+	{"cprop",	OPT_CPROP, 0, 0, 0},
+	{"sccp",	OPT_CPROP | OPT_CFOLD, 0, 0, 0},
+	{"peep",	OPT_PEEP,  0, 0, 0},
+	{"cfold",	OPT_CFOLD, 0, 0, 0},
+	{"cse",		OPT_CSE,   0, 0, 0},
+	{"loop",	OPT_LOOP,  0, 0, 0},
+	{"flow",	OPT_JFLOW, 0, 0, 0},
+	{"dassign",	OPT_DEADA, 0, 0, 0},
+	{"deadvar",	OPT_DEADV, 0, 0, 0},
+};
+
+static Bool	optStatsWanted = false;
+static int	optPassMask    = 0;	/* Bit of the pass being run */
+static ULong	optPassStamp   = 0;	/* Bumped for each pass run */
+static int	optPassChanged = 0;	/* Progs changed by this run */
+static int	optLoopIters   = 0;	/* Iterations of the main loop */
+static Millisec	optPassStartTime;
+
+void
+optSetStatsWanted(Bool flag)
+{
+	optStatsWanted = flag;
+}
+
+/*
+ * Mark prog as needing the passes in mask.  The first mark made by a
+ * pass run also counts the prog as changed by that run.
+ */
+void
+optSetPending(Foam prog, int mask)
+{
+	OptInfo	info = foamOptInfo(prog);
+
+	info->optMask |= (mask | OPT_Rerun) & ~optPassMask;
+
+	if (info->optStamp != optPassStamp) {
+		info->optStamp = optPassStamp;
+		optPassChanged += 1;
+	}
+}
+
+/*
+ * Mark the work of a pass on the i-th definition of unit on the timeline.
+ */
+void
+optProgSpanStart(Foam unit, int i)
+{
+	Foam	lhs;
+	String	name = "prog";
+
+	if (!phTimelineOn()) return;
+
+	lhs = unit->foamUnit.defs->foamDDef.argv[i]->foamDef.lhs;
+	if (foamTag(lhs) == FOAM_Const)
+		name = foamUnitConstants(unit)->foamDDecl.argv
+			[lhs->foamConst.index]->foamDecl.id;
+	phSpanStart("prog", name);
+}
+
+void
+optProgSpanEnd(void)
+{
+	phSpanEnd();
+}
+
+local void
+optSetUnitPending(Foam unit, int mask)
+{
+	Foam	defs = unit->foamUnit.defs, rhs;
+	int	i;
+
+	for (i = 0; i < foamArgc(defs); i++) {
+		rhs = defs->foamDDef.argv[i]->foamDef.rhs;
+		if (foamTag(rhs) == FOAM_Prog && foamOptInfo(rhs))
+			foamOptInfo(rhs)->optMask |= mask;
+	}
+}
+
+local void
+optPassStart(int pass)
+{
+	optPassMask    = optPassInfo[pass].mask;
+	optPassStamp  += 1;
+	optPassChanged = 0;
+	optPassStartTime = osCpuTime();
+	phSpanStart("optfoam", optPassInfo[pass].name);
+}
+
+/*
+ * Finish a pass run, returning true if it changed any prog.
+ */
+local Bool
+optPassFinish(int pass)
+{
+	struct optPassInfo *pi = &optPassInfo[pass];
+
+	pi->runs    += 1;
+	pi->changed += optPassChanged;
+	pi->time    += osCpuTime() - optPassStartTime;
+	phSpanEnd();
+
+	optPassMask  = 0;
+	optPassStamp += 1;
+
+	if (DEBUG(phase)){stoAudit();}
+
+	return optPassChanged > 0;
+}
+
+/*
+ * Print the pass statistics for the unit just optimized, and clear them.
+ */
+local void
+optPrintPassStats(FILE *fout)
+{
+	int	i;
+
+	fprintf(fout, "Optimizer loop: %d iteration(s)\n", optLoopIters);
+	fprintf(fout, "%10s %6s %8s %10s\n", "pass", "runs", "changed", "time (ms)");
+	for (i = 0; i < OPT_PassLimit; i++)
+		fprintf(fout, "%10s %6d %8d %10lu\n", optPassInfo[i].name,
+			optPassInfo[i].runs, optPassInfo[i].changed,
+			(unsigned long) optPassInfo[i].time);
+
+	for (i = 0; i < OPT_PassLimit; i++) {
+		optPassInfo[i].runs    = 0;
+		optPassInfo[i].changed = 0;
+		optPassInfo[i].time    = 0;
+	}
+	optLoopIters = 0;
+}
+
 Foam
 optimizeFoam(Foam foam)
 {
-	Bool	newConsts = false;
+	Bool	newConsts = false, changed;
 	int	i, iters;
 	if (DEBUG(optf)){optPrintOpts(dbOut);}
 	if (DEBUG(optfShow)) {
@@ -271,68 +460,96 @@ optimizeFoam(Foam foam)
 
 	if (optDeadVar)   {
 		optfDEBUG(dbOut, "Starting deadvar...\n");
+		phSpanStart("optfoam", "deadvar");
 		dvElim(foam);
+		phSpanEnd();
 		if (DEBUG(phase)){stoAudit();}
 	}
 	if (optInline) 	  {
 		optfDEBUG(dbOut, "Starting inline...\n");
+		phSpanStart("optfoam", "inline");
 		inlineUnit(foam, optInlineAll, optInlineLimit, true);
+		phSpanEnd();
 		if (DEBUG(phase)){stoAudit();}
 	}
 	if (optInline) 	  {
 		optfDEBUG(dbOut, "Starting coroutine inline...\n");
+		phSpanStart("optfoam", "coroutine inline");
 		crinUnit(foam);
 		inlineUnit(foam, optInlineAll, optInlineLimit, true);
+		phSpanEnd();
 		if (DEBUG(phase)){stoAudit();}
 	}
 	/* Maybe we ought to cprop before cfold? */
 	if (optConstFold || optFloatFold) {
 		optfDEBUG(dbOut, "Starting cfold...\n");
+		phSpanStart("optfoam", "cfold");
+		/* Inlining does not mark the progs it changes. */
+		optSetUnitPending(foam, OPT_CFOLD);
 		newConsts = cfoldUnit(foam, optConstFold, optFloatFold);
+		phSpanEnd();
 		if (DEBUG(phase)){stoAudit();}
 	}
 	while (newConsts && optInline) {
 		optfDEBUG(dbOut, "Starting expr inline...\n");
+		phSpanStart("optfoam", "expr inline");
 		/* If const folding made new constants, inline them. */
 		inlineUnit(foam, optInlineAll, optInlineLimit, false);
+		optSetUnitPending(foam, OPT_CFOLD);
 		newConsts = cfoldUnit(foam, optConstFold, optFloatFold);
+		phSpanEnd();
 		if (DEBUG(phase)){stoAudit();}
 	}
 	if (newConsts && optInline) {
 		optfDEBUG(dbOut, "Starting coroutine inline...\n");
+		phSpanStart("optfoam", "coroutine inline");
 		crinUnit(foam);
+		phSpanEnd();
 		if (DEBUG(phase)){stoAudit();}
 	}
 	if (optHashFold) {
 		optfDEBUG(dbOut, "Starting hfold...\n");
+		phSpanStart("optfoam", "hfold");
 		hfoldUnit(foam);
 		cpropUnit(foam, false);
+		optSetUnitPending(foam, OPT_CFOLD);
 		cfoldUnit(foam, optConstFold, optFloatFold);
+		phSpanEnd();
 		if (DEBUG(phase)){stoAudit();}
 	}
 	if (optEmergeRRFmt)  {
 		optfDEBUG(dbOut, "Starting emerge-rr...\n");
+		phSpanStart("optfoam", "emerge-rr");
 		rrUnitEmerge(foam);
+		phSpanEnd();
 		if (DEBUG(phase)){stoAudit();}
 	}
 	if (optEnvMerge)  {
 		optfDEBUG(dbOut, "Starting emerge...\n");
+		phSpanStart("optfoam", "emerge");
 		emMergeUnit(foam);
+		phSpanEnd();
 		if (DEBUG(phase)){stoAudit();}
 	}
 	if (optDeadVar)   {
 		optfDEBUG(dbOut, "Starting deadvar...\n");
+		phSpanStart("optfoam", "deadvar");
 		dvElim(foam);
+		phSpanEnd();
 		if (DEBUG(phase)){stoAudit();}
 	}
 	if (optEnvOpts) {
 		optfDEBUG(dbOut, "Starting env. opts...\n");
+		phSpanStart("optfoam", "env. opts");
 		oeUnit(foam);
+		phSpanEnd();
 		if (DEBUG(phase)){stoAudit();}
 	}
 	if (optCast) {
 		optfDEBUG(dbOut, "Starting retype...\n");
+		phSpanStart("optfoam", "retype");
 		retypeUnit(foam);
+		phSpanEnd();
 		if (DEBUG(phase)){stoAudit();}
 	}
 
@@ -343,87 +560,87 @@ optimizeFoam(Foam foam)
 	else
 		iters = optLevel;
 
-	for (i=0; i<iters; i++) {
-	optfDEBUG(dbOut, "STARTING LOOP (%d)\n", i);
+	/* Everything is worth a look on the first iteration. */
+	optSetUnitPending(foam, OPT_Rerun);
+	changed = true;
 
+	for (i = 0; i < iters && changed; i++) {
+		optfDEBUG(dbOut, "STARTING LOOP (%d)\n", i);
 		if (DEBUG(optf)){foamWrSExpr(dbOut, foam, int0);}
-#if 0
-		if (optInline) 	  {
-			optfDEBUG(dbOut, "Starting inline...\n");
-			inlineUnit(foam, optInlineAll, optInlineLimit, true);
-			if (DEBUG(phase)){stoAudit();}
+
+		changed = false;
+		optLoopIters += 1;
+
+		if (optSccp && (optCopyProp || optConstFold || optFloatFold)) {
+			optfDEBUG(dbOut, "Starting sccp...\n");
+			optPassStart(OPT_PassSccp);
+			sccpUnit(foam, optConstFold, optFloatFold);
+			changed |= optPassFinish(OPT_PassSccp);
 		}
-#endif
-		if (optCopyProp)  {
+		else if (optCopyProp)  {
 			optfDEBUG(dbOut, "Starting cprop...\n");
+			optPassStart(OPT_PassCProp);
 			cpropUnit(foam, i == 0);
-			if (DEBUG(phase)){stoAudit();}
+			changed |= optPassFinish(OPT_PassCProp);
 		}
 		if (optPeepHole)  {
 			optfDEBUG(dbOut, "Starting peep...\n");
+			optPassStart(OPT_PassPeep);
 			peepUnit(foam,optFloatFold);
-			if (DEBUG(phase)){stoAudit();}
+			changed |= optPassFinish(OPT_PassPeep);
 		}
 		if (optConstFold || optFloatFold) {
 			optfDEBUG(dbOut, "Starting cfold...\n");
+			optPassStart(OPT_PassCFold);
 			newConsts = cfoldUnit(foam, optConstFold,optFloatFold);
-			if (DEBUG(phase)){stoAudit();}
+			changed |= optPassFinish(OPT_PassCFold);
 		}
 		if (optCommExp)  {
 			optfDEBUG(dbOut, "Starting cse...\n");
+			optPassStart(OPT_PassCse);
 			cseUnit(foam);
-			if (DEBUG(phase)){stoAudit();}
+			changed |= optPassFinish(OPT_PassCse);
 		}
-#if 0
-		while (newConsts && optInline) {
-			optfDEBUG(dbOut, "Starting expr inline...\n");
-			/* If const folding made new constants, inline them. */
-			inlineUnit(foam, optInlineAll, optInlineLimit, false);
-			newConsts = cfoldUnit(foam, optConstFold, optFloatFold);
-			if (DEBUG(phase)){stoAudit();}
-		}
-#endif
-#if 0
-		if (optArgSub)  {
-			optfDEBUG(dbOut, "Starting argsub...\n");
-			argsubUnit(foam);
-			if (DEBUG(phase)){stoAudit();}
+		if (optLoopInv)  {
+			optfDEBUG(dbOut, "Starting loop...\n");
+			optPassStart(OPT_PassLoop);
+			loopUnit(foam);
+			changed |= optPassFinish(OPT_PassLoop);
 		}
-#endif
 		if (optJumpFlow)  {
 			optfDEBUG(dbOut, "Starting jflow...\n");
+			optPassStart(OPT_PassJFlow);
 	       		jflowUnit(foam, optJFlowLimit);
-			if (DEBUG(phase)){stoAudit();}
+			changed |= optPassFinish(OPT_PassJFlow);
 		}
 		if (optDeadAssign) {
 			optfDEBUG(dbOut, "Starting dead assign...\n");
+			optPassStart(OPT_PassDeadA);
 			deadAssign(foam);
-			if (DEBUG(phase)){stoAudit();}
+			changed |= optPassFinish(OPT_PassDeadA);
 		}
-	
-		if (optDeadVar)   {
+		/* dvElim sees the whole unit: skip it once nothing changes. */
+		if (optDeadVar && (changed || i == 0)) {
 			optfDEBUG(dbOut, "Starting deadvar...\n");
+			optPassStart(OPT_PassDeadV);
 			dvElim(foam);
-			if (DEBUG(phase)){stoAudit();}
-		}
-#if 0
-		if (optEnvMerge)  {
-			optfDEBUG(dbOut, "Starting emerge...\n");
-			emMergeUnit(foam);
-			if (DEBUG(phase)){stoAudit();}
+			changed |= optPassFinish(OPT_PassDeadV);
 		}
-#endif
 	}
 
 	if (optEnvOpts) {
 		optfDEBUG(dbOut, "Starting env. opts...\n");
+		phSpanStart("optfoam", "env. opts");
 		oeUnit(foam);
+		phSpanEnd();
 		if (DEBUG(phase)){stoAudit();}
 	}
 
 	if (optPeepHole)  {
 		optfDEBUG(dbOut, "Starting peep...\n");
+		phSpanStart("optfoam", "peep");
 		peepUnit(foam,optFloatFold);
+		phSpanEnd();
 		if (DEBUG(phase)){stoAudit();}
 	}
 
@@ -431,6 +648,12 @@ optimizeFoam(Foam foam)
 
 	fpPatchUnit(foam);
 
+	/* Needs the leaf bits from fpPatchUnit and must follow every pass. */
+	optfDEBUG(dbOut, "Starting escape...\n");
+	phSpanStart("optfoam", "escape");
+	escapeUnit(foam, optEscape);
+	phSpanEnd();
+
 	/*
  	* inlSetAfterInline turns on checking for domainGetExport
  	* when using -W runtime.
@@ -447,6 +670,8 @@ optimizeFoam(Foam foam)
 
 	optfDEBUG(dbOut, "Optimizations finished.\n");
 
+	if (optStatsWanted) optPrintPassStats(osStdout);
+
 	if (DEBUG(optfShow)) {
 		afprintf(dbOut, "optfoam - out:\n%pFoam\n", foam);
 	}
@@ -498,6 +723,12 @@ optIsDeadVarWanted(void)
 	return optDeadVar;
 }
 
+Bool
+optIsInlineWanted(void)
+{
+	return optInline;
+}
+
 Bool
 optIsKillPointersWanted(void)
 {
@@ -17,16 +17,21 @@ extern void	optSetInit	        (void);
 extern int	optSetOptimization	(String);
 extern int	optSetStdOptimization	(void);
 extern void	optSetLoopOption	(void);
+extern void	optSetStatsWanted	(Bool);
 
 extern Bool	optIsCcOptimizeWanted	(void);
 extern Bool     optIsCcFNonStdWanted    (void);
 extern Bool	optIsFloatFoldWanted	(void);
 extern Bool	optIsDeadVarWanted	(void);
+extern Bool	optIsInlineWanted	(void);
 extern Bool	optIsMaxLevel		(void);
 extern Bool 	optIsIgnoreAssertsWanted(void);
 extern Bool	optIsKillPointersWanted	(void);
 
 extern Foam     optimizeFoam    	(Foam);
+extern void	optSetPending		(Foam, int);
+extern void	optProgSpanStart	(Foam unit, int i);
+extern void	optProgSpanEnd		(void);
 
 #define	OPT_CPROP		(1 << 0)
 #define OPT_JFLOW		(1 << 1)
@@ -34,6 +39,9 @@ extern Foam     optimizeFoam    	(Foam);
 #define OPT_DEADV		(1 << 3)
 #define OPT_PEEP		(1 << 4)
 #define OPT_CAST		(1 << 5)
+#define OPT_CFOLD		(1 << 6)
+#define OPT_DEADA		(1 << 7)
+#define OPT_LOOP		(1 << 8)
 
 #define optIsCPropPending(prog)	(foamOptInfo(prog)->optMask & OPT_CPROP)
 #define optIsJFlowPending(prog)	(foamOptInfo(prog)->optMask & OPT_JFLOW)
@@ -41,13 +49,21 @@ extern Foam     optimizeFoam    	(Foam);
 #define optIsDeadvPending(prog)	(foamOptInfo(prog)->optMask & OPT_DEADV)
 #define optIsPeepPending(prog)	(foamOptInfo(prog)->optMask & OPT_PEEP)
 #define optIsCastPending(prog)	(foamOptInfo(prog)->optMask & OPT_CAST)
+#define optIsCFoldPending(prog)	(foamOptInfo(prog)->optMask & OPT_CFOLD)
+#define optIsDeadaPending(prog)	(foamOptInfo(prog)->optMask & OPT_DEADA)
+#define optIsLoopPending(prog)	(foamOptInfo(prog)->optMask & OPT_LOOP)
 
-#define optSetCPropPending(prog) (foamOptInfo(prog)->optMask |= OPT_CPROP)
-#define optSetJFlowPending(prog) (foamOptInfo(prog)->optMask |= OPT_JFLOW)
-#define optSetCsePending(prog)	 (foamOptInfo(prog)->optMask |= OPT_CSE)
-#define optSetDeadvPending(prog) (foamOptInfo(prog)->optMask |= OPT_DEADV)
-#define optSetPeepPending(prog)	 (foamOptInfo(prog)->optMask |= OPT_PEEP)
-#define optSetCastPending(prog)	 (foamOptInfo(prog)->optMask |= OPT_CAST)
+/*
+ * Setting a pending bit also records that the prog has changed, so that
+ * optimizeFoam can tell when its pass loop has reached a fixpoint.
+ */
+#define optSetCPropPending(prog) optSetPending(prog, OPT_CPROP)
+#define optSetJFlowPending(prog) optSetPending(prog, OPT_JFLOW)
+#define optSetCsePending(prog)	 optSetPending(prog, OPT_CSE)
+#define optSetDeadvPending(prog) optSetPending(prog, OPT_DEADV)
+#define optSetPeepPending(prog)	 optSetPending(prog, OPT_PEEP)
+#define optSetCastPending(prog)	 optSetPending(prog, OPT_CAST)
+#define optSetLoopPending(prog)	 optSetPending(prog, OPT_LOOP)
 
 #define optResetCPropPending(prog) (foamOptInfo(prog)->optMask &= ~OPT_CPROP)
 #define optResetJFlowPending(prog) (foamOptInfo(prog)->optMask &= ~OPT_JFLOW)
@@ -55,5 +71,8 @@ extern Foam     optimizeFoam    	(Foam);
 #define optResetDeadvPending(prog) (foamOptInfo(prog)->optMask &= ~OPT_DEADV)
 #define optResetPeepPending(prog)  (foamOptInfo(prog)->optMask &= ~OPT_PEEP)
 #define optResetCastPending(prog)  (foamOptInfo(prog)->optMask &= ~OPT_CAST)
+#define optResetCFoldPending(prog) (foamOptInfo(prog)->optMask &= ~OPT_CFOLD)
+#define optResetDeadaPending(prog) (foamOptInfo(prog)->optMask &= ~OPT_DEADA)
+#define optResetLoopPending(prog)  (foamOptInfo(prog)->optMask &= ~OPT_LOOP)
 
 #endif /* !_OPTFOAM_H_ */
@@ -41,6 +41,7 @@ optInfoNew0(Stab stab, Foam prog, Syme lhs, Bool isGener, Bool external)
 	new->originalSize = 0;
 	new->size	  = 0;
 	new->optMask	  = 0xffff;
+	new->optStamp	  = 0;
 
 	return new;
 }
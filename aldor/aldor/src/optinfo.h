@@ -29,6 +29,7 @@ struct optInfo {
 	unsigned	size;		/* size during inlining		*/
 
 	UShort		optMask;	/* Pending optimizations  */
+	ULong		optStamp;	/* Last pass run to change it */
 
 };
 
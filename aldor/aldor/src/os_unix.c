@@ -159,6 +159,354 @@ osRunConcurrent(String cmd, FILE **pstdin, FILE **pstdout, FILE **pstderr)
 
 #endif /* OS_UNIX */
 
+/*****************************************************************************
+ *
+ * :: osFork
+ * :: osRunAsync
+ * :: osWait
+ * :: osForkExit
+ * :: osWaitDone
+ * :: osWaitAny
+ * :: osGetPid
+ *
+ ****************************************************************************/
+
+#if defined(OS_UNIX)
+#define OS_Has_Fork
+
+#include <errno.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char	**environ;
+
+int
+osFork(FILE *out)
+{
+	int	pid;
+
+	/* Otherwise buffered output would be written by both processes. */
+	fflush(NULL);
+
+	pid = fork();
+	if (pid == 0 && out) {
+		dup2(fileno(out), 1);
+		dup2(fileno(out), 2);
+	}
+	return pid;
+}
+
+int
+osRunAsync(String cmd, FILE *out)
+{
+	posix_spawn_file_actions_t	fa;
+	char	*argv[4];
+	pid_t	pid;
+	int	rc;
+
+	argv[0] = "sh";
+	argv[1] = "-c";
+	argv[2] = cmd;
+	argv[3] = NULL;
+
+	if (posix_spawn_file_actions_init(&fa) != 0) return -1;
+	if (out) {
+		posix_spawn_file_actions_adddup2(&fa, fileno(out), 1);
+		posix_spawn_file_actions_adddup2(&fa, fileno(out), 2);
+	}
+	rc = posix_spawn(&pid, "/bin/sh", &fa, NULL, argv, environ);
+	posix_spawn_file_actions_destroy(&fa);
+
+	return rc == 0 ? (int) pid : -1;
+}
+
+int
+osWait(int pid, int *pstatus)
+{
+	int	rc, status;
+
+	do
+		rc = waitpid(pid, &status, 0);
+	while (rc == -1 && errno == EINTR);
+
+	if (rc != -1)
+		*pstatus = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+	return rc;
+}
+
+void
+osForkExit(int status)
+{
+	fflush(NULL);
+	_exit(status);
+}
+
+int
+osWaitDone(int *pstatus)
+{
+	int	rc, status;
+
+	do
+		rc = waitpid(-1, &status, WNOHANG);
+	while (rc == -1 && errno == EINTR);
+
+	if (rc > 0)
+		*pstatus = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+	return rc;
+}
+
+int
+osWaitAny(int *pidv, int n, int *pstatus)
+{
+	siginfo_t	info;
+	int		rc, status, i;
+
+	if (n == 0) return -1;
+
+	for (;;) {
+		for (i = 0; i < n; i++) {
+			do
+				rc = waitpid(pidv[i], &status, WNOHANG);
+			while (rc == -1 && errno == EINTR);
+
+			if (rc > 0) {
+				*pstatus = WIFEXITED(status)
+					? WEXITSTATUS(status) : -1;
+				return rc;
+			}
+		}
+
+		/* Sleep until a child has finished, without collecting it. */
+		info.si_pid = 0;
+		do
+			rc = waitid(P_ALL, 0, &info, WEXITED | WNOWAIT);
+		while (rc == -1 && errno == EINTR);
+
+		if (rc == -1) return -1;
+
+		/* Someone else's child would wake us again at once. */
+		for (i = 0; i < n && pidv[i] != info.si_pid; i++) ;
+		if (i == n) return osWait(pidv[0], pstatus);
+	}
+}
+
+int
+osGetPid(void)
+{
+	return (int) getpid();
+}
+
+#endif /* OS_UNIX */
+
+/*****************************************************************************
+ *
+ * :: osServerOpen
+ * :: osServerAccept
+ * :: osServerConnect
+ *
+ ****************************************************************************/
+
+#if defined(OS_UNIX)
+#define OS_Has_Server
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static int
+osServerAddress(String path, struct sockaddr_un *addr)
+{
+	if (strlen(path) >= sizeof(addr->sun_path)) return -1;
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	strcpy(addr->sun_path, path);
+	return 0;
+}
+
+/* Give the descriptor "fd" a stream for each direction. */
+static FILE *
+osServerStreams(int fd, FILE **pout)
+{
+	FILE	*in, *out;
+	int	fd2 = dup(fd);
+
+	in  = fd2 == -1 ? NULL : fdopen(fd, "r");
+	out = in ? fdopen(fd2, "w") : NULL;
+
+	if (!out) {
+		if (in) fclose(in); else close(fd);
+		if (fd2 != -1) close(fd2);
+		return NULL;
+	}
+	*pout = out;
+	return in;
+}
+
+/*
+ * The socket is made with mode 0600, so that only its owner may connect
+ * and have the server compile files and write outputs in its name.
+ */
+int
+osServerOpen(String path)
+{
+	struct sockaddr_un	addr;
+	mode_t			mask;
+	int			sd, rc;
+
+	if (osServerAddress(path, &addr) == -1) return -1;
+	if ((sd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) return -1;
+
+	unlink(path);
+	mask = umask(077);
+	rc   = bind(sd, (struct sockaddr *) &addr, sizeof(addr));
+	umask(mask);
+
+	if (rc == -1 || chmod(path, 0600) == -1 ||
+	    listen(sd, SOMAXCONN) == -1) {
+		close(sd);
+		return -1;
+	}
+	fcntl(sd, F_SETFD, FD_CLOEXEC);
+	return sd;
+}
+
+FILE *
+osServerAccept(int sd, FILE **pout)
+{
+	int	fd;
+
+	do
+		fd = accept(sd, NULL, NULL);
+	while (fd == -1 && errno == EINTR);
+
+	return fd == -1 ? NULL : osServerStreams(fd, pout);
+}
+
+FILE *
+osServerConnect(String path, FILE **pout)
+{
+	struct sockaddr_un	addr;
+	int			fd;
+
+	if (osServerAddress(path, &addr) == -1) return NULL;
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) return NULL;
+
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+		close(fd);
+		return NULL;
+	}
+	return osServerStreams(fd, pout);
+}
+
+#endif /* OS_UNIX */
+
+/*****************************************************************************
+ *
+ * :: osThreadStart
+ * :: osThreadJoin
+ * :: osThreadYield
+ * :: osCpuCount
+ *
+ ****************************************************************************/
+
+#if defined(OS_UNIX) && !defined(OS_NO_THREADS)
+#define OS_Has_Threads
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#define OS_THREAD_STACK	(256*1024)
+
+struct osThread {
+	pthread_t	tid;
+	void		(*fun)(Pointer);
+	Pointer		arg;
+	Pointer		stack;
+};
+
+local void *
+osThreadMain(void *t0)
+{
+	OsThread	t = (OsThread) t0;
+
+	t->fun(t->arg);
+	return NULL;
+}
+
+OsThread
+osThreadStart(void (*fun)(Pointer), Pointer arg)
+{
+	pthread_attr_t	attr;
+	OsThread	t;
+	int		rc;
+
+	t = (OsThread) malloc(sizeof(*t));
+	if (!t) return 0;
+
+	t->fun	 = fun;
+	t->arg	 = arg;
+	t->stack = 0;
+
+	if (pthread_attr_init(&attr) != 0) {
+		free(t);
+		return 0;
+	}
+#if defined(MAP_ANONYMOUS)
+	/* Our own stack, so it can be unmapped when the thread is joined. */
+	t->stack = mmap(NULL, OS_THREAD_STACK, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (t->stack == MAP_FAILED)
+		t->stack = 0;
+	else
+		pthread_attr_setstack(&attr, t->stack, OS_THREAD_STACK);
+#endif
+	if (!t->stack)
+		pthread_attr_setstacksize(&attr, OS_THREAD_STACK);
+
+	rc = pthread_create(&t->tid, &attr, osThreadMain, t);
+	pthread_attr_destroy(&attr);
+
+	if (rc != 0) {
+#if defined(MAP_ANONYMOUS)
+		if (t->stack) munmap(t->stack, OS_THREAD_STACK);
+#endif
+		free(t);
+		return 0;
+	}
+	return t;
+}
+
+void
+osThreadJoin(OsThread t)
+{
+	pthread_join(t->tid, NULL);
+#if defined(MAP_ANONYMOUS)
+	if (t->stack) munmap(t->stack, OS_THREAD_STACK);
+#endif
+	free(t);
+}
+
+void
+osThreadYield(void)
+{
+	sched_yield();
+}
+
+int
+osCpuCount(void)
+{
+#if defined(_SC_NPROCESSORS_ONLN)
+	long	n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int) n : 1;
+#else
+	return 1;
+#endif
+}
+
+#endif /* OS_UNIX && !OS_NO_THREADS */
+
 /*****************************************************************************
  *
  * :: osCpuTime
@@ -195,6 +543,27 @@ osCpuTime(void)
 }
 #endif /* OS_UNIX */
 
+/*****************************************************************************
+ *
+ * :: osWallTime
+ *
+ ****************************************************************************/
+
+#if defined(OS_UNIX)
+#define OS_Has_WallTime
+
+#include <sys/time.h>
+
+ULong
+osWallTime(void)
+{
+	struct timeval	tv;
+
+	gettimeofday(&tv, NULL);
+	return (ULong) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+#endif /* OS_UNIX */
+
 /*****************************************************************************
  *
  * :: osDate
@@ -447,6 +816,45 @@ osFileHash(String name)
 #endif /* OS_UNIX */
 
 
+/*****************************************************************************
+ *
+ * :: osFileMap
+ * :: osFileUnmap
+ *
+ ****************************************************************************/
+
+#if defined(OS_UNIX)
+#define OS_Has_FileMap
+
+#include <sys/mman.h>
+
+Pointer
+osFileMap(FILE *f, Length *psize)
+{
+	struct stat	buf;
+	void		*p;
+
+	if (fstat(fileno(f), &buf) == -1 || buf.st_size <= 0)
+		return 0;
+
+	/* Private and writable, so a page is only copied if it is changed. */
+	p = mmap(NULL, buf.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		 fileno(f), 0);
+	if (p == MAP_FAILED)
+		return 0;
+
+	*psize = buf.st_size;
+	return (Pointer) p;
+}
+
+void
+osFileUnmap(Pointer p, Length size)
+{
+	munmap(p, size);
+}
+#endif /* OS_UNIX */
+
+
 /*****************************************************************************
  *
  * :: osDirIsThere
@@ -838,6 +1246,36 @@ osAllocShow(void)
 #endif /* OS_UNIX || OS_UnixLike_Alloc */
 
 
+/****************************************************************************
+ *
+ * :: osMemRelease
+ *
+ ****************************************************************************/
+
+#if defined(OS_UNIX)
+#include <sys/mman.h>
+
+#if defined(MADV_DONTNEED)
+#define OS_Has_MemRelease
+
+void
+osMemRelease(Pointer p, ULong nbytes)
+{
+	unsigned long	pgsz = sysconf(_SC_PAGESIZE);
+	unsigned long	lo, hi;
+
+	/* Only the whole pages inside the range can go. */
+	lo = ptrToLong(p);
+	hi = lo + nbytes;
+	lo = (lo + pgsz - 1) & ~(pgsz - 1);
+	hi = hi & ~(pgsz - 1);
+
+	if (lo < hi) madvise((void *) lo, hi - lo, MADV_DONTNEED);
+}
+#endif /* MADV_DONTNEED */
+#endif /* OS_UNIX */
+
+
 /****************************************************************************
  *
  * :: osMemMap
@@ -7,6 +7,9 @@
  ****************************************************************************/
 
 #include "debug.h"
+#include "emit.h"
+#include "fname.h"
+#include "file.h"
 #include "include.h"
 #include "opsys.h"
 #include "phase.h"
@@ -219,6 +222,7 @@ phStart(PhTag phno)
 	thisPhaseStartGc    = stoBytesGc;
 
 	phCurrent = &(phInfo[phno]);
+	phSpanStart("phase", phCurrent->name);
 
 	DEBUG_MODE(phCurrent->flags & PHX_Debug);
 
@@ -256,6 +260,7 @@ phEnd(PhPrFun prf, PhPrFun pprf, Pointer ob)
 	phCurrent->alloc += stoBytesAlloc - thisPhaseStartAlloc;
 	phCurrent->free	 += stoBytesFree  - thisPhaseStartFree;
 	phCurrent->gc	 += stoBytesGc	  - thisPhaseStartGc;
+	phSpanEnd();
 
 	if ((phCurrent->flags & PHX_Announce) && allPhasesVerbose) {
 		fprintf(osStdout, "Time  %5ld.%.3ld s\n",
@@ -337,6 +342,146 @@ phGrandTotals(Bool verboseFlag)
 	phPrintSourceSummary(grandPhasesLines, osCpuTime());
 	phPrintLibStats(grandLibStatsSeen);
 	phPrintStoreSummary(stoBytesOwn,stoBytesAlloc,stoBytesFree,stoBytesGc);
+	emitShowReuseStats(osStdout);
+}
+
+/*****************************************************************************
+ *
+ * :: Timeline (-W timeline=<file>)
+ *
+ ****************************************************************************/
+
+/*
+ * The timeline is a JSON array of Chrome trace events, one to a line.
+ * Spans of work are "B" and "E" events, which the viewer nests.  Copies
+ * of the compiler made by osFork append to the same file, as threads of
+ * the same process, so the file is opened for appending and written a
+ * line at a time.  Only the process which opened it closes the array.
+ */
+
+static FILE	*phTimelineFile = 0;
+static int	phTimelinePid;		/* Process which opened the file */
+static ULong	phTimelineStart;	/* osWallTime() when it was opened */
+
+local void	phTimelineEvent	(String ph, String cat, String name,
+				 ULong ts, ULong dur, int tid);
+local void	phTimelineGc	(Bool start);
+
+void
+phTimelineOpen(String fname)
+{
+	FileName	fn = fnameParse(fname);
+
+	phTimelineClose();
+
+	fileRemove(fn);
+	phTimelineFile = fileMustOpen(fn, osIoApMode);
+	fnameFree(fn);
+	setvbuf(phTimelineFile, NULL, _IOLBF, BUFSIZ);
+
+	phTimelinePid	= osGetPid();
+	phTimelineStart	= osWallTime();
+
+	fprintf(phTimelineFile, "[\n");
+	stoCtl(StoCtl_GcNotify, (StoGcFun) phTimelineGc);
+}
+
+void
+phTimelineClose(void)
+{
+	if (!phTimelineFile) return;
+
+	stoCtl(StoCtl_GcNotify, (StoGcFun) 0);
+	if (osGetPid() == phTimelinePid)
+		fprintf(phTimelineFile, "{\"ph\":\"M\",\"pid\":%d,"
+			"\"name\":\"process_name\","
+			"\"args\":{\"name\":\"aldor\"}}\n]\n", phTimelinePid);
+	fclose(phTimelineFile);
+	phTimelineFile = 0;
+}
+
+Bool
+phTimelineOn(void)
+{
+	return phTimelineFile != 0;
+}
+
+void
+phSpanStart(String cat, String name)
+{
+	if (!phTimelineFile) return;
+	phTimelineEvent("B", cat, name, phSpanClock(), 0, osGetPid());
+}
+
+void
+phSpanEnd(void)
+{
+	if (!phTimelineFile) return;
+	phTimelineEvent("E", NULL, NULL, phSpanClock(), 0, osGetPid());
+}
+
+ULong
+phSpanClock(void)
+{
+	return osWallTime() - phTimelineStart;
+}
+
+void
+phSpanDone(String cat, String name, ULong start, int tid)
+{
+	if (!phTimelineFile) return;
+	phTimelineEvent("X", cat, name, start, phSpanClock() - start, tid);
+}
+
+/*
+ * Collections are spans of the process in which they happen.
+ * This is called by the store manager, so it must not allocate.
+ */
+local void
+phTimelineGc(Bool start)
+{
+	if (start)
+		phSpanStart("gc", "gc");
+	else
+		phSpanEnd();
+}
+
+local void
+phTimelinePutString(String s)
+{
+	FILE	*f = phTimelineFile;
+
+	putc('"', f);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(f, "\\%c", *s);
+		else if ((UByte) *s < ' ')
+			fprintf(f, "\\u%04x", (UByte) *s);
+		else
+			putc(*s, f);
+	}
+	putc('"', f);
+}
+
+local void
+phTimelineEvent(String ph, String cat, String name, ULong ts, ULong dur,
+		int tid)
+{
+	FILE	*f = phTimelineFile;
+
+	fprintf(f, "{\"ph\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%lu",
+		ph, phTimelinePid, tid, ts);
+	if (cat) {
+		fputs(",\"cat\":", f);
+		phTimelinePutString(cat);
+	}
+	if (name) {
+		fputs(",\"name\":", f);
+		phTimelinePutString(name);
+	}
+	if (*ph == 'X')
+		fprintf(f, ",\"dur\":%lu", dur);
+	fputs("},\n", f);
 }
 
 
@@ -99,6 +99,36 @@ extern void	phGrandTotals(Bool verboseFlag);
 				 * Print grand totals of what has happened.
 				 */
 
+extern void	phTimelineOpen(String fname);
+				/*
+				 * Write a timeline of what the compiler does
+				 * from now on to fname, as Chrome trace events.
+				 */
+
+extern void	phTimelineClose(void);
+				/*
+				 * Finish the timeline, if any.
+				 */
+
+extern Bool	phTimelineOn(void);
+				/*
+				 * Is a timeline being written?
+				 */
+
+extern void	phSpanStart(String cat, String name);
+extern void	phSpanEnd(void);
+				/*
+				 * Mark the start and end of a span of work
+				 * on the timeline.  Spans may be nested.
+				 */
+
+extern ULong	phSpanClock(void);
+extern void	phSpanDone(String cat, String name, ULong start, int tid);
+				/*
+				 * Record a span of work done by process tid
+				 * from phSpanClock() time "start" until now.
+				 */
+
 extern struct phInfo	phInfo[];
 				/*
 				 * E.g. phInfo[PH_Scan]
@@ -45,6 +45,27 @@
  * whose size is not an integral power of two we use division via a lookup
  * table. Enable this by defining STO_DIVISION_BY_LOOKUP and suffer a
  * penalty of a 48K table in static data.
+ *
+ * The run-time system can collect generationally: set GC_GENERATIONAL in
+ * the environment or call stoCtl(StoCtl_Generational, true).  All the
+ * Aldor code of the program must then be compiled with -Wwrite-barrier,
+ * or collection stays full.
+ * See ":: Generational collection" below.
+ *
+ * The heap can be marked by several threads: set GC_THREADS to the number
+ * wanted (0 for one per processor) or call stoCtl(StoCtl_MarkThreads, n).
+ * See ":: Parallel marking" below.
+ *
+ * Sections are swept as their free pieces are needed rather than all at
+ * the end of a collection.  See ":: Lazy sweeping" below.
+ *
+ * The heap can be sized for a target cost of collection: set GC_RATIO to
+ * the gc time wanted as a percentage of the rest, or call
+ * stoCtl(StoCtl_GcRatio, n).  Free pages beyond the size chosen are then
+ * given back to the system with osMemRelease.
+ *
+ * Allocations can be sampled for a profiler with stoCtl(StoCtl_Sample, ...).
+ * See ":: Allocation sampling" below, and GC_PROFILE in foam_c.c.
  */
 
 #include "debug.h"
@@ -176,6 +197,9 @@
  *****************************************************************************/
 
 #define LgPgSize	  12	/* Log[2](PgSize). pagesTest ok for 3..15. */
+#if LgPgSize != STO_LG_CARD
+# error "store.c: a card must be a page"
+#endif
 
 #define PgSize (1L<<LgPgSize)	/* Granularity for OS request. */
 
@@ -318,6 +342,12 @@ long   GcMinGrowth       = (512*1024)/PgSize; /* Grow by a minumum of 0.5meg */
 long GcFrugalFactorNum = 70;
 long GcFrugalFactorDen = 100;
 
+/* Generational collection: at most this many minor gcs between full ones. */
+long GcMinorLimit	= 16;
+
+/* Size the heap so gc takes this percentage of the other time (0 => off). */
+long GcTimeRatio	= 0;
+
 
 /* Set GC_FRUGAL to enable more reticent heap growth */
 static Bool GcIsFrugal = false;
@@ -366,10 +396,21 @@ static StoTraceFun stoObCTracer[OB_MAX];
 
 static Bool	gcLevel		= StoCtl_GcLevel_Automatic;
 static FILE	*gcTraceFile	= 0;
+static StoGcFun	gcNotifyFun	= 0;
 static Bool	stoMustWash	= true;
 static Bool	stoMustTag      = true;
 
 static Bool     markingStats    = false;
+static Bool	stoGenerational = false;
+static int	stoMarkThreads	= 1;
+static Bool	stoParMarking	= false;
+
+static ULong	sampleMean	= 0;	/* Mean bytes between samples. */
+static long	sampleLeft	= 0;	/* Bytes before the next sample. */
+
+static long	gcTargetPages	= 0;	/* Heap size chosen for GcTimeRatio. */
+static long	gcLastCpuTime	= 0;	/* Times when it was last chosen. */
+static long	gcLastGcTime	= 0;
 
 #ifdef STO_DEBUG_DISPLAY
 # define stoDebug		true
@@ -526,6 +567,11 @@ static FxMem	*fixedPieces[FixedSizeCount];
 static BTree	mixedPieces;
 static MxMem	*mixedFrontier;
 
+static Section	*sweepFixed[FixedSizeCount];	/* Sections to sweep. */
+static Section	*sweepMixed;
+static Bool	sweepClear;	/* Clear marks on busy pieces when sweeping? */
+static Bool	sweepBusy;	/* Sweeping outside a collection? */
+
 ULong	       stoBytesOwn;	 /* Total owned by allocator. */
 ULong	       stoBytesAlloc;	 /* Total ever allocated. */
 ULong	       stoBytesFree;	 /* Total ever freed. */
@@ -654,6 +700,16 @@ byteGetIfCan(Length alignment, ULong nbytes, ULong *pnbytesGot)
 
 local Page *	pagesFind(Length npages);
 local void	pagesPut (Page *, Length npages);
+local int	cardmapSync(void);
+local void	stoGcCollect(Bool minor);
+local void	stoGcSweepNext(Section **);
+local void	stoGcSweepSection(Section *);
+local void	stoGcSweepPending(void);
+local Bool	stoGcWantMinor(void);
+local Bool	stoSetGenerational(Bool);
+local void	stoSampleTake(Pointer, ULong);
+local void	stoSampleForget(Pointer);
+local void	stoSampleCheck(void);
 
 /*
  * Obtain and free storage for page map.
@@ -899,6 +955,10 @@ pagesAdd(Length nBest, Length nMin)
 		/* New store is in middle (formerly foreign). */
 	}
 
+	/* Keep the card map covering the whole heap. */
+	if (stoGenerational && !cardmapSync())
+		stoSetGenerational(false);
+
 	/* Add pages to heap. */
 	pagesPut((Page *) b, nRequest);
 
@@ -919,6 +979,138 @@ pagesFind(Length npages)
 	return (i == -1) ? 0 : pgAt(i);
 }
 
+/*
+ * Choose the heap size after a full gc left free of tot pages.  Until
+ * there is enough time to measure, gcTargetPages stays 0 and the heap
+ * grows by the fixed factors.
+ *
+ * The cost of a collection is roughly proportional to the live pages, and
+ * the number of collections to the reciprocal of the free pages, so the
+ * free pages are scaled by the measured ratio over the wanted one.  Each
+ * step is limited to a factor of four either way.
+ */
+#define GcRatioMinTime	50	/* Milliseconds between choices. */
+
+local void
+pagesChooseSize(int tot, int free)
+{
+	long	cpu, gc, mut, pct, room, want;
+
+	cpu = osCpuTime();
+	gc  = tmRead(stoGcTimer());
+	mut = (cpu - gcLastCpuTime) - (gc - gcLastGcTime);
+	if (mut < GcRatioMinTime) return;
+
+	pct = 100 * (gc - gcLastGcTime) / mut;
+	gcLastCpuTime = cpu;
+	gcLastGcTime  = gc;
+
+	room = free < GcMinGrowth ? GcMinGrowth : free;
+	want = room * pct / GcTimeRatio;
+	if (want < room / 4) want = room / 4;
+	if (want > room * 4) want = room * 4;
+	if (want < GcMinGrowth) want = GcMinGrowth;
+
+	gcTargetPages = (tot - free) + want;
+}
+
+/*
+ * Give the store of free pages back to the system, keeping the first keep
+ * of them.  pgmapFindFree looks from low addresses, so those are kept.
+ * The pages stay in the heap and are refilled by the system when used.
+ */
+local Length
+pagesRelease(Length keep)
+{
+	Length	i, j, n = 0;
+
+#if defined(STO_FREE_CHAR)
+	/* Washed pages must keep their fill. */
+	if (stoMustWash) return 0;
+#endif
+
+	for (i = 0; i < pgMapSize; i = j) {
+		if (pgMap[i] != PgFree) {
+			j = i + 1;
+			continue;
+		}
+		for (j = i; j < pgMapSize && pgMap[j] == PgFree; j++)
+			;
+		if (j - i <= keep) {
+			keep -= j - i;
+			continue;
+		}
+		i   += keep;
+		keep = 0;
+		osMemRelease((Pointer) pgAt(i), (ULong) (j - i) * PgSize);
+		n   += j - i;
+	}
+	return n;
+}
+
+/*
+ * The number of free pages to keep for the heap size target.  Without a
+ * target every free page is kept, as before.
+ */
+local Length
+pagesToKeep(void)
+{
+	long	busy;
+
+	if (!GcTimeRatio) return pgmapCountFree();
+	if (!gcTargetPages) return pgmapCountFree();
+	busy = pgmapCountDomestic() - pgmapCountFree();
+	return gcTargetPages > busy ? gcTargetPages - busy : 0;
+}
+
+/*
+ * Resize the heap after a full gc, for GcTimeRatio.
+ */
+local void
+pagesResize(void)
+{
+	int	tot, free;
+	Length	n;
+
+	tot  = pgmapCountDomestic();
+	free = pgmapCountFree();
+	pagesChooseSize(tot, free);
+	n = pagesRelease(pagesToKeep());
+
+	if (gcTraceFile)
+		fprintf(gcTraceFile, " [GC: Heap target %ld pages, released "
+			LENGTH_FMT "]\n", gcTargetPages, n);
+#ifdef FOAM_RTS
+	if (markingStats)
+		fprintf(osStderr, " [GC: Heap target %ld pages, released "
+			LENGTH_FMT "]\n", gcTargetPages, n);
+#endif
+}
+
+/*
+ * Should the heap grow, given free of tot pages after a gc?
+ */
+local Bool
+pagesNeedGrowth(int tot, int free, Length nMin)
+{
+	int	gceLhs, gceRhs;
+
+	/* Are there sufficient free pages for this request? */
+	if (nMin > free) return true;
+
+	/* With a target ratio, grow to the size chosen for it. */
+	if (GcTimeRatio && gcTargetPages) return tot < gcTargetPages;
+
+	/* If there are enough, is the headroom big enough? */
+	/* Frugal or normal heap growth? */
+	if (GcIsFrugal)
+		return stoNeedsMoreHeadroom(free);
+
+	gceLhs = GcEffectiveFactorNum * tot;
+	gceRhs = GcEffectiveFactorDen * free;
+	return (gceLhs > gceRhs);
+}
+
 local Page *
 pagesGet(Length nMin)
 {
@@ -934,33 +1126,28 @@ pagesGet(Length nMin)
 	}
 	else if (gcLevel == StoCtl_GcLevel_Automatic) {
 		int	tot, free0, free1;
-		int	gceLhs, gceRhs;
+		Bool	minor;
 
 		tot   = pgmapCountDomestic();
 		free0 = pgmapCountFree();
-		stoGc();
+		minor = stoGcWantMinor();
+		stoGcCollect(minor);
 		free1 = pgmapCountFree();
+		addAnyway = pagesNeedGrowth(tot, free1, nMin);
 
-
-		/* Are there sufficient free pages for this request? */
-		addAnyway = (nMin > free1);
-
-
-		/* If there are enough, is the headroom big enough? */
-		if (!addAnyway)
-		{
-			/* Frugal or normal heap growth? */
-			if (GcIsFrugal)
-				addAnyway = stoNeedsMoreHeadroom(free1);
-			else
-			{
-				gceLhs = GcEffectiveFactorNum * tot;
-				gceRhs = GcEffectiveFactorDen * free1;
-				addAnyway = (gceLhs > gceRhs);
-			}
+		/* Before growing, see if old pieces have died. */
+		if (addAnyway && minor) {
+			stoGcCollect(false);
+			free1 = pgmapCountFree();
+			addAnyway = pagesNeedGrowth(tot, free1, nMin);
 		}
 
-		if (addAnyway &&
+		if (addAnyway && GcTimeRatio && gcTargetPages) {
+			nBest = gcTargetPages > (long) (tot + nMin)
+				? (Length) (gcTargetPages - tot) : nMin;
+			nBest = nBest < GcMinGrowth ? GcMinGrowth : nBest;
+		}
+		else if (addAnyway &&
 			(GcGrowthFactorNum * tot) > (GcGrowthFactorDen*(tot + nMin)))
 		{
 			nBest = (Length) ((GcGrowthFactorNum - GcGrowthFactorDen ) * tot /GcGrowthFactorDen  + 1);
@@ -1014,6 +1201,67 @@ pagesPut(Page *pg, Length count)
 	freeFill(pg, count*PgSize);
 }
 
+/*****************************************************************************
+ *
+ * :: Card map
+ *
+ * With generational collection, stoWriteBarrier sets the card holding
+ * each word stored into.  A card is a page, so the card map parallels
+ * the page map.
+ *
+ * Modifies globals: stoCardMap, stoCardBase, stoCardSize
+ *
+ ****************************************************************************/
+
+UByte	*stoCardMap  = 0;
+char	*stoCardBase = 0;
+ULong	stoCardSize  = 0;
+
+/*
+ * Make the card map cover the current heap, keeping the cards already set.
+ */
+local int
+cardmapSync(void)
+{
+	UByte	*ncardMap;
+	ULong	nbytes = pgMapSize;
+	Length	i, off, ncards;
+
+	ncardMap = (UByte *) osAlloc(&nbytes);
+	if (!ncardMap) return 0;
+	memset(ncardMap, 0, pgMapSize);
+
+	if (stoCardMap) {
+		off    = pgNo(stoCardBase);
+		ncards = stoCardSize >> LgPgSize;
+		for (i = 0; i < ncards; i++)
+			ncardMap[off + i] = stoCardMap[i];
+		osFree((Pointer) stoCardMap);
+	}
+
+	stoCardMap  = ncardMap;
+	stoCardBase = heapStart;
+	stoCardSize = pgMapSize * PgSize;
+
+	return 1;
+}
+
+local void
+cardmapClear(void)
+{
+	memset(stoCardMap, 0, stoCardSize >> LgPgSize);
+}
+
+local void
+cardmapFree(void)
+{
+	if (stoCardMap) osFree((Pointer) stoCardMap);
+
+	stoCardMap  = 0;
+	stoCardBase = 0;
+	stoCardSize = 0;
+}
+
 /*****************************************************************************
  *
  * :: Section manipulation
@@ -1029,8 +1277,10 @@ struct Section {
 	short		qmSize;		/* Alloc quantum. */
 	UByte		qmSizeIndex;	/* Index of quantum in size table. */
 	BPack(Bool)	isFixed;	/* Alloc of same or different sizes? */
+	BPack(Bool)	isUnswept;	/* Queued for sweeping? */
 
 	FxMem		*free;		/* Section free list (for stoTune). */
+	Section		*sweepNext;	/* Next section queued for sweeping. */
 	ULong		qmCount;	/* Number of quanta of data. */
 	Pointer		data;		/* Pointer to start of data. */
 	QmInfo		info[NARY];	/* Per quantum information. */
@@ -1133,6 +1383,8 @@ sectPrepare(Page *p, Length npages, Length sz, int isFixed)
 		? 0 : fixedSizeLog[x->qmSizeIndex] + lgWordSize;
 #endif
 	x->isFixed     = isFixed;
+	x->isUnswept   = false;
+	x->sweepNext   = 0;
 	x->qmCount     = nq = sectQmCount(npages, sz);
 	x->data	       = ptrOff((char *) p, npages * PgSize - nq * sz);
 
@@ -1192,6 +1444,14 @@ piecesGetFixed(Length nbytes)
 	Section		*sect;
 	FxMem		*pieces, *pieces0;
 	Length		sz, i, npages, npieces;
+	int		ix;
+
+	/* Sweep queued sections until one gives some pieces. */
+	ix = fixedSizeIndexFor[nbytes];
+	while (sweepFixed[ix]) {
+		stoGcSweepNext(&sweepFixed[ix]);
+		if (fixedPieces[ix]) return fixedPieces[ix];
+	}
 
 	npages	= FixedSizePgGroup;
 	sz	= fixedSizeFor[nbytes];
@@ -1553,6 +1813,12 @@ pieceGetMixed(ULong nbytes)
 
 	/* First check in mixed-size pieces free tree. */
 	bnode = btreeSearchGE(mixedPieces, nbytes, &bix);
+
+	/* Then sweep queued sections until one gives a big enough piece. */
+	WHILE (!bnode && sweepMixed) {
+		stoGcSweepNext(&sweepMixed);
+		bnode = btreeSearchGE(mixedPieces, nbytes, &bix);
+	}
 	IF (bnode) {
 		mi	   = ((MxMemDLL *) btreeElt(bnode, bix))->pieces;
 		dll	   = mxmemUnlink(mi);
@@ -1647,6 +1913,10 @@ pieceGetMixed(ULong nbytes)
 
 		stoWatchFrontier(mixedFrontier);
 	}
+
+	/* Sweep first, or the new piece would be taken for garbage. */
+	if (mi->sect->isUnswept) stoGcSweepSection(mi->sect);
+
 	return mi;
 }
 
@@ -1664,12 +1934,17 @@ pieceGetMixed(ULong nbytes)
  * Pointers into the middle of structures are properly recognized.
  */
 
-local void	stoGcMarkAndSweep (void);
+local void	stoGcMarkAndSweep (Bool minor);
 local int	stoGcMark	  (void);
+local void	stoParMarkBegin	  (void);
+local int	stoParMarkFinish  (void);
+local Bool	stoParPush	  (Pointer *lo, Pointer *hi, int tag);
 local int	stoGcMarkRange	  (Pointer *lo, Pointer *hi, int check);
-local int	stoGcSweep	  (void);
-local int	stoGcSweepFixed	  (Section *);
-local int	stoGcSweepMixed	  (Section *);
+local int	stoGcMarkCards	  (void);
+local void	stoGcClearMarks	  (void);
+local int	stoGcSweep	  (Bool clear);
+local void	stoGcSweepFixed	  (Section *, Bool clear);
+local void	stoGcSweepMixed	  (Section *, Bool clear);
 
 static int	stoGcMarkedFree;
 
@@ -1722,10 +1997,11 @@ stoNeedsMoreHeadroom(int npgFree)
 /*
  * Entry point to garbage collector.
  * Use setjmp to force registers onto stack, then mark from roots.
+ * A minor collection also marks from the cards set since the last one.
  */
 
 local void
-stoGcMarkAndSweep(void)
+stoGcMarkAndSweep(Bool minor)
 {
 	jmp_buf jb;
 	int	nm, ns;
@@ -1748,16 +2024,28 @@ stoGcMarkAndSweep(void)
 	if (!setjmp(stoAllocInner_ErrorCatch)) return;
 #endif
 
+	stoGcSweepPending();
+	if (stoGenerational && !minor)
+		stoGcClearMarks();
+
+	stoParMarkBegin();
 	nm = stoGcMark();
-	ns = stoGcSweep();
+	if (minor)
+		nm += stoGcMarkCards();
+	nm += stoParMarkFinish();
+	if (sampleMean) stoSampleCheck();
+	ns = stoGcSweep(!stoGenerational);
+
+	if (stoGenerational)
+		cardmapClear();
 	
 	if (gcTraceFile) {
-	fprintf(gcTraceFile, "marked %d (+ %d free), swept  %d.]\n",
-			nm, stoGcMarkedFree, ns);
+	fprintf(gcTraceFile, "%smarked %d (+ %d free), swept  %d.]\n",
+			minor ? "minor, " : "", nm, stoGcMarkedFree, ns);
 	}
 #ifdef FOAM_RTS
-	if (markingStats) fprintf(osStderr, "marked %d (+ %d free), swept  %d.]\n",
-			nm, stoGcMarkedFree, ns);
+	if (markingStats) fprintf(osStderr, "%smarked %d (+ %d free), swept  %d.]\n",
+			minor ? "minor, " : "", nm, stoGcMarkedFree, ns);
 #endif 
 }
 
@@ -2031,6 +2319,9 @@ local int stoGcMarkRange1(Pointer *lo, Pointer *hi, int check);
 local int
 stoGcMarkRange(Pointer *lo, Pointer *hi, int check)
 {
+	/* Leave the range for the marking threads. */
+	if (stoParMarking && stoParPush(lo, hi, 0)) return 0;
+
 	lvl++;
 	if (DEBUG(sto) && lvl % 3000 == 0) {
 		printf("Deep stack %d\n", lvl);
@@ -2328,32 +2619,608 @@ PagesOkay: {}
 				stoMarkArea += MEM_MAX_TYPE;
 			}
 		}
-
-		n += stoGcMarkRange(plo, phi, (int) 0);
-
-		/* Pointer classification */
-		if (DEBUG(sto)) {stoMarkArea = oldStoMarkArea;}
+
+		n += stoGcMarkRange(plo, phi, (int) 0);
+
+		/* Pointer classification */
+		if (DEBUG(sto)) {stoMarkArea = oldStoMarkArea;}
+	}
+
+	/* Pointer classification */
+	if (DEBUG(sto)) {stoMarkArea = oldStoMarkArea;}
+	return n;
+}
+
+/****************************************************************************
+ *
+ * :: Parallel marking
+ *
+ * With stoMarkThreads > 1, the ranges given to stoGcMarkRange by the root
+ * scan are queued rather than scanned.  The queue is then emptied by that
+ * many threads, each with its own stack of ranges still to be scanned.  A
+ * thread with nothing left steals from the bottom of another's stack.
+ * Pieces are claimed by setting their mark bits atomically, so each is
+ * scanned once, by the thread which marked it.
+ *
+ * Pieces with tracers are marked by the threads, but their tracers are
+ * called afterwards, one at a time, as they use stoMarkObject.
+ *
+ * Marking is otherwise as in stoGcMarkRange1, so the same pieces are
+ * marked whatever the number of threads.
+ *
+ ***************************************************************************/
+
+#if defined(__GNUC__) && !defined(STO_CAN_BLACKLIST) && !defined(STO_USE_MALLOC)
+# define STO_PAR_MARK
+#endif
+
+#define STO_PAR_MAX	  64	/* Most marking threads. */
+#define STO_PAR_CHUNK	  1024	/* Most words scanned before queueing the rest. */
+#define STO_PAR_MIN_PAGES 256	/* Smaller heaps are marked serially. */
+
+/*
+ * The stacks are in memory scanned for roots, so a range keeps its last
+ * word rather than its end: both then point into the same piece, which
+ * is already marked, and the stacks keep nothing else alive.
+ */
+typedef struct {
+	Pointer		*lo, *last;
+	int		tag;		/* QmInfo for a traced piece. */
+} StoParRange;
+
+typedef struct {
+	char		lock;
+	Length		base, top;	/* items[base..top) are to be scanned. */
+	Length		size, used;
+	StoParRange	*items;
+	StoParRange	*retired;	/* Earlier items, kept until the end. */
+
+	/* Work done in the last collection. */
+	int		nmarked, nfree, nsteals;
+	ULong		nwords;
+} StoParMarker;
+
+static int		stoParCount;
+static int		stoParIdle;
+static StoParMarker	stoParMarkers[STO_PAR_MAX];
+static StoParMarker	stoParTraced;
+
+#ifdef STO_PAR_MARK
+
+local void	stoParScan	(StoParMarker *, Pointer *, Pointer *);
+
+#define stoParLoad(x)		__atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define stoParSetMark(qm)	__atomic_fetch_or(&(qm), QmMarkMask, __ATOMIC_RELAXED)
+
+local void
+stoParLock(StoParMarker *m)
+{
+	while (__atomic_test_and_set(&m->lock, __ATOMIC_ACQUIRE))
+		;
+}
+
+local void
+stoParUnlock(StoParMarker *m)
+{
+	__atomic_clear(&m->lock, __ATOMIC_RELEASE);
+}
+
+/*
+ * Make room for one more item.  The stacks come from malloc rather
+ * than osAlloc, as they may grow in several threads at once.  Old
+ * stacks are not freed until marking is over: they may lie in a range
+ * queued by the root scan, which must still be there to be scanned.
+ */
+local Bool
+stoParGrow(StoParMarker *m)
+{
+	StoParRange	*items;
+	Length		size;
+
+	if (m->base > 0) {
+		memmove(m->items, m->items + m->base,
+			(m->top - m->base) * sizeof(StoParRange));
+		memset(m->items + m->top - m->base, 0,
+		       m->base * sizeof(StoParRange));
+		m->top -= m->base;
+		m->base = 0;
+		return true;
+	}
+
+	size  = m->size ? 2 * m->size : 1024;
+	items = (StoParRange *) malloc(size * sizeof(StoParRange));
+	if (!items) return false;
+
+	memset(items, 0, size * sizeof(StoParRange));
+	if (m->items) {
+		memcpy(items, m->items, m->top * sizeof(StoParRange));
+		memset(m->items, 0, m->size * sizeof(StoParRange));
+		m->items[0].lo = (Pointer *) m->retired;
+		m->retired     = m->items;
+	}
+	m->items = items;
+	m->size  = size;
+	return true;
+}
+
+local Bool
+stoParPushOn(StoParMarker *m, Pointer *lo, Pointer *hi, int tag)
+{
+	if (!ptrLT(lo, hi)) return true;
+
+	stoParLock(m);
+	if (m->top == m->size && !stoParGrow(m)) {
+		stoParUnlock(m);
+		return false;
+	}
+	m->items[m->top].lo   = lo;
+	m->items[m->top].last = hi - 1;
+	m->items[m->top].tag  = tag;
+	m->top++;
+	if (m->top > m->used) m->used = m->top;
+	stoParUnlock(m);
+	return true;
+}
+
+local Bool
+stoParPop(StoParMarker *m, StoParRange *r)
+{
+	Bool	ok = false;
+
+	stoParLock(m);
+	if (m->top > m->base) {
+		*r = m->items[--m->top];
+		ok = true;
+	}
+	if (m->top == m->base) m->top = m->base = 0;
+	stoParUnlock(m);
+	return ok;
+}
+
+local Bool
+stoParSteal(StoParMarker *m, StoParRange *r)
+{
+	StoParMarker	*v;
+	Bool		ok;
+	int		i, me = m - stoParMarkers;
+
+	for (i = 1; i < stoParCount; i++) {
+		v = &stoParMarkers[(me + i) % stoParCount];
+		if (stoParLoad(v->top) == stoParLoad(v->base)) continue;
+
+		ok = false;
+		stoParLock(v);
+		if (v->top > v->base) {
+			*r = v->items[v->base++];
+			ok = true;
+		}
+		if (v->top == v->base) v->top = v->base = 0;
+		stoParUnlock(v);
+
+		if (ok) {
+			m->nsteals++;
+			return true;
+		}
+	}
+	return false;
+}
+
+local Bool
+stoParHasWork(void)
+{
+	int	i;
+
+	for (i = 0; i < stoParCount; i++)
+		if (stoParLoad(stoParMarkers[i].top) !=
+		    stoParLoad(stoParMarkers[i].base))
+			return true;
+	return false;
+}
+
+/*
+ * Queue a range from the root scan.  Our own stack is scanned at once,
+ * as its frames will have been reused by the time the threads run.
+ */
+local Bool
+stoParPush(Pointer *lo, Pointer *hi, int tag)
+{
+	Pointer	here = (Pointer) &here;
+
+	if (ptrLE(lo, here) && ptrLT(here, hi)) return false;
+	return stoParPushOn(&stoParMarkers[0], lo, hi, tag);
+}
+
+/*
+ * Mark the pieces pointed to from [lo, hi), queueing their contents.
+ * The last piece found is scanned next by this thread.
+ */
+local void
+stoParScan(StoParMarker *m, Pointer *lo, Pointer *hi)
+{
+	Pointer		p, *pp, *plo, *phi, *hi0, *nlo, *nhi;
+	int		pgno;
+	Length		qmno, qi, nq;
+	PgInfo		pgtag;
+	QmInfo		qmtag;
+	Section		*sect;
+	MxMem		*pc;
+
+ Again:
+	hi = (Pointer *) ptrCanon(hi);
+	if (ptrDiff((char *) hi, (char *) lo) >
+	    (long) (STO_PAR_CHUNK * sizeof(Pointer))) {
+		nlo = lo + STO_PAR_CHUNK;
+		if (stoParPushOn(m, nlo, hi, 0)) hi = nlo;
+	}
+	hi0 = (Pointer *) ptrOff(((char *) hi), 1 - sizeof(char *));
+	nlo = nhi = 0;
+
+	for (pp = lo; ptrLT(pp, hi0);
+	     pp = (Pointer *) ptrOff((char *) pp, alignof(Pointer))) {
+		p = *pp;
+		m->nwords++;
+
+		if (!isInHeap(p)) continue;
+
+		pgno  = pgNo(p);
+		pgtag = pgMap[pgno];
+		if (pgtag != PgBusyFirst && pgtag != PgBusyFollow) continue;
+
+		while (pgtag == PgBusyFollow) pgtag = pgMap[--pgno];
+		sect = sectAt(pgno);
+
+		if (ptrLT(p, sect->data)) continue;
+
+		if (sect->isFixed) {
+			qmno  = sect->qmLog ? qmLogNo(p, sect) : qmNo(p, sect);
+			qmtag = stoParSetMark(sect->info[qmno]);
+			if (QmInfoMark(qmtag)) continue;
+
+			plo = (Pointer *) ptrOff((char *) sect->data,
+						 qmno * sect->qmSize);
+			phi = (Pointer *) ptrOff((char *) plo, sect->qmSize);
+		}
+		else {
+			qmno = qmNo(p, sect);
+			if (QmInfoMark(stoParLoad(sect->info[qmno]))) continue;
+
+			while (QmInfoKind(stoParLoad(sect->info[qmno])) == QmFollow)
+				qmno--;
+			qmtag = stoParSetMark(sect->info[qmno]);
+			if (QmInfoMark(qmtag)) continue;
+
+			pc = (MxMem *) ptrOff((char *) sect->data,
+					      qmno * sect->qmSize);
+			nq = pc->nbytesThis / sect->qmSize;
+			for (qi = qmno + 1; qi < qmno + nq; qi++)
+				stoParSetMark(sect->info[qi]);
+
+			plo = (Pointer *) (&pc->body.busy.data);
+			phi = (Pointer *) ptrOff((char *) plo,
+						 pc->nbytesThis - MxMemHeadSize);
+		}
+
+		if (QmInfoKind(qmtag) == QmFreeFirst) {
+			m->nfree++;
+			continue;
+		}
+		m->nmarked++;
+
+		if (QmIsPtrFree(qmtag)) continue;
+
+#if STO_USER_CAN_TRACE
+		if (QmAldorTraced(qmtag) || QmCTraced(qmtag)) {
+			if (!stoParPushOn(&stoParTraced, plo, phi, qmtag))
+				(*stoError)(StoErr_OutOfMemory);
+			continue;
+		}
+#endif
+
+		/* Keep the latest piece for ourselves. */
+		if (nlo && !stoParPushOn(m, nlo, nhi, 0))
+			stoParScan(m, nlo, nhi);
+		nlo = plo;
+		nhi = phi;
+	}
+
+	if (nlo) {
+		lo = nlo;
+		hi = nhi;
+		goto Again;
+	}
+}
+
+local void
+stoParWork(Pointer arg)
+{
+	StoParMarker	*m = (StoParMarker *) arg;
+	StoParRange	r;
+
+	for (;;) {
+		if (stoParPop(m, &r) || stoParSteal(m, &r)) {
+			stoParScan(m, r.lo, r.last + 1);
+			continue;
+		}
+
+		/* Finished when every thread is idle. */
+		__atomic_add_fetch(&stoParIdle, 1, __ATOMIC_SEQ_CST);
+		for (;;) {
+			if (__atomic_load_n(&stoParIdle, __ATOMIC_SEQ_CST)
+			    == stoParCount)
+				return;
+			if (stoParHasWork()) break;
+			osThreadYield();
+		}
+		__atomic_sub_fetch(&stoParIdle, 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+local void
+stoParMarkBegin(void)
+{
+	int	i;
+
+	stoParMarking = stoMarkThreads > 1 && !DEBUG(sto) &&
+			pgMapSize >= STO_PAR_MIN_PAGES;
+	if (!stoParMarking) {
+		stoParCount = 0;
+		return;
+	}
+
+	stoParCount = stoMarkThreads;
+	stoParIdle  = 0;
+	for (i = 0; i < stoParCount; i++) {
+		stoParMarkers[i].nmarked = 0;
+		stoParMarkers[i].nfree	 = 0;
+		stoParMarkers[i].nsteals = 0;
+		stoParMarkers[i].nwords	 = 0;
+	}
+}
+
+/*
+ * Forget the ranges, so they are not taken as roots next time.
+ */
+local void
+stoParClear(StoParMarker *m)
+{
+	StoParRange	*r;
+
+	if (m->used) memset(m->items, 0, m->used * sizeof(StoParRange));
+	m->base = m->top = m->used = 0;
+
+	while ((r = m->retired) != 0) {
+		m->retired = (StoParRange *) r[0].lo;
+		free(r);
+	}
+}
+
+local int
+stoParMarkFinish(void)
+{
+	OsThread	threads[STO_PAR_MAX];
+	StoParRange	r;
+	int		i, nthreads = 0, n = 0;
+
+	if (!stoParMarking) return 0;
+
+	/*
+	 * Even the work on our own stack is done by another thread, so
+	 * that the frames it leaves cannot be taken for roots later.
+	 */
+	for (i = 0; i < stoParCount; i++) {
+		threads[i] = osThreadStart(stoParWork, &stoParMarkers[i]);
+		if (threads[i])
+			nthreads++;
+		else	/* A thread which does not start is always idle. */
+			__atomic_add_fetch(&stoParIdle, 1, __ATOMIC_SEQ_CST);
+	}
+	if (nthreads == 0) {
+		stoParIdle = 0;
+		stoParCount = 1;
+		stoParWork(&stoParMarkers[0]);
+	}
+	for (i = 0; i < stoParCount; i++)
+		if (threads[i]) osThreadJoin(threads[i]);
+
+	stoParMarking = false;
+
+	for (i = 0; i < stoParCount; i++) {
+		n		+= stoParMarkers[i].nmarked;
+		stoGcMarkedFree += stoParMarkers[i].nfree;
+		stoParClear(&stoParMarkers[i]);
+	}
+
+#if STO_USER_CAN_TRACE
+	for (i = 0; i < (int) stoParTraced.top; i++) {
+		r = stoParTraced.items[i];
+		if (QmAldorTraced(r.tag))
+			n += (int) stoFiCCall2(int, QmAldorTraced(r.tag),
+					       r.lo, r.last + 1);
+		else
+			n += (QmCTraced(r.tag))(r.lo, r.last + 1);
+	}
+#endif
+	stoParClear(&stoParTraced);
+
+	return n;
+}
+
+#else /* !STO_PAR_MARK */
+
+local void
+stoParMarkBegin(void)
+{
+	stoParMarking = false;
+	stoParCount   = 0;
+}
+
+local int
+stoParMarkFinish(void)
+{
+	return 0;
+}
+
+local Bool
+stoParPush(Pointer *lo, Pointer *hi, int tag)
+{
+	return false;
+}
+
+#endif /* STO_PAR_MARK */
+
+local Bool
+stoSetMarkThreads(int n)
+{
+	if (n <= 0) n = osCpuCount();
+	if (n > STO_PAR_MAX) n = STO_PAR_MAX;
+#ifndef STO_PAR_MARK
+	if (n > 1) return false;
+#endif
+	stoMarkThreads = n;
+	return true;
+}
+
+local void
+stoShowThreads(void)
+{
+	int	i;
+
+	if (stoParCount == 0) {
+		fprintf(osStderr, "| %-11s serial\n", "Marking:");
+		return;
+	}
+	for (i = 0; i < stoParCount; i++)
+		fprintf(osStderr,
+			"| %-11s %d: %d marked, %lu words, %d steals\n",
+			i ? "" : "Marking:", i,
+			stoParMarkers[i].nmarked,
+			stoParMarkers[i].nwords,
+			stoParMarkers[i].nsteals);
+}
+
+/****************************************************************************
+ *
+ * :: Lazy sweeping
+ *
+ * After marking, stoGcSweep reads only the info bytes of each section.
+ * It counts the busy and free pieces, tallies the garbage, and gives
+ * back the pages of sections with nothing left alive.  Sections that
+ * hold both live and dead pieces are queued, by piece size for fixed
+ * sections.  piecesGetFixed and pieceGetMixed sweep them one at a time
+ * as they need free pieces, so the pause does not grow with the heap.
+ *
+ * Whatever is still queued is swept before the next collection marks,
+ * and before anything that walks the heap: the audit, the census and
+ * the free list rebuild.
+ *
+ * A queued fixed section's free pieces are not on the free lists, so
+ * stoFree leaves pieces freed there for the sweep to collect.  Marks on
+ * free mixed pieces are cleared straight away, as those pieces stay in
+ * the free tree and may be handed out before their section is swept.
+ *
+ ***************************************************************************/
+
+/*
+ * Count the pieces of a fixed section.  Return the number of garbage
+ * pieces, setting *pbusy and *pfree to the number live and available.
+ */
+local int
+stoGcCountFixed(Section *sect, ULong *pbusy, ULong *pfree)
+{
+	Length	qmno;
+	QmInfo	qmtag;
+	int	swept = 0;
+	ULong	nbusy = 0, nfree = 0;
+
+	for (qmno = 0; qmno < sect->qmCount; qmno++) {
+		qmtag = sect->info[qmno];
+
+		if (QmInfoKind(qmtag) == QmBusyFirst) {
+#ifdef USE_MEMORY_CLIMATE
+			incrMemoryClimateHistogram(QmInfoCode(qmtag),
+						   !QmInfoMark(qmtag), 1);
+#endif
+			if (QmInfoMark(qmtag)) {
+				nbusy++;
+				continue;
+			}
+			stoPiecesGc[QmInfoCode(qmtag)]++;
+			stoTally(stoBytesGc += sect->qmSize);
+			swept++;
+		}
+#ifdef STO_CAN_BLACKLIST
+		else if (QmInfoKind(qmtag) == QmBlacklisted) {
+			stoTally(stoBytesBlack += sect->qmSize);
+			continue;
+		}
+#endif
+		nfree++;
 	}
 
-	/* Pointer classification */
-	if (DEBUG(sto)) {stoMarkArea = oldStoMarkArea;}
-	return n;
+	*pbusy = nbusy;
+	*pfree = nfree;
+	return swept;
 }
 
 /*
- * Collect unmarked busy pieces.
- * The small piece free lists are reconstructed, sorted by section.
+ * Count the pieces of a mixed section, and clear the marks on its free
+ * pieces.  Return the number of garbage pieces, setting *pbusy to the
+ * number of quanta in live pieces, and *pdead and *plive to the bytes
+ * in dead and live ones.
  */
+local int
+stoGcCountMixed(Section *sect, ULong *pbusy, ULong *pdead, ULong *plive)
+{
+	Length	qmno, qi, nq;
+	QmInfo	qmtag;
+	int	swept = 0;
+	ULong	nbusy = 0, ndead = 0, nlive = 0;
+
+	for (qmno = 0; qmno < sect->qmCount; qmno += nq) {
+		qmtag = sect->info[qmno];
+
+		for (nq = 1; qmno + nq < sect->qmCount; nq++)
+			if (QmInfoKind(sect->info[qmno+nq]) != QmFollow)
+				break;
+
+		if (QmInfoKind(qmtag) != QmBusyFirst) {
+			for (qi = qmno; qi < qmno + nq; qi++)
+				QmInfoClearMark(sect->info[qi]);
+			continue;
+		}
+#ifdef USE_MEMORY_CLIMATE
+		incrMemoryClimateHistogram(QmInfoCode(qmtag),
+					   !QmInfoMark(qmtag), 1);
+#endif
+		if (QmInfoMark(qmtag)) {
+			nbusy += nq;
+			nlive += nq * sect->qmSize;
+			continue;
+		}
+		stoPiecesGc[QmInfoCode(qmtag)]++;
+		stoTally(stoBytesGc += nq * sect->qmSize - MxMemHeadSize);
+		ndead += nq * sect->qmSize;
+		swept++;
+	}
 
-static FxMem	fixedHeadStruct[FixedSizeCount], *fixedTail[FixedSizeCount];
-static ULong	freeFixedStruct[FixedSizeCount];
-static ULong	busyFixedStruct[FixedSizeCount];
+	*pbusy = nbusy;
+	*pdead = ndead;
+	*plive = nlive;
+	return swept;
+}
 
+/*
+ * Tally the unmarked busy pieces and queue the sections holding them.
+ * Marks on busy pieces are cleared, when they are swept, only if clear
+ * is true.
+ */
 local int
-stoGcSweep(void)
+stoGcSweep(Bool clear)
 {
 	int	cd, ix, pgno, pgcount, swept, got;
-	Section *sect;
+	Section *sect, **fixedLast[FixedSizeCount], **mixedLast;
+	ULong	nbusy, nfree, nlive;
+	Pointer pstart, pend, pfront;
 
 #ifdef USE_MEMORY_CLIMATE
 	initMemoryClimateHistogram();
@@ -2362,14 +3229,19 @@ stoGcSweep(void)
 	for (cd = 0; cd < STO_CODE_LIMIT; cd++)
 		stoPiecesGc[cd] = 0;	/* Tally by code of pieces swept. */
 
-	/* Reset the fixed-sized free lists and counters. */
+	/* The free lists are rebuilt as the sections are swept. */
 	for (ix = 0; ix < FixedSizeCount; ix++)
 	{
-		fixedTail[ix] = &fixedHeadStruct[ix];
+		fixedPieces[ix] = 0;
+		sweepFixed[ix]	= 0;
+		fixedLast[ix]	= &sweepFixed[ix];
 
-		freeFixedStruct[ix] = 0L;
-		busyFixedStruct[ix] = 0L;
+		freeFixedPieces[ix] = 0L;
+		busyFixedPieces[ix] = 0L;
 	}
+	sweepMixed = 0;
+	mixedLast  = &sweepMixed;
+	sweepClear = clear;
 
 
 	/* Reset the mixed-sized store counting */
@@ -2378,6 +3250,8 @@ stoGcSweep(void)
 
 
 	/* Check each section in the heap */
+	pfront = ptrCanon((char *) mixedFrontier);
+
 	for (swept = 0, pgno = 0; pgno < pgMapSize; pgno += pgcount)
 	{
 		if (pgMap[pgno] != PgBusyFirst) { pgcount = 1; continue; }
@@ -2387,19 +3261,45 @@ stoGcSweep(void)
 
 		if (sect->isFixed)
 		{
-			got = stoGcSweepFixed(sect);
-			swept += got;
+			ix	= sect->qmSizeIndex;
+			got	= stoGcCountFixed(sect, &nbusy, &nfree);
+			swept  += got;
+
+			if (!nbusy)
+				pagesPut((Page *) sect, sect->pgCount);
+			else if (!nfree)
+				stoGcSweepFixed(sect, clear);
+			else {
+				sect->isUnswept = true;
+				*fixedLast[ix]	= sect;
+				fixedLast[ix]	= &sect->sweepNext;
+			}
+			if (nbusy) {
+				freeFixedPieces[ix] += nfree;
+				busyFixedPieces[ix] += nbusy;
+			}
 		}
 		else
-			swept += stoGcSweepMixed(sect);
-	}
+		{
+			got	= stoGcCountMixed(sect, &nbusy, &nfree, &nlive);
+			swept  += got;
 
-	for (ix = 0; ix < FixedSizeCount; ix++) {
-		fixedTail[ix]->next = 0;
-		fixedPieces[ix] = fixedHeadStruct[ix].next;
+			pstart = ptrCanon((char *) sect);
+			pend   = ptrCanon((char *) sect + sect->pgCount*PgSize);
 
-		freeFixedPieces[ix] = freeFixedStruct[ix];
-		busyFixedPieces[ix] = busyFixedStruct[ix];
+			/* Sweep now if the pages can be given back. */
+			if (!got || (!nbusy && (pfront < pstart || pend <= pfront)))
+				stoGcSweepMixed(sect, clear);
+			else {
+				sect->isUnswept = true;
+				*mixedLast	= sect;
+				mixedLast	= &sect->sweepNext;
+			}
+			if (nbusy) {
+				freeMixedBytes += nfree;
+				busyMixedBytes += nlive;
+			}
+		}
 	}
 #ifdef USE_MEMORY_CLIMATE
 	finiMemoryClimateHistogram();
@@ -2408,23 +3308,74 @@ stoGcSweep(void)
 	return swept;
 }
 
-local int
-stoGcSweepFixed(Section *sect)
+/*
+ * Sweep the first section in the queue *pq.
+ */
+local void
+stoGcSweepNext(Section **pq)
+{
+	Section	*sect = *pq;
+	Bool	busy  = sweepBusy;
+
+	*pq		= sect->sweepNext;
+	sect->sweepNext = 0;
+	sect->isUnswept = false;
+
+	/* The free tree may need pages: do not collect half way. */
+	sweepBusy = true;
+	if (sect->isFixed)
+		stoGcSweepFixed(sect, sweepClear);
+	else
+		stoGcSweepMixed(sect, sweepClear);
+	sweepBusy = busy;
+}
+
+/*
+ * Sweep a queued section ahead of its turn.
+ */
+local void
+stoGcSweepSection(Section *sect)
+{
+	Section	**pq;
+
+	pq = sect->isFixed ? &sweepFixed[sect->qmSizeIndex] : &sweepMixed;
+	while (*pq != sect) pq = &(*pq)->sweepNext;
+	stoGcSweepNext(pq);
+}
+
+/*
+ * Sweep every queued section.
+ */
+local void
+stoGcSweepPending(void)
+{
+	int	ix;
+
+	for (ix = 0; ix < FixedSizeCount; ix++)
+		while (sweepFixed[ix])
+			stoGcSweepNext(&sweepFixed[ix]);
+	while (sweepMixed)
+		stoGcSweepNext(&sweepMixed);
+}
+
+/*
+ * Put the free pieces of a fixed section on the front of its free list,
+ * freeing the unmarked busy pieces.
+ */
+local void
+stoGcSweepFixed(Section *sect, Bool clear)
 {
-	int	qmcount, qmsize, qmsizeix, qmno, qmbusy, mark, swept;
+	int	qmcount, qmsize, qmsizeix, qmno, qmbusy, mark;
 	QmInfo	qmtag;
 	char	*data;
-	FxMem	*pc, *nfixedTail;
-	ULong	nfixedFree;
+	FxMem	head, *pc, *tail;
 
 	data	 = (char *) sect->data;
 	qmcount	 = sect->qmCount;
 	qmsize	 = sect->qmSize;
 	qmsizeix = sect->qmSizeIndex;
-	swept	 = 0;
 	qmbusy	 = 0;
-	nfixedTail = fixedTail[qmsizeix];
-	nfixedFree = 0L;
+	tail	 = &head;
 
 	for (qmno = 0; qmno < qmcount; qmno++) {
 		qmtag = sect->info[qmno];
@@ -2432,75 +3383,52 @@ stoGcSweepFixed(Section *sect)
 
 		if (QmInfoKind(qmtag) == QmBusyFirst) {
 			if (mark) {
-				QmInfoClearMark(sect->info[qmno]);
-#ifdef USE_MEMORY_CLIMATE
-				incrMemoryClimateHistogram(
-					QmInfoCode(sect->info[qmno]), (int) 0, 1
-				);
-#endif
+				if (clear) QmInfoClearMark(sect->info[qmno]);
 				qmbusy++;
+				continue;
 			}
-			else {
-				pc = (FxMem *)(data+qmno*qmsize);
-				stoPiecesGc[ QmInfoCode(sect->info[qmno]) ]++;
-#ifdef USE_MEMORY_CLIMATE
-				incrMemoryClimateHistogram(
-					QmInfoCode(sect->info[qmno]), 1, 1
-				);
-#endif
-				sect->info[qmno] = QmInfoMake0(QmFreeFirst);
-				fxmemCleanBody(pc, qmsize);
-				stoTally(stoBytesGc += qmsize);
-				nfixedTail->next = pc;
-				nfixedTail = pc;
-				swept++;
-			}
+			pc = (FxMem *)(data+qmno*qmsize);
+			sect->info[qmno] = QmInfoMake0(QmFreeFirst);
+			fxmemCleanBody(pc, qmsize);
 		}
 		else {
 			if (mark) QmInfoClearMark(sect->info[qmno]);
 
 #ifdef STO_CAN_BLACKLIST
 			/* Skip blacklisted pieces */
-			if (QmInfoKind(qmtag) == QmBlacklisted) {
-				stoTally(stoBytesBlack += qmsize);
-				continue;
-			}
+			if (QmInfoKind(qmtag) == QmBlacklisted) continue;
 #endif
-
 			pc = (FxMem *)(data+qmno*qmsize);
-			nfixedTail->next = pc;
-			nfixedTail = pc;
-			nfixedFree++;
 		}
+		tail->next = pc;
+		tail = pc;
 	}
 
 	if (qmbusy)
 	{
-		fixedTail[qmsizeix] = nfixedTail;
-		freeFixedStruct[qmsizeix] += (nfixedFree + swept);
-		busyFixedStruct[qmsizeix] += qmbusy;
+		tail->next = fixedPieces[qmsizeix];
+		fixedPieces[qmsizeix] = head.next;
 	}
 	else
 		pagesPut((Page *) sect, sect->pgCount);
-	return swept;
 }
 
-local int
-stoGcSweepMixed(Section *sect)
+/*
+ * Put the unmarked busy pieces of a mixed section in the free tree.
+ */
+local void
+stoGcSweepMixed(Section *sect, Bool clear)
 {
-	int	qmcount, qmsize, qmno, qi, nq, sz, mark, swept, qmbusy;
+	int	qmcount, qmsize, qmno, qi, nq, sz, mark, qmbusy;
 	QmInfo	qmtag;
 	MxMem	*pc;
 	char	*data;
 	Pointer pstart, pend, pfront;
-	ULong	nMixedFree = freeMixedBytes;
-	ULong	nMixedBusy = busyMixedBytes;
 
 	data	= (char *) sect->data;
 	qmsize	= sect->qmSize;
 	qmcount = sect->qmCount;
 
-	swept	= 0;
 	qmbusy	= 0;
 
 	for (qmno = 0; qmno < qmcount; qmno += nq) {
@@ -2517,17 +3445,9 @@ stoGcSweepMixed(Section *sect)
 			if (npc == 0 || !npc->isFree) {
 
 				/* Free piece. */
-				stoPiecesGc[ QmInfoCode(sect->info[qmno]) ]++;
-#ifdef USE_MEMORY_CLIMATE
-				incrMemoryClimateHistogram(
-					QmInfoCode(sect->info[qmno]), 1, 1
-				);
-#endif
 				sect->info[qmno]  = QmInfoMake0(QmFreeFirst);
 				mxmemCleanBody(pc, sz);
-				stoTally(stoBytesGc += sz-MxMemHeadSize);
 				piecePutMixed(pc);
-				swept++;
 			}
 			else {
 				/* Save info, in case of merge. */
@@ -2537,17 +3457,9 @@ stoGcSweepMixed(Section *sect)
 				QmInfo nqmtag	  = sect->info[nqmno];
 
 				/* Free piece. */
-				stoPiecesGc[ QmInfoCode(sect->info[qmno]) ]++;
-#ifdef USE_MEMORY_CLIMATE
-				incrMemoryClimateHistogram(
-					QmInfoCode(sect->info[qmno]), 1, 1
-				);
-#endif
 				sect->info[qmno]  = QmInfoMake0(QmFreeFirst);
 				mxmemCleanBody(pc, sz);
-				stoTally(stoBytesGc += sz-MxMemHeadSize);
 				piecePutMixed(pc);
-				swept++;
 
 				/* Handle if next piece was merged. */
 				if (QmInfoKind(sect->info[nqmno])==QmFollow) {
@@ -2560,20 +3472,14 @@ stoGcSweepMixed(Section *sect)
 					nq += nnq;
 				}
 			}
-			nMixedFree += sz;
 		}
 		else if (mark) {
-#ifdef USE_MEMORY_CLIMATE
-			incrMemoryClimateHistogram(
-				QmInfoCode(sect->info[qmno]), (int) 0, 1
-			);
-#endif
-			for (qi = qmno; qi < qmno+nq; qi++)
-			    QmInfoClearMark(sect->info[qi]);
+			if (clear || QmInfoKind(qmtag) != QmBusyFirst)
+			    for (qi = qmno; qi < qmno+nq; qi++)
+				QmInfoClearMark(sect->info[qi]);
 
 			if (QmInfoKind(qmtag) == QmBusyFirst)
 				qmbusy += nq;
-			nMixedBusy += sz;
 		}
 	}
 
@@ -2586,13 +3492,279 @@ stoGcSweepMixed(Section *sect)
 		mxmemUnlinkFromBTree((MxMem *) data, &mixedPieces);
 		pagesPut((Page *) sect, sect->pgCount);
 	}
-	else
-	{
-		/* Note these changes in busy/free counts */
-		freeMixedBytes = nMixedFree;
-		busyMixedBytes = nMixedBusy;
+}
+
+
+/****************************************************************************
+ *
+ * :: Generational collection
+ *
+ * Pieces cannot be moved, as roots are found conservatively, so the
+ * generations are told apart by the mark bit: the marks left by one
+ * collection are not cleared, and a piece is old if it is marked.
+ * Pieces allocated since are unmarked, so they make up the nursery.
+ *
+ * A minor collection marks from the roots and from the old pieces on
+ * cards set by the write barrier, stopping at old pieces, then frees the
+ * unmarked ones.  Survivors stay marked, which promotes them in place.
+ * A full collection clears all marks first.  Full collections are made
+ * every GcMinorLimit collections, when a minor one does not free enough
+ * to avoid growing the heap, and after stoWriteBarrierAll.
+ *
+ * Missing barriers would let a minor collection free live pieces, so the
+ * generated code of each unit says, as the unit is initialised, whether
+ * it was compiled with -Wwrite-barrier (see stoWriteBarrierUnit).  Once
+ * a unit without barriers has been seen, collection stays full.
+ *
+ ***************************************************************************/
+
+static int	gcMinorCount;
+static Bool	gcFullPending;
+static String	gcNoBarrierUnit;	/* First unit seen without barriers */
+
+/*
+ * Mark from the old pieces on page pgno.
+ */
+local int
+stoGcMarkCard(int pgno)
+{
+	Section	*sect;
+	char	*lo, *hi, *plo, *phi, *data;
+	QmInfo	qmtag;
+	Length	qmno, nq;
+	int	sgno, n = 0;
+
+	for (sgno = pgno; pgMap[sgno] == PgBusyFollow; sgno--)
+		;
+	sect = sectAt(sgno);
+
+	lo   = (char *) pgAt(pgno);
+	hi   = lo + PgSize;
+	data = (char *) sect->data;
+	if (ptrLE(hi, data)) return 0;
+	if (ptrLT(lo, data)) lo = data;
+
+	qmno = qmNo(lo, sect);
+	if (!sect->isFixed)
+		while (qmno > 0 && QmInfoKind(sect->info[qmno]) == QmFollow)
+			qmno--;
+
+	for (; qmno < sect->qmCount; qmno += nq) {
+		plo = data + qmno*sect->qmSize;
+		if (ptrLE(hi, plo)) break;
+
+		if (sect->isFixed) {
+			nq  = 1;
+			phi = plo + sect->qmSize;
+		}
+		else {
+			MxMem	*pc = (MxMem *) plo;
+
+			nq  = pc->nbytesThis/sect->qmSize;
+			phi = plo + pc->nbytesThis;
+			plo = (char *) (&pc->body.busy.data);
+		}
+
+		qmtag = sect->info[qmno];
+		if (QmInfoKind(qmtag) != QmBusyFirst) continue;
+		if (!QmInfoMark(qmtag) || QmIsPtrFree(qmtag)) continue;
+
+		if (ptrLT(plo, lo)) plo = lo;
+		if (ptrLT(hi, phi)) phi = hi;
+		if (ptrLT(plo, phi))
+			n += stoGcMarkRange((Pointer *) plo, (Pointer *) phi, 0);
+	}
+	return n;
+}
+
+/*
+ * Mark from the old pieces on all cards set since the last collection.
+ */
+local int
+stoGcMarkCards(void)
+{
+	Length	i, ncards = stoCardSize >> LgPgSize;
+	int	n = 0;
+
+	for (i = 0; i < ncards; i++) {
+		if (!stoCardMap[i]) continue;
+		if (pgMap[i] != PgBusyFirst && pgMap[i] != PgBusyFollow)
+			continue;
+		n += stoGcMarkCard(i);
+	}
+	return n;
+}
+
+/*
+ * Clear the mark on every quantum, making all pieces young.
+ */
+local void
+stoGcClearMarks(void)
+{
+	int	pgno, pgcount;
+	Length	qi;
+	Section *sect;
+
+	stoGcSweepPending();
+
+	for (pgno = 0; pgno < pgMapSize; pgno += pgcount) {
+		if (pgMap[pgno] != PgBusyFirst) { pgcount = 1; continue; }
+
+		sect	= sectAt(pgno);
+		pgcount = sect->pgCount;
+
+		for (qi = 0; qi < sect->qmCount; qi++)
+			QmInfoClearMark(sect->info[qi]);
+	}
+}
+
+/*
+ * Can the next automatic collection be a minor one?
+ */
+local Bool
+stoGcWantMinor(void)
+{
+	if (!stoGenerational || gcFullPending) return false;
+	return gcMinorCount < GcMinorLimit;
+}
+
+local Bool
+stoSetGenerational(Bool on)
+{
+	if (on == stoGenerational) return true;
+
+	if (on) {
+		if (gcNoBarrierUnit) {
+			fprintf(osStderr, "[GC: Not generational: %s was "
+				"compiled without -Wwrite-barrier]\n",
+				gcNoBarrierUnit);
+			return false;
+		}
+		if (!stoMustTag || !cardmapSync()) return false;
+		gcMinorCount  = 0;
+		gcFullPending = false;
+	}
+	else {
+		stoGcClearMarks();
+		cardmapFree();
+	}
+	stoGenerational = on;
+	return true;
+}
+
+void
+stoWriteBarrierAll(void)
+{
+	if (stoGenerational) gcFullPending = true;
+}
+
+/*
+ * Called as each unit of generated code is initialised, before any of
+ * its code has run, to say whether it has write barriers.
+ */
+void
+stoWriteBarrierUnit(char *unit, int withBarriers)
+{
+	if (withBarriers || gcNoBarrierUnit) return;
+
+	gcNoBarrierUnit = unit;
+	if (stoGenerational) {
+		fprintf(osStderr, "[GC: Not generational: %s was "
+			"compiled without -Wwrite-barrier]\n", unit);
+		stoSetGenerational(false);
+	}
+}
+
+
+/****************************************************************************
+ *
+ * :: Allocation sampling
+ *
+ * With stoCtl(StoCtl_Sample, mean, sampleFun, surviveFun), about one
+ * piece in every mean bytes allocated is passed to sampleFun.  The gaps
+ * are drawn uniformly from [1, 2*mean], so the samples do not fall in
+ * step with the allocation pattern.
+ *
+ * The sampled pieces are remembered in a small table hashed by address
+ * until the next collection.  That collection calls surviveFun for each
+ * one which is marked, and empties the table.  A sample which collides
+ * with a later one, or which is freed explicitly, is forgotten.
+ *
+ * The table is static data, which the collector scans for roots, so the
+ * addresses are kept complemented: otherwise every sample would be marked
+ * and kept alive by the table itself.
+ *
+ ****************************************************************************/
+
+#define StoSampleSlots	1024
+
+static struct stoSample {
+	ULong		hidden;		/* ~(address), or 0 */
+	Pointer		tag;
+	ULong		nbytes;
+}			sampleTab[StoSampleSlots];
+static ULong		sampleSeed = 1;
+static StoSampleFun	sampleFun;
+static StoSurviveFun	surviveFun;
+
+#define stoSampleSlot(p)	(((ULong) (p) >> 4) % StoSampleSlots)
+#define stoSampleHide(p)	(~(ULong) (p))
+#define stoSampleShow(h)	((Pointer) ~(h))
+
+local void
+stoSetSampling(ULong mean, StoSampleFun sample, StoSurviveFun survive)
+{
+	memset(sampleTab, 0, sizeof(sampleTab));
+	sampleFun  = sample;
+	surviveFun = survive;
+	sampleMean = sample ? mean : 0;
+	sampleLeft = (long) sampleMean;
+}
+
+local void
+stoSampleTake(Pointer p, ULong nbytes)
+{
+	struct stoSample *s = &sampleTab[stoSampleSlot(p)];
+
+	/* Set the next gap first: sampleFun may allocate. */
+	sampleSeed = sampleSeed * 1103515245UL + 12345UL;
+	sampleLeft = (long) (1 + (sampleSeed >> 8) % (2 * sampleMean));
+
+	s->hidden = 0;
+	s->tag	  = sampleFun(nbytes);
+	s->nbytes = nbytes;
+	s->hidden = stoSampleHide(p);
+}
+
+local void
+stoSampleForget(Pointer p)
+{
+	struct stoSample *s = &sampleTab[stoSampleSlot(p)];
+
+	if (s->hidden == stoSampleHide(p)) s->hidden = 0;
+}
+
+/*
+ * Called after marking, before the sweep.
+ */
+local void
+stoSampleCheck(void)
+{
+	struct stoSample *s;
+	Section		*sect;
+	Pointer		p, pc;
+
+	for (s = sampleTab; s < sampleTab + StoSampleSlots; s++) {
+		if (!s->hidden) continue;
+
+		p    = stoSampleShow(s->hidden);
+		sect = sectFor(p);
+		pc   = sect->isFixed ? p :
+			ptrOff((char *) p, -(long) MxMemHeadSize);
+		if (QmInfoMark(sect->info[qmNo(pc, sect)]) && surviveFun)
+			surviveFun(s->tag, s->nbytes);
+		s->hidden = 0;
 	}
-	return swept;
 }
 
 
@@ -2615,6 +3787,14 @@ local  long	stoAuditMixedSizePieces	 (void);
 
 static long	nMixed, nSizes;
 
+/*
+ * Outside gc, only old pieces are marked.  The mark on a quantum is
+ * checked against the tag of the first quantum of its piece.
+ */
+#define stoAuditMark(qmtag, first) \
+	assert(!QmInfoMark(qmtag) || \
+	       (stoGenerational && QmInfoKind(first) == QmBusyFirst))
+
 /*
  * Main entry into the audit code.
  */
@@ -2625,6 +3805,8 @@ stoAuditAll(void)
 
 	nMixed = 0, nSizes = 0;
 
+	stoGcSweepPending();
+
 	stoAuditHeapLocation();
 	stoAuditMapPages();
 
@@ -2729,7 +3911,7 @@ stoAuditFixedSizeSections(void)
 				/* Do nothing */;
 			else
 				assert(QmInfoKind(qmtag) == QmBusyFirst);
-			assert(!QmInfoMark(qmtag));
+			stoAuditMark(qmtag, qmtag);
 		}
 	}
 
@@ -2879,7 +4061,7 @@ stoAuditMixedSizeSections(void)
 			/* Verify tags. */
 			qmtag = sect->info[qmno];
 			cd    = QmInfoKind(qmtag);
-			assert(!QmInfoMark(qmtag));
+			stoAuditMark(qmtag, qmtag);
 
 			if (pc->isFree) {
 				mxmemAssertCleanBody(pc, pc->nbytesThis);
@@ -2895,7 +4077,7 @@ stoAuditMixedSizeSections(void)
 			for (i = qmno+1; i < qmno+nq; i++) {
 				qmtag = sect->info[i];
 				cd    = QmInfoKind(qmtag);
-				assert(!QmInfoMark(qmtag));
+				stoAuditMark(qmtag, sect->info[qmno]);
 				assert(cd == QmFollow);
 			}
 			if (qmno+nq < qmcount) {
@@ -3126,6 +4308,8 @@ stoRebuildFreeLists(void)
 	int	ix, pgno, pgcount;
 	FxMem	*pc, *hd, *fp;
 
+	stoGcSweepPending();
+
 	/* Initialize each section's free list to 0. */
 	for (pgno = 0; pgno < pgMapSize; pgno += pgcount) {
 		if (pgMap[pgno] != PgBusyFirst)
@@ -3202,6 +4386,10 @@ stoInit(void)
 	if (osGetEnv("GC_GGFN")) GcGrowthFactorNum = atoi(osGetEnv("GC_GGFN"));
 	if (osGetEnv("GC_GGFD")) GcGrowthFactorDen = atoi(osGetEnv("GC_GGFD"));
 
+	if (osGetEnv("GC_MINOR")) GcMinorLimit = atoi(osGetEnv("GC_MINOR"));
+	if (osGetEnv("GC_THREADS")) stoSetMarkThreads(atoi(osGetEnv("GC_THREADS")));
+	if (osGetEnv("GC_RATIO")) GcTimeRatio = atoi(osGetEnv("GC_RATIO"));
+
 	if (osGetEnv("GC_DETAIL")) markingStats = true;
 
 
@@ -3289,6 +4477,12 @@ stoInit(void)
 	gcTimer.time = 0;
 	gcTimer.live = 0;
 
+#ifdef FOAM_RTS
+	/* Only the run-time system is built with write barriers. */
+	if (stoIsInit && osGetEnv("GC_GENERATIONAL"))
+		stoSetGenerational(true);
+#endif
+
 	return stoIsInit;
 }
 
@@ -3400,6 +4594,8 @@ stoAlloc(unsigned code, ULong nbytes)
 	/* Canonicalise the pointer and return it */
 	ap = (MostAlignedType *) ptrCanon(p);
 	stoWatchAlloc(ap, nbytes);
+	if (sampleMean && (sampleLeft -= (long) nbytes) <= 0)
+		stoSampleTake((Pointer) ap, nbytes);
 	return ap;
 }
 
@@ -3417,6 +4613,7 @@ stoFree(Pointer p)
 		return;
 	}
 	stoWatchFree(p);
+	if (sampleMean) stoSampleForget(p);
 
 	if (sect->isFixed) {
 		FxMem	*pc = (FxMem *) p;
@@ -3437,8 +4634,12 @@ stoFree(Pointer p)
 		}
 		stoTally(stoBytesFree += fixedSize[si]);
 		fxmemCleanBody(pc, fixedSize[si]);
-		pc->next	= fixedPieces[si];
-		fixedPieces[si] = pc;
+
+		/* The sweep will find it, if the section is queued. */
+		if (!sect->isUnswept) {
+			pc->next	= fixedPieces[si];
+			fixedPieces[si] = pc;
+		}
 	}
 	else {
 		MxMem	*pc = (MxMem *) ptrOff((char *) p, -(long)MxMemHeadSize);
@@ -3446,11 +4647,19 @@ stoFree(Pointer p)
 		if (setjmp(stoAllocInner_ErrorCatch))
 			return;
 #endif
+		if (sect->isUnswept) stoGcSweepSection(sect);
 		if (stoMustTag) {
 			qi   = qmNo(p, sect);
 			if (QmInfoKind(sect->info[qi]) != QmBusyFirst)
 				(*stoError)(StoErr_FreeBad);
 			sect->info[qi] = QmInfoMake0(QmFreeFirst);
+
+			/* An old piece is marked throughout. */
+			if (stoGenerational) {
+				Length	qj, nq = pc->nbytesThis/sect->qmSize;
+				for (qj = qi + 1; qj < qi + nq; qj++)
+					QmInfoClearMark(sect->info[qj]);
+			}
 		}
 		stoTally(stoBytesFree += pc->nbytesThis - MxMemHeadSize);
 		mxmemCleanBody(pc, pc->nbytesThis);
@@ -3578,6 +4787,7 @@ stoIsPointer(Pointer p)
 #define STO_SHOW_SHOW		0x00000200
 #define STO_SHOW_CENSUS		0x00000400
 #define STO_SHOW_USAGE		0x00000800
+#define STO_SHOW_THREADS	0x00001000
 #define STO_SHOW_ALL		((-1) & ~STO_SHOW_PAGEKEY & ~STO_SHOW_SHOW)
 #define STO_SHOW_BEFORE_MASK	(~(STO_SHOW_CENSUS | STO_SHOW_USAGE))
 
@@ -3627,11 +4837,12 @@ stoShowArgs(char *detail)
 		else if (!strncmp(w,"memmap",l))   r |= STO_SHOW_MEMMAP;
 		else if (!strncmp(w,"census",l))   r |= STO_SHOW_CENSUS;
 		else if (!strncmp(w,"usage",l))    r |= STO_SHOW_USAGE;
+		else if (!strncmp(w,"threads",l))  r |= STO_SHOW_THREADS;
 		else if (!strncmp(w,"all",l))      r |= STO_SHOW_ALL;
 		else if (!strncmp(w,"show",l))
 		{
 			(void)fprintf(osStderr,
-	"\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n\n",
+	"\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n\n",
 	"Possible values are a space or comma separated list of:",
 	"        all: select all options (except pagekey and show)",
 	"     census: display object counts/sizes by type",
@@ -3645,6 +4856,7 @@ stoShowArgs(char *detail)
 	"      pages: classification and count of store pages",
 	"   reserved: amount of free memory in reserve",
 	"       show: display this message",
+	"    threads: work done by each thread in the last mark",
 	"      usage: fixed-sized pages free/busy usage");
 		}
 	}
@@ -3658,6 +4870,12 @@ stoShowArgs(char *detail)
 
 void
 stoGc(void)
+{
+	stoGcCollect(false);
+}
+
+local void
+stoGcCollect(Bool minor)
 {
 	static int doShow = -1;
 
@@ -3665,8 +4883,9 @@ stoGc(void)
 		doShow = stoShowArgs(osGetEnv("GC_DETAIL"));
 	if (stoMustTag) {
 		static Bool inGc = false;
-		if (inGc) return;
+		if (inGc || sweepBusy) return;
 		tmStart(stoGcTimer());
+		if (gcNotifyFun) gcNotifyFun(true);
 		if (DEBUG(sto)) {
 			if (doShow) {
 				/* Census taking is special */
@@ -3679,8 +4898,18 @@ stoGc(void)
 			}
 		}
 		inGc = true;
-		stoGcMarkAndSweep();
+		stoGcMarkAndSweep(minor);
 		inGc = false;
+
+		if (doShow & STO_SHOW_THREADS)
+			stoShowThreads();
+
+		if (minor)
+			gcMinorCount++;
+		else {
+			gcMinorCount  = 0;
+			gcFullPending = false;
+		}
 		if (DEBUG(sto)) {
 			if (doShow) {
 				/* Census taking is special */
@@ -3692,7 +4921,11 @@ stoGc(void)
 				stoShowDetail(doShow);
 			}
 		}
+		if (gcNotifyFun) gcNotifyFun(false);
 		tmStop(stoGcTimer());
+
+		if (GcTimeRatio && !minor)
+			pagesResize();
 	}
 }
 
@@ -3700,6 +4933,7 @@ void
 stoTune(void)
 {
 	stoRebuildFreeLists();
+	pagesRelease(pagesToKeep());
 }
 
 void
@@ -3815,6 +5049,8 @@ stoTakeCensus(AInt before)
 	ULong	*hist, *mem;
 
 
+	stoGcSweepPending();
+
 	/* Which table are we filling? */
 	hist = before ? censusBefore : censusAfter;
 	mem  = before ? censusMemBefore : censusMemAfter;
@@ -4026,6 +5262,10 @@ stoShowDetail(int stoDetail)
 	String	sep = stoCensusDivider;
 
 
+	/* Queued sections would show their garbage as busy. */
+	stoGcSweepPending();
+
+
 	/*
 	 * If we are showing some output other than the census
 	 * then we provide a simple separator to help the user.
@@ -4325,6 +5565,11 @@ stoShowDetail(int stoDetail)
 	}
 
 
+	/* Display the work done by the marking threads */
+	if (stoDetail & STO_SHOW_THREADS)
+		stoShowThreads();
+
+
 	/* Display the memory map of this process */
 	if (stoDetail & STO_SHOW_MEMMAP)
 	{
@@ -4380,8 +5625,10 @@ stoAudit(void)
 int
 stoCtl(int cmd, ...)
 {
-	va_list	argp;
-	int	rc;
+	va_list		argp;
+	int		rc;
+	ULong		mean;
+	StoSampleFun	sample;
 
 	va_start(argp, cmd);
 	rc = 0;
@@ -4399,6 +5646,32 @@ stoCtl(int cmd, ...)
 	case StoCtl_Wash:
 		stoMustWash   = va_arg(argp, Bool);
 		break;
+	case StoCtl_Generational:
+		if (!stoIsInit && !stoInit())
+			rc = -1;
+		else if (!stoSetGenerational(va_arg(argp, Bool)))
+			rc = -1;
+		break;
+	case StoCtl_MarkThreads:
+		if (!stoSetMarkThreads(va_arg(argp, int)))
+			rc = -1;
+		break;
+	case StoCtl_GcRatio:
+		GcTimeRatio   = va_arg(argp, int);
+		gcTargetPages = 0;
+		if (GcTimeRatio < 0) {
+			GcTimeRatio = 0;
+			rc = -1;
+		}
+		break;
+	case StoCtl_Sample:
+		mean   = va_arg(argp, ULong);
+		sample = va_arg(argp, StoSampleFun);
+		stoSetSampling(mean, sample, va_arg(argp, StoSurviveFun));
+		break;
+	case StoCtl_GcNotify:
+		gcNotifyFun   = va_arg(argp, StoGcFun);
+		break;
 	default:
 		rc = -1;
 	}
@@ -4915,6 +6188,12 @@ void stoSetTracer		(int code, StoTraceFun fun) {}
 int  stoMarkObject		(Pointer p)	{ return 0; }
 int  stoWritablePointer		(Pointer p)	{ return POINTER_IS_UNKNOWN; }
 int  stoCtl			(int cmd, ...)	{ return 0; }
+void stoWriteBarrierAll		(void)		{ }
+void stoWriteBarrierUnit	(char *u, int b) { }
+
+UByte	*stoCardMap  = 0;
+char	*stoCardBase = 0;
+ULong	stoCardSize  = 0;
 
 static struct tmTimer gcTimer;
 TmTimer stoGcTimer		(void) { return &gcTimer; }
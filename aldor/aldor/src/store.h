@@ -87,6 +87,79 @@ extern int		stoCtl		(int cmd, ...);
 			 * Arg 1 Bool: true/false => do/don't fill.
 			 */
 
+# define StoCtl_Generational		4
+			/* Collect young pieces separately (when available).
+			 * Arg 1 Bool: true/false => do/don't.
+			 *
+			 * Only safe if every store of a pointer into the
+			 * heap is followed by stoWriteBarrier, as it is in
+			 * code generated by genc with -Wwrite-barrier.
+			 * Fails, or is undone, once a unit compiled without
+			 * them is seen (see stoWriteBarrierUnit).
+			 */
+
+# define StoCtl_MarkThreads		5
+			/* Number of threads used to mark the heap.
+			 * Arg 1 int: 1 => mark serially, 0 => one per cpu.
+			 */
+
+# define StoCtl_GcRatio			6
+			/* Size the heap for a target cost of collection.
+			 * Arg 1 int: gc time as a percentage of the time
+			 * spent elsewhere.  0 => grow by fixed factors.
+			 *
+			 * With a target, free pages beyond those it needs
+			 * are given back to the system after a collection.
+			 * stoTune gives them back at once.
+			 */
+
+# define StoCtl_Sample			7
+			/* Sample the allocations.
+			 * Arg 1 ULong: mean bytes between samples, 0 => off.
+			 * Arg 2 StoSampleFun: called with the size of each
+			 *       sampled piece; returns a tag for it.
+			 * Arg 3 StoSurviveFun: called with the tag and size
+			 *       if the piece survives its first collection.
+			 */
+
+# define StoCtl_GcNotify		8
+			/* Report each collection.
+			 * Arg 1 StoGcFun: called with true as a collection
+			 *       starts and false as it ends, 0 => none.
+			 *       It must not allocate.
+			 */
+
+typedef Pointer	(*StoSampleFun)		(ULong nbytes);
+typedef void	(*StoSurviveFun)	(Pointer tag, ULong nbytes);
+typedef void	(*StoGcFun)		(Bool start);
+
+/*
+ * Write barrier for generational collection.
+ * Notes that the word at p may now point to a young piece.
+ * stoCardSize is 0 unless generational collection is on.
+ */
+# define STO_LG_CARD			12
+
+extern UByte *		stoCardMap;
+extern char *		stoCardBase;
+extern ULong		stoCardSize;
+
+# define stoWriteBarrier(p) \
+	((ULong) (p) - (ULong) stoCardBase < stoCardSize ? \
+	 (void) (stoCardMap[((ULong) (p) - (ULong) stoCardBase) >> STO_LG_CARD] = 1) \
+	 : (void) 0)
+
+extern void		stoWriteBarrierAll	(void);
+			/*
+			 * For stores whose address can't be recomputed:
+			 * the next collection will be a full one.
+			 */
+extern void		stoWriteBarrierUnit	(char *unit, int);
+			/*
+			 * Says whether the code of unit has write barriers.
+			 * Without, generational collection is turned off.
+			 */
+
 /*
  * Install handler for error situations.
  */
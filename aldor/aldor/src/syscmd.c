@@ -11,6 +11,7 @@
 #include "fintphase.h"
 #include "macex.h"
 #include "parseby.h"
+#include "phase.h"
 #include "scan.h"
 #include "stab.h"
 #include "syscmd.h"
@@ -372,8 +373,22 @@ scmdHandleIncludeDir(String filename)
  *	if the id is non-null.
  * Return 0 on success, -1 on failure.
  */
+local int	scmd0HandleLibrary	(String id, String key);
+
 int
 scmdHandleLibrary(String id, String key)
+{
+	int	rc;
+
+	phSpanStart("lib", key);
+	rc = scmd0HandleLibrary(id, key);
+	phSpanEnd();
+
+	return rc;
+}
+
+local int
+scmd0HandleLibrary(String id, String key)
 {
 	Symbol		sym;
 	FileName	fn;
@@ -8,6 +8,8 @@
 local void testBitvToInt();
 local void testBitvCount();
 local void testBitvToAIntList();
+local void testBitvWide();
+local void testBitvFused();
 local void testBInt();
 
 void
@@ -17,6 +19,8 @@ bitvTestSuite()
 	TEST(testBitvToInt);
 	TEST(testBitvCount);
 	TEST(testBitvToAIntList);
+	TEST(testBitvWide);
+	TEST(testBitvFused);
 	TEST(testBInt);
 	fini();
 }
@@ -84,6 +88,81 @@ testBitvToAIntList()
 	bitvClassDestroy(clss);
 }
 
+local void
+testBitvWide()
+{
+	BitvClass clss = bitvClassCreate(150);
+	Bitv bitv = bitvNew(clss);
+
+	bitvClearAll(clss, bitv);
+	testIntEqual("max0", -1, bitvMax(clss, bitv));
+	testIntEqual("next0", -1, bitvNext(clss, bitv, 0));
+
+	bitvSet(clss, bitv, 3);
+	bitvSet(clss, bitv, 63);
+	bitvSet(clss, bitv, 64);
+	bitvSet(clss, bitv, 149);
+	testIntEqual("count", 4, bitvCount(clss, bitv));
+	testIntEqual("countTo", 2, bitvCountTo(clss, bitv, 64));
+	testIntEqual("countTo", 3, bitvCountTo(clss, bitv, 65));
+	testIntEqual("max", 149, bitvMax(clss, bitv));
+	testIntEqual("next", 3, bitvNext(clss, bitv, 0));
+	testIntEqual("next", 63, bitvNext(clss, bitv, 4));
+	testIntEqual("next", 64, bitvNext(clss, bitv, 64));
+	testIntEqual("next", 149, bitvNext(clss, bitv, 65));
+	testIntEqual("next", -1, bitvNext(clss, bitv, 150));
+
+	bitvSetAll(clss, bitv);
+	testIntEqual("all", 150, bitvCount(clss, bitv));
+	testIntEqual("allmax", 149, bitvMax(clss, bitv));
+
+	bitvFree(bitv);
+	bitvClassDestroy(clss);
+}
+
+local void
+testBitvFused()
+{
+	BitvClass clss = bitvClassCreate(130);
+	Bitv r = bitvNew(clss);
+	Bitv a = bitvNew(clss);
+	Bitv b = bitvNew(clss);
+	Bitv c = bitvNew(clss);
+
+	bitvClearAll(clss, r);
+	bitvClearAll(clss, a);
+	bitvClearAll(clss, b);
+	bitvClearAll(clss, c);
+	bitvSet(clss, a, 1);
+	bitvSet(clss, a, 100);
+	bitvSet(clss, b, 70);
+	bitvSet(clss, c, 100);
+
+	testTrue("or", bitvOrInto(clss, r, a));
+	testFalse("or again", bitvOrInto(clss, r, a));
+	testTrue("and", bitvAndInto(clss, r, c));
+	testIntEqual("and", 100, bitvNext(clss, r, 0));
+	testFalse("and again", bitvAndInto(clss, r, c));
+
+	/* (a \/ b) - c */
+	testTrue("orMinus", bitvOrMinus(clss, r, a, b, c));
+	testIntEqual("orMinus", 2, bitvCount(clss, r));
+	testTrue("orMinus", bitvTest(clss, r, 1) && bitvTest(clss, r, 70));
+	testFalse("orMinus again", bitvOrMinus(clss, r, a, b, c));
+
+	/* b \/ (a - c) */
+	testFalse("orAndNot", bitvOrAndNot(clss, r, b, a, c));
+	testTrue("copy", bitvCopyInto(clss, r, c));
+	testTrue("equal", bitvEqual(clss, r, c));
+	testFalse("copy again", bitvCopyInto(clss, r, c));
+
+	bitvFree(r);
+	bitvFree(a);
+	bitvFree(b);
+	bitvFree(c);
+	bitvClassDestroy(clss);
+}
+
 local void
 testBInt()
 {
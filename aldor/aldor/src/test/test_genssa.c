@@ -0,0 +1,130 @@
+#include "axlobs.h"
+#include "cmdline.h"
+#include "flog.h"
+#include "foam.h"
+#include "genssa.h"
+#include "optinfo.h"
+#include "testlib.h"
+#include "strops.h"
+
+local void testSsaPhi(void);
+local void testSsaCopy(void);
+
+local Foam ssaTestProg(Foam body, int nLabels);
+local int  ssaTestCountPhis(FlowGraph flog);
+
+void
+genssaTest()
+{
+	init();
+	TEST(testSsaPhi);
+	TEST(testSsaCopy);
+}
+
+/*
+ * A prog with one SInt parameter and one SInt local.
+ */
+local Foam
+ssaTestProg(Foam body, int nLabels)
+{
+	Foam prog;
+
+	prog = foamNewProgEmpty();
+	prog->foamProg.locals = foamNewDDecl(FOAM_DDecl_Local,
+		foamNewDecl(FOAM_SInt, strCopy("x"), emptyFormatSlot), NULL);
+	prog->foamProg.body = body;
+	prog->foamProg.params = foamNewDDecl(FOAM_DDecl_Param,
+		foamNewDecl(FOAM_SInt, strCopy("n"), emptyFormatSlot), NULL);
+	prog->foamProg.fluids = foamNewEmptyDDecl(int0);
+	prog->foamProg.nLabels = nLabels;
+	prog->foamProg.levels = foamNewEmptyDEnv();
+	foamOptInfo(prog) = optInfoNew(NULL, prog, NULL, false);
+
+	return prog;
+}
+
+local int
+ssaTestCountPhis(FlowGraph flog)
+{
+	int nPhis = 0;
+
+	flogIter(flog, bb, {
+		foamIter(bb->code, pstmt, {
+			if (foamIsPhiStmt(*pstmt)) nPhis += 1;
+		});
+	});
+	return nPhis;
+}
+
+/*
+ * A local assigned on both sides of a branch gets a phi function at the
+ * join, and going back to normal form gives the original code.
+ */
+local void
+testSsaPhi()
+{
+	Foam body, bodyCopy, prog, seq, ret;
+	FlowGraph flog;
+	SSA ssa;
+	int nLabels;
+
+	body = foamNewSeq(foamNewSet(foamNewLoc(int0), foamNewSInt(1)),
+			  foamNewIf(foamNewBCall1(FOAM_BVal_SIntIsZero,
+						  foamNewPar(int0)), 1),
+			  foamNewSet(foamNewLoc(int0), foamNewSInt(2)),
+			  foamNewLabel(1),
+			  foamNewReturn(foamNewLoc(int0)),
+			  NULL);
+	bodyCopy = foamCopy(body);
+	prog = ssaTestProg(body, 2);
+
+	flog = flogFrProg(prog, FLOG_UniqueExit);
+	ssa = ssaFromFlog(flog, false);
+	testIsNotNull("ssa", ssa);
+
+	testIntEqual("phis", 1, ssaTestCountPhis(flog));
+	testIntEqual("names", 4, ssa->namec);
+
+	flog = ssaToFlog(ssa);
+	testIntEqual("no phis", 0, ssaTestCountPhis(flog));
+	seq = flogToSeq(flog, &nLabels);
+
+	ret = foamFindFirstTag(FOAM_Return, seq);
+	testIsNotNull("found", ret);
+	testTrue("eq", foamEqual(foamNewLoc(int0), ret->foamReturn.value));
+	testIntEqual("stmts", foamArgc(bodyCopy), foamArgc(seq));
+
+	cmdDebugReset();
+}
+
+/*
+ * Uses of a copy of a parameter which is never assigned are replaced by
+ * the parameter.
+ */
+local void
+testSsaCopy()
+{
+	Foam body, prog, seq, ret;
+	FlowGraph flog;
+	SSA ssa;
+	int nLabels;
+
+	body = foamNewSeq(foamNewSet(foamNewLoc(int0), foamNewPar(int0)),
+			  foamNewReturn(foamNewLoc(int0)),
+			  NULL);
+	prog = ssaTestProg(body, 0);
+
+	flog = flogFrProg(prog, FLOG_UniqueExit);
+	ssa = ssaFromFlog(flog, true);
+	testIsNotNull("ssa", ssa);
+	testIntEqual("copies", 1, ssa->copies);
+
+	flog = ssaToFlog(ssa);
+	seq = flogToSeq(flog, &nLabels);
+
+	ret = foamFindFirstTag(FOAM_Return, seq);
+	testIsNotNull("found", ret);
+	testTrue("eq", foamEqual(foamNewPar(int0), ret->foamReturn.value));
+
+	cmdDebugReset();
+}
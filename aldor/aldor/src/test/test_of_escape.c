@@ -0,0 +1,159 @@
+#include "axlobs.h"
+#include "foam.h"
+#include "of_escape.h"
+#include "optinfo.h"
+#include "strops.h"
+#include "testlib.h"
+
+local void testEscapeLocal(void);
+local void testEscapeCall(void);
+local void testEscapeClos(void);
+
+local Foam escTestProg(Foam body);
+local Foam escTestUnit(Foam caller, Foam callee);
+
+void
+ofEscapeTest()
+{
+	init();
+	TEST(testEscapeLocal);
+	TEST(testEscapeCall);
+	TEST(testEscapeClos);
+	fini();
+}
+
+/*
+ * A prog with a record local, an SInt local and a closure local.
+ */
+local Foam
+escTestProg(Foam body)
+{
+	Foam prog;
+
+	prog = foamNewProgEmpty();
+	prog->foamProg.locals = foamNewDDecl(FOAM_DDecl_Local,
+		foamNewDecl(FOAM_Rec, strCopy("r"), 1),
+		foamNewDecl(FOAM_SInt, strCopy("x"), emptyFormatSlot),
+		foamNewDecl(FOAM_Clos, strCopy("c"), emptyFormatSlot), NULL);
+	prog->foamProg.body = body;
+	prog->foamProg.params = foamNewEmptyDDecl(FOAM_DDecl_Param);
+	prog->foamProg.fluids = foamNewEmptyDDecl(int0);
+	prog->foamProg.nLabels = 0;
+	prog->foamProg.levels = foamNewEmptyDEnv();
+	foamOptInfo(prog) = optInfoNew(NULL, prog, NULL, false);
+
+	return prog;
+}
+
+/*
+ * A record only used through its fields stays in the prog, and so does
+ * a level only reached through Lex references: the Free goes.
+ */
+local void
+testEscapeLocal()
+{
+	Foam body, prog, rnew;
+
+	rnew = foamNewRNew(1);
+	body = foamNewSeq(foamNewSet(foamNewLoc(int0), rnew),
+			  foamNewSet(foamNewRElt(1, foamNewLoc(int0), int0),
+				     foamNewSInt(3)),
+			  foamNewSet(foamNewLoc(1),
+				     foamNewRElt(1, foamNewLoc(int0), int0)),
+			  foamNewSet(foamNewLex(int0, int0), foamNewLoc(1)),
+			  foamNewFree(foamNewLoc(int0)),
+			  foamNewReturn(foamNewLoc(1)),
+			  NULL);
+	prog = escTestProg(body);
+
+	escapeProg(prog);
+
+	testTrue("rnew", foamOnStack(rnew));
+	testIntEqual("stmts", 5, foamArgc(prog->foamProg.body));
+	testIsNull("free", foamFindFirstTag(FOAM_Free, prog->foamProg.body));
+	testTrue("env", foamProgHasLocalEnv(prog));
+}
+
+/*
+ * A record passed to a call escapes, and so does a level whose
+ * environment is.
+ */
+local void
+testEscapeCall()
+{
+	Foam body, prog, rnew;
+
+	rnew = foamNewRNew(1);
+	body = foamNewSeq(foamNewSet(foamNewLoc(int0), rnew),
+			  foamNewCCall(FOAM_NOp, foamNewGlo(int0),
+				       foamNewEnv(int0), foamNewLoc(int0),
+				       NULL),
+			  foamNewFree(foamNewLoc(int0)),
+			  foamNewReturn(foamNewSInt(0)),
+			  NULL);
+	prog = escTestProg(body);
+
+	escapeProg(prog);
+
+	testFalse("rnew", foamOnStack(rnew));
+	testIntEqual("stmts", 4, foamArgc(prog->foamProg.body));
+	testFalse("env", foamProgHasLocalEnv(prog));
+}
+
+/*
+ * A unit with caller as (Const 0) and callee as (Const 1).
+ */
+local Foam
+escTestUnit(Foam caller, Foam callee)
+{
+	return foamNew(FOAM_Unit, 2,
+		       foamNewDFmt(foamNewDDecl(FOAM_DDecl_Global, NULL),
+				   foamNewDDecl(FOAM_DDecl_Consts,
+						foamNewDecl(FOAM_Prog,
+							    strCopy("caller"),
+							    emptyFormatSlot),
+						foamNewDecl(FOAM_Prog,
+							    strCopy("callee"),
+							    emptyFormatSlot),
+						NULL),
+				   foamNewDDecl(FOAM_DDecl_LocalEnv, NULL),
+				   foamNewDDecl(FOAM_DDecl_Fluid, NULL),
+				   foamNewDDecl(FOAM_DDecl_LocalEnv, NULL),
+				   NULL),
+		       foamNew(FOAM_DDef, 2,
+			       foamNewDef(foamNewConst(int0), caller),
+			       foamNewDef(foamNewConst(1), callee)));
+}
+
+/*
+ * A level captured by a closure which is only called stays in the prog,
+ * unless the prog called lets its environment go.
+ */
+local void
+testEscapeClos()
+{
+	Foam caller, callee, unit;
+	int  i;
+
+	for (i = 0; i < 2; i++) {
+		caller = escTestProg(
+			foamNewSeq(foamNewSet(foamNewLoc(2),
+					      foamNewClos(foamNewEnv(int0),
+							  foamNewConst(1))),
+				   foamNewCCall(FOAM_NOp, foamNewLoc(2), NULL),
+				   foamNewReturn(foamNewLex(int0, int0)),
+				   NULL));
+		callee = escTestProg(
+			foamNewSeq(foamNewSet(foamNewLex(1, int0),
+					      foamNewSInt(1)),
+				   i == 0 ? foamNewReturn(foamNewSInt(0))
+				   : foamNewReturn(foamNewEnv(1)),
+				   NULL));
+		unit = escTestUnit(caller, callee);
+
+		escapeUnit(unit, true);
+
+		testIntEqual("env", i == 0, foamProgHasLocalEnv(caller) != 0);
+		foamFree(unit);
+	}
+}
@@ -0,0 +1,52 @@
+#include "axlobs.h"
+#include "of_inlin.h"
+#include "opsys.h"
+#include "strops.h"
+#include "testlib.h"
+
+local void testInlProfHeat(void);
+
+void
+ofInlinTest()
+{
+	init();
+	TEST(testInlProfHeat);
+	fini();
+}
+
+/*
+ * Calls are ranked against the busiest line: a line with 1/100 of its
+ * calls is hot, and one with less than 1/10000 is cold.  The progs of a
+ * unit which has counts, but which are missing from them, were never
+ * entered and so are cold.
+ */
+local void
+testInlProfHeat()
+{
+	String	file = strPrintf("%s/aldor-inlprof-%d.prof", osTmpDirName(),
+				 (int) osGetPid());
+	FILE	*out = fopen(file, "w");
+
+	testIsNotNull("open", out);
+	fprintf(out, "# aldor call counts\n");
+	fprintf(out, "1 prog u 0 u\n");
+	fprintf(out, "7 prog u 1 f\n");
+	fprintf(out, "1000000 call u 1 10\n");
+	fprintf(out, "5000 call u 1 11\n");
+	fprintf(out, "50 call u 1 12\n");
+	fclose(out);
+
+	inlSetProfileUse(file);
+	osFileRemove(file);
+	strFree(file);
+
+	testIntEqual("busiest", InlProfHot,  inlProfSiteHeat("u", 1, 10));
+	testIntEqual("middle",  InlProfWarm, inlProfSiteHeat("u", 1, 11));
+	testIntEqual("rare",    InlProfCold, inlProfSiteHeat("u", 1, 12));
+	testIntEqual("no line", InlProfWarm, inlProfSiteHeat("u", 1, -1));
+	testIntEqual("uncounted line", InlProfWarm,
+		     inlProfSiteHeat("u", 1, 99));
+	testIntEqual("never entered", InlProfCold,
+		     inlProfSiteHeat("u", 2, 10));
+	testIntEqual("other unit", InlProfWarm, inlProfSiteHeat("v", 1, 10));
+}
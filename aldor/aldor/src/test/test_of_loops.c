@@ -0,0 +1,377 @@
+#include "axlobs.h"
+#include "cmdline.h"
+#include "of_loops.h"
+#include "optfoam.h"
+#include "optinfo.h"
+#include "store.h"
+#include "strops.h"
+#include "testlib.h"
+
+local void testLoopHoistArith(void);
+local void testLoopZeroTripTrap(void);
+local void testLoopZeroTripLookup(void);
+local void testLoopHoistLookup(void);
+local void testLoopGenerLookup(void);
+
+local Foam loopTestUnit(Foam body, int nLabels);
+local Foam loopTestLookup(void);
+local int  loopTestLabelPos(Foam body, AInt lab);
+local Bool loopTestReaches(Foam body, int from, int to, Bool stopAtIf);
+local Bool loopTestIsMoved(Foam unit, Foam rhs, Bool guarded);
+local Bool loopTestIsHoisted(Foam unit, Foam rhs);
+local Bool loopTestIsGuarded(Foam unit, Foam rhs);
+
+void
+ofLoopsTest()
+{
+	init();
+	TEST(testLoopHoistArith);
+	TEST(testLoopZeroTripTrap);
+	TEST(testLoopZeroTripLookup);
+	TEST(testLoopHoistLookup);
+	TEST(testLoopGenerLookup);
+	fini();
+}
+
+/*
+ * A unit whose second prog has BODY, parameters n and d, and locals x, i
+ * and w, all SInt apart from w, which holds a Word.  The first prog is
+ * never looked at by the pass.  The only global is domainGetExport!.
+ */
+local Foam
+loopTestUnit(Foam body, int nLabels)
+{
+	Foam prog, prog0;
+
+	prog0 = foamNewProgEmpty();
+	prog0->foamProg.locals = foamNewEmptyDDecl(FOAM_DDecl_Local);
+	prog0->foamProg.params = foamNewEmptyDDecl(FOAM_DDecl_Param);
+	prog0->foamProg.fluids = foamNewEmptyDDecl(int0);
+	prog0->foamProg.levels = foamNewEmptyDEnv();
+	prog0->foamProg.body = foamNewSeq(foamNewReturn(foamNewSInt(0)), NULL);
+	foamOptInfo(prog0) = optInfoNew(NULL, prog0, NULL, false);
+
+	prog = foamNewProgEmpty();
+	prog->foamProg.locals = foamNewDDecl(FOAM_DDecl_Local,
+		foamNewDecl(FOAM_SInt, strCopy("x"), emptyFormatSlot),
+		foamNewDecl(FOAM_SInt, strCopy("i"), emptyFormatSlot),
+		foamNewDecl(FOAM_Word, strCopy("w"), emptyFormatSlot), NULL);
+	prog->foamProg.params = foamNewDDecl(FOAM_DDecl_Param,
+		foamNewDecl(FOAM_SInt, strCopy("n"), emptyFormatSlot),
+		foamNewDecl(FOAM_SInt, strCopy("d"), emptyFormatSlot), NULL);
+	prog->foamProg.fluids = foamNewEmptyDDecl(int0);
+	prog->foamProg.levels = foamNewEmptyDEnv();
+	prog->foamProg.body = body;
+	prog->foamProg.nLabels = nLabels;
+	foamOptInfo(prog) = optInfoNew(NULL, prog, NULL, false);
+
+	return foamNew(FOAM_Unit, 2,
+		       foamNewDFmt(foamNewDDecl(FOAM_DDecl_Global,
+				foamNewGDecl(FOAM_Word,
+					     strCopy("domainGetExport!"),
+					     FOAM_Word, emptyFormatSlot,
+					     FOAM_GDecl_Import,
+					     FOAM_Proto_Foam),
+				NULL),
+				   foamNewDDecl(FOAM_DDecl_Consts,
+						foamNewDecl(FOAM_Prog, strCopy("p0"),
+							    emptyFormatSlot),
+						foamNewDecl(FOAM_Prog, strCopy("p"),
+							    emptyFormatSlot),
+						NULL),
+				   foamNewDDecl(FOAM_DDecl_LocalEnv, NULL),
+				   foamNewDDecl(FOAM_DDecl_Fluid, NULL),
+				   foamNewDDecl(FOAM_DDecl_LocalEnv, NULL),
+				   NULL),
+		       foamNew(FOAM_DDef, 2,
+			       foamNewDef(foamNewConst(int0), prog0),
+			       foamNewDef(foamNewConst(1), prog)));
+}
+
+/* An export lookup in the domain given by d. */
+local Foam
+loopTestLookup()
+{
+	return foamNewCCall(FOAM_Word, foamNewGlo(int0),
+			    foamNewCast(FOAM_Word, foamNewPar(1)),
+			    foamNewSInt(11), foamNewSInt(12), NULL);
+}
+
+/* The position of (Label LAB) in BODY. */
+local int
+loopTestLabelPos(Foam body, AInt lab)
+{
+	int	i;
+
+	for (i = 0; i < foamArgc(body); i++)
+		if (foamTag(body->foamSeq.argv[i]) == FOAM_Label &&
+		    body->foamSeq.argv[i]->foamLabel.label == lab)
+			return i;
+	return -1;
+}
+
+/*
+ * Can the statement TO of BODY be run after the statement FROM?  With
+ * STOPATIF, only the paths which run no test are followed.
+ */
+local Bool
+loopTestReaches(Foam body, int from, int to, Bool stopAtIf)
+{
+	int	n = foamArgc(body), i, j, c, nc, sp = 0, next[2], *stack;
+	Bool	*seen, found = false;
+	Foam	stmt;
+
+	stack = (int *) stoAlloc(OB_Other, (n + 1) * sizeof(int));
+	seen  = (Bool *) stoAlloc(OB_Other, n * sizeof(Bool));
+	for (i = 0; i < n; i++) seen[i] = false;
+
+	stack[sp++] = from;
+	while (sp > 0 && !found) {
+		i    = stack[--sp];
+		stmt = body->foamSeq.argv[i];
+		nc   = 0;
+
+		switch (foamTag(stmt)) {
+		case FOAM_Return:
+			break;
+		case FOAM_Goto:
+			next[nc++] = loopTestLabelPos(body, stmt->foamGoto.label);
+			break;
+		case FOAM_If:
+			if (stopAtIf) break;
+			next[nc++] = loopTestLabelPos(body, stmt->foamIf.label);
+			next[nc++] = i + 1;
+			break;
+		default:
+			next[nc++] = i + 1;
+			break;
+		}
+
+		for (c = 0; c < nc; c++) {
+			j = next[c];
+			if (j < 0 || j >= n || seen[j]) continue;
+			if (j == to) found = true;
+			seen[j] = true;
+			stack[sp++] = j;
+		}
+	}
+
+	stoFree(stack);
+	stoFree(seen);
+	return found;
+}
+
+/*
+ * Is the assignment computing RHS outside the loop, that is not run
+ * again after itself?  If GUARDED, it must also only be reached through
+ * a test, so that it is not run when the loop is not entered.
+ */
+local Bool
+loopTestIsMoved(Foam unit, Foam rhs, Bool guarded)
+{
+	Foam	body = unit->foamUnit.defs->foamDDef.argv[1]->foamDef.rhs
+			->foamProg.body, stmt;
+	int	i, k = -1;
+
+	for (i = 0; i < foamArgc(body) && k < 0; i++) {
+		stmt = body->foamSeq.argv[i];
+		if (foamTag(stmt) == FOAM_Set &&
+		    foamEqual(stmt->foamSet.rhs, rhs))
+			k = i;
+	}
+	if (k < 0 || loopTestReaches(body, k, k, false))
+		return false;
+
+	return !guarded || (k > 0 && !loopTestReaches(body, 0, k, true));
+}
+
+local Bool
+loopTestIsHoisted(Foam unit, Foam rhs)
+{
+	return loopTestIsMoved(unit, rhs, false);
+}
+
+local Bool
+loopTestIsGuarded(Foam unit, Foam rhs)
+{
+	return loopTestIsMoved(unit, rhs, true);
+}
+
+/*
+ * The loop below tests at the top, so its body is run on every trip but
+ * not before leaving: n + 1 cannot trap, and is still computed once.
+ *
+ *	i := 0; while i < n repeat { x := n + 1; i := i + x }
+ */
+local void
+testLoopHoistArith()
+{
+	Foam unit, rhs;
+
+	rhs = foamNewBCall2(FOAM_BVal_SIntPlus, foamNewPar(int0),
+			    foamNewSInt(1));
+	unit = loopTestUnit(
+		foamNewSeq(foamNewSet(foamNewLoc(1), foamNewSInt(0)),
+			   foamNewLabel(int0),
+			   foamNewIf(foamNewBCall2(FOAM_BVal_SIntLE,
+						   foamNewPar(int0),
+						   foamNewLoc(1)), 1),
+			   foamNewSet(foamNewLoc(int0), foamCopy(rhs)),
+			   foamNewSet(foamNewLoc(1),
+				      foamNewBCall2(FOAM_BVal_SIntPlus,
+						    foamNewLoc(1),
+						    foamNewLoc(int0))),
+			   foamNewGoto(int0),
+			   foamNewLabel(1),
+			   foamNewReturn(foamNewLoc(1)),
+			   NULL), 2);
+
+	loopUnit(unit);
+
+	testTrue("hoisted", loopTestIsHoisted(unit, rhs));
+
+	cmdDebugReset();
+}
+
+/*
+ * With n <= 0 the loop is never entered, and computing 100 quo d before
+ * it would fail when d = 0: the loop is rotated, and 100 quo d is only
+ * computed once the copy of its test has let it be entered.
+ */
+local void
+testLoopZeroTripTrap()
+{
+	Foam unit, rhs;
+
+	rhs = foamNewBCall2(FOAM_BVal_SIntQuo, foamNewSInt(100),
+			    foamNewPar(1));
+	unit = loopTestUnit(
+		foamNewSeq(foamNewSet(foamNewLoc(1), foamNewSInt(0)),
+			   foamNewLabel(int0),
+			   foamNewIf(foamNewBCall2(FOAM_BVal_SIntLE,
+						   foamNewPar(int0),
+						   foamNewLoc(1)), 1),
+			   foamNewSet(foamNewLoc(int0), foamCopy(rhs)),
+			   foamNewSet(foamNewLoc(1),
+				      foamNewBCall2(FOAM_BVal_SIntPlus,
+						    foamNewLoc(1),
+						    foamNewLoc(int0))),
+			   foamNewGoto(int0),
+			   foamNewLabel(1),
+			   foamNewReturn(foamNewLoc(1)),
+			   NULL), 2);
+
+	loopUnit(unit);
+
+	testTrue("guarded", loopTestIsGuarded(unit, rhs));
+
+	cmdDebugReset();
+}
+
+/*
+ * Nor is an export looked up when the loop is not entered: the lookup
+ * instantiates the domain, and may fail.
+ */
+local void
+testLoopZeroTripLookup()
+{
+	Foam unit, rhs;
+
+	rhs = loopTestLookup();
+	unit = loopTestUnit(
+		foamNewSeq(foamNewSet(foamNewLoc(1), foamNewSInt(0)),
+			   foamNewLabel(int0),
+			   foamNewIf(foamNewBCall2(FOAM_BVal_SIntLE,
+						   foamNewPar(int0),
+						   foamNewLoc(1)), 1),
+			   foamNewSet(foamNewLoc(2), foamCopy(rhs)),
+			   foamNewSet(foamNewLoc(1),
+				      foamNewBCall2(FOAM_BVal_SIntPlus,
+						    foamNewLoc(1),
+						    foamNewCast(FOAM_SInt,
+								foamNewLoc(2)))),
+			   foamNewGoto(int0),
+			   foamNewLabel(1),
+			   foamNewReturn(foamNewLoc(1)),
+			   NULL), 2);
+
+	loopUnit(unit);
+
+	testTrue("guarded", loopTestIsGuarded(unit, rhs));
+
+	cmdDebugReset();
+}
+
+/*
+ * When the test is at the bottom, the body is run before the loop is
+ * left, and the lookup is made once before it.
+ *
+ *	i := 0; repeat { w := lookup; i := i + w; if n <= i then break }
+ */
+local void
+testLoopHoistLookup()
+{
+	Foam unit, rhs;
+
+	rhs = loopTestLookup();
+	unit = loopTestUnit(
+		foamNewSeq(foamNewSet(foamNewLoc(1), foamNewSInt(0)),
+			   foamNewLabel(int0),
+			   foamNewSet(foamNewLoc(2), foamCopy(rhs)),
+			   foamNewSet(foamNewLoc(1),
+				      foamNewBCall2(FOAM_BVal_SIntPlus,
+						    foamNewLoc(1),
+						    foamNewCast(FOAM_SInt,
+								foamNewLoc(2)))),
+			   foamNewIf(foamNewBCall2(FOAM_BVal_SIntLT,
+						   foamNewLoc(1),
+						   foamNewPar(int0)), int0),
+			   foamNewReturn(foamNewLoc(1)),
+			   NULL), 1);
+
+	loopUnit(unit);
+
+	testTrue("hoisted", loopTestIsHoisted(unit, rhs));
+
+	cmdDebugReset();
+}
+
+/*
+ * A loop over 1..n as the compiler writes it: the test at the top jumps
+ * into the body, and falls through to the return.
+ *
+ *	x := 0; for i in 1..n repeat { w := lookup; x := x + w }; x
+ */
+local void
+testLoopGenerLookup()
+{
+	Foam unit, rhs;
+
+	rhs = loopTestLookup();
+	unit = loopTestUnit(
+		foamNewSeq(foamNewSet(foamNewLoc(int0), foamNewSInt(0)),
+			   foamNewSet(foamNewLoc(1), foamNewSInt(1)),
+			   foamNewLabel(int0),
+			   foamNewIf(foamNewBCall2(FOAM_BVal_SIntLE,
+						   foamNewLoc(1),
+						   foamNewPar(int0)), 1),
+			   foamNewReturn(foamNewLoc(int0)),
+			   foamNewLabel(1),
+			   foamNewSet(foamNewLoc(2), foamCopy(rhs)),
+			   foamNewSet(foamNewLoc(int0),
+				      foamNewBCall2(FOAM_BVal_SIntPlus,
+						    foamNewLoc(int0),
+						    foamNewCast(FOAM_SInt,
+								foamNewLoc(2)))),
+			   foamNewSet(foamNewLoc(1),
+				      foamNewBCall1(FOAM_BVal_SIntNext,
+						    foamNewLoc(1))),
+			   foamNewGoto(int0),
+			   NULL), 2);
+
+	loopUnit(unit);
+
+	testTrue("guarded", loopTestIsGuarded(unit, rhs));
+
+	cmdDebugReset();
+}
@@ -0,0 +1,163 @@
+#include "axlobs.h"
+#include "cmdline.h"
+#include "of_cfold.h"
+#include "of_cprop.h"
+#include "of_sccp.h"
+#include "optfoam.h"
+#include "optinfo.h"
+#include "strops.h"
+#include "testlib.h"
+
+local void testSccpFoldBranch(void);
+local void testSccpDeadBranch(void);
+local void testSccpAgainstCProp(void);
+
+local Foam sccpTestUnit(Foam body, int nLabels);
+local Foam sccpTestReturnValue(Foam unit);
+
+void
+ofSccpTest()
+{
+	init();
+	TEST(testSccpFoldBranch);
+	TEST(testSccpDeadBranch);
+	TEST(testSccpAgainstCProp);
+	fini();
+}
+
+/*
+ * A unit holding a single prog with one SInt parameter and one SInt local,
+ * marked for copy propagation and constant folding.
+ */
+local Foam
+sccpTestUnit(Foam body, int nLabels)
+{
+	Foam prog;
+
+	prog = foamNewProgEmpty();
+	prog->foamProg.locals = foamNewDDecl(FOAM_DDecl_Local,
+		foamNewDecl(FOAM_SInt, strCopy("x"), emptyFormatSlot), NULL);
+	prog->foamProg.body = body;
+	prog->foamProg.params = foamNewDDecl(FOAM_DDecl_Param,
+		foamNewDecl(FOAM_SInt, strCopy("n"), emptyFormatSlot), NULL);
+	prog->foamProg.fluids = foamNewEmptyDDecl(int0);
+	prog->foamProg.nLabels = nLabels;
+	prog->foamProg.levels = foamNewEmptyDEnv();
+	foamOptInfo(prog) = optInfoNew(NULL, prog, NULL, false);
+	optSetPending(prog, OPT_CPROP | OPT_CFOLD);
+
+	return foamNew(FOAM_Unit, 2,
+		       foamNewDFmt(foamNewDDecl(FOAM_DDecl_Global, NULL),
+				   foamNewDDecl(FOAM_DDecl_Consts,
+						foamNewDecl(FOAM_Prog, strCopy("p"),
+							    emptyFormatSlot),
+						NULL),
+				   foamNewDDecl(FOAM_DDecl_LocalEnv, NULL),
+				   foamNewDDecl(FOAM_DDecl_Fluid, NULL),
+				   foamNewDDecl(FOAM_DDecl_LocalEnv, NULL),
+				   NULL),
+		       foamNew(FOAM_DDef, 1,
+			       foamNewDef(foamNewConst(int0), prog)));
+}
+
+local Foam
+sccpTestReturnValue(Foam unit)
+{
+	Foam ret;
+
+	ret = foamFindFirstTag(FOAM_Return, unit->foamUnit.defs);
+	return ret ? ret->foamReturn.value : NULL;
+}
+
+/*
+ * A branch on a test which is always true becomes unconditional, and only
+ * the code reached by it is left.
+ */
+local void
+testSccpFoldBranch()
+{
+	Foam unit, ret;
+
+	unit = sccpTestUnit(
+		foamNewSeq(foamNewSet(foamNewLoc(int0), foamNewSInt(1)),
+			   foamNewIf(foamNewBCall2(FOAM_BVal_SIntEQ,
+						   foamNewLoc(int0),
+						   foamNewSInt(1)), 1),
+			   foamNewReturn(foamNewSInt(2)),
+			   foamNewLabel(1),
+			   foamNewReturn(foamNewSInt(3)),
+			   NULL), 2);
+
+	sccpUnit(unit, true, false);
+
+	testIsNull("no if", foamFindFirstTag(FOAM_If, unit->foamUnit.defs));
+	ret = sccpTestReturnValue(unit);
+	testIsNotNull("found", ret);
+	testTrue("eq", foamEqual(foamNewSInt(3), ret));
+
+	cmdDebugReset();
+}
+
+/*
+ * The assignment on the path which is never taken does not reach the join,
+ * so the local is still known to be constant there.
+ */
+local void
+testSccpDeadBranch()
+{
+	Foam unit, ret;
+
+	unit = sccpTestUnit(
+		foamNewSeq(foamNewSet(foamNewLoc(int0), foamNewSInt(1)),
+			   foamNewIf(foamNewBCall2(FOAM_BVal_SIntEQ,
+						   foamNewLoc(int0),
+						   foamNewSInt(1)), 1),
+			   foamNewSet(foamNewLoc(int0), foamNewSInt(2)),
+			   foamNewLabel(1),
+			   foamNewReturn(foamNewLoc(int0)),
+			   NULL), 2);
+
+	sccpUnit(unit, true, false);
+
+	ret = sccpTestReturnValue(unit);
+	testIsNotNull("found", ret);
+	testTrue("eq", foamEqual(foamNewSInt(1), ret));
+
+	cmdDebugReset();
+}
+
+/*
+ * A single sccp pass finds the same constant result as the rounds of copy
+ * propagation and constant folding which are run with -Qno-sccp.
+ */
+local void
+testSccpAgainstCProp()
+{
+	Foam body, unit1, unit2, ret1, ret2;
+	int  i;
+
+	body = foamNewSeq(foamNewSet(foamNewLoc(int0), foamNewSInt(4)),
+			  foamNewSet(foamNewLoc(int0),
+				     foamNewBCall2(FOAM_BVal_SIntPlus,
+						   foamNewLoc(int0),
+						   foamNewSInt(3))),
+			  foamNewReturn(foamNewLoc(int0)),
+			  NULL);
+	unit1 = sccpTestUnit(foamCopy(body), 0);
+	unit2 = sccpTestUnit(body, 0);
+
+	sccpUnit(unit1, true, false);
+	for (i = 0; i < 2; i++) {
+		cpropUnit(unit2, i == 0);
+		cfoldUnit(unit2, true, false);
+	}
+
+	ret1 = sccpTestReturnValue(unit1);
+	ret2 = sccpTestReturnValue(unit2);
+	testIsNotNull("sccp", ret1);
+	testIsNotNull("cprop", ret2);
+	testTrue("const", foamEqual(foamNewSInt(7), ret1));
+	testTrue("eq", foamEqual(ret2, ret1));
+
+	cmdDebugReset();
+}
@@ -73,6 +73,11 @@ main(int argc, char *argv[])
 	if (testShouldRun("of_peep")) ofPeepTest();
 	if (testShouldRun("of_cprop")) ofCPropTest();
 	if (testShouldRun("of_crin")) ofCrinTest();
+	if (testShouldRun("of_escape")) ofEscapeTest();
+	if (testShouldRun("of_inlin")) ofInlinTest();
+	if (testShouldRun("of_loops")) ofLoopsTest();
+	if (testShouldRun("of_sccp")) ofSccpTest();
+	if (testShouldRun("genssa")) genssaTest();
 
 	testIntEqual("fluidlevel", 0, fluidLevel);
 
@@ -19,6 +19,7 @@ void forgTest(void);
 void formatTest(void);
 void fptrTest(void);
 void genfoamTestSuite(void);
+void genssaTest(void);
 void intTestSuite(void);
 void javaTestSuite(void);
 void jcodeTest(void);
@@ -28,6 +29,10 @@ void ostreamTest(void);
 void ofPeepTest(void);
 void ofCPropTest(void);
 void ofCrinTest(void);
+void ofEscapeTest(void);
+void ofInlinTest(void);
+void ofLoopsTest(void);
+void ofSccpTest(void);
 void printfTest(void);
 void retypeTest(void);
 void scobindTest(void);
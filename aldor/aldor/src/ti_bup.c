@@ -13,6 +13,7 @@
 #include "fluid.h"
 #include "format.h"
 #include "lib.h"
+#include "phase.h"
 #include "sefo.h"
 #include "spesym.h"
 #include "stab.h"
@@ -210,7 +211,9 @@ void
 tibup(Stab stab, AbSyn absyn, TForm type)
 {
 	static int	serialNo = 0, depthNo = 0;
+	static AbSyn	top;		/* Outermost node */
 	int		serialThis;
+	Bool		span;		/* On the timeline? */
 
 	assert(absyn);
 
@@ -232,6 +235,9 @@ tibup(Stab stab, AbSyn absyn, TForm type)
 	serialNo += 1;
 	depthNo	 += 1;
 	serialThis = serialNo;
+	if (depthNo == 1) top = absyn;
+	span = depthNo == 2 && abTag(top) == AB_Sequence;
+	if (span) tiSpanStart("bup", absyn);
 	if (DEBUG(tipBup)) {
 		fprintf(dbOut,"->Bup: %*s %d= ", depthNo, "", serialThis);
 		abPrettyPrint(dbOut, absyn);
@@ -279,6 +285,7 @@ tibup(Stab stab, AbSyn absyn, TForm type)
 		fnewline(dbOut);
 		tpossFree(abtposs);
 	}
+	if (span) phSpanEnd();
 	depthNo -= 1;
 }
 
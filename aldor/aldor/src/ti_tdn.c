@@ -13,6 +13,7 @@
 #include "fluid.h"
 #include "format.h"
 #include "lib.h"
+#include "phase.h"
 #include "sefo.h"
 #include "simpl.h"
 #include "spesym.h"
@@ -193,7 +194,9 @@ titdn(Stab stab, AbSyn absyn, TForm type)
 {
 	TPoss		abtposs;
 	static int	serialNo = 0, depthNo = 0;
+	static AbSyn	top;		/* Outermost node */
 	int		serialThis;
+	Bool		span;		/* On the timeline? */
 	Bool		s = false;
 	TForm		stype;
 
@@ -232,6 +235,9 @@ titdn(Stab stab, AbSyn absyn, TForm type)
 	serialNo += 1;
 	depthNo	 += 1;
 	serialThis = serialNo;
+	if (depthNo == 1) top = absyn;
+	span = depthNo == 2 && abTag(top) == AB_Sequence;
+	if (span) tiSpanStart("tdn", absyn);
 	if (DEBUG(tipTdn)) {
 		fprintf(dbOut,"->Tdn: %*s%d= ", depthNo, "", serialThis);
 		abPrettyPrint(dbOut, absyn);
@@ -270,6 +276,7 @@ titdn(Stab stab, AbSyn absyn, TForm type)
 			tfPrint(dbOut, type);
 		fnewline(dbOut);
 	}
+	if (span) phSpanEnd();
 	depthNo -= 1;
 	return s;
 }
@@ -15,6 +15,7 @@
 #include "lib.h"
 
 #include "opsys.h"
+#include "phase.h"
 #include "sefo.h"
 #include "spesym.h"
 #include "stab.h"
@@ -296,6 +297,32 @@ typeInferCheck(Stab stab, AbSyn absyn, TForm type)
 	}
 }
 
+/*
+ * Mark a pass over a statement of the outermost sequence on the timeline,
+ * naming it by what it defines, or else by its kind and line.
+ */
+void
+tiSpanStart(String pass, AbSyn absyn)
+{
+	AbSyn	ab = absyn, id = NULL;
+	String	name;
+
+	if (!phTimelineOn()) return;
+
+	if (abTag(ab) == AB_Documented)
+		ab = ab->abDocumented.expr;
+	if (abTag(ab) == AB_Define)
+		id = abDefineeIdOrElse(ab, NULL);
+
+	if (id)
+		name = strPrintf("%s %s", pass, symString(id->abId.sym));
+	else
+		name = strPrintf("%s %s (line %d)", pass, abInfo(abTag(ab)).str,
+				 (int) sposLine(abPos(ab)));
+	phSpanStart("tinfer", name);
+	strFree(name);
+}
+
 void
 tiTfSefo(Stab stab, TForm tf)
 {
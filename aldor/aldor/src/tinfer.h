@@ -66,6 +66,7 @@ extern AbSyn	abExpandDefs(Stab, AbSyn);
  */
 
 extern void		tiTfSefo		(Stab, TForm);
+extern void		tiSpanStart		(String, AbSyn);
 extern void		tiTfPushDefinee 	(AbSyn);
 extern void		tiTfPopDefinee		(AbSyn);
 extern void		tiTfPopDefinee0		(Symbol);
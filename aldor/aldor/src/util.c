@@ -463,6 +463,23 @@ bintOpAndFree(BInt (*op)(BInt, BInt) , BInt x, BInt y)
 	return r;
 }
 
+ULong
+hashBytes(ULong h, const void *p, Length n)
+{
+	const UByte	*s = (const UByte *) p;
+	Length		i;
+
+	for (i = 0; i < n; i++) {
+		h ^= s[i];
+#ifdef CC_long_not_int32
+		h *= 0x100000001b3UL;
+#else
+		h *= 16777619UL;
+#endif
+	}
+	return h;
+}
+
 int
 hashCombinePair(int i1, int i2)
 {
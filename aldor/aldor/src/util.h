@@ -117,6 +117,18 @@ extern void	lisort		(Pointer base, Length n, Length sz,
 
 extern int hashCombinePair(int h1, int h2);
 
+#ifdef CC_long_not_int32
+#define HASH_BYTES_INIT	0xcbf29ce484222325UL
+#else
+#define HASH_BYTES_INIT	2166136261UL
+#endif
+
+extern ULong	hashBytes	(ULong h, const void *p, Length n);
+	/*
+	 * hashBytes continues the FNV-1a hash h, begun with HASH_BYTES_INIT,
+	 * over the n bytes at p.  It is as wide as a ULong.
+	 */
+
 /******************************************************************************
  *
  * :: Memory operations
@@ -0,0 +1,33 @@
+#include "foamlib"
+#include "assertlib"
+#pile
+
+-- The array in sumSquares and the level of triangle do not escape, so
+-- with -Q3 they are kept in the C frame (see of_escape.c).  Makefile.in
+-- checks that the C code has fiARRSTACK and fiEnvPushStack.
+
+import from Assert SingleInteger
+import from SingleInteger
+
+sumSquares(n: SingleInteger): SingleInteger ==
+    import from Array SingleInteger
+    a: Array SingleInteger := new(4, 0)
+    s: SingleInteger := 0
+    for i in 1..n repeat
+        a.(1 + i mod 4) := i*i
+        s := s + a.(1 + i mod 4)
+    s
+
+triangle(n: SingleInteger): SingleInteger ==
+    acc: SingleInteger := 0
+    step(k: SingleInteger): () ==
+        free acc: SingleInteger
+        k = 0 => return
+        acc := acc + k
+        step(k - 1)
+    step(n)
+    acc
+
+assertEquals(30, sumSquares(4))
+assertEquals(55, triangle(10))
+assertEquals(5050, triangle(100))
@@ -0,0 +1,3 @@
+#include "foamlib"
+
+f(x: SingleInteger): SingleInteger == x + 1;
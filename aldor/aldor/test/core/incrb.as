@@ -0,0 +1,6 @@
+#include "foamlib"
+#library IncrA "incra.ao"
+
+import from IncrA;
+
+g(x: SingleInteger): SingleInteger == f(x) + 2;
@@ -0,0 +1,15 @@
+#include "foamlib"
+#include "assertlib"
+#pile
+
+import from SingleInteger
+import from Assert SingleInteger
+
+-- 100 quo d is computed once, and not at all when the loop is not entered.
+quoSum(n: SingleInteger, d: SingleInteger): SingleInteger ==
+    s: SingleInteger := 0
+    for i in 1..n repeat s := s + 100 quo d
+    s
+
+assertEquals(0, quoSum(0, 0))
+assertEquals(150, quoSum(3, 2))
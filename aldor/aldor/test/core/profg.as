@@ -0,0 +1,13 @@
+#include "foamlib"
+#pile
+
+import from SingleInteger
+
+sq(n: SingleInteger): SingleInteger == n * n
+
+total(n: SingleInteger): SingleInteger ==
+    s: SingleInteger := 0
+    for i in 1..n repeat s := s + sq i
+    s
+
+total 100
@@ -0,0 +1,32 @@
+AC_DEFUN([ALDOR_PTHREAD_OPTION],
+[AC_MSG_CHECKING(Determining flags for POSIX threads)
+cat > conftest_pthread.c << EOF
+#include <pthread.h>
+static void *run(void *p) { return p; }
+int main(int argc, char **argv);
+int main(int argc, char **argv) { pthread_t t; return pthread_create(&t, 0, run, 0); }
+EOF
+pthread_cflags=
+pthread_libs=
+if ${CC} ${CFLAGS} conftest_pthread.c -o conftest_pthread >&AS_MESSAGE_LOG_FD 2>&1;
+then
+     pthread_result="none needed"
+elif ${CC} ${CFLAGS} -pthread conftest_pthread.c -o conftest_pthread >&AS_MESSAGE_LOG_FD 2>&1;
+then
+     pthread_cflags=-pthread
+     pthread_libs=-pthread
+     pthread_result=-pthread
+elif ${CC} ${CFLAGS} conftest_pthread.c -o conftest_pthread -lpthread >&AS_MESSAGE_LOG_FD 2>&1;
+then
+     pthread_libs=-lpthread
+     pthread_result=-lpthread
+else
+     AC_MSG_FAILURE([No way to link with pthread_create()])
+fi
+rm -f conftest_pthread conftest_pthread.c
+PTHREAD_CFLAGS=$pthread_cflags
+PTHREAD_LIBS=$pthread_libs
+AC_SUBST(PTHREAD_CFLAGS)
+AC_SUBST(PTHREAD_LIBS)
+AC_MSG_RESULT($pthread_result)
+])